@@ -11,6 +11,7 @@
 #include "pentago/utility/popcount.h"
 #include "pentago/utility/random.h"
 #include "pentago/utility/box.h"
+#include "pentago/utility/thread.h"
 #include <unordered_map>
 #include <unordered_set>
 namespace pentago {
@@ -28,6 +29,14 @@ template<> board_t maybe_standardize<1>(board_t board) { return board; }
 template<> board_t maybe_standardize<8>(board_t board) { return standardize(board); }
 template<> board_t maybe_standardize<2048>(board_t board) { return get<0>(superstandardize(board)); }
 
+template<int symmetries> static inline void maybe_standardize(RawArray<board_t> boards) {
+  for (auto& board : boards)
+    board = maybe_standardize<symmetries>(board);
+}
+template<> void maybe_standardize<2048>(RawArray<board_t> boards) {
+  superstandardize(boards, boards, RawArray<symmetry_t>());
+}
+
 // List all standardized boards with n stones, assuming black plays first.
 // The symmetries are controls how many symmetries are taken into account: 1 for none, 8 for global, 2048 for super.
 template<int symmetries> static Array<board_t> all_boards_helper(int n) {
@@ -112,6 +121,7 @@ template<int symmetries> static Array<board_t> all_boards_helper(int n) {
   }
   {
     unordered_set<board_t> board_set;
+    const Array<board_t> white_boards(subsets.size(), uninit);
     for (const board_t black : black_boards) {
       board_set.clear();
       // Make a list of occupied singleton boards
@@ -121,13 +131,16 @@ template<int symmetries> static Array<board_t> all_boards_helper(int n) {
         if (unpack(black,0) & unpack(singletons[i], 0))
           occupied[c++] = singletons[i];
       GEODE_ASSERT(c == n);
-      // Traverse all white subsets
-      for (const uint64_t subset : subsets) {
+      // Traverse all white subsets, standardizing them together
+      for (const int s : range(int(subsets.size()))) {
         board_t board = black;
         for (int i=0;i<n;i++)
-          if (subset&(uint64_t)1<<i)
+          if (subsets[s]&(uint64_t)1<<i)
             board += occupied[i];
-        board = maybe_standardize<symmetries>(board);
+        white_boards[s] = board;
+      }
+      maybe_standardize<symmetries>(white_boards);
+      for (const board_t board : white_boards) {
         if (board_set.insert(board).second) {
           GEODE_ASSERT(   popcount(unpack(board,0))==n-white
                        && popcount(unpack(board,1))==white);
@@ -149,6 +162,132 @@ Array<board_t> all_boards(const int n, const int symmetries) {
           /* 2048 */  :all_boards_helper<2048>(n);
 }
 
+// All quadrants with the given stone counts, in increasing order
+static RawArray<const quadrant_t> count_quadrants(const Vector<uint8_t,2> counts) {
+  static const auto lists = []() {
+    vector<vector<quadrant_t>> lists(10*10);
+    for (quadrant_t q=0;q<quadrant_count;q++) {
+      const auto c = count(q);
+      lists[10*c[0]+c[1]].push_back(q);
+    }
+    return lists;
+  }();
+  return asarray(lists[10*counts[0]+counts[1]]);
+}
+
+static inline board_t rotation_standardize_board(const board_t board) {
+  return quadrants(get<0>(rotation_standardize_quadrant(quadrant(board,0))),
+                   get<0>(rotation_standardize_quadrant(quadrant(board,1))),
+                   get<0>(rotation_standardize_quadrant(quadrant(board,2))),
+                   get<0>(rotation_standardize_quadrant(quadrant(board,3))));
+}
+
+// Append the standardized canonical boards among candidates [lo,hi) of a section to boards.  The candidates
+// are all boards in the section for symmetries 1 and 8, and those with rotation minimal quadrants for 2048.
+// Global symmetries fixing the section map any orbit's candidates onto each other, so the canonical board
+// is the smallest candidate in its orbit.  Local rotations are taken care of by rotation standardization.
+template<int symmetries> static void
+all_boards_chunk(const Vector<RawArray<const quadrant_t>,4>& lists, RawArray<const uint8_t> stabilizer,
+                 const uint64_t lo, const uint64_t hi, vector<board_t>& boards) {
+  if (lo == hi) return;
+  // Decode lo into quadrant indices, with quadrant 3 varying fastest
+  Vector<int,4> index;
+  uint64_t rest = lo;
+  for (int i=3;i>=0;i--) {
+    index[i] = int(rest % lists[i].size());
+    rest /= lists[i].size();
+  }
+  const auto start = boards.size();
+  for (uint64_t k=lo;;) {
+    const board_t board = quadrants(lists[0][index[0]], lists[1][index[1]],
+                                    lists[2][index[2]], lists[3][index[3]]);
+    bool canonical = true;
+    if (symmetries > 1)
+      for (const auto g : stabilizer) {
+        auto other = transform_board(symmetry_t(g,0), board);
+        if (symmetries == 2048)
+          other = rotation_standardize_board(other);
+        if (other < board) {
+          canonical = false;
+          break;
+        }
+      }
+    if (canonical)
+      boards.push_back(board);
+    if (++k == hi) break;
+    for (int i=3;i>=0;i--) {
+      if (++index[i] < lists[i].size()) break;
+      index[i] = 0;
+    }
+  }
+  maybe_standardize<symmetries>(asarray(boards).slice(start, boards.size()));
+}
+
+template<int symmetries> static void
+all_boards_stream_helper(const int n, const function<void(RawArray<const board_t>)>& emit,
+                         const uint64_t chunk, const int window) {
+  GEODE_ASSERT(0<=n && n<=36);
+  struct chunk_t {
+    Vector<RawArray<const quadrant_t>,4> lists;
+    Array<const uint8_t> stabilizer;
+    uint64_t lo, hi;
+  };
+
+  // Process window chunks at a time, emitting each window in order
+  vector<chunk_t> chunks;
+  vector<vector<board_t>> results(window);
+  const auto flush = [&]() {
+    for (const int i : range(int(chunks.size()))) {
+      const auto& c = chunks[i];
+      auto& boards = results[i];
+      boards.clear();
+      threads_schedule(CPU, [&c,&boards]() {
+        all_boards_chunk<symmetries>(c.lists, c.stabilizer, c.lo, c.hi, boards);
+      });
+    }
+    threads_wait_all();
+    for (const int i : range(int(chunks.size())))
+      if (results[i].size())
+        emit(asarray(results[i]));
+    chunks.clear();
+  };
+
+  for (const auto s : all_boards_sections(n, symmetries == 1 ? 1 : 8)) {
+    Vector<RawArray<const quadrant_t>,4> lists;
+    uint64_t total = 1;
+    for (const int i : range(4)) {
+      lists[i] = symmetries == 2048 ? get<0>(rotation_minimal_quadrants(s.counts[i]))
+                                    : count_quadrants(s.counts[i]);
+      total *= lists[i].size();
+    }
+    vector<uint8_t> stabilizer;
+    if (symmetries > 1)
+      for (const int g : range(1, 8))
+        if (s.transform(g) == s)
+          stabilizer.push_back(g);
+    const auto shared_stabilizer = asarray(stabilizer).copy();
+    for (uint64_t lo=0;lo<total;lo+=chunk) {
+      chunks.push_back(chunk_t{lists, shared_stabilizer, lo, min(total, lo+chunk)});
+      if (int(chunks.size()) == window)
+        flush();
+    }
+  }
+  flush();
+}
+
+void all_boards_stream(const int n, const int symmetries,
+                       const function<void(RawArray<const board_t>)>& emit,
+                       const uint64_t chunk, int window) {
+  GEODE_ASSERT(symmetries==1 || symmetries==8 || symmetries==2048);
+  GEODE_ASSERT(chunk > 0 && window >= 0);
+  if (!window)
+    window = 2*max(1, thread_counts()[0]);
+  const auto helper = symmetries==1?all_boards_stream_helper<1>
+                     :symmetries==8?all_boards_stream_helper<8>
+                       /* 2048 */  :all_boards_stream_helper<2048>;
+  helper(n, emit, chunk, window);
+}
+
 Array<quadrant_t> minimal_quadrants() {
   vector<quadrant_t> mins;
   for (quadrant_t q=0;q<quadrant_count;q++)
@@ -7,8 +7,11 @@
 #include "pentago/base/board.h"
 #include "pentago/base/section.h"
 #include "pentago/utility/array.h"
+#include <functional>
 namespace pentago {
 
+using std::function;
+
 // Enumerate the different ways n stones can be distributed into the four quadrants
 Array<section_t> all_boards_sections(int n, int symmetries=8);
 
@@ -21,6 +24,18 @@ Array<board_t> all_boards_list(int n);
 // Enumerate all boards, reducing by the given number of symmetries
 Array<board_t> all_boards(const int n, const int symmetries);
 
+// Stream all boards with n stones, reducing by the given number of symmetries (1, 8, or 2048).
+//
+// Unlike all_boards, this uses bounded memory and the CPU thread pool: each section of all_boards_sections
+// is split into chunks of at most chunk candidate boards, and a board is kept if it is the canonical
+// representative of its orbit within the section.  Up to window chunks are computed at once, then
+// passed to emit in order on the calling thread.  Each orbit is emitted exactly once as a standardized
+// board, in an order independent of the number of threads and of window, but not the same order as
+// all_boards.  window = 0 means twice the number of CPU threads.  Requires init_threads.
+void all_boards_stream(const int n, const int symmetries,
+                       const function<void(RawArray<const board_t>)>& emit,
+                       const uint64_t chunk = 1<<20, int window = 0);
+
 // Quadrants minimal w.r.t. rotations and reflections
 Array<quadrant_t> minimal_quadrants();
 
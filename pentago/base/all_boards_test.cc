@@ -6,6 +6,7 @@
 #include "pentago/utility/hash.h"
 #include "pentago/utility/range.h"
 #include "pentago/utility/log.h"
+#include "pentago/utility/thread.h"
 #include "gtest/gtest.h"
 #include <unordered_map>
 #include <unordered_set>
@@ -88,6 +89,55 @@ TEST(all_boards, raw) { helper(1); }
 TEST(all_boards, all) { helper(8); }
 TEST(all_boards, super) { helper(2048); }
 
+// Streaming should produce the same boards as all_boards, each exactly once, in a fixed order
+TEST(all_boards, stream) {
+  init_threads(-1, -1);
+  for (const int symmetries : {1, 8, 2048}) {
+    for (const int n : range(symmetries == 1 ? 5 : 6)) {
+      string first;
+      for (const auto& [chunk, window] : {make_pair(uint64_t(1)<<20, 0), make_pair(uint64_t(1000), 3)}) {
+        vector<board_t> boards;
+        all_boards_stream(n, symmetries, [&boards](RawArray<const board_t> chunk) {
+          extend(boards, chunk);
+        }, chunk, window);
+        const auto h = portable_hash(boards);
+        if (first.size()) {
+          ASSERT_EQ(first, h);
+        }
+        first = h;
+        ASSERT_EQ(boards.size(), count_boards(n, symmetries));
+        auto expected = all_boards(n, symmetries);
+        std::sort(boards.begin(), boards.end());
+        std::sort(expected.begin(), expected.end());
+        ASSERT_TRUE(std::equal(boards.begin(), boards.end(), expected.begin(), expected.end()))
+            << "symmetries " << symmetries << ", n " << n;
+      }
+    }
+  }
+}
+
+TEST(all_boards, count_sections) {
+  // Sections sum to the slice totals
+  for (const int symmetries : {1, 8, 2048})
+    for (const int n : range(37)) {
+      uint64_t total = 0;
+      for (const auto& s : all_boards_sections(n, symmetries==1 ? 1 : 8))
+        total += count_section_boards(s, symmetries);
+      ASSERT_EQ(total, count_boards(n, symmetries)) << "symmetries " << symmetries << ", n " << n;
+    }
+
+  // Compare against explicit enumeration
+  for (const int symmetries : {1, 8, 2048})
+    for (const int n : range(6)) {
+      unordered_map<section_t,uint64_t> counts;
+      for (const auto board : all_boards(n, symmetries))
+        counts[symmetries==1 ? count(board) : get<0>(count(board).standardize<8>())]++;
+      for (const auto& s : all_boards_sections(n, symmetries==1 ? 1 : 8))
+        ASSERT_EQ(counts[s], count_section_boards(s, symmetries))
+            << "symmetries " << symmetries << ", section " << s;
+    }
+}
+
 // Verify that boards with at most 2 stones all map to different hashes mod 511.
 // This ensures that such positions will never disappear from the transposition
 // table as the result of a collision.
@@ -3,10 +3,13 @@
 #include "pentago/base/count.h"
 #include "pentago/base/section.h"
 #include "pentago/base/symmetry.h"
+#include "pentago/utility/integer_log.h"
 #include "pentago/utility/sort.h"
 #include "pentago/utility/uint128.h"
 #include "pentago/utility/random.h"
 #include "pentago/utility/sqr.h"
+#include <algorithm>
+#include <cstring>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
@@ -168,6 +171,85 @@ Polynomial<2> count_generator(int symmetries) {
   return F;
 }
 
+// Per-section counts follow from Burnside's lemma restricted to the union U of a section's orbit under
+// global symmetries: the number of orbits in U is the average over g of the number of boards in U fixed by g.
+// A board fixed by g is constant on cycles of cells, and the quadrant counts of a fixed board are constant
+// on orbits of quadrants under the global part of g.  The cycles within one quadrant orbit depend only on
+// the global symmetry and the local rotations of quadrants in that orbit, so the sum over local rotations
+// factors into a product over quadrant orbits, each a small polynomial in the per-quadrant counts.
+struct section_generator_t {
+  int symmetries;
+  Vector<int,4> orbit[8];  // Quadrant orbits for each global symmetry, labeled by their smallest quadrant
+  uint128_t fixed[8][4][10][10];  // Fixed boards for each global symmetry and orbit, indexed by per-quadrant counts
+};
+
+static section_generator_t make_section_generator(const int symmetries) {
+  GEODE_ASSERT(symmetries==1 || symmetries==8 || symmetries==2048);
+  section_generator_t gen;
+  gen.symmetries = symmetries;
+  memset(gen.fixed, 0, sizeof(gen.fixed));
+  const auto quadrant_of = [](const side_t side) { return integer_log_exact(side)/16; };
+  for (const int g : range(symmetries==1 ? 1 : 8)) {
+    // Find quadrant orbits under g
+    auto& orbit = gen.orbit[g];
+    for (const int q : range(4)) {
+      orbit[q] = q;
+      for (int p = q;;) {
+        p = quadrant_of(transform_side(symmetry_t(g,0),(side_t)1<<16*p));
+        if (p == q) break;
+        orbit[q] = std::min(orbit[q], p);
+      }
+    }
+    for (const int o : range(4)) {
+      if (orbit[o] != o) continue;
+      vector<int> qs;
+      for (const int q : range(4))
+        if (orbit[q] == o)
+          qs.push_back(q);
+      const int size = qs.size();
+
+      // Sum over local rotations of quadrants in this orbit
+      for (const int r : range(symmetries==2048 ? 1<<2*size : 1)) {
+        uint8_t local = 0;
+        for (const int i : range(size))
+          local |= (r>>2*i&3)<<2*qs[i];
+        const symmetry_t s(g,local);
+
+        // Fixed boards are products of (1 + b^m + w^m) over cycles, where m is the number of cells per quadrant
+        uint128_t poly[10][10] = {{0}};
+        poly[0][0] = 1;
+        side_t seen = 0;
+        for (const int q : qs)
+          for (const int i : range(9)) {
+            const side_t start = (side_t)1<<(16*q+i);
+            if (seen & start) continue;
+            int length = 0;
+            for (side_t side = start; !length || side != start; side = transform_side(s,side)) {
+              seen |= side;
+              length++;
+            }
+            GEODE_ASSERT(length%size == 0);
+            const int m = length/size;
+            for (int b=9;b>=0;b--)
+              for (int w=9-b;w>=0;w--)
+                poly[b][w] += (b>=m ? poly[b-m][w] : 0) + (w>=m ? poly[b][w-m] : 0);
+          }
+        for (const int b : range(10))
+          for (const int w : range(10))
+            gen.fixed[g][o][b][w] += poly[b][w];
+      }
+    }
+  }
+  return gen;
+}
+
+static const section_generator_t& section_generator(const int symmetries) {
+  static const auto gen1 = make_section_generator(1),
+                    gen8 = make_section_generator(8),
+                    gen2048 = make_section_generator(2048);
+  return symmetries==1 ? gen1 : symmetries==8 ? gen8 : gen2048;
+}
+
 }
 
 static uint64_t safe_mul(uint64_t a, uint64_t b) {
@@ -207,6 +289,41 @@ uint64_t count_boards(int n, int symmetries) {
   return it != F.x.end() ? it->second : 0;
 }
 
+uint64_t count_section_boards(const section_t section, const int symmetries) {
+  GEODE_ASSERT(symmetries==1 || symmetries==8 || symmetries==2048);
+  for (const auto& c : section.counts)
+    GEODE_ASSERT(c.sum() <= 9);
+  const auto& gen = section_generator(symmetries);
+
+  // Distinct sections in the orbit of section
+  vector<section_t> orbit = {section};
+  if (symmetries > 1)
+    for (const int g : range(1,8)) {
+      const auto t = section.transform(g);
+      if (std::find(orbit.begin(), orbit.end(), t) == orbit.end())
+        orbit.push_back(t);
+    }
+
+  // Burnside's lemma over boards in the orbit
+  uint128_t total = 0;
+  for (const auto& s : orbit)
+    for (const int g : range(symmetries==1 ? 1 : 8)) {
+      uint128_t fixed = 1;
+      for (const int q : range(4)) {
+        const int o = gen.orbit[g][q];
+        if (s.counts[q] != s.counts[o]) {
+          fixed = 0;
+          break;
+        }
+        if (o == q)
+          fixed *= gen.fixed[g][o][s.counts[q][0]][s.counts[q][1]];
+      }
+      total += fixed;
+    }
+  GEODE_ASSERT(total%symmetries == 0 && !((total/symmetries)>>64));
+  return uint64_t(total/symmetries);
+}
+
 double estimate_choose(int n, int k) {
   return exp(lgamma(n+1)-lgamma(k+1)-lgamma(n-k+1));
 }
@@ -16,6 +16,11 @@ namespace pentago {
 uint64_t choose(int n, int k) __attribute__((const));
 uint64_t count_boards(int n, int symmetries) __attribute__((const));
 
+// Count boards in the given section, reduced by the given number of symmetries (1, 8, or 2048).  For 8 or
+// 2048 symmetries, boards in all sections related to the given one by global symmetries are included, so
+// summing over the standardized sections of all_boards_sections(n) gives count_boards(n, symmetries).
+uint64_t count_section_boards(section_t section, int symmetries) __attribute__((const));
+
 // Compute (wins,losses,total) for the given super evaluation, count each distinct locally rotated position exactly once.
 Vector<uint16_t,3> popcounts_over_stabilizers(
     board_t board, const Vector<super_t,2>& wins) __attribute__((const));
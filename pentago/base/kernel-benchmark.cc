@@ -0,0 +1,129 @@
+// Time the inner kernels of pentago/base
+//
+// The unit tests check these routines for correctness only.  This binary times them: super_wins,
+// transform_super, superstandardize, board packing, and fill_moves.  Each timing is the best of
+// several tries.
+
+#include "pentago/base/moves.h"
+#include "pentago/base/superscore.h"
+#include "pentago/base/symmetry.h"
+#include "pentago/utility/log.h"
+#include "pentago/utility/random.h"
+#include "pentago/utility/range.h"
+#include "pentago/utility/wall_time.h"
+
+namespace pentago {
+namespace {
+
+using std::min;
+using std::tie;
+
+// Run f several times and return the best time in seconds
+template<class F> double best_time(const int tries, const F& f) {
+  double best = std::numeric_limits<double>::infinity();
+  for (int t = 0; t < tries; t++) {
+    const auto start = wall_time();
+    f();
+    best = min(best, (wall_time()-start).seconds());
+  }
+  return best;
+}
+
+volatile uint64_t sink;
+
+void super_benchmarks(Random& random) {
+  const int count = 1<<18;
+  Array<side_t> sides(count, uninit);
+  Array<symmetry_t> symmetries(count, uninit);
+  Array<super_t> supers(count, uninit);
+  for (const int i : range(count)) {
+    sides[i] = random.bits<uint64_t>()&(i&1?random.bits<uint64_t>():~uint64_t(0))&side_mask;
+    symmetries[i] = random_symmetry(random);
+    supers[i] = random_super(random);
+  }
+  slog("super_wins = %.3g ns", 1e9/count*best_time(5, [&]() {
+    super_t sum = 0;
+    for (const auto side : sides)
+      sum ^= super_wins(side);
+    sink = sum.parity();
+  }));
+  slog("transform_super = %.3g ns", 1e9/count*best_time(5, [&]() {
+    super_t sum = 0;
+    for (const int i : range(count))
+      sum ^= transform_super(symmetries[i], supers[i]);
+    sink = sum.parity();
+  }));
+
+  // Boards with duplicated quadrants exercise ties in superstandardize
+  Array<board_t> boards(count, uninit);
+  for (auto& board : boards) {
+    const side_t side0 = random_side(random),
+                 side1 = random_side(random)&~side0;
+    const board_t pre = pack(side0, side1);
+    const int q = random.uniform<int>(0, 256);
+    board = quadrants(quadrant(pre,q&3), quadrant(pre,q>>2&3), quadrant(pre,q>>4&3), quadrant(pre,q>>6&3));
+  }
+  const Array<board_t> standard(count, uninit);
+  const double scalar = best_time(3, [&]() {
+    for (const int i : range(count))
+      tie(standard[i], symmetries[i]) = superstandardize(boards[i]);
+  });
+  const double single = best_time(3, [&]() {
+    for (const int i : range(count))
+      superstandardize(unpack(boards[i],0), unpack(boards[i],1), standard[i], symmetries[i]);
+  });
+  const double batch = best_time(3, [&]() { superstandardize(boards, standard, symmetries); });
+  slog("superstandardize: scalar = %.3g ns, single = %.3g ns, batch = %.3g ns, speedup %.2f",
+       1e9/count*scalar, 1e9/count*single, 1e9/count*batch, scalar/batch);
+}
+
+void board_benchmarks(Random& random) {
+  const int count = 1<<14, repeats = 64;
+  Array<board_t> boards(count, uninit);
+  for (const int i : range(count))
+    boards[i] = random_board(random);
+  const auto time = [&](const char* name, const auto& f) {
+    slog("%s = %.3g ns", name, 1e9/(count*repeats)*best_time(3, [&]() {
+      uint64_t sum = 0;
+      for (__attribute__((unused)) const int j : range(repeats))
+        for (const auto board : boards)
+          sum += f(board);
+      sink = sum;
+    }));
+  };
+  time("unpack", [](const board_t board) {
+    const auto sides = unpack(board);
+    return sides[0] ^ 3*sides[1]; });
+  time("pack", [](const board_t board) {
+    return pack(side_t(board&side_mask), side_t(board>>9&side_mask&~board)); });
+  time("flip_board", [](const board_t board) { return flip_board(board); });
+
+  // fill_moves on boards of all sizes
+  int total = 0;
+  for (const int i : range(count)) {
+    boards[i] = random_board(random, i%30);
+    total += count_moves(boards[i]);
+  }
+  Array<board_t> children(total, uninit);
+  slog("fill_moves = %.3g ns per child", 1e9/total*best_time(5, [&]() { fill_moves(boards, children); }));
+}
+
+void toplevel() {
+  Scope scope("kernel benchmark");
+  Random random(7183);
+  super_benchmarks(random);
+  board_benchmarks(random);
+}
+
+}  // namespace
+}  // namespace pentago
+
+int main() {
+  try {
+    pentago::toplevel();
+    return 0;
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+}
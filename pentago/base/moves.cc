@@ -4,22 +4,35 @@
 #include "pentago/utility/array.h"
 namespace pentago {
 
+void fill_moves(RawArray<const board_t> boards, RawArray<board_t> children) {
+  int64_t n = 0;
+  for (const auto board : boards) {
+    GEODE_ASSERT(n+count_moves(board) <= children.size());
+    n += fill_moves(board, children.data()+n);
+  }
+  GEODE_ASSERT(n == children.size());
+}
+
+void fill_simple_moves(RawArray<const board_t> boards, RawArray<board_t> children) {
+  int64_t n = 0;
+  for (const auto board : boards) {
+    GEODE_ASSERT(n+count_simple_moves(board) <= children.size());
+    n += fill_simple_moves(board, children.data()+n);
+  }
+  GEODE_ASSERT(n == children.size());
+}
+
 Array<board_t> moves(board_t board) {
   check_board(board);
-  // const board_t moves[total] = {...};
-  MOVES(board)
-  return RawArray<board_t>(total, moves).copy();
+  Array<board_t> result(count_moves(board), uninit);
+  fill_moves(board, result.data());
+  return result;
 }
 
 Array<board_t> simple_moves(board_t board) {
   check_board(board);
-  const side_t side0 = unpack(board,0),
-               side1 = unpack(board,1);
-  // const side_t moves[total] = {...};
-  SIMPLE_MOVES(side0,side1)
-  Array<board_t> result(total,uninit);
-  for (int i=0;i<total;i++)
-    result[i] = pack(side1,moves[i]);
+  Array<board_t> result(count_simple_moves(board), uninit);
+  fill_simple_moves(board, result.data());
   return result;
 }
 
@@ -1,64 +1,88 @@
 // Move generation code
 //
-// This move generation code is a hideously ugly pile of macros to
-// ensure loop enrolling and allocate moves entirely on the stack.
-// See search/superengine.cpp for example usage.
+// Moves are generated entirely without allocation: fill_moves writes all children of a board into a
+// caller provided buffer, and the MOVES macro wraps it in a stack allocated array.  See search/engine.cc
+// for example usage.
 #pragma once
 
 #include "pentago/base/board.h"
+#include "pentago/utility/array.h"
 #include "pentago/utility/integer_log.h"
 #include "pentago/utility/popcount.h"
+#include "pentago/utility/sse.h"
 namespace pentago {
 
-// We declare the move listing code as a huge macro in order to use it in multiple functions while taking advantage of gcc's variable size arrays.
-// To use, invoke MOVES(board) to fill a board_t moves[total] array.
-#define QR0(s,q,dir) rotations[quadrant(side##s,q)][dir]
-#define QR1(s,q) {QR0(s,q,0),QR0(s,q,1)}
-#define QR2(s) {QR1(s,0),QR1(s,1),QR1(s,2),QR1(s,3)}
-#define COUNT_MOVES(q,qpp) \
-  const int offset##q  = move_offsets[quadrant(filled,q)]; \
-  const int count##q   = move_offsets[quadrant(filled,q)+1]-offset##q; \
-  const int total##qpp = total##q + 8*count##q;
-#define MOVE_QUAD(q,qr,dir,i) \
-  quadrant_t side0_quad##i, side1_quad##i; \
-  if (qr!=i) { \
-    side0_quad##i = quadrant(side1,i); \
-    side1_quad##i = q==i?changed:quadrant(side0,i); \
-  } else { \
-    side0_quad##i = rotated[1][i][dir]; \
-    side1_quad##i = q==i?rotations[changed][dir]:rotated[0][i][dir]; \
-  } \
-  const quadrant_t both##i = pack(side0_quad##i,side1_quad##i);
-#define MOVE(q,qr,dir) { \
-  MOVE_QUAD(q,qr,dir,0) \
-  MOVE_QUAD(q,qr,dir,1) \
-  MOVE_QUAD(q,qr,dir,2) \
-  MOVE_QUAD(q,qr,dir,3) \
-  moves[total##q+8*i+2*qr+dir] = quadrants(both0,both1,both2,both3); \
+// Number of children of a board, with and without rotations
+static inline int count_moves(board_t board) {
+  return 8*(36-count_stones(board));
 }
-#define COLLECT_MOVES(q) \
-  for (int i=0;i<count##q;i++) { \
-    const quadrant_t changed = quadrant(side0,q)|move_flat[offset##q+i]; \
-    MOVE(q,0,0) MOVE(q,0,1) \
-    MOVE(q,1,0) MOVE(q,1,1) \
-    MOVE(q,2,0) MOVE(q,2,1) \
-    MOVE(q,3,0) MOVE(q,3,1) \
+
+static inline int count_simple_moves(board_t board) {
+  return 36-count_stones(board);
+}
+
+// Write all children of board to children, returning their number (count_moves(board)).  The sides of
+// each child are flipped so that it's still player 0's turn.  The children of a stone placed in cell 16q+i
+// are contiguous in increasing cell order, with the child rotating quadrant qr in direction dir at offset
+// 2*qr+dir.  Cost: 16 table lookups per board, then one 8-wide add per empty cell.
+static inline int fill_moves(const board_t board, board_t* children) {
+  const side_t side0 = unpack(board,0),
+               side1 = unpack(board,1);
+
+  // The flipped parent with one quadrant rotated, for each quadrant and direction
+  const board_t flipped = pack(side1,side0);
+  board_t rotated[8];
+  for (int qr=0;qr<4;qr++)
+    for (int dir=0;dir<2;dir++)
+      rotated[2*qr+dir] = (flipped&~((board_t)0xffff<<16*qr))
+                        | (board_t)pack(rotations[quadrant(side1,qr)][dir],
+                                        rotations[quadrant(side0,qr)][dir])<<16*qr;
+
+  // Placing a stone adds the same delta to each rotated parent, except that the delta is rotated
+  // along with the quadrant it lands in.
+  side_t empty = side_mask^(side0|side1);
+  int n = 0;
+#if PENTAGO_AVX2
+  const __m256i r0 = _mm256_loadu_si256((const __m256i*)rotated),
+                r1 = _mm256_loadu_si256((const __m256i*)rotated+1);
+#endif
+  while (empty) {
+    const uint64_t* delta = move_deltas[integer_log_exact(min_bit(empty))];
+    empty &= empty-1;
+#if PENTAGO_AVX2
+    _mm256_storeu_si256((__m256i*)(children+n),
+                        _mm256_add_epi64(r0,_mm256_loadu_si256((const __m256i*)delta)));
+    _mm256_storeu_si256((__m256i*)(children+n)+1,
+                        _mm256_add_epi64(r1,_mm256_loadu_si256((const __m256i*)delta+1)));
+#else
+    for (int k=0;k<8;k++)
+      children[n+k] = rotated[k]+delta[k];
+#endif
+    n += 8;
   }
+  return n;
+}
+
+// Same as fill_moves, but ignores rotations.  There are count_simple_moves(board) children, in cell order.
+static inline int fill_simple_moves(const board_t board, board_t* children) {
+  const side_t side0 = unpack(board,0),
+               side1 = unpack(board,1);
+  const board_t flipped = pack(side1,side0);
+  side_t empty = side_mask^(side0|side1);
+  int n = 0;
+  while (empty) {
+    const int c = integer_log_exact(min_bit(empty));
+    empty &= empty-1;
+    children[n++] = flipped+((board_t)(2*pack_table[1<<(c&15)])<<(c&~15));
+  }
+  return n;
+}
+
+// Declare a board_t moves[total] array holding all children of board, as in fill_moves.  total is left
+// mutable to allow in-place pruning of the list.
 #define MOVES(board) \
-  /* Unpack sides */ \
-  const side_t side0 = unpack(board,0), \
-               side1 = unpack(board,1); \
-  /* Rotate all four quadrants left and right in preparation for move generation */ \
-  const quadrant_t rotated[2][4][2] = {QR2(0),QR2(1)}; \
-  /* Count the number of moves in each quadrant */ \
-  const side_t filled = side0|side1; \
-  const int total0 = 0; \
-  COUNT_MOVES(0,1) COUNT_MOVES(1,2) COUNT_MOVES(2,3) COUNT_MOVES(3,4) \
-  int total = total4; /* Leave mutable to allow in-place pruning of the list */ \
-  /* Collect the list of all possible moves.  Note that we repack with the sides */ \
-  /* flipped so that it's still player 0's turn. */ \
-  board_t moves[total]; \
-  COLLECT_MOVES(0) COLLECT_MOVES(1) COLLECT_MOVES(2) COLLECT_MOVES(3)
+  board_t moves[count_moves(board)]; \
+  int total = fill_moves(board, moves);
 
 // Same as MOVES, but ignores rotations and operates in unpacked mode
 #define SIMPLE_MOVES(side0, side1) \
@@ -72,6 +96,11 @@ namespace pentago {
     _move_mask ^= move; \
   }
 
+// Children of many boards, concatenated in order into children, which must have size equal to the sum of
+// count_moves (or count_simple_moves) over boards.
+void fill_moves(RawArray<const board_t> boards, RawArray<board_t> children);
+void fill_simple_moves(RawArray<const board_t> boards, RawArray<board_t> children);
+
 // Simple versions for bindings
 Array<board_t> moves(board_t board);
 Array<board_t> simple_moves(board_t board);
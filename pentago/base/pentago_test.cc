@@ -31,11 +31,59 @@ TEST(pentago, misc) {
   for (int step = 0; step < 100; step++) {
     const auto board = random_board(random);
     ASSERT_EQ(pack(unpack(board, 0), unpack(board, 1)), board);
+    ASSERT_EQ(unpack(board), vec(unpack(board, 0), unpack(board, 1)));
     ASSERT_EQ(from_table(to_table(board)), board);
     ASSERT_EQ(flip_board(flip_board(board)), board);
   }
 }
 
+TEST(pentago, moves) {
+  Random random(73122);
+  for (const int step : range(1000)) {
+    const auto board = random_board(random, step%37);
+    const auto side0 = unpack(board, 0), side1 = unpack(board, 1);
+
+    // Place and rotate by hand
+    vector<board_t> expected, simple;
+    for (const int c : range(64)) {
+      const side_t move = side_t(1)<<c;
+      if (!(move&side_mask&~(side0|side1))) continue;
+      simple.push_back(pack(side1, side0|move));
+      for (const int qr : range(4))
+        for (const int dir : range(2)) {
+          Vector<side_t,2> sides(side1, side0|move);
+          for (auto& s : sides)
+            s = (s&~(side_t(0x1ff)<<16*qr)) | side_t(rotations[quadrant(s,qr)][dir])<<16*qr;
+          expected.push_back(pack(sides[0], sides[1]));
+        }
+    }
+    const auto children = moves(board);
+    ASSERT_EQ(children.size(), count_moves(board));
+    ASSERT_TRUE(std::equal(children.begin(), children.end(), expected.begin(), expected.end()));
+    const auto simple_children = simple_moves(board);
+    ASSERT_TRUE(std::equal(simple_children.begin(), simple_children.end(), simple.begin(), simple.end()));
+  }
+
+  // Batched versions concatenate
+  Array<board_t> boards(100, uninit);
+  int total = 0, simple_total = 0;
+  for (auto& board : boards) {
+    board = random_board(random, random.uniform<int>(0, 36));
+    total += count_moves(board);
+    simple_total += count_simple_moves(board);
+  }
+  Array<board_t> children(total, uninit), simple_children(simple_total, uninit);
+  fill_moves(boards, children);
+  fill_simple_moves(boards, simple_children);
+  int n = 0, simple_n = 0;
+  for (const auto board : boards) {
+    for (const auto child : moves(board))
+      ASSERT_EQ(children[n++], child);
+    for (const auto child : simple_moves(board))
+      ASSERT_EQ(simple_children[simple_n++], child);
+  }
+}
+
 template<class A> auto choose(Random& random, const A& options) {
   GEODE_ASSERT(options.size());
   return options[random.uniform(options.size())];
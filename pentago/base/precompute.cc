@@ -569,6 +569,21 @@ REMEMBER(moves,
   remember("uint16_t", "move_flat", "%d", flat);
 );
 
+// Placing a stone in cell c = 16q+i adds move_deltas[c][2qr+dir] to the side-flipped parent whose quadrant
+// qr has already been rotated in direction dir, since radix 3 packing is additive over disjoint stones.
+REMEMBER(move_deltas,
+  const Array<uint64_t,2> deltas(64, 8);
+  for (const int q : range(4))
+    for (const int i : range(9))
+      for (const int qr : range(4))
+        for (const int dir : range(2)) {
+          const int v = q == qr ? rotations[1 << i][dir] : 1 << i;
+          deltas(16*q+i, 2*qr+dir) = uint64_t(2*pack[v]) << 16*q;
+        }
+  check(deltas, "29fa9681198edf48dd5f8e50fc890d1f2097d857");
+  remember("uint64_t", "move_deltas", "0x%xL", deltas);
+);
+
 const int newaxis = -1;
 const int fullaxis = -2;
 
@@ -684,31 +699,37 @@ template<class T> struct View {
   }
 };
 
+// The eight ways to win used by super_wins, each given by the role each quadrant plays
+const string superwin_types = "hvlua";  // Horizontal, vertical, diagonal lo/hi/assist
+const string superwin_patterns[] = {"vv--", "h-h-", "-h-h", "--vv", "l-al", "ua-u", "all-", "-uua"};
+
+// The win patterns matching a superwin pattern, split into per quadrant masks
+vector<Vector<uint16_t,4>> superwin_ways(const string& pattern) {
+  GEODE_ASSERT(pattern.size() == 4);
+  vector<Vector<uint16_t,4>> ws;
+  for (const auto p : win_patterns) {
+    Vector<uint16_t,4> w;
+    for (const int i : range(4))
+      w[i] = p>>16*i&0x1ff;
+    for (const int i : range(4))
+      if (!(bool(w[i]) == (pattern[i]!='-') || pattern[i]=='a'))
+        goto skip;
+    ws.push_back(w);
+    skip:;
+  }
+  GEODE_ASSERT(ws.size() == 6 || ws.size() == 3);
+  return ws;
+}
+
 REMEMBER(superwin_info,
-  const Array<Vector<uint16_t,4>> ways(32);
-  char_view(ways).copy(char_view(win_patterns));
-  for (const int i : range(32))
-    for (const int j : range(4))
-      ways[i][j] = win_patterns[i]>>16*j&0x1ff;
-
-  const string types = "hvlua";  // Horizontal, vertical, diagonal lo/hi/assist
-  const string patterns[] = {"vv--", "h-h-", "-h-h", "--vv", "l-al", "ua-u", "all-", "-uua"};
+  const auto& types = superwin_types;
   const Array<bool,7> info(vec(4,512,5,4,4,4,4));  // Indexed by quadrants, quadrant state, superwin_info field, r0-3
-  for (const auto& pattern : patterns) {
-    GEODE_ASSERT(pattern.size() == 4);
+  for (const auto& pattern : superwin_patterns) {
     vector<int> used, unused;
     for (const int i : range(4))
       (pattern[i] != '-' ? used : unused).push_back(i);
     GEODE_ASSERT(used.size() == 2 || used.size() == 3);
-    vector<Vector<uint16_t,4>> ws;
-    for (const auto& w : ways) {
-      for (const int i : range(4))
-        if (!(bool(w[i]) == (pattern[i]!='-') || pattern[i]=='a'))
-          goto skip;
-      ws.push_back(w);
-      skip:;
-    }
-    GEODE_ASSERT(ws.size() == 6 || ws.size() == 3);
+    const auto ws = superwin_ways(pattern);
     GEODE_ASSERT(ws.size() <= ipow(4,4-used.size()));
     for (const auto q : used) {
       for (const int i : range(ws.size())) {
@@ -744,6 +765,28 @@ REMEMBER(superwin_info,
   remember("uint64_t", "superwin_info", "0x%xL", bits);
 )
 
+// A compact form of superwin_info for the AVX2 version of super_wins, 16K instead of 320K.  Byte f of
+// superwin_rows[q][v] belongs to superwin_info field f, and has bit i set if the unrotated quadrant state
+// v contains quadrant q's part of the ith way of the pattern in which quadrant q plays role f.  super_wins
+// looks up the rows of all four rotations and combines them across quadrants on the fly.
+REMEMBER(superwin_rows,
+  const Array<uint64_t,2> rows(4,512);
+  for (const auto& pattern : superwin_patterns) {
+    const auto ws = superwin_ways(pattern);
+    GEODE_ASSERT(ws.size() <= 8);
+    for (const int q : range(4)) {
+      if (pattern[q] == '-') continue;
+      const int f = int(superwin_types.find(pattern[q]));
+      for (const int i : range(ws.size()))
+        for (const int v : range(512))
+          if ((v&ws[i][q]) == ws[i][q])
+            rows(q,v) |= uint64_t(1) << (8*f+i);
+    }
+  }
+  check(rows, "4351b34ded2af9c17979c13bc93e7e751bf5058f");
+  remember("uint64_t", "superwin_rows", "0x%xL", rows);
+)
+
 // An element of S_{6*6}
 struct Sym {
   Vector<uint8_t,6*6> p;
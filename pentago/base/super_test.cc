@@ -11,6 +11,7 @@ namespace pentago {
 namespace {
 
 using std::abs;
+using std::get;
 using std::min;
 using std::swap;
 using std::unordered_set;
@@ -66,6 +67,25 @@ TEST(super, wins) {
   }
 }
 
+TEST(super, wins_moves) {
+  Random random(1740291);
+  for (int step=0;step<10000;step++) {
+    // Alternate between half and quarter density
+    const side_t side = random.bits<uint64_t>()&(step&1?random.bits<uint64_t>():~uint64_t(0))&side_mask;
+    for (int q=0;q<4;q++) {
+      const quadrant_t moves = random.bits<uint16_t>()&511&~quadrant(side,q);
+      super_t wins[9];
+      const int n = super_wins_moves(side,q,moves,wins);
+      ASSERT_EQ(n,popcount(moves));
+      int k = 0;
+      for (int m=0;m<9;m++)
+        if (moves>>m&1) {
+          ASSERT_EQ(wins[k++],super_wins(side|(side_t)1<<(16*q+m)));
+        }
+    }
+  }
+}
+
 TEST(super, rmax) {
   const int steps = 100000;
   Random random(1740291);
@@ -182,6 +202,66 @@ TEST(super, superstandardize) {
   }
 }
 
+// Random boards with possibly duplicated quadrants, which exercise ties in superstandardize
+static Array<board_t> random_duplicated_boards(Random& random, const int count) {
+  Array<board_t> boards(count, uninit);
+  for (auto& board : boards) {
+    const side_t side0 = random_side(random),
+                 side1 = random_side(random)&~side0;
+    const board_t pre = pack(side0,side1);
+    const int q = random.uniform<int>(0,256);
+    board = quadrants(quadrant(pre,q&3),quadrant(pre,q>>2&3),quadrant(pre,q>>4&3),quadrant(pre,q>>6&3));
+  }
+  return boards;
+}
+
+TEST(super, superstandardize_batch) {
+  Random random(875431);
+  const auto boards = random_duplicated_boards(random, 100000);
+  const Array<board_t> standard(boards.size(), uninit);
+  const Array<symmetry_t> symmetry(boards.size(), uninit);
+  superstandardize(boards, standard, symmetry);
+  for (const int i : range(boards.size())) {
+    const auto [b, s] = superstandardize(boards[i]);
+    ASSERT_EQ(standard[i], b) << boards[i];
+    ASSERT_EQ(symmetry[i], s) << boards[i];
+  }
+
+  // From sides
+  const Array<side_t> side0(boards.size(), uninit), side1(boards.size(), uninit);
+  for (const int i : range(boards.size())) {
+    side0[i] = unpack(boards[i], 0);
+    side1[i] = unpack(boards[i], 1);
+  }
+  const Array<board_t> standard2(boards.size(), uninit);
+  const Array<symmetry_t> symmetry2(boards.size(), uninit);
+  superstandardize(side0, side1, standard2, symmetry2);
+  ASSERT_EQ(standard2, standard);
+  ASSERT_EQ(symmetry2, symmetry);
+
+  // One board at a time
+  for (const int i : range(boards.size())) {
+    board_t b;
+    symmetry_t s;
+    superstandardize(side0[i], side1[i], b, s);
+    ASSERT_EQ(b, standard[i]) << boards[i];
+    ASSERT_EQ(s, symmetry[i]) << boards[i];
+  }
+
+  // In place, without symmetries
+  const auto copy = boards.copy();
+  superstandardize(copy, copy, RawArray<symmetry_t>());
+  ASSERT_EQ(copy, standard);
+
+  // All single quadrant boards
+  const Array<board_t> quads(quadrant_count, uninit);
+  for (const int q : range(quadrant_count))
+    quads[q] = q;
+  superstandardize(quads, quads, RawArray<symmetry_t>());
+  for (const int q : range(quadrant_count))
+    ASSERT_EQ(quads[q], get<0>(superstandardize(board_t(q))));
+}
+
 TEST(super, super_action) {
   const int steps = 10000;
   // First, test that transform_super satisfies our group theoretic definition:
@@ -209,6 +289,17 @@ TEST(super, super_action) {
   }
 }
 
+// transform_super permutes bits, so checking every singleton for every symmetry checks everything
+TEST(super, transform_super_exhaustive) {
+  for (const symmetry_t s : symmetries) {
+    const symmetry_t sg(s.global,0), sl(0,s.local);
+    for (const int r : range(256))
+      ASSERT_EQ(transform_super(s,super_t::singleton(r)),
+                super_t::singleton((sg*symmetry_t(0,r)*(sl.inverse()*sg.inverse())).local))
+          << "s = " << s << ", r = " << r;
+  }
+}
+
 TEST(super, count) {
   const vector<int> counts = {1,3,30,227,2013,13065,90641,493844,2746022,12420352,56322888};
   for (const int n : range(counts.size())) {
@@ -4,6 +4,7 @@
 #include "pentago/base/score.h"
 #include "pentago/utility/array.h"
 #include "pentago/utility/debug.h"
+#include "pentago/utility/integer_log.h"
 #include "pentago/utility/range.h"
 #include <numeric>
 #include "pentago/utility/random.h"
@@ -25,6 +26,138 @@ int popcount(super_t s) {
 #endif
 }
 
+#if PENTAGO_AVX2
+
+// With AVX2, we avoid the 320K superwin_info table, which does not fit in L1 and competes with the rest of
+// the endgame solver for L2.  Instead, the 16K superwin_rows table records which ways to win each quadrant state contains, and we
+// combine rows across quadrants with byte shuffles.  See the SSE version below for the meaning of the
+// eight ways.
+//
+// For each way, bytes of a shuffled vector are indexed by the rotations of the quadrants it uses, and
+// bits of each byte by the different ways of winning.  ANDing the rows of the used quadrants and testing
+// for nonzero bytes gives one bit for each relevant combination of rotations, which we then broadcast to
+// a full super_t over the unused quadrants.
+//
+// Cost: 4*(4+4+4) = 48 ops to load rows, 2*10+4*14 = 76 ops to test, and 39 ops to broadcast, for about
+// 163 ops touching 16*4*8 = 512 bytes of superwin_rows and rotations.
+
+// The rows of a quadrant for all four rotations, transposed so that bytes 4f+r of fields give field f
+// (horizontal, vertical, diagonal_lo, diagonal_hi) for rotation r, and bytes r of assist give diagonal_assist.
+struct superwin_info_t {
+  __m128i fields, assist;
+};
+
+static inline superwin_info_t superwin_info_get(const int q, const quadrant_t v) {
+  const auto row = [q](const quadrant_t v) { return _mm_cvtsi64_si128(superwin_rows[q][v]); };
+  const quadrant_t v1 = rotations[v][0], v2 = rotations[v1][0], v3 = rotations[v][1];
+  const auto r01 = _mm_unpacklo_epi8(row(v),row(v1)),
+             r23 = _mm_unpacklo_epi8(row(v2),row(v3));
+  return superwin_info_t({_mm_unpacklo_epi16(r01,r23),_mm_unpackhi_epi16(r01,r23)});
+}
+
+// Constant vector with byte j = expr, for j in [0,32)
+struct alignas(32) superwin_bytes_t { uint8_t b[32]; };
+template<class F> static constexpr superwin_bytes_t superwin_bytes(const F& f) {
+  superwin_bytes_t r = {};
+  for (int j=0;j<32;j++)
+    r.b[j] = f(j);
+  return r;
+}
+#define BYTES(expr) ({ \
+  static constexpr auto _b = superwin_bytes([](const int j) { return uint8_t(expr); }); \
+  _mm256_load_si256((const __m256i*)_b.b); })
+
+enum { H, V, L, U };  // Lanes of superwin_info_t::fields
+
+static inline __m256i lanes(const __m128i lo, const __m128i hi) {
+  return _mm256_inserti128_si256(_mm256_castsi128_si256(lo),hi,1);
+}
+
+// Bit j is set iff byte j is nonzero: 3 ops
+static inline uint32_t nonzero_bytes(const __m256i z) {
+  return ~_mm256_movemask_epi8(_mm256_cmpeq_epi8(z,_mm256_setzero_si256()));
+}
+
+// Test a way involving three quadrants, with the rows of fast varying with bits 0-1 of the result index,
+// mid with bits 2-3, and slow with bits 4-5.  14 ops.
+template<int ff, int fm, int fs> static inline uint64_t
+superwin_triple(const __m128i fast, const __m128i mid, const __m128i slow) {
+  const auto p = _mm256_castsi256_si128(
+      _mm256_shuffle_epi8(_mm256_castsi128_si256(fast),BYTES(4*ff+(j&3)))
+    & _mm256_shuffle_epi8(_mm256_castsi128_si256(mid),BYTES(4*fm+(j>>2&3))));
+  const auto both = lanes(p,p), s = lanes(slow,slow);
+  return          nonzero_bytes(both & _mm256_shuffle_epi8(s,BYTES(4*fs+(j>>4))))
+       | uint64_t(nonzero_bytes(both & _mm256_shuffle_epi8(s,BYTES(4*fs+2+(j>>4)))))<<32;
+}
+
+// 16 bit chunk c of the result is nibble n(c) of r repeated four times, given dup = byte n(c)/2 in both
+// bytes of chunk c and mask = 0x0f or 0xf0 for even or odd n(c): 6 ops
+static inline __m256i nibble_chunks(const uint64_t r, const __m256i dup, const __m256i mask) {
+  const auto w = _mm256_shuffle_epi8(_mm256_set1_epi64x(r),dup) & mask;
+  return w | _mm256_slli_epi16(w,4) | _mm256_srli_epi16(w,4);
+}
+
+// 16 bit chunk c of the result has nibble k full iff bit k of nibble n(c) of r is set, with dup as above
+// and odd = 0xff for odd n(c): 10 ops
+static inline __m256i spread_chunks(const uint64_t r, const __m256i dup, const __m256i odd) {
+  auto w = _mm256_shuffle_epi8(_mm256_set1_epi64x(r),dup);
+  w = _mm256_blendv_epi8(w,_mm256_srli_epi16(w,4),odd) & _mm256_set1_epi8(0xf);
+  const auto lo = BYTES((j&1?0x0f:0)|(j&2?0xf0:0)),
+             hi = BYTES((j&4?0x0f:0)|(j&8?0xf0:0));
+  return _mm256_shuffle_epi8(lo,w&_mm256_set1_epi16(0x00ff))
+       | _mm256_shuffle_epi8(hi,w&_mm256_set1_epi16(int16_t(0xff00)));
+}
+
+template<uint8_t ways> static inline super_t super_wins_ways(const superwin_info_t& i0, const superwin_info_t& i1,
+                                                             const superwin_info_t& i2, const superwin_info_t& i3) {
+  // Ways which don't involve a moving quadrant are harmless to recompute, so we test ways 0,1 and 2,3
+  // together in the two lanes of a 256 bit vector.  Chunk c of a super_t is 16 bits indexed by r0+4*r1,
+  // with c = r2+4*r3.
+  __m256i wins = _mm256_setzero_si256();
+  if (ways&0x3) {
+    // Vertical between quadrants 0,1 and horizontal between 0,2, indexed by r0+4*r1 and r0+4*r2
+    const auto r = nonzero_bytes(
+        _mm256_shuffle_epi8(lanes(i0.fields,i0.fields),BYTES(4*(j<16?V:H)+(j&3)))
+      & _mm256_shuffle_epi8(lanes(i1.fields,i2.fields),BYTES(4*(j<16?V:H)+(j>>2&3))));
+    wins |= _mm256_set1_epi16(int16_t(r));
+    wins |= nibble_chunks(r>>16,BYTES((j>>1&3)>>1),BYTES((j>>1&1)?0xf0:0x0f));
+  }
+  if (ways&0xc) {
+    // Horizontal between quadrants 1,3 and vertical between 2,3, indexed by r1+4*r3 and r2+4*r3
+    const auto r = nonzero_bytes(
+        _mm256_shuffle_epi8(lanes(i1.fields,i2.fields),BYTES(4*(j<16?H:V)+(j&3)))
+      & _mm256_shuffle_epi8(lanes(i3.fields,i3.fields),BYTES(4*(j<16?H:V)+(j>>2&3))));
+    wins |= spread_chunks(r&0xffff,BYTES((j>>3)>>1),BYTES((j>>3&1)?0xff:0));
+    const auto bit = _mm256_setr_epi16(1<<0,1<<1,1<<2,1<<3,1<<4,1<<5,1<<6,1<<7,
+                                       1<<8,1<<9,1<<10,1<<11,1<<12,1<<13,1<<14,int16_t(1<<15));
+    wins |= _mm256_cmpeq_epi16(_mm256_set1_epi16(int16_t(r>>16))&bit,bit);
+  }
+  // Middle or low diagonal from quadrant 0 to 3, indexed by r0+4*(r2+4*r3)
+  if (ways>>4&1)
+    wins |= nibble_chunks(superwin_triple<L,0,L>(i0.fields,i2.assist,i3.fields),
+                          BYTES(j>>2),BYTES((j>>1&1)?0xf0:0x0f));
+  // High diagonal from quadrant 0 to 3, indexed by r0+4*r1+16*r3
+  if (ways>>5&1)
+    wins |= _mm256_shuffle_epi8(_mm256_set1_epi64x(superwin_triple<U,0,U>(i0.fields,i1.assist,i3.fields)),
+                                BYTES(2*(j>>3)+(j&1)));
+  // Middle or low diagonal from quadrant 1 to 2, indexed by r0+4*r1+16*r2
+  if (ways>>6&1)
+    wins |= _mm256_shuffle_epi8(_mm256_set1_epi64x(superwin_triple<0,L,L>(i0.assist,i1.fields,i2.fields)),
+                                BYTES(2*(j>>1&3)+(j&1)));
+  // High diagonal from quadrant 1 to 2, indexed by r1+4*(r2+4*r3)
+  if (ways>>7&1)
+    wins |= spread_chunks(superwin_triple<U,U,0>(i1.fields,i2.fields,i3.assist),
+                          BYTES(j>>2),BYTES((j>>1&1)?0xff:0));
+  return super_t(_mm256_castsi256_si128(wins),_mm256_extracti128_si256(wins,1));
+}
+#undef BYTES
+
+// Load lookup table entries
+#define LOAD(q) const auto i##q = superwin_info_get(q,quadrant(side,q));
+#define MOVED(q,move) superwin_info_get(q,quadrant(side,q)|(move))
+
+#else  // !PENTAGO_AVX2
+
 struct superwin_info_t {
   super_t horizontal, vertical, diagonal_lo, diagonal_hi, diagonal_assist;
 };
@@ -35,12 +168,11 @@ struct superwin_info_t {
 // could be achieved.  We then do an or reduction over those quadrants.
 //
 // Cost: 4*5*32 = 640 bytes, 16+174 = 190 ops
-super_t super_wins(side_t side) {
-  // Load lookup table entries: 4*(1+3) = 16 ops
-  const superwin_info_t* table = (const superwin_info_t*)superwin_info;
-  #define LOAD(q) const superwin_info_t& i##q = table[512*q+quadrant(side,q)];
-  LOAD(0) LOAD(1) LOAD(2) LOAD(3)
-
+//
+// The ways argument selects a subset of the eight ways to win (in the order below), so that
+// super_wins_moves can share work between sides which differ in only one quadrant.
+template<uint8_t ways> static inline super_t super_wins_ways(const superwin_info_t& i0, const superwin_info_t& i1,
+                                                             const superwin_info_t& i2, const superwin_info_t& i3) {
   // Prepare for reductions over unused quadrant rotations.  OR<i> is an all-reduce over the ith quadrant.
 #if PENTAGO_SSE
   #define OR3 /* 3 ops */ \
@@ -80,19 +212,70 @@ super_t super_wins(side_t side) {
   #define OR1 OR1_PART(w.a) OR1_PART(w.b) OR1_PART(w.c) OR1_PART(w.d)
   #define OR2 OR2_PART(w.a) OR2_PART(w.b) OR2_PART(w.c) OR2_PART(w.d)
 #endif
-  #define WAY(base,reduction) { super_t w = base; reduction; wins |= w; }
+  #define WAY(k,base,reduction) if (ways>>k&1) { super_t w = base; reduction; wins |= w; }
 
   // Consider all ways to win: 2*12+3*(10+16+24) = 174 ops
   super_t wins(0);
-  WAY(i0.vertical & i1.vertical,     OR3 OR2) // Vertical between quadrant 0=(0,0) and 1=(0,1)
-  WAY(i0.horizontal & i2.horizontal, OR3 OR1) // Horizontal between quadrant 0=(0,0) and 2=(1,0)
-  WAY(i1.horizontal & i3.horizontal, OR0 OR2) // Horizontal between quadrant 1=(0,1) and 3=(1,1)
-  WAY(i2.vertical & i3.vertical,     OR0 OR1) // Vertical between quadrant 2=(1,0) and 3=(1,1)
-  WAY(i0.diagonal_lo & i2.diagonal_assist & i3.diagonal_lo, OR1) // Middle or low diagonal from quadrant 0=(0,0) to 3=(1,1)
-  WAY(i0.diagonal_hi & i1.diagonal_assist & i3.diagonal_hi, OR2) // High diagonal from quadrant 0=(0,0) to 3=(1,1)
-  WAY(i1.diagonal_lo & i0.diagonal_assist & i2.diagonal_lo, OR3) // Middle or low diagonal from quadrant 1=(0,1) to 2=(1,0)
-  WAY(i1.diagonal_hi & i3.diagonal_assist & i2.diagonal_hi, OR0) // High diagonal from quadrant 1=(0,1) to 2=(1,0)
+  WAY(0, i0.vertical & i1.vertical,     OR3 OR2) // Vertical between quadrant 0=(0,0) and 1=(0,1)
+  WAY(1, i0.horizontal & i2.horizontal, OR3 OR1) // Horizontal between quadrant 0=(0,0) and 2=(1,0)
+  WAY(2, i1.horizontal & i3.horizontal, OR0 OR2) // Horizontal between quadrant 1=(0,1) and 3=(1,1)
+  WAY(3, i2.vertical & i3.vertical,     OR0 OR1) // Vertical between quadrant 2=(1,0) and 3=(1,1)
+  WAY(4, i0.diagonal_lo & i2.diagonal_assist & i3.diagonal_lo, OR1) // Middle or low diagonal from quadrant 0=(0,0) to 3=(1,1)
+  WAY(5, i0.diagonal_hi & i1.diagonal_assist & i3.diagonal_hi, OR2) // High diagonal from quadrant 0=(0,0) to 3=(1,1)
+  WAY(6, i1.diagonal_lo & i0.diagonal_assist & i2.diagonal_lo, OR3) // Middle or low diagonal from quadrant 1=(0,1) to 2=(1,0)
+  WAY(7, i1.diagonal_hi & i3.diagonal_assist & i2.diagonal_hi, OR0) // High diagonal from quadrant 1=(0,1) to 2=(1,0)
   return wins;
+  #undef WAY
+  #undef OR0
+  #undef OR1
+  #undef OR2
+  #undef OR3
+}
+
+// Load lookup table entries: 4*(1+3) = 16 ops
+#define LOAD(q) const superwin_info_t& i##q = ((const superwin_info_t*)superwin_info)[512*q+quadrant(side,q)];
+#define MOVED(q,move) ((const superwin_info_t*)superwin_info)[512*q+(quadrant(side,q)|(move))]
+
+#endif  // PENTAGO_AVX2
+
+super_t super_wins(side_t side) {
+  LOAD(0) LOAD(1) LOAD(2) LOAD(3)
+  return super_wins_ways<0xff>(i0,i1,i2,i3);
+}
+
+// The ways to win which involve quadrant q, as a mask suitable for super_wins_ways
+static constexpr uint8_t ways_using(const int q) {
+  const uint8_t way_quadrants[8] = {0x3,0x5,0xa,0xc,0xd,0xb,0x7,0xe};
+  uint8_t ways = 0;
+  for (int k=0;k<8;k++)
+    ways |= (way_quadrants[k]>>q&1)<<k;
+  return ways;
+}
+
+// Ways not involving quadrant q are computed once, so each move pays only for the 5 of 8 ways involving q
+template<int q> static inline int super_wins_moves_helper(const side_t side, quadrant_t moves, super_t* wins) {
+  LOAD(0) LOAD(1) LOAD(2) LOAD(3)
+  const auto fixed = super_wins_ways<uint8_t(~ways_using(q))>(i0,i1,i2,i3);
+  int n = 0;
+  while (moves) {
+    const quadrant_t move = min_bit(moves);
+    moves ^= move;
+    const auto& im = MOVED(q,move);
+    wins[n++] = fixed | super_wins_ways<ways_using(q)>(q==0?im:i0,q==1?im:i1,q==2?im:i2,q==3?im:i3);
+  }
+  return n;
+}
+#undef LOAD
+#undef MOVED
+
+int super_wins_moves(const side_t side, const int q, const quadrant_t moves, super_t* wins) {
+  assert(!(moves&quadrant(side,q)));
+  switch (q) {
+    case 0: return super_wins_moves_helper<0>(side,moves,wins);
+    case 1: return super_wins_moves_helper<1>(side,moves,wins);
+    case 2: return super_wins_moves_helper<2>(side,moves,wins);
+    default: return super_wins_moves_helper<3>(side,moves,wins);
+  }
 }
 
 const Vector<int,4> single_rotations[8] = {
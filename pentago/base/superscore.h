@@ -248,6 +248,12 @@ static inline super_t rmax(super_t f) __attribute__((const)); // Definition belo
 // Given a single side, compute all rotations which yield five in a row
 super_t super_wins(side_t side) __attribute__((const));
 
+// Compute super_wins(side|move<<16*q) for each bit of moves in increasing order, storing the results in wins
+// (which must have room for popcount(moves) entries) and returning their count.  moves must be disjoint from
+// quadrant(side,q).  This is cheaper than calling super_wins once per move, since ways to win that don't
+// involve quadrant q are shared.
+int super_wins_moves(side_t side, int q, quadrant_t moves, super_t* wins);
+
 // Do not use in performance critical code
 extern const Vector<int,4> single_rotations[8];
 
@@ -260,6 +266,31 @@ int popcount(super_t s);
 // Version of shuffle with arguments in expected little endian order
 #define LE_MM_SHUFFLE(i0,i1,i2,i3) _MM_SHUFFLE(i3,i2,i1,i0)
 
+#if PENTAGO_AVX2
+
+// Same as the SSE version, but with all 256 bits in one register: 29+2+4 = 35 ops
+static inline super_t rmax(const super_t f) {
+  const uint32_t each0 = 0x11111111,
+                 each1 = 0x000f000f;
+  #define SHIFT_MASK(x,shift,mask) /* 2 ops */ \
+    ((shift>0?_mm256_slli_epi32(x,shift):_mm256_srli_epi32(x,-(shift)))&_mm256_set1_epi32(mask))
+  const int left = LE_MM_SHUFFLE(3,0,1,2), right = LE_MM_SHUFFLE(1,2,3,0);
+  const __m256i x = _mm256_set_m128i(f.y,f.x);
+  const __m256i r =
+       SHIFT_MASK(x, 1,~each0)   |SHIFT_MASK(x, -3,each0)                   // Rotate quadrant 0 left
+     | SHIFT_MASK(x,-1,~each0>>1)|SHIFT_MASK(x,  3,each0<<3)                // Rotate quadrant 0 right
+     | SHIFT_MASK(x, 4,~each1)   |SHIFT_MASK(x,-12,each1)                   // Rotate quadrant 1 left
+     | SHIFT_MASK(x,-4,~each1>>4)|SHIFT_MASK(x, 12,each1<<12)               // Rotate quadrant 1 right
+     | _mm256_shufflelo_epi16(_mm256_shufflehi_epi16(x,left),left)          // Rotate quadrant 2 left
+     | _mm256_shufflelo_epi16(_mm256_shufflehi_epi16(x,right),right)        // Rotate quadrant 2 right
+     | _mm256_permute4x64_epi64(x,left)                                     // Rotate quadrant 3 left
+     | _mm256_permute4x64_epi64(x,right);                                   // Rotate quadrant 3 right
+  return super_t(_mm256_castsi256_si128(r),_mm256_extracti128_si256(r,1));
+  #undef SHIFT_MASK
+}
+
+#else // SSE without AVX2
+
 // 2*29+4+14 = 76 ops
 static inline super_t rmax(const super_t f) {
   const uint32_t each0 = 0x11111111,
@@ -285,6 +316,8 @@ static inline super_t rmax(const super_t f) {
   #undef SHIFT_MASK
 }
 
+#endif  // PENTAGO_AVX2
+
 #else // Non-SSE version of rmax
 
 static inline super_t rmax(const super_t f) {
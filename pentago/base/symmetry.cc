@@ -6,12 +6,15 @@
 #include "pentago/utility/integer_log.h"
 #include "pentago/utility/range.h"
 #include "pentago/utility/random.h"
+#include <cstring>
+#include <initializer_list>
 namespace pentago {
 
 using std::get;
 using std::make_tuple;
 using std::min;
 using std::swap;
+using std::tie;
 using std::tuple;
 
 const symmetries_t symmetries;
@@ -124,13 +127,171 @@ tuple<board_t,symmetry_t> superstandardize(side_t side0, side_t side1) {
   return make_tuple(bmin,symmetry_t(reflect<<2|gr,local[0]|local[1]<<2|local[2]<<4|local[3]<<6));
 }
 
-// Cost: 57+[2,12+90+40] = [59,199] ops
+#if PENTAGO_SSE
+// In the batched version, each quadrant is held in one 32-bit lane as an 18 bit key with two bits
+// per cell (side0 even, side1 odd).  Comparing keys is equivalent to comparing packed quadrants,
+// since both read cells as digits from the most significant end, and rotations and reflections are
+// fixed bit permutations of the keys.  The layout of cells is qbit(x,y) = 1<<(3x+y).
+static constexpr int key_cells(const std::initializer_list<int> cells) {
+  int mask = 0;
+  for (const int c : cells)
+    mask |= 3<<2*c;
+  return mask;
+}
+#define KEY_CELLS(...) _mm_set1_epi32(key_cells(__VA_ARGS__))
+
+// Rotate all quadrants left: cell 3x+y moves to 3(2-y)+x.  Cost: 20 ops
+static inline __m128i rotate_keys(const __m128i k) {
+  return _mm_slli_epi32(k&KEY_CELLS({0}),12)|_mm_slli_epi32(k&KEY_CELLS({3}),8)
+        |_mm_slli_epi32(k&KEY_CELLS({1,6}),4)|(k&KEY_CELLS({4}))|_mm_srli_epi32(k&KEY_CELLS({2,7}),4)
+        |_mm_srli_epi32(k&KEY_CELLS({5}),8)|_mm_srli_epi32(k&KEY_CELLS({8}),12);
+}
+
+// Reflect all quadrants about the x = y line: cell 3x+y moves to 8-x-3y.  Cost: 14 ops
+static inline __m128i reflect_keys(const __m128i k) {
+  return _mm_slli_epi32(k&KEY_CELLS({0}),16)|_mm_slli_epi32(k&KEY_CELLS({1,3}),8)
+        |(k&KEY_CELLS({2,4,6}))|_mm_srli_epi32(k&KEY_CELLS({5,7}),8)|_mm_srli_epi32(k&KEY_CELLS({8}),16);
+}
+
+// Unsigned keys fit in 18 bits, so signed comparison works.  Cost: 4 ops
+static inline __m128i min_keys(const __m128i a, const __m128i b) {
+  const auto lt = _mm_cmplt_epi32(a,b);
+  return (lt&a)|_mm_andnot_si128(lt,b);
+}
+
+// Convert base 4 digits to base 3 by combining adjacent pairs of digit groups.  Cost: 23 ops
+static inline __m128i keys_to_quadrants(__m128i k) {
+  #define COMBINE(k,bits,mask,scale) _mm_add_epi32(k&_mm_set1_epi32(mask),_mm_mullo_epi16(_mm_srli_epi32(k,bits)&_mm_set1_epi32(mask),_mm_set1_epi16(scale)))
+  k = COMBINE(k,2,0x33333333,3);
+  k = COMBINE(k,4,0x0f0f0f0f,9);
+  k = COMBINE(k,8,0x00ff00ff,81);
+  return COMBINE(k,16,0x0000ffff,6561);
+  #undef COMBINE
+}
+
+// Quadrant i of side s in bits 16s..16s+8 of lane i
+static inline __m128i sides_to_lanes(const board_t board) {
+  uint32_t sides[4];
+  for (int i=0;i<4;i++)
+    memcpy(&sides[i],unpack_table[quadrant(board,i)],sizeof(sides[i]));
+  return _mm_loadu_si128((const __m128i*)sides);
+}
+
+static inline __m128i sides_to_lanes(const side_t side0, const side_t side1) {
+  return _mm_unpacklo_epi16(_mm_cvtsi64_si128(side0),_mm_cvtsi64_si128(side1));
+}
+
+// Sum the four lanes.  Cost: 4 ops
+static inline int horizontal_sum(__m128i x) {
+  x = _mm_add_epi32(x,_mm_shuffle_epi32(x,LE_MM_SHUFFLE(2,3,0,1)));
+  x = _mm_add_epi32(x,_mm_shuffle_epi32(x,LE_MM_SHUFFLE(1,0,3,2)));
+  return _mm_cvtsi128_si32(x);
+}
+
+// The SIGNATURE of the scalar version: for each quadrant, count the smaller quadrants, and combine
+// the counts with the given weights.  Cost: 16 ops
+static inline int weighted_places(const __m128i k, const __m128i weights) {
+  auto place = _mm_sub_epi32(_mm_setzero_si128(),_mm_cmpgt_epi32(k,_mm_shuffle_epi32(k,LE_MM_SHUFFLE(1,2,3,0))));
+  place = _mm_sub_epi32(place,_mm_cmpgt_epi32(k,_mm_shuffle_epi32(k,LE_MM_SHUFFLE(2,3,0,1))));
+  place = _mm_sub_epi32(place,_mm_cmpgt_epi32(k,_mm_shuffle_epi32(k,LE_MM_SHUFFLE(3,0,1,2))));
+  return horizontal_sum(_mm_mullo_epi16(place,weights));
+}
+
+static inline void superstandardize_sse(__m128i k, board_t& standard, symmetry_t& symmetry) {
+  // Interleave the bits of both sides into keys.  Cost: 24 ops
+  #define SHUFFLE(k,mask,shift) (_mm_slli_epi32(k&_mm_set1_epi32(mask),shift)|(_mm_srli_epi32(k,shift)&_mm_set1_epi32(mask))|_mm_andnot_si128(_mm_set1_epi32(mask|mask<<shift),k))
+  k = SHUFFLE(k,0x0000ff00,8);
+  k = SHUFFLE(k,0x00f000f0,4);
+  k = SHUFFLE(k,0x0c0c0c0c,2);
+  k = SHUFFLE(k,0x22222222,1);
+  #undef SHUFFLE
+
+  // Compute all rotated and reflected versions of all quadrants, indexed by reflection, rotation
+  __m128i versions[8];
+  versions[0] = k;
+  for (int j=1;j<4;j++)
+    versions[j] = rotate_keys(versions[j-1]);
+  for (int j=0;j<4;j++)
+    versions[4+j] = reflect_keys(versions[j]);
+  const __m128i kmin[2] = {min_keys(min_keys(versions[0],versions[1]),min_keys(versions[2],versions[3])),
+                           min_keys(min_keys(versions[4],versions[5]),min_keys(versions[6],versions[7]))};
+
+  // Choose global reflection and rotation via lookup table, as in the scalar version
+  const int r0 =    superstandardize_table[weighted_places(kmin[0],_mm_setr_epi32(1,4,16,64))],
+            r1 = 3&-superstandardize_table[weighted_places(kmin[1],_mm_setr_epi32(64,4,16,1))];
+  uint32_t qmin[2][4];
+  _mm_storeu_si128((__m128i*)qmin[0],keys_to_quadrants(kmin[0]));
+  _mm_storeu_si128((__m128i*)qmin[1],keys_to_quadrants(kmin[1]));
+  const board_t b0 = quadrants(qmin[0][rotate_quadrants[r0][0]],qmin[0][rotate_quadrants[r0][1]],
+                               qmin[0][rotate_quadrants[r0][2]],qmin[0][rotate_quadrants[r0][3]]),
+                b1 = quadrants(qmin[1][rotate_quadrants[r1][3]],qmin[1][rotate_quadrants[r1][1]],
+                               qmin[1][rotate_quadrants[r1][2]],qmin[1][rotate_quadrants[r1][0]]);
+  const bool reflect = b1<b0;
+  const int gr = reflect?r1:r0;
+  standard = reflect?b1:b0;
+
+  // Determine local rotations from the first version matching each minimum, without branches
+  const int o = 4*reflect;
+  const auto m = kmin[reflect], one = _mm_set1_epi32(1);
+  auto r = _mm_andnot_si128(_mm_cmpeq_epi32(m,versions[o+2]),one);
+  r = _mm_andnot_si128(_mm_cmpeq_epi32(m,versions[o+1]),_mm_add_epi32(r,one));
+  r = _mm_andnot_si128(_mm_cmpeq_epi32(m,versions[o+0]),_mm_add_epi32(r,one));
+  r = _mm_sub_epi32(r,_mm_set1_epi32(gr))&_mm_set1_epi32(3);
+  symmetry = symmetry_t(reflect<<2|gr,horizontal_sum(_mm_mullo_epi16(r,_mm_setr_epi32(1,4,16,64))));
+}
+#endif  // PENTAGO_SSE
+
+void superstandardize(const side_t side0, const side_t side1, board_t& standard, symmetry_t& symmetry) {
+#if PENTAGO_SSE
+  superstandardize_sse(sides_to_lanes(side0,side1),standard,symmetry);
+#else
+  tie(standard,symmetry) = superstandardize(side0,side1);
+#endif
+}
+
+void superstandardize(RawArray<const board_t> boards, RawArray<board_t> standard,
+                      RawArray<symmetry_t> symmetry) {
+  GEODE_ASSERT(boards.size()==standard.size() && (!symmetry.size() || boards.size()==symmetry.size()));
+  for (const int i : range(boards.size())) {
+#if PENTAGO_SSE
+    symmetry_t s;
+    superstandardize_sse(sides_to_lanes(boards[i]),standard[i],s);
+#else
+    const auto [b,s] = superstandardize(boards[i]);
+    standard[i] = b;
+#endif
+    if (symmetry.size())
+      symmetry[i] = s;
+  }
+}
+
+void superstandardize(RawArray<const side_t> side0, RawArray<const side_t> side1,
+                      RawArray<board_t> standard, RawArray<symmetry_t> symmetry) {
+  GEODE_ASSERT(side0.size()==side1.size() && side0.size()==standard.size()
+               && (!symmetry.size() || side0.size()==symmetry.size()));
+  for (const int i : range(side0.size())) {
+    symmetry_t s;
+    superstandardize(side0[i],side1[i],standard[i],s);
+    if (symmetry.size())
+      symmetry[i] = s;
+  }
+}
+
+// Cost: 57+[2,12+90+40] = [59,199] ops with SSE, [20,77] ops with AVX2
 super_t transform_super(symmetry_t s, super_t C) {
   // We view C as a subset of the local rotation group L: C(r0,r1,r2,r3) iff (rotation of quadrant i by ri) in C.
   // See the header for more details.
 
   // First apply the local part: C = C local'
-#if PENTAGO_SSE
+#if PENTAGO_AVX2
+  // With AVX2, all 256 bits live in one register, and everything that crosses 64-bit chunks is a
+  // single permute.  Total cost: 3+17+[0,3*12+2]+[0,19] = [20,77] ops.
+  __m256i X = _mm256_set_m128i(C.y,C.x);
+  #define APPLY_ALL(f,k) /* cost(f) */ ({ X = f(X,(k)); })
+  #define ROTATE_RIGHT_MOD_4(x,k) /* 7 ops */ ((_mm256_srli_epi16(x,(k))&_mm256_set1_epi8(0x11*(0xf>>(k))))|(_mm256_slli_epi16(x,(4-(k))&3)&_mm256_set1_epi8(0x11*((0xf<<(4-(k)))&0xf))))
+  #define ROTATE_RIGHT_MOD_16(x,k) /* 3 ops */ (_mm256_srli_epi16(x,(k))|_mm256_slli_epi16(x,(16-(k))&15))
+  #define ROTATE_RIGHT_MOD_64(x,k) /* 3 ops */ (_mm256_srli_epi64(x,(k))|_mm256_slli_epi64(x,(64-(k))&63))
+#elif PENTAGO_SSE
   #define APPLY_ALL(f,k) /* 2cost(f) */ ({ C.x = f(C.x,(k)); C.y = f(C.y,(k)); })
   #define ROTATE_RIGHT_MOD_4(x,k) /* 15 ops */ ((_mm_srli_epi16(x,(k))&_mm_set1_epi8(0x11*(0xf>>(k))))|(_mm_slli_epi16(x,(4-(k))&3)&_mm_set1_epi8(0x11*((0xf<<(4-(k)))&0xf))))
   #define ROTATE_RIGHT_MOD_16(x,k) /* 5 ops */ (_mm_srli_epi16(x,(k))|_mm_slli_epi16(x,(16-(k))&15))
@@ -145,7 +306,10 @@ super_t transform_super(symmetry_t s, super_t C) {
   APPLY_ALL(ROTATE_RIGHT_MOD_4,s.local&3);
   APPLY_ALL(ROTATE_RIGHT_MOD_16,4*(s.local>>2&3));
   APPLY_ALL(ROTATE_RIGHT_MOD_64,16*(s.local>>4&3));
-#if PENTAGO_SSE
+#if PENTAGO_AVX2
+  // Rotate 64-bit chunks: 4 ops
+  X = _mm256_permutevar8x32_epi32(X,(_mm256_setr_epi32(0,1,2,3,4,5,6,7)+_mm256_set1_epi32(2*(s.local>>6)))&_mm256_set1_epi32(7));
+#elif PENTAGO_SSE
   // ~12 ops
   if (s.local&1<<6) { // Low bit of quadrant 3 rotations
     const int swap = LE_MM_SHUFFLE(2,3,0,1);
@@ -172,7 +336,15 @@ super_t transform_super(symmetry_t s, super_t C) {
   // the code follows http://alaska-kamtchatka.blogspot.com/2011/09/4-matrix-transposition.html.
   // LOW_TRANSPOSE(i,j) transposes quadrants i and j where i,j < 3.
   #define BIT(i) ((uint64_t)1<<(i))
-#if PENTAGO_SSE
+#if PENTAGO_AVX2
+  #define LOW_TRANSPOSE(i,j) ({ /* 12 ops */ \
+    const int ii = 1<<2*i, jj = 1<<2*j, kk = 1<<2*(3-i-j), sh = jj-ii; \
+    const uint64_t other = 1|BIT(kk)|BIT(2*kk)|BIT(3*kk); \
+    auto t = (X^_mm256_srli_epi64(X,sh))&_mm256_set1_epi64x(other*(BIT(ii)|BIT(3*ii)|BIT(ii+2*jj)|BIT(3*ii+2*jj))); \
+    X ^= t^_mm256_slli_epi64(t,sh); \
+    t = (X^_mm256_srli_epi64(X,2*sh))&_mm256_set1_epi64x(other*(BIT(2*ii)|BIT(3*ii)|BIT(2*ii+jj)|BIT(3*ii+jj))); \
+    X ^= t^_mm256_slli_epi64(t,2*sh); })
+#elif PENTAGO_SSE
   #define LOW_HALF_TRANSPOSE(x,i,j) ({ /* 12 ops */ \
     const int ii = 1<<2*i, jj = 1<<2*j, kk = 1<<2*(3-i-j), sh = jj-ii; \
     const uint64_t other = 1|BIT(kk)|BIT(2*kk)|BIT(3*kk); \
@@ -196,7 +368,14 @@ super_t transform_super(symmetry_t s, super_t C) {
     LOW_QUARTER_TRANSPOSE(C.d,i,j); })
 #endif
 
-#if PENTAGO_SSE
+#if PENTAGO_AVX2
+  // Transposing quadrants 2 and 3 transposes the 4x4 matrix of 16 bit chunks: interleave the chunks of
+  // each pair of 64-bit chunks, then gather 32-bit pieces across lanes.  2 ops.
+  #define TRANSPOSE_23() ({ \
+    const auto interleave = _mm256_setr_epi8(0,1,8,9,2,3,10,11,4,5,12,13,6,7,14,15, \
+                                             0,1,8,9,2,3,10,11,4,5,12,13,6,7,14,15); \
+    X = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(X,interleave),_mm256_setr_epi32(0,4,1,5,2,6,3,7)); })
+#elif PENTAGO_SSE
   // Transposing quadrants 2 and 3 is analogous, but operates on 16 bit chunks instead of single bits, and knits the two __m128i's together
   #define TRANSPOSE_23() ({ /* 18 ops */ \
     const auto a = sse_pack<uint32_t>(0xffff0000,0xffff0000,0,0); \
@@ -222,30 +401,32 @@ super_t transform_super(symmetry_t s, super_t C) {
   // Armed with the above transpositions, we can now form the conjugate s.global C s.global' by expanding s.global into transpositions
   // and an optional per-quadrant reflection.  See `dihedral` for computation of the minimal sequence of transpositions required to build
   // up each element.  First, we conjugate by the quadrant interchange part of the map.
-  #define T(i,j) (j==3?3:(j*(j-1)/2+i))
-  static const uint8_t offsets[] = {0,0,3,7,10,13,17,18,20};
-  static const uint8_t transpositions[] = { // Here r = global rotate left by 90, s = reflect about x = y line
-    /* nothing */                // e    = ()
-    T(0,1),T(0,2),T(2,3),        // r    = (01)(02)(23)
-    T(0,2),T(0,1),T(2,3),T(0,2), // r^2  = (02)(01)(23)(02) // 3*24+18 = 90 ops
-    T(2,3),T(0,2),T(0,1),        // r^3  = (23)(02)(01)
-    T(0,2),T(2,3),T(0,2),        // s    = (02)(23)(02)
-    T(0,2),T(1,2),T(2,3),T(1,2), // sr   = (02)(12)(23)(12)
-    T(1,2),                      // sr^2 = (12)
-    T(0,1),T(2,3) };             // sr^3 = (01)(23)
-  // Apply transpositions in reverse order
-  for (int i=offsets[s.global+1]-1;i>=offsets[s.global];i--)
-    switch (transpositions[i]) {
-      case T(0,1): LOW_TRANSPOSE(0,1); break;
-      case T(0,2): LOW_TRANSPOSE(0,2); break;
-      case T(1,2): LOW_TRANSPOSE(1,2); break;
-      case T(2,3): TRANSPOSE_23(); break;
-    }
+  // Here r = global rotate left by 90, s = reflect about x = y line:
+  //   e    = ()
+  //   r    = (01)(02)(23)
+  //   r^2  = (02)(01)(23)(02)  // 3*24+18 = 90 ops
+  //   r^3  = (23)(02)(01)
+  //   s    = (02)(23)(02)
+  //   sr   = (02)(12)(23)(12)
+  //   sr^2 = (12)
+  //   sr^3 = (01)(23)
+  // Each element gets its own straight line kernel, applying its transpositions in reverse order, so that the
+  // only branch is a single jump on s.global.  For random symmetries, this is much cheaper than a loop over
+  // a table of transpositions, which mispredicts on nearly every step.
 
-  // Finally, if necessary, we conjugate by the quadrant-local reflection map, which amounts to applying the
-  // negation isomorphism to each direct product term in Z_4^4.  40 ops.
-  if (s.global&4) {
-#if PENTAGO_SSE
+  // If s.global includes a reflection, we also conjugate by the quadrant-local reflection map, which amounts
+  // to applying the negation isomorphism to each direct product term in Z_4^4.  40 ops.
+  const auto negate = [&]() {
+#if PENTAGO_AVX2
+    // Negate rotations of the first three quadrants as below, then of quadrant 3: 19 ops
+    auto t = (X^_mm256_srli_epi16(X,2))&_mm256_set1_epi8(0x22);
+    X ^= t^_mm256_slli_epi16(t,2);
+    t = (X^_mm256_srli_epi16(X,2*4))&_mm256_set1_epi16(0xf0);
+    X ^= t^_mm256_slli_epi16(t,2*4);
+    t = (X^_mm256_srli_epi64(X,2*16))&_mm256_set1_epi64x(0xffff0000);
+    X ^= t^_mm256_slli_epi64(t,2*16);
+    X = _mm256_permute4x64_epi64(X,LE_MM_SHUFFLE(0,3,2,1));
+#elif PENTAGO_SSE
     #define HALF_NEGATE(x) ({ /* 18 ops */ \
       /* Negate quadrant 0 rotations */ \
       auto t = (x^_mm_srli_epi16(x,2))&_mm_set1_epi8(0x22); \
@@ -282,10 +463,25 @@ super_t transform_super(symmetry_t s, super_t C) {
     // Negate quadrant 3 rotations
     swap(C.b,C.d);
 #endif
+  };
+
+  switch (s.global) {
+    case 0: break;
+    case 1: TRANSPOSE_23(); LOW_TRANSPOSE(0,2); LOW_TRANSPOSE(0,1); break;
+    case 2: LOW_TRANSPOSE(0,2); TRANSPOSE_23(); LOW_TRANSPOSE(0,1); LOW_TRANSPOSE(0,2); break;
+    case 3: LOW_TRANSPOSE(0,1); LOW_TRANSPOSE(0,2); TRANSPOSE_23(); break;
+    case 4: LOW_TRANSPOSE(0,2); TRANSPOSE_23(); LOW_TRANSPOSE(0,2); negate(); break;
+    case 5: LOW_TRANSPOSE(1,2); TRANSPOSE_23(); LOW_TRANSPOSE(1,2); LOW_TRANSPOSE(0,2); negate(); break;
+    case 6: LOW_TRANSPOSE(1,2); negate(); break;
+    case 7: TRANSPOSE_23(); LOW_TRANSPOSE(0,1); negate(); break;
   }
 
   // Whew.
+#if PENTAGO_AVX2
+  return super_t(_mm256_castsi256_si128(X),_mm256_extracti128_si256(X,1));
+#else
   return C;
+#endif
 }
 
 // Different from hash_board, since it used to be geode's 64->32 bit hash
@@ -122,6 +122,18 @@ super_t transform_super(symmetry_t s, super_t super) __attribute__((const));
 tuple<board_t,symmetry_t> superstandardize(board_t board) __attribute__((const));
 tuple<board_t,symmetry_t> superstandardize(side_t side0, side_t side1) __attribute__((const));
 
+// The same for one board given as two sides, but with the SIMD kernel of the batched versions if we
+// have one.  For hot single board paths such as transposition table lookups.
+void superstandardize(side_t side0, side_t side1, board_t& standard, symmetry_t& symmetry);
+
+// Superstandardize many boards at once, given either packed or as two sides, with one board per
+// SIMD register.  symmetry may be empty if only the standardized boards are needed, and standard
+// may alias boards.
+void superstandardize(RawArray<const board_t> boards, RawArray<board_t> standard,
+                      RawArray<symmetry_t> symmetry);
+void superstandardize(RawArray<const side_t> side0, RawArray<const side_t> side1,
+                      RawArray<board_t> standard, RawArray<symmetry_t> symmetry);
+
 // A meaningless function invariant to global board transformations.  Extremely slow.
 bool meaningless(board_t board, uint64_t salt=0) __attribute__((const));
 super_t super_meaningless(board_t board, uint64_t salt=0) __attribute__((const));
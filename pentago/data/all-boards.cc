@@ -0,0 +1,136 @@
+// Stream all boards with a given number of stones, optionally writing them to .npy shards
+//
+// For example, to write all superstandardized 10 stone boards in shards of 2^24 boards,
+//
+//   all-boards --stones 10 --symmetries 2048 --shards boards-10
+
+#include "pentago/base/all_boards.h"
+#include "pentago/base/count.h"
+#include "pentago/data/numpy.h"
+#include "pentago/end/options.h"
+#include "pentago/utility/large.h"
+#include "pentago/utility/log.h"
+#include "pentago/utility/thread.h"
+#include "pentago/utility/wall_time.h"
+#include <getopt.h>
+#include <sys/stat.h>
+
+namespace pentago {
+namespace {
+
+struct options_t {
+  int stones = 5;
+  int symmetries = 2048;
+  int threads = -1;
+  int64_t chunk = 1<<20;
+  int window = 0;
+  string shards;
+  int64_t shard_size = 1<<24;
+};
+
+options_t parse_options(int argc, char** argv) {
+  options_t o;
+  static const option options[] = {
+      {"help", no_argument, 0, 'h'},
+      {"stones", required_argument, 0, 'n'},
+      {"symmetries", required_argument, 0, 's'},
+      {"threads", required_argument, 0, 't'},
+      {"chunk", required_argument, 0, 'c'},
+      {"window", required_argument, 0, 'w'},
+      {"shards", required_argument, 0, 'o'},
+      {"shard-size", required_argument, 0, 'z'},
+      {0, 0, 0, 0},
+  };
+  const int rank = 0;
+  for (;;) {
+    int option = 0;
+    int c = getopt_long(argc, argv, "hn:s:t:", options, &option);
+    if (c == -1) break;  // Out of options
+    switch (c) {
+      case 'h':
+        slog("usage: %s [options...]", argv[0]);
+        slog("Stream all boards with a given number of stones, reduced by symmetries.");
+        slog("  -h, --help                Display usage information and quit");
+        slog("  -n, --stones <n>          Number of stones (default %d)", o.stones);
+        slog("  -s, --symmetries <n>      Symmetries to reduce by: 1, 8, or 2048 (default %d)", o.symmetries);
+        slog("  -t, --threads <n>         Number of compute threads (default: one per core)");
+        slog("      --chunk <n>           Candidate boards per parallel job (default %d)", o.chunk);
+        slog("      --window <n>          Jobs in flight at once (default: twice the threads)");
+        slog("      --shards <dir>        Write boards to <dir>/boards-<n>-<k>.npy");
+        slog("      --shard-size <n>      Boards per shard (default %d)", o.shard_size);
+        exit(0);
+      PENTAGO_INT_ARG('n', stones, stones)
+      PENTAGO_INT_ARG('s', symmetries, symmetries)
+      PENTAGO_INT_ARG('t', threads, threads)
+      PENTAGO_INT_ARG('c', chunk, chunk)
+      PENTAGO_INT_ARG('w', window, window)
+      PENTAGO_INT_ARG('z', shard-size, shard_size)
+      case 'o':
+        o.shards = optarg;
+        break;
+      default:
+        die("impossible option character %d", c);
+    }
+  }
+  if (!(0 <= o.stones && o.stones <= 36))
+    PENTAGO_OPTION_ERROR("--stones %d must be in [0,36]", o.stones);
+  if (o.symmetries != 1 && o.symmetries != 8 && o.symmetries != 2048)
+    PENTAGO_OPTION_ERROR("--symmetries %d must be 1, 8, or 2048", o.symmetries);
+  if (o.chunk < 1)
+    PENTAGO_OPTION_ERROR("--chunk %d must be positive", o.chunk);
+  if (o.window < 0)
+    PENTAGO_OPTION_ERROR("--window %d must be nonnegative", o.window);
+  if (o.shard_size < 1)
+    PENTAGO_OPTION_ERROR("--shard-size %d must be positive", o.shard_size);
+  if (optind != argc)
+    PENTAGO_OPTION_ERROR("expected no arguments");
+  return o;
+}
+
+void toplevel(int argc, char** argv) {
+  const auto o = parse_options(argc, argv);
+  Scope scope("all boards");
+  init_threads(o.threads, 0);
+  slog("stones = %d, symmetries = %d, expected count = %s", o.stones, o.symmetries,
+       large(count_boards(o.stones, o.symmetries)));
+  if (o.shards.size())
+    mkdir(o.shards.c_str(), 0777);
+
+  // Buffer boards into shards as they arrive
+  uint64_t total = 0;
+  int shards = 0;
+  vector<board_t> shard;
+  const auto write_shard = [&]() {
+    write_numpy(format("%s/boards-%d-%d.npy", o.shards, o.stones, shards++), asarray(shard));
+    shard.clear();
+  };
+  const auto start = wall_time();
+  all_boards_stream(o.stones, o.symmetries, [&](RawArray<const board_t> boards) {
+    total += boards.size();
+    if (o.shards.size())
+      for (const auto board : boards) {
+        shard.push_back(board);
+        if (int64_t(shard.size()) == o.shard_size)
+          write_shard();
+      }
+  }, o.chunk, o.window);
+  if (shard.size())
+    write_shard();
+  const double elapsed = (wall_time()-start).seconds();
+  slog("count = %s, shards = %d, time = %.3g s, %.3g boards/s", large(total), shards, elapsed,
+       total/elapsed);
+  GEODE_ASSERT(total == count_boards(o.stones, o.symmetries));
+}
+
+}  // namespace
+}  // namespace pentago
+
+int main(int argc, char** argv) {
+  try {
+    pentago::toplevel(argc, argv);
+    return 0;
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+}
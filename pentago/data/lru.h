@@ -14,12 +14,12 @@ using std::make_tuple;
 using std::tuple;
 using std::unordered_map;
 
-template<class K,class V> class lru_t : boost::noncopyable {
+template<class K,class V,class H=boost::hash<K>> class lru_t : boost::noncopyable {
   // Least to most recently used
   mutable list<tuple<K,V>> order;
 
   // Key to position in order
-  unordered_map<K,typename list<tuple<K,V>>::iterator,boost::hash<K>> table;
+  unordered_map<K,typename list<tuple<K,V>>::iterator,H> table;
 public:
 
   void add(const K key, const V& value) {
@@ -34,6 +34,10 @@ public:
     return &std::get<1>(*it->second);
   }
 
+  bool empty() const {
+    return order.empty();
+  }
+
   tuple<K,V> drop() {
     GEODE_ASSERT(order.size());
     const auto r = order.front();
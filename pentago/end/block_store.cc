@@ -70,7 +70,8 @@ accumulating_block_store_t::accumulating_block_store_t(
     RawArray<const local_block_t> blocks, const int samples_per_section,
     const shared_ptr<compacting_store_t>& store)
   : Base(partition,rank,blocks,store)
-  , section_counts(sections->sections.size()) {
+  , section_counts(sections->sections.size())
+  , completion_times(total_blocks()) {
   // Count random samples in each block
   Array<int> sample_counts(total_blocks());
   for (const auto& section : sections->sections) {
@@ -123,7 +124,8 @@ uint64_t readable_block_store_t::base_memory_usage() const {
 }
 
 uint64_t accumulating_block_store_t::base_memory_usage() const {
-  return Base::base_memory_usage() + pentago::memory_usage(section_counts);
+  return Base::base_memory_usage() + pentago::memory_usage(section_counts)
+                                   + pentago::memory_usage(completion_times);
 }
 
 const block_info_t& readable_block_store_t::block_info(const local_id_t local_id) const {
@@ -189,6 +191,7 @@ void accumulating_block_store_t::accumulate(local_id_t local_id, uint8_t dimensi
     info.missing_dimensions &= ~(1<<dimension);
     if (!info.missing_dimensions) {
       thread_time_t time(count_kind,event);
+      completion_times[flat_id] = wall_time();
       for (auto& sample : samples[flat_id])
         sample.wins = local_data[sample.index];
       const auto counts = count_block_wins(info.section,info.block,local_data);
@@ -216,6 +219,7 @@ void accumulating_block_store_t::accumulate(local_id_t local_id, uint8_t dimensi
   info.missing_dimensions &= ~(1<<dimension);
   if (!info.missing_dimensions) {
     thread_time_t time(count_kind,event);
+    completion_times[flat_id] = wall_time();
     for (auto& sample : samples[flat_id])
       sample.wins = new_data[sample.index];
     const auto counts = count_block_wins(info.section,info.block,new_data);
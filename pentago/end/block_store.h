@@ -13,6 +13,7 @@
 #include "pentago/utility/counter.h"
 #include "pentago/utility/spinlock.h"
 #include "pentago/utility/nested.h"
+#include "pentago/utility/wall_time.h"
 #if PENTAGO_MPI_COMPRESS
 #include "pentago/end/compacting_store.h"
 #endif
@@ -128,6 +129,9 @@ public:
   };
   const Nested<sample_t> samples;
 
+  // When each block (by flat id) received its last contribution, or zero if it hasn't yet
+  const Array<wall_time_t> completion_times;
+
   accumulating_block_store_t(const shared_ptr<const block_partition_t>& partition, const int rank,
                              RawArray<const local_block_t> blocks, const int samples_per_section,
                              const shared_ptr<compacting_store_t>& store);
@@ -40,6 +40,7 @@ struct options_t {
   vector<string> dirs;
   string old = "../old-data-15july2012";
   bool restart = false;
+  bool skip_hashes = false;
   int reader_test = -1;
   int high_test = -1;
 };
@@ -50,6 +51,7 @@ options_t parse_options(int argc, char** argv) {
       {"help", no_argument, 0, 'h'},
       {"old", required_argument, 0, 'o'},
       {"restart", no_argument, 0, 's'},
+      {"skip-hashes", no_argument, 0, 'k'},
       {"reader-test", required_argument, 0, 'r'},
       {"high-test", required_argument, 0, 'i'},
       {0, 0, 0, 0},
@@ -66,6 +68,7 @@ options_t parse_options(int argc, char** argv) {
         slog("  -h, --help                  Display usage information and quit");
         slog("      --old <dir>             Compare against an old directory (default '%s')", o.old);
         slog("      --restart               Check restart consistency");
+        slog("      --skip-hashes           Don't compare against memorized hashes, which depend on the rank count");
         slog("      --reader-test <slice>   Check consistency of <slice> with smaller slices");
         slog("      --high-test <slice>     Check consistency of high level interface up to <slice>");
         exit(0);
@@ -75,6 +78,9 @@ options_t parse_options(int argc, char** argv) {
       case 's':
         o.restart = true;
         break;
+      case 'k':
+        o.skip_hashes = true;
+        break;
       PENTAGO_INT_ARG('r', reader-test, reader_test)
       PENTAGO_INT_ARG('i', high-test, high_test)
       default:
@@ -143,6 +149,7 @@ void toplevel(int argc, char** argv) {
     };
     const auto check_hash = [&](const string& file) {
       if (!meaningless) return;  // We don't have nonmeaningless results memorized
+      if (o.skip_hashes) return;
       const std::regex restarted_re("-restarted");
       for (const auto& [p, hs] : hashes) {
         const auto file_sub = regex_replace(file, restarted_re, "");
@@ -169,7 +176,7 @@ void toplevel(int argc, char** argv) {
     }();
 
     // Process each slice that exists, keeping track of which files we've checked
-    const std::regex skip_pattern(R"(^(?:log(?:-\d+)?|\.{1,2}|empty.pentago|history.*|output-.*|.*\.pbs|meaningless-\d|\d+\.(cobaltlog|error|output))$)");
+    const std::regex skip_pattern(R"(^(?:log(?:-\d+)?|\.{1,2}|empty.pentago|checkpoint|history.*|trace.*\.json|output-.*|.*\.pbs|meaningless-\d|\d+\.(cobaltlog|error|output))$)");
     unordered_set<string> unchecked;
     for (const auto& f : listdir(dir))
       if (!regex_match(f, skip_pattern))
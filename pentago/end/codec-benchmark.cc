@@ -0,0 +1,169 @@
+// Benchmark in memory compression codecs on real endgame blocks
+//
+// Reads every block of the given supertensor files, converts them to the
+// in memory format used by the block store, and reports compression ratio and
+// single threaded compression and decompression speed for each fast codec,
+// with and without interleave filtering.
+
+#include "pentago/data/supertensor.h"
+#include "pentago/end/config.h"
+#include "pentago/end/fast_compress.h"
+#include "pentago/end/options.h"
+#include "pentago/utility/join.h"
+#include "pentago/utility/large.h"
+#include "pentago/utility/log.h"
+#include "pentago/utility/memory_usage.h"
+#include "pentago/utility/thread.h"
+#include "pentago/utility/wall_time.h"
+#include <getopt.h>
+
+namespace pentago {
+namespace end {
+namespace {
+
+using std::max;
+
+struct options_t {
+  vector<string> inputs;
+  vector<string> codecs = {"snappy", "lz4", "zstd-5", "zstd-3", "zstd-1", "zstd1"};
+  int repeats = 3;
+};
+
+options_t parse_options(int argc, char** argv) {
+  options_t o;
+  static const option options[] = {
+      {"help", no_argument, 0, 'h'},
+      {"codecs", required_argument, 0, 'c'},
+      {"repeats", required_argument, 0, 'r'},
+      {0, 0, 0, 0},
+  };
+  const int rank = 0;
+  for (;;) {
+    int option = 0;
+    int c = getopt_long(argc, argv, "h", options, &option);
+    if (c == -1) break;  // Out of options
+    switch (c) {
+      case 'h':
+        slog("usage: %s [options...] <slice.pentago>...", argv[0]);
+        slog("Benchmark in memory compression codecs on real endgame blocks.");
+        slog("  -h, --help                  Display usage information and quit");
+        slog("      --codecs <a,b,...>      Codecs to compare (default %s)", join(",", o.codecs));
+        slog("      --repeats <n>           Time the best of n runs (default %d)", o.repeats);
+        exit(0);
+      case 'c': {
+        o.codecs.clear();
+        string s = optarg;
+        for (size_t i = 0;;) {
+          const size_t j = s.find(',', i);
+          o.codecs.push_back(s.substr(i, j-i));
+          if (j == string::npos) break;
+          i = j+1;
+        }
+        break; }
+      PENTAGO_INT_ARG('r', repeats, repeats)
+      default:
+        die("impossible option character %d", c);
+    }
+  }
+  if (o.repeats < 1)
+    PENTAGO_OPTION_ERROR("--repeats %d must be at least 1", o.repeats);
+  if (optind == argc)
+    PENTAGO_OPTION_ERROR("expected at least one <slice.pentago> argument");
+  o.inputs.assign(argv + optind, argv + argc);
+  return o;
+}
+
+// Read all blocks, converted to (we-win,we-win-or-tie) format as in read_sections
+vector<Array<const Vector<super_t,2>>> read_blocks(const string& path) {
+  vector<Array<const Vector<super_t,2>>> blocks;
+  for (const auto& reader : open_supertensors(path)) {
+    const bool turn = reader->header.stones&1;
+    const auto shape = Vector<int,4>(reader->header.blocks);
+    for (const uint8_t i0 : range(shape[0]))
+      for (const uint8_t i1 : range(shape[1]))
+        for (const uint8_t i2 : range(shape[2]))
+          for (const uint8_t i3 : range(shape[3])) {
+            const auto data = reader->read_block(vec(i0,i1,i2,i3)).flat_own();
+            for (auto& s : data)
+              s = !turn ? vec(s[0],~s[1]) : vec(s[1],~s[0]);
+            blocks.push_back(data);
+          }
+  }
+  return blocks;
+}
+
+void benchmark(const options_t& o, const vector<Array<const Vector<super_t,2>>>& blocks,
+               const string& codec, const bool filter) {
+  set_fast_codec(codec, filter);
+  const string name = fast_codec_name();
+
+  // Scratch space: compress destroys its input, so we copy in before each pass
+  vector<Array<Vector<super_t,2>>> work;
+  vector<Array<uint8_t>> compressed;
+  uint64_t raw = 0;
+  for (const auto& b : blocks) {
+    work.emplace_back(b.size(), uninit);
+    compressed.emplace_back(raw_max_fast_compressed_size, uninit);
+    raw += memory_usage(b);
+  }
+
+  // Time the best of several runs to reduce noise
+  uint64_t total = 0;
+  wall_time_t compress_time(std::numeric_limits<int64_t>::max()), uncompress_time = compress_time;
+  for (int r = 0; r < o.repeats; r++) {
+    for (const int i : range(int(blocks.size())))
+      work[i].raw().copy(blocks[i]);
+    total = 0;
+    auto start = wall_time();
+    for (const int i : range(int(blocks.size()))) {
+      const int size = fast_compress(work[i], compressed[i], unevent);
+      compressed[i] = compressed[i].slice_own(0, size);
+      total += size;
+    }
+    compress_time = std::min(compress_time, wall_time()-start);
+    start = wall_time();
+    for (const int i : range(int(blocks.size())))
+      fast_uncompress(compressed[i], work[i], unevent);
+    uncompress_time = std::min(uncompress_time, wall_time()-start);
+    for (const int i : range(int(blocks.size()))) {
+      GEODE_ASSERT(work[i] == blocks[i]);
+      compressed[i] = Array<uint8_t>(raw_max_fast_compressed_size, uninit);
+    }
+  }
+  slog("%-8s filter %d: ratio %.4f, compress %.3g GB/s, uncompress %.3g GB/s", name, filter,
+       double(total)/max(raw, uint64_t(1)), raw/max(compress_time.seconds(), 1e-6)/1e9,
+       raw/max(uncompress_time.seconds(), 1e-6)/1e9);
+}
+
+void toplevel(int argc, char** argv) {
+  const auto o = parse_options(argc, argv);
+  Scope scope("codec benchmark");
+  init_threads(-1, -1);
+
+  vector<Array<const Vector<super_t,2>>> blocks;
+  uint64_t raw = 0;
+  for (const auto& path : o.inputs)
+    for (const auto& b : read_blocks(path)) {
+      blocks.push_back(b);
+      raw += memory_usage(b);
+    }
+  slog("blocks = %d, raw size = %s", blocks.size(), large(raw));
+
+  for (const auto& codec : o.codecs)
+    for (const bool filter : {true, false})
+      benchmark(o, blocks, codec, filter);
+}
+
+}  // namespace
+}  // namespace end
+}  // namespace pentago
+
+int main(int argc, char** argv) {
+  try {
+    pentago::end::toplevel(argc, argv);
+    return 0;
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+}
@@ -17,15 +17,29 @@ namespace end {
 compacting_store_t::compacting_store_t(const uint64_t heap_size_, function<void()> collect_callback)
   : heap_size(align_size(heap_size_))
   , heap_start(heap_size?(uint8_t*)mmap(0,heap_size,PROT_READ|PROT_WRITE,MAP_ANON|MAP_PRIVATE,-1,0):0)
+  , owns_heap(true)
   , heap_next(0)
+  , live(0)
+  , live_peak(0)
   , collect_callback(collect_callback) {
   if (heap_start==MAP_FAILED)
     die("compacting_store_t: anonymous mmap of size %zu failed, %s",heap_size,strerror(errno));
   report_large_alloc(heap_size);
 }
 
+compacting_store_t::compacting_store_t(RawArray<uint8_t> heap, function<void()> collect_callback)
+  : heap_size(heap.size())
+  , heap_start(heap.data())
+  , owns_heap(false)
+  , heap_next(0)
+  , live(0)
+  , live_peak(0)
+  , collect_callback(collect_callback) {
+  GEODE_ASSERT(heap_size==align_size(heap_size) && !(uintptr_t(heap_start)&(alignment-1)));
+}
+
 compacting_store_t::~compacting_store_t() {
-  if (heap_start) {
+  if (heap_start && owns_heap) {
     munmap(heap_start,heap_size);
     report_large_alloc(-heap_size);
   }
@@ -39,6 +53,10 @@ uint64_t compacting_store_t::memory_usage(const uint64_t arrays, const uint64_t
   return sizeof(array_t)*arrays+heap_size;
 }
 
+double compacting_store_t::free_ratio() const {
+  return heap_size ? 1-double(live.load(std::memory_order_relaxed))/heap_size : 0;
+}
+
 compacting_store_t::group_t::group_t(const shared_ptr<compacting_store_t>& store, const int count)
   : store(store) {
   if (count<=0)
@@ -59,8 +77,14 @@ compacting_store_t::group_t::group_t(const shared_ptr<compacting_store_t>& store
 }
 
 compacting_store_t::group_t::~group_t() {
-  if (group>=0)
-    store->groups[group].clear();
+  if (group>=0) {
+    auto& g = store->groups[group];
+    uint64_t size = 0;
+    for (const auto& array : g)
+      size += align_size(array.size);
+    store->live -= size;
+    g.clear();
+  }
 }
 
 void compacting_store_t::group_t::freeze() {
@@ -115,6 +139,7 @@ void compacting_store_t::lock_t::set(RawArray<const uint8_t> new_data) {
     array->data = store.heap_start+end-asize;
 #else
     // First, deallocate the array and release the lock to preserve locking discipline.
+    store.live -= align_size(array->size);
     array->size = 0;
     array->data = 0;
     array->lock.unlock();
@@ -134,7 +159,10 @@ void compacting_store_t::lock_t::set(RawArray<const uint8_t> new_data) {
   }
   // Finally, copy the data into place
   memcpy(array->data,new_data.data(),new_data.size());
+  const uint64_t live = store.live += asize-align_size(array->size);
   array->size = new_data.size();
+  uint64_t peak = store.live_peak.load(std::memory_order_relaxed);
+  while (live>peak && !store.live_peak.compare_exchange_weak(peak,live,std::memory_order_relaxed));
 }
 
 struct array_before_t {
@@ -167,7 +195,7 @@ void compacting_store_t::unlocked_garbage_collect() {
   }
   // Initialize the next allocation cycle
   heap_next = target-heap_start;
-  GEODE_ASSERT(heap_next<=heap_size);
+  GEODE_ASSERT(heap_next<=heap_size && heap_next==live);
   const uint64_t free = heap_size-heap_next;
   const double ratio = double(free)/heap_size;
   slog("collection: free ratio = %g", ratio);
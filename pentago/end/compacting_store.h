@@ -30,6 +30,7 @@
 #include "pentago/end/config.h"
 #include "pentago/utility/spinlock.h"
 #include "pentago/utility/array.h"
+#include <atomic>
 namespace pentago {
 namespace end {
 
@@ -53,8 +54,11 @@ public:
   const uint64_t heap_size;
 private:
   uint8_t* const heap_start;
+  const bool owns_heap; // False if the heap was supplied by the caller
   spinlock_t heap_lock; // See notes above
   uint64_t heap_next; // Next free index
+  std::atomic<uint64_t> live; // Aligned size of all arrays, which is heap_next after a garbage collection
+  std::atomic<uint64_t> live_peak; // Maximum of live so far
 
   struct array_t {
     spinlock_t lock;
@@ -72,12 +76,23 @@ public:
   // Warning: The entire heap_size is allocated immediately upon construction.
   // If we run out, we die.  Choose wisely.
   compacting_store_t(const uint64_t heap_size, function<void()> collect_callback=nullptr);
+
+  // Use caller allocated heap memory, such as an MPI shared memory window, which must outlive the store
+  // and be aligned.  Since frozen arrays never move, other processes may read them in place.
+  compacting_store_t(RawArray<uint8_t> heap, function<void()> collect_callback=nullptr);
   ~compacting_store_t();
 
   // These functions are essentially exact
   uint64_t memory_usage() const;
   static uint64_t memory_usage(const uint64_t arrays, const uint64_t heap_size);
 
+  // Fraction of the heap that would be free after a garbage collection.  We die if this drops
+  // below compacting_store_min_free_ratio during a collection.
+  double free_ratio() const;
+
+  // Largest total size of live arrays so far
+  uint64_t peak_live() const { return live_peak.load(std::memory_order_relaxed); }
+
   // For simplicity, arrays are divided into group, and arrays within each group
   // are numbered from 0 to n-1.  Under the hood, there are at most two groups.
   class group_t : public boost::noncopyable {
@@ -94,6 +109,8 @@ public:
 
     // Grab the array in frozen form.  If the array is not frozen, we die.
     RawArray<const uint8_t> get_frozen(const int index) const;
+
+    const compacting_store_t& parent() const { return *store; }
   };
 
   // Lock access to a given array
@@ -0,0 +1,147 @@
+// Benchmark the endgame compute kernel on synthetic lines
+//
+// Picks random block lines from a slice, fills their inputs with random data, and times
+// compute_microline over all of them without MPI.  The output hash depends only on the
+// kernel, so it should be unchanged by any optimization of compute_microline.
+//
+// Results (one thread, --lines 128, positions/s for slices 12, 20, 34):
+//
+//   19oct2026 - 4.8e5, 7.3e5, 2.0e6 - initial version
+//             - 7.4e5, 1.0e6, 2.5e6 - batched super_wins, one rmax per position, AVX2 rmax
+
+#include "pentago/base/all_boards.h"
+#include "pentago/end/compute.h"
+#include "pentago/end/options.h"
+#include "pentago/end/sections.h"
+#include "pentago/end/simple_partition.h"
+#include "pentago/utility/char_view.h"
+#include "pentago/utility/hash.h"
+#include "pentago/utility/large.h"
+#include "pentago/utility/log.h"
+#include "pentago/utility/random.h"
+#include "pentago/utility/thread.h"
+#include "pentago/utility/wall_time.h"
+#include <getopt.h>
+
+namespace pentago {
+namespace end {
+namespace {
+
+using std::make_shared;
+using std::max;
+using std::min;
+using std::unique_ptr;
+
+struct options_t {
+  int slice = 12;
+  int lines = 32;
+  int threads = 1;
+  int repeats = 3;
+  int seed = 17;
+};
+
+options_t parse_options(int argc, char** argv) {
+  options_t o;
+  static const option options[] = {
+      {"help", no_argument, 0, 'h'},
+      {"slice", required_argument, 0, 's'},
+      {"lines", required_argument, 0, 'l'},
+      {"threads", required_argument, 0, 't'},
+      {"repeats", required_argument, 0, 'r'},
+      {"seed", required_argument, 0, 'k'},
+      {0, 0, 0, 0},
+  };
+  const int rank = 0;
+  for (;;) {
+    int option = 0;
+    int c = getopt_long(argc, argv, "h", options, &option);
+    if (c == -1) break;  // Out of options
+    switch (c) {
+      case 'h':
+        slog("usage: %s [options...]", argv[0]);
+        slog("Benchmark the endgame compute kernel on synthetic lines.");
+        slog("  -h, --help                  Display usage information and quit");
+        slog("      --slice <n>             Slice to take lines from (default %d)", o.slice);
+        slog("      --lines <n>             Number of random lines (default %d)", o.lines);
+        slog("      --threads <n>           Number of compute threads, or -1 for all cores (default %d)", o.threads);
+        slog("      --repeats <n>           Time the best of n runs (default %d)", o.repeats);
+        slog("      --seed <n>              Random seed for line selection and input data (default %d)", o.seed);
+        exit(0);
+      PENTAGO_INT_ARG('s', slice, slice)
+      PENTAGO_INT_ARG('l', lines, lines)
+      PENTAGO_INT_ARG('t', threads, threads)
+      PENTAGO_INT_ARG('r', repeats, repeats)
+      PENTAGO_INT_ARG('k', seed, seed)
+      default:
+        die("impossible option character %d", c);
+    }
+  }
+  if (!(0 <= o.slice && o.slice <= 35))
+    PENTAGO_OPTION_ERROR("--slice %d must be in [0,35]", o.slice);
+  if (o.lines < 1)
+    PENTAGO_OPTION_ERROR("--lines %d must be at least 1", o.lines);
+  if (o.repeats < 1)
+    PENTAGO_OPTION_ERROR("--repeats %d must be at least 1", o.repeats);
+  if (optind != argc)
+    PENTAGO_OPTION_ERROR("expected no positional arguments");
+  return o;
+}
+
+void toplevel(int argc, char** argv) {
+  const auto o = parse_options(argc, argv);
+  Scope scope("compute benchmark");
+  init_threads(o.threads, 0);
+
+  // Pick random lines
+  const auto sections = make_shared<const sections_t>(o.slice, all_boards_sections(o.slice, 8));
+  const simple_partition_t partition(1, sections);
+  const auto all_lines = partition.rank_lines(0);
+  Random random(o.seed);
+  vector<unique_ptr<const line_data_t>> lines;
+  uint64_t positions = 0, memory = 0;
+  for (int i = 0; i < min(o.lines, all_lines.size()); i++) {
+    lines.emplace_back(new line_data_t(all_lines[random.uniform<int>(0, all_lines.size())]));
+    positions += lines.back()->output_shape.product();
+    memory += lines.back()->memory_usage;
+  }
+  slog("slice %d: lines = %d of %d, positions = %s, memory = %s", o.slice, lines.size(),
+       all_lines.size(), large(positions), large(memory));
+
+  // Time the best of several runs.  Each run needs fresh line_details_t's, since their counters are one shot.
+  wall_time_t best(std::numeric_limits<int64_t>::max());
+  string hashes;
+  for (int r = 0; r < o.repeats; r++) {
+    vector<unique_ptr<line_details_t>> details;
+    for (const int i : range(int(lines.size()))) {
+      details.emplace_back(new line_details_t(*lines[i], [](line_details_t&, line_details_t::wakeup_block_t) {}));
+      const auto input = char_view(details.back()->input);
+      input.copy(char_view(random_supers(uint128_t(o.seed)<<32|i, input.size()/sizeof(super_t))));
+    }
+    const auto start = wall_time();
+    for (auto& line : details)
+      schedule_compute_line(*line);
+    threads_wait_all();
+    best = min(best, wall_time()-start);
+    if (!r)
+      for (const auto& line : details)
+        hashes += portable_hash(char_view(line->output));
+  }
+  slog("time = %.3g s, speed = %.3g positions/s, %.3g positions/s/thread",
+       best.seconds(), positions/max(best.seconds(), 1e-9),
+       positions/max(best.seconds(), 1e-9)/thread_counts()[0]);
+  slog("output hash = %s", sha1(char_view(RawArray<const char>(hashes.size(), hashes.data()))));
+}
+
+}  // namespace
+}  // namespace end
+}  // namespace pentago
+
+int main(int argc, char** argv) {
+  try {
+    pentago::end::toplevel(argc, argv);
+    return 0;
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+}
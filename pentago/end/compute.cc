@@ -313,30 +313,41 @@ template<bool slice_35> static void compute_microline(line_details_t* const line
     const auto wins0 = super_wins(side0),
                wins1 = super_wins(side1),
                immediate = wins0|wins1;
-    super_t wins = 0,     // Known wins, ignoring immediate
-            not_loss = 0; // Known wins or ties, ignoring immediate
-    // Process moves
-    quadrant_t moves = 511&~(side_q0|side_q1);
-    while (moves) {
-      const quadrant_t move = min_bit(moves);
-      moves ^= move;
-      // Can we win without rotating?
-      const side_t new_side0 = side0|(side_t)move<<dim_shift;
-      const auto new_wins = super_wins(new_side0);
-      wins |= new_wins;
-      // If not, look up child position
-      if (slice_35) {
-        // The game ends after this move, so the child result is immediate.
-        wins |= rmax(new_wins&~wins1);
-        not_loss |= rmax(new_wins|~wins1);
-      } else {
-        // Slice < 35, so we have to do some real work
+    // Can we win without rotating?  All moves share one batched super_wins call.
+    const quadrant_t moves = 511&~(side_q0|side_q1);
+    super_t move_wins[9];
+    const int count = super_wins_moves(side0,dim,moves,move_wins);
+    super_t wins = 0; // Known wins, ignoring immediate
+    for (int k=0;k<count;k++)
+      wins |= move_wins[k];
+    // If not, look up child positions.  Since rmax distributes over |, we accumulate children
+    // before rotation and call rmax once per position rather than twice per move.
+    super_t child_wins = 0,     // Wins before rotation, ignoring immediate
+            child_not_loss = 0; // Wins or ties before rotation, ignoring immediate
+    if (slice_35) {
+      // The game ends after this move, so the child result is immediate.
+      if (count) {
+        child_wins = wins&~wins1;
+        child_not_loss = wins|~wins1;
+      }
+    } else {
+      // Slice < 35, so we have to do some real work.  Gather all children first, so that
+      // their loads are independent of the transforms.
+      const Vector<super_t,2>* children[9];
+      symmetry_t child_symmetries[9];
+      quadrant_t left = moves;
+      for (int k=0;k<count;k++) {
+        const quadrant_t move = min_bit(left);
+        left ^= move;
         const quadrant_t new_q = quadrant+(1+turn)*pack_table[move];
         const uint16_t ir = rotation_minimal_quadrants_inverse[new_q];
         const int j = ir/4;
-        const symmetry_t symmetry = local_symmetry_t((ir&3)<<2*dim)*base_transform*local_symmetry_t(symmetries[j]);
-        const auto& child = input[((j>>block_shift)==child_length-1?last_input_base:input_base)+(block_stride+PENTAGO_MPI_COMPRESS)*(j>>block_shift)+input_stride*((j^(j<line_moves))&(block_size-1))];
+        child_symmetries[k] = local_symmetry_t((ir&3)<<2*dim)*base_transform*local_symmetry_t(symmetries[j]);
+        children[k] = &input[((j>>block_shift)==child_length-1?last_input_base:input_base)+(block_stride+PENTAGO_MPI_COMPRESS)*(j>>block_shift)+input_stride*((j^(j<line_moves))&(block_size-1))];
 #if PENTAGO_MPI_DEBUG
+        const auto& child = *children[k];
+        const auto& symmetry = child_symmetries[k];
+        const side_t new_side0 = side0|(side_t)move<<dim_shift;
         const auto child_board = child_board_base|(board_t)child_rmin[child_dim].x[j^(j<line_moves)]<<16*child_dim;
         slow_verify("child inline",child_board,child,true);
         const auto after_board = flip_board(pack(new_side0,side1),turn);
@@ -344,10 +355,14 @@ template<bool slice_35> static void compute_microline(line_details_t* const line
         const auto after_super = vec(transform_super(symmetry,child.x),transform_super(symmetry,child.y));
         slow_verify("after",after_board,after_super,true);
 #endif
-        wins |= rmax(transform_super(symmetry,~child[1]));
-        not_loss |= rmax(transform_super(symmetry,~child[0]));
+      }
+      for (int k=0;k<count;k++) {
+        child_wins |= transform_super(child_symmetries[k],~(*children[k])[1]);
+        child_not_loss |= transform_super(child_symmetries[k],~(*children[k])[0]);
       }
     }
+    wins |= rmax(child_wins);
+    const super_t not_loss = rmax(child_not_loss); // Known wins or ties, ignoring immediate
     // Finish up
     auto& result = output[((i>>block_shift)==length-1?last_output_base:output_base)+(block_stride+PENTAGO_MPI_COMPRESS_OUTPUTS)*(i>>block_shift)+output_stride*(i&(block_size-1))];
     result[0] = (wins&~immediate)|(wins0&~wins1);
@@ -34,7 +34,10 @@ namespace end {
 const int block_size = 8;
 const int block_shift = 3;
 
-// Hopefully conservative estimate of snappy's compression ratio on our data
+// Hopefully conservative estimate of the fast codec's compression ratio on our data, originally for snappy.
+// We use it for lz4 and zstd (see fast_compress.h) too.  codec-benchmark ratios with the filter on, for
+// data/small slices 0-4 and for slice 35 of 44544544, are lz4 .063 .390, zstd-1 .053 .278, and
+// zstd1 .049 .237, so lz4 on large slices has little margin.
 const double snappy_compression_estimate = .4;
 
 #if PENTAGO_MPI_COMPRESS
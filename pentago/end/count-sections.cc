@@ -0,0 +1,137 @@
+// Print exact board counts for each section, for capacity planning
+//
+// For each standardized section with the given number of stones (or all slices), prints the number of
+// rotation minimal positions stored by the endgame solver and the exact number of boards in the section's
+// orbit under global symmetries, reduced by 1, 8, and 2048 symmetries.  For example,
+//
+//   count-sections --stones 18
+
+#include "pentago/base/all_boards.h"
+#include "pentago/base/count.h"
+#include "pentago/end/options.h"
+#include "pentago/utility/large.h"
+#include "pentago/utility/log.h"
+#include "pentago/utility/range.h"
+#include "pentago/utility/thread.h"
+#include "pentago/utility/wall_time.h"
+#include <getopt.h>
+
+namespace pentago {
+namespace end {
+namespace {
+
+struct options_t {
+  int stones = -1;
+  int threads = -1;
+};
+
+options_t parse_options(int argc, char** argv) {
+  options_t o;
+  static const option options[] = {
+      {"help", no_argument, 0, 'h'},
+      {"stones", required_argument, 0, 'n'},
+      {"threads", required_argument, 0, 't'},
+      {0, 0, 0, 0},
+  };
+  const int rank = 0;
+  for (;;) {
+    int option = 0;
+    int c = getopt_long(argc, argv, "hn:t:", options, &option);
+    if (c == -1) break;  // Out of options
+    switch (c) {
+      case 'h':
+        slog("usage: %s [options...]", argv[0]);
+        slog("Print exact board counts for each section.");
+        slog("  -h, --help                Display usage information and quit");
+        slog("  -n, --stones <n>          Number of stones (default: all slices)");
+        slog("  -t, --threads <n>         Number of compute threads (default: one per core)");
+        exit(0);
+      PENTAGO_INT_ARG('n', stones, stones)
+      PENTAGO_INT_ARG('t', threads, threads)
+      default:
+        die("impossible option character %d", c);
+    }
+  }
+  if (!(-1 <= o.stones && o.stones <= 36))
+    PENTAGO_OPTION_ERROR("--stones %d must be in [0,36], or -1 for all slices", o.stones);
+  if (optind != argc)
+    PENTAGO_OPTION_ERROR("expected no arguments");
+  return o;
+}
+
+struct row_t {
+  section_t section;
+  uint64_t size;   // Rotation minimal positions
+  int orbit;       // Sections equivalent under global symmetries
+  Vector<uint64_t,3> boards;  // Boards in the orbit, reduced by 1, 8, and 2048 symmetries
+};
+
+vector<row_t> count_slice(const int n) {
+  vector<row_t> rows;
+  for (const auto& s : all_boards_sections(n, 8)) {
+    row_t row;
+    row.section = s;
+    row.size = s.size();
+    row.orbit = 1;
+    for (const int g : range(1,8)) {
+      const auto t = s.transform(g);
+      bool seen = t == s;
+      for (const int h : range(1,g))
+        seen |= t == s.transform(h);
+      row.orbit += !seen;
+    }
+    row.boards = vec(row.orbit*count_section_boards(s, 1), count_section_boards(s, 8),
+                     count_section_boards(s, 2048));
+    rows.push_back(row);
+  }
+  return rows;
+}
+
+void toplevel(int argc, char** argv) {
+  const auto o = parse_options(argc, argv);
+  Scope scope("count sections");
+  init_threads(o.threads, 0);
+
+  // Count each slice in parallel
+  const auto slices = o.stones < 0 ? range(37) : range(o.stones, o.stones+1);
+  vector<vector<row_t>> rows(37);
+  const auto start = wall_time();
+  for (const int n : slices)
+    threads_schedule(CPU, [n, &rows]() { rows[n] = count_slice(n); });
+  threads_wait_all();
+  const double elapsed = (wall_time()-start).seconds();
+
+  Vector<uint64_t,3> total;
+  for (const int n : slices) {
+    Scope scope(format("slice %d", n));
+    Vector<uint64_t,3> sum;
+    uint64_t size = 0;
+    for (const auto& r : rows[n]) {
+      slog("section %s: positions %s, orbit %d, boards %s, %s, %s", r.section, large(r.size), r.orbit,
+           large(r.boards[0]), large(r.boards[1]), large(r.boards[2]));
+      sum += r.boards;
+      size += r.size;
+    }
+    slog("slice %d: sections %d, positions %s, boards %s, %s, %s", n, rows[n].size(), large(size),
+         large(sum[0]), large(sum[1]), large(sum[2]));
+    for (const int i : range(3))
+      GEODE_ASSERT(sum[i] == count_boards(n, i==0 ? 1 : i==1 ? 8 : 2048));
+    total += sum;
+  }
+  slog("total boards %s, %s, %s, time = %.3g s", large(total[0]), large(total[1]), large(total[2]),
+       elapsed);
+}
+
+}  // namespace
+}  // namespace end
+}  // namespace pentago
+
+int main(int argc, char** argv) {
+  try {
+    pentago::end::toplevel(argc, argv);
+    return 0;
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+}
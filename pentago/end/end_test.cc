@@ -4,10 +4,13 @@
 #include "pentago/end/check.h"
 #include "pentago/end/config.h"
 #include "pentago/end/fast_compress.h"
+#include "pentago/end/load_balance.h"
+#include "pentago/end/locality_partition.h"
 #include "pentago/end/partition.h"
 #include "pentago/end/predict.h"
 #include "pentago/end/random_partition.h"
 #include "pentago/end/simple_partition.h"
+#include "pentago/end/simulate.h"
 #include "pentago/utility/ceil_div.h"
 #include "pentago/utility/log.h"
 #include "pentago/utility/memory_usage.h"
@@ -103,10 +106,114 @@ TEST(end, partition) {
           partition_test(simple_partition_t(ranks, sections, false));
         }
       }
+      for (const double tolerance : {0., .2}) {
+        Scope scope(format("locality partition test: slice %d, ranks %d, tolerance %g",
+                           sections->slice, ranks, tolerance));
+        partition_test(locality_partition_t(ranks, sections, tolerance));
+      }
     }
   }
 }
 
+TEST(end, locality_partition) {
+  init_threads(-1, -1);
+  typedef Vector<uint8_t,2> CV;
+  const auto slices = descendent_sections(vec(CV(4,4),CV(4,3),CV(4,4),CV(3,4)), 35);
+  for (const int slice : {32}) {
+    for (const int ranks : {4, 16}) {
+      Scope scope(format("slice %d, ranks %d", slice, ranks));
+      const auto prev_random = make_shared<random_partition_t>(17, ranks, slices[slice+1]);
+      const auto prev_local = make_shared<locality_partition_t>(ranks, slices[slice+1]);
+      const auto random = serial_load_balance(make_shared<random_partition_t>(17, ranks, slices[slice]),
+                                              prev_random);
+      const auto local_partition = make_shared<locality_partition_t>(ranks, slices[slice]);
+      const auto local = serial_load_balance(local_partition, prev_local);
+      slog("random: input bytes %d, output bytes %d", random->input_bytes.max, random->output_bytes.max);
+      slog("locality: input bytes %d, output bytes %d", local->input_bytes.max, local->output_bytes.max);
+
+      // Work is balanced to within one line
+      uint64_t max_line_work = 0;
+      for (const int rank : range(ranks))
+        for (const auto& line : local_partition->rank_lines(rank))
+          max_line_work = max(max_line_work, uint64_t(line.section.shape()[line.dimension]*
+              block_shape(line.section.shape().remove_index(line.dimension), line.block_base).product()));
+      ASSERT_LE(local->line_nodes.max, local_partition->total_work/ranks+max_line_work);
+      ASSERT_EQ(local_partition->work_before(local_partition->total_lines), local_partition->total_work);
+
+      // Most outputs stay local
+      ASSERT_LT(local->output_bytes.max, random->output_bytes.max/2);
+    }
+  }
+}
+
+// Fraction of blocks completed by the first half of the lines
+double half_completion(RawArray<const line_t> lines) {
+  typedef tuple<section_t,Vector<uint8_t,4>> block_t;
+  unordered_map<block_t,Vector<int,2>,boost::hash<block_t>> counts; // Lines needed, lines run
+  for (const int i : range(lines.size()))
+    for (const int b : range(int(lines[i].length))) {
+      auto& c = counts[make_tuple(lines[i].section, lines[i].block(b))];
+      c[0]++;
+      c[1] += 2*i < lines.size();
+    }
+  int complete = 0;
+  for (const auto& [block, c] : counts)
+    complete += c[0] == c[1];
+  return double(complete)/counts.size();
+}
+
+TEST(end, completion_order) {
+  typedef Vector<uint8_t,2> CV;
+  const auto sections = descendent_sections(vec(CV(4,4),CV(4,3),CV(4,4),CV(3,4)), 35)[32];
+  const auto random = random_partition_t(17, 1, sections).rank_lines(0);
+  const auto ordered = completion_order(random);
+
+  // Same lines, in a different order
+  ASSERT_EQ(ordered.size(), random.size());
+  unordered_set<event_t> events;
+  for (const auto& line : random)
+    events.insert(line.line_event());
+  for (const auto& line : ordered)
+    ASSERT_TRUE(events.erase(line.line_event()));
+
+  // Many more blocks complete early
+  const double before = half_completion(random),
+               after = half_completion(ordered);
+  slog("blocks complete after half the lines: random %g, completion order %g", before, after);
+  ASSERT_GT(after, 2*before);
+}
+
+TEST(end, simulate) {
+  init_threads(-1, -1);
+  typedef Vector<uint8_t,2> CV;
+  const auto slices = descendent_sections(vec(CV(4,4),CV(4,3),CV(4,4),CV(3,4)), 35);
+  const int ranks = 3, threads = 4;
+  const uint64_t memory_limit = uint64_t(1)<<30;
+  const auto prev = make_shared<simple_partition_t>(ranks, slices[35]);
+  const auto partition = make_shared<simple_partition_t>(ranks, slices[34]);
+  const auto load = serial_load_balance(partition);
+  flow_costs_t costs;
+  const auto sim = simulate_flow(prev, partition, threads, costs, memory_limit, 8, 8);
+
+  // No rank can beat perfect parallelism
+  ASSERT_GE(sim.time, load->line_nodes.max/(threads*costs.compute_speed));
+  ASSERT_GT(sim.messages, 0);
+  for (const int rank : range(ranks)) {
+    ASSERT_LE(sim.rank_time[rank], sim.time);
+    ASSERT_TRUE(0 <= sim.idle[rank] && sim.idle[rank] < 1);
+    ASSERT_LE(sim.peak_memory[rank], memory_limit);
+    ASSERT_GT(sim.peak_memory[rank], 0);
+    ASSERT_EQ(sim.memory(sim.memory.shape()[0]-1, rank), 0);
+  }
+
+  // With slow messages, more simultaneous gathers help
+  costs.latency = .1;
+  const auto slow1 = simulate_flow(prev, partition, threads, costs, memory_limit, 1, 8);
+  const auto slow8 = simulate_flow(prev, partition, threads, costs, memory_limit, 8, 8);
+  slog("time = %g, slow time = %g (1 gather), %g (8 gathers)", sim.time, slow1.time, slow8.time);
+  ASSERT_LT(slow8.time, slow1.time/2);
+}
+
 TEST(end, simple_partition) {
   init_threads(-1, -1);
   const int stones = 24;
@@ -263,24 +370,28 @@ Array<const uint8_t> compress_check(RawArray<const Vector<super_t,2>> input, con
 
 void test_fast_compress(const bool local) {
   init_threads(-1, -1);
-  // Test a highly compressible sequence
-  const Array<Vector<super_t,2>> regular(2*1873, uninit);
-  char_view(regular).copy(char_view(arange<uint64_t>(64/4*1873)));
-  const auto compressed = compress_check(regular, local);
-  ASSERT_EQ(compressed[0], 1);
-  const double ratio = compressed.size() / memory_usage(regular);
-  ASSERT_LT(ratio, .314);
-  // Test various random (incompressible) sequences
-  Random random(18731);
-  for (const int n : {0, 1, 1873}) {
-    Array<Vector<super_t,2>> bad(n/8, uninit);
-    for (auto& b : char_view(bad)) {
-      b = random.bits<uint8_t>();
+  for (const auto codec : {snappy_codec, lz4_codec, zstd_codec}) {
+    set_fast_codec(codec, codec == zstd_codec ? -3 : -1);
+    // Test a highly compressible sequence
+    const Array<Vector<super_t,2>> regular(2*1873, uninit);
+    char_view(regular).copy(char_view(arange<uint64_t>(64/4*1873)));
+    const auto compressed = compress_check(regular, local);
+    ASSERT_EQ(compressed[0], codec);
+    const double ratio = compressed.size() / memory_usage(regular);
+    ASSERT_LT(ratio, .314);
+    // Test various random (incompressible) sequences
+    Random random(18731);
+    for (const int n : {0, 1, 1873}) {
+      Array<Vector<super_t,2>> bad(n/8, uninit);
+      for (auto& b : char_view(bad)) {
+        b = random.bits<uint8_t>();
+      }
+      const auto compressed = compress_check(bad, local);
+      ASSERT_EQ(compressed[0], 0);
+      ASSERT_EQ(compressed.size(), memory_usage(bad)+1);
     }
-    const auto compressed = compress_check(bad, local);
-    ASSERT_EQ(compressed[0], 0);
-    ASSERT_EQ(compressed.size(), memory_usage(bad)+1);
   }
+  set_fast_codec(snappy_codec);
 }
 
 TEST(end, fast_compress) {
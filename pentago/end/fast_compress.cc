@@ -1,4 +1,4 @@
-// Interface to snappy
+// Interface to fast in memory compression
 
 #include "pentago/end/fast_compress.h"
 #include "pentago/data/filter.h"
@@ -11,28 +11,159 @@
 #include "pentago/utility/array.h"
 #include "pentago/utility/sqr.h"
 #include "snappy.h"
+#include "lz4.h"
+#include "zstd.h"
+#include "zstd_errors.h"
 namespace pentago {
 namespace end {
 
+using std::max;
+
+static size_t max_compressed_length(const size_t input_size) {
+  return max(max(snappy::MaxCompressedLength(input_size),
+                 size_t(LZ4_COMPRESSBOUND(input_size))),
+             size_t(ZSTD_COMPRESSBOUND(input_size)));
+}
+
 const int raw_max_fast_compressed_size =
-    int(1+snappy::MaxCompressedLength(sizeof(Vector<super_t,2>) * sqr(sqr(block_size))));
+    int(1+max_compressed_length(sizeof(Vector<super_t,2>) * sqr(sqr(block_size))));
+
+// The current codec.  These change only at startup, so we don't lock them.
+static fast_codec_t codec = snappy_codec;
+static int codec_level = -1;
+static bool codec_filter = snappy_filter;
+
+void set_fast_codec(const fast_codec_t codec, const int level, const bool filter) {
+  if (codec!=snappy_codec && codec!=lz4_codec && codec!=zstd_codec)
+    THROW(ValueError,"set_fast_codec: invalid codec %d",int(codec));
+  if (codec==zstd_codec && !(ZSTD_minCLevel()<=level && level<=ZSTD_maxCLevel()))
+    THROW(ValueError,"set_fast_codec: zstd level %d outside valid range [%d,%d]",
+          level,ZSTD_minCLevel(),ZSTD_maxCLevel());
+  end::codec = codec;
+  codec_level = level;
+  codec_filter = filter;
+}
+
+void set_fast_codec(const string& name, const bool filter) {
+  if (name=="snappy")
+    set_fast_codec(snappy_codec,-1,filter);
+  else if (name=="lz4")
+    set_fast_codec(lz4_codec,-1,filter);
+  else if (name=="zstd")
+    set_fast_codec(zstd_codec,-1,filter);
+  else if (name.size()>4 && !name.compare(0,4,"zstd")) {
+    char* end;
+    const long level = strtol(name.c_str()+4,&end,10);
+    if (*end)
+      THROW(ValueError,"set_fast_codec: invalid zstd level in '%s'",name);
+    set_fast_codec(zstd_codec,int(level),filter);
+  } else
+    THROW(ValueError,"set_fast_codec: unknown codec '%s', expected snappy, lz4, zstd, or zstd<level>",name);
+}
+
+string fast_codec_name() {
+  switch (codec) {
+    case snappy_codec: return "snappy";
+    case lz4_codec: return "lz4";
+    case zstd_codec: return format("zstd%d",codec_level);
+  }
+  die("fast_codec_name: invalid codec %d",int(codec));
+}
+
+#ifdef __clang__
+// __thread is broken under clang on BlueGene, so use pthread function calls instead
+#define USE_PTHREADS 1
+#else
+#define USE_PTHREADS 0
+#endif
+
+// Thread local state for local compression and decompression
+namespace {
+struct local_state_t {
+  Vector<super_t,2>* buffer; // Temporary buffer
+  ZSTD_CCtx* cctx; // zstd contexts, allocated on first use
+  ZSTD_DCtx* dctx;
+};
+}
+
+#if USE_PTHREADS
+static pthread_key_t state_key;
+static void free_local_state(void* state_) {
+  const auto state = (local_state_t*)state_;
+  free(state->buffer);
+  ZSTD_freeCCtx(state->cctx);
+  ZSTD_freeDCtx(state->dctx);
+  free(state);
+}
+__attribute__((constructor)) static void create_state_key() {
+  const int r = pthread_key_create(&state_key,free_local_state);
+  if (r)
+    die("local_fast_compress/uncompress: failed to create thread local state pthread key: %s",strerror(r));
+}
+#endif
+
+static inline local_state_t& local_state() {
+#if USE_PTHREADS
+  auto state = (local_state_t*)pthread_getspecific(state_key);
+#else
+  static __thread local_state_t* state = 0;
+#endif
+  if (!state) {
+    state = (local_state_t*)calloc(1,sizeof(local_state_t));
+    if (!state)
+      die("local_fast_compress/uncompress: failed to allocate thread local state");
+#if USE_PTHREADS
+    pthread_setspecific(state_key,state);
+#endif
+  }
+  return *state;
+}
+
+static ZSTD_CCtx* local_zstd_cctx() {
+  auto& state = local_state();
+  if (!state.cctx && !(state.cctx = ZSTD_createCCtx()))
+    die("fast_compress: failed to allocate zstd compression context");
+  return state.cctx;
+}
+
+static ZSTD_DCtx* local_zstd_dctx() {
+  auto& state = local_state();
+  if (!state.dctx && !(state.dctx = ZSTD_createDCtx()))
+    die("fast_uncompress: failed to allocate zstd decompression context");
+  return state.dctx;
+}
 
 int fast_compress(RawArray<Vector<super_t,2>> uncompressed, RawArray<uint8_t> compressed,
                   const event_t event) {
   thread_time_t time(snappy_kind,event);
   // Filter
-  if (snappy_filter)
+  if (codec_filter)
     interleave(uncompressed);
-  // Compress
+  // Compress.  LZ4 and zstd take an output limit, so we ask them to fail if they can't beat the input size.
   const size_t input_size = sizeof(Vector<super_t,2>)*uncompressed.size();
-  const size_t max_output = 1 + snappy::MaxCompressedLength(input_size);
+  const size_t max_output = 1 + (codec==snappy_codec ? snappy::MaxCompressedLength(input_size) : input_size);
   GEODE_ASSERT(size_t(compressed.size()) >= max_output,
-               format("fast_compress: compressed.size = %d < 1 + snappy_max_output(%d) = %d",
-                      compressed.size(), input_size, max_output));
-  size_t output_size;
-  compressed[0] = 1; // Set compressed flag
-  snappy::RawCompress((const char*)uncompressed.data(),input_size,(char*)compressed.data()+1,&output_size);
-  if (output_size>=input_size) {
+               format("fast_compress: compressed.size = %d < 1 + %s_max_output(%d) = %d",
+                      compressed.size(), fast_codec_name(), input_size, max_output));
+  const auto input = (const char*)uncompressed.data();
+  const auto output = (char*)compressed.data()+1;
+  size_t output_size = 0; // Zero means incompressible
+  compressed[0] = codec; // Set compressed flag
+  switch (codec) {
+    case snappy_codec:
+      snappy::RawCompress(input,input_size,output,&output_size);
+      break;
+    case lz4_codec:
+      output_size = max(0,LZ4_compress_default(input,output,int(input_size),int(input_size)));
+      break;
+    case zstd_codec: {
+      const size_t r = ZSTD_compressCCtx(local_zstd_cctx(),output,input_size,input,input_size,codec_level);
+      if (ZSTD_isError(r) && ZSTD_getErrorCode(r)!=ZSTD_error_dstSize_tooSmall)
+        die("fast_compress: zstd failed: %s, event 0x%llx",ZSTD_getErrorName(r),event);
+      output_size = ZSTD_isError(r) ? 0 : r;
+      break; }
+  }
+  if (!output_size || output_size>=input_size) {
     compressed[0] = 0; // Fall back to uncompressed mode
     output_size = input_size;
     memcpy(compressed.data()+1,uncompressed.data(),input_size);
@@ -46,23 +177,43 @@ static inline int fast_uncompress_helper(RawArray<const uint8_t> compressed, Raw
   thread_time_t time(unsnappy_kind,event);
   // Uncompress
   GEODE_ASSERT(compressed.size());
-  int count;
-  if (compressed[0]) { // Compressed mode
-    size_t uncompressed_size;
-    GEODE_ASSERT(snappy::GetUncompressedLength((const char*)compressed.data()+1,compressed.size()-1,&uncompressed_size));
-    if (uncompressed_size > memory_usage(uncompressed))
-      die("fast_uncompress: expected size at most %zu, got %zu, event 0x%llx",(size_t)uncompressed.size(),uncompressed_size,event);
-    if (uncompressed_size & (n-1))
-      die("fast_uncompress: expected size a multiple of %zu, got %zu, event 0x%llx",n,uncompressed_size,event);
-    GEODE_ASSERT(snappy::RawUncompress((const char*)compressed.data()+1,compressed.size()-1,(char*)uncompressed.data()));
-    count = int(uncompressed_size/n);
-  } else {
-    GEODE_ASSERT((size_t)compressed.size()<=1+memory_usage(uncompressed) && !((compressed.size()-1)&(n-1)));
-    memcpy(uncompressed.data(),compressed.data()+1,compressed.size()-1);
-    count = compressed.size()/n;
+  const auto input = (const char*)compressed.data()+1;
+  const size_t input_size = compressed.size()-1;
+  const auto output = (char*)uncompressed.data();
+  const size_t output_limit = memory_usage(uncompressed);
+  size_t uncompressed_size;
+  switch (compressed[0]) {
+    case 0: // Uncompressed mode
+      GEODE_ASSERT(input_size<=output_limit && !(input_size&(n-1)));
+      memcpy(output,input,input_size);
+      uncompressed_size = input_size;
+      break;
+    case snappy_codec:
+      GEODE_ASSERT(snappy::GetUncompressedLength(input,input_size,&uncompressed_size));
+      if (uncompressed_size > output_limit)
+        die("fast_uncompress: expected size at most %zu, got %zu, event 0x%llx",output_limit,uncompressed_size,event);
+      GEODE_ASSERT(snappy::RawUncompress(input,input_size,output));
+      break;
+    case lz4_codec: {
+      const int r = LZ4_decompress_safe(input,output,int(input_size),int(output_limit));
+      if (r < 0)
+        die("fast_uncompress: lz4 failed with code %d, size limit %zu, event 0x%llx",r,output_limit,event);
+      uncompressed_size = r;
+      break; }
+    case zstd_codec:
+      uncompressed_size = ZSTD_decompressDCtx(local_zstd_dctx(),output,output_limit,input,input_size);
+      if (ZSTD_isError(uncompressed_size))
+        die("fast_uncompress: zstd failed: %s, size limit %zu, event 0x%llx",
+            ZSTD_getErrorName(uncompressed_size),output_limit,event);
+      break;
+    default:
+      die("fast_uncompress: unknown codec %d, event 0x%llx",compressed[0],event);
   }
+  if (uncompressed_size & (n-1))
+    die("fast_uncompress: expected size a multiple of %zu, got %zu, event 0x%llx",n,uncompressed_size,event);
+  const int count = int(uncompressed_size/n);
   // Unfilter
-  if (snappy_filter)
+  if (codec_filter)
     uninterleave(uncompressed.slice(0,count));
   return count;
 }
@@ -74,37 +225,14 @@ void fast_uncompress(RawArray<const uint8_t> compressed, RawArray<Vector<super_t
     die("fast_uncompress: expected count %d, got %d, event 0x%llx",uncompressed.size(),count,event);
 }
 
-#ifdef __clang__
-// __thread is broken under clang on BlueGene, so use pthread function calls instead
-#define USE_PTHREADS 1
-#else
-#define USE_PTHREADS 0
-#endif
-
-#if USE_PTHREADS
-static pthread_key_t buffer_key;
-__attribute__((constructor)) static void create_buffer_key() {
-  const int r = pthread_key_create(&buffer_key,free);
-  if (r)
-    die("local_fast_compress/uncompress: failed to create thread local buffer pthread key: %s",strerror(r));
-}
-#endif
-
 // Thread local temporary buffer for local compression and decompression.
 static inline RawArray<Vector<super_t,2>> local_buffer() {
   const int count = ceil_div(raw_max_fast_compressed_size, int(sizeof(Vector<super_t,2>)));
-#if USE_PTHREADS
-  auto buffer = (Vector<super_t,2>*)pthread_getspecific(buffer_key);
-#else
-  static __thread Vector<super_t,2>* buffer = 0;
-#endif
+  auto& buffer = local_state().buffer;
   if (!buffer) {
     buffer = (Vector<super_t,2>*)malloc(sizeof(Vector<super_t,2>)*count);
     if (!buffer)
       die("local_fast_compress/uncompress: failed to allocate thread local buffer of size %zu",sizeof(Vector<super_t,2>)*count);
-#if USE_PTHREADS
-    pthread_setspecific(buffer_key,buffer); 
-#endif
   }
   return RawArray<Vector<super_t,2>>(count,buffer);
 }
@@ -113,7 +241,7 @@ RawArray<uint8_t> local_fast_compress(RawArray<Vector<super_t,2>> uncompressed,
   const auto compressed = char_view(local_buffer());
   return compressed.slice(0, fast_compress(uncompressed,compressed,event));
 }
-   
+
 RawArray<Vector<super_t,2>> local_fast_uncompress(RawArray<const uint8_t> compressed,
                                                   const event_t event) {
   const auto uncompressed = local_buffer();
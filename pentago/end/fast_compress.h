@@ -1,19 +1,43 @@
-// Interface to snappy
+// Interface to fast in memory compression
 //
 // Snappy is used for in memory compression.  On average we get about a factor
 // of three, cutting the memory requirement from 240 TB to 80 TB.  By comparison,
 // lzma provides a factor of ten, but is far slower.
+//
+// LZ4 and zstd at negative (fast) levels are available as alternatives, selected
+// at startup via set_fast_codec.  The first byte of each compressed array records
+// which codec produced it, so decompression works regardless of the current choice.
 #pragma once
 
 #include "pentago/base/superscore.h"
+#include "pentago/end/config.h"
 #include "pentago/utility/thread.h"
 namespace pentago {
 namespace end {
 
-// We modify the snappy format to expand by at most 1 byte.  This number is the maximum size before we
+// Codecs available for in memory compression.  The value is stored in the first byte
+// of each compressed array, with 0 meaning the data was stored uncompressed.
+enum fast_codec_t : uint8_t {
+  snappy_codec = 1,
+  lz4_codec = 2,
+  zstd_codec = 3,
+};
+
+// We modify each codec's format to expand by at most 1 byte.  This number is the maximum size before we
 // fix the format, since snappy's compression routine doesn't take an output limit.
 extern const int raw_max_fast_compressed_size;
 
+// Select the codec used by all subsequent fast_compress calls.  level is used only by zstd, where negative
+// levels are the fast ones.  filter controls interleave preconditioning, and must not change while any
+// compressed data is live.  Not thread safe: call at startup before compressing anything.
+void set_fast_codec(const fast_codec_t codec, const int level=-1, const bool filter=snappy_filter);
+
+// Select a codec by name: snappy, lz4, zstd, or zstd<level> (e.g., zstd-3).
+void set_fast_codec(const string& name, const bool filter=snappy_filter);
+
+// The current codec, in the format accepted by set_fast_codec
+string fast_codec_name();
+
 // Compress an array and return the size of the result.  The input is destroyed.
 int fast_compress(RawArray<Vector<super_t,2>> uncompressed, RawArray<uint8_t> compressed, const event_t event);
 
@@ -12,6 +12,7 @@
 #include "pentago/utility/str.h"
 #include "pentago/utility/sqr.h"
 #include "pentago/utility/log.h"
+#include <map>
 #include <unordered_map>
 namespace pentago {
 namespace end {
@@ -300,7 +301,8 @@ unordered_map<string,Array<const Vector<float,2>>>
 message_statistics(const vector<vector<Array<const history_t>>>& event_sorted_history,
                    const int ranks_per_node, const int threads_per_rank,
                    const time_kind_t source_kind, const int steps,
-                   RawArray<const double> slice_compression_ratio) {
+                   RawArray<const double> slice_compression_ratio,
+                   const double aggregate_window) {
   GEODE_ASSERT(ranks_per_node>=1);
   GEODE_ASSERT(threads_per_rank>1);
   GEODE_ASSERT(vec(request_send_kind,response_send_kind,output_send_kind).contains(source_kind));
@@ -308,10 +310,14 @@ message_statistics(const vector<vector<Array<const history_t>>>& event_sorted_hi
   GEODE_ASSERT((int)event_sorted_history.size()==ranks*threads_per_rank);
   GEODE_ASSERT(slice_compression_ratio.size()==37);
   GEODE_ASSERT(steps==1 || steps==2);
+  GEODE_ASSERT(aggregate_window>=0);
 
   // Separate same-rank, same-node, and internode
   Vector<vector<Vector<float,2>>,3> data;
 
+  // Batches by type, source rank, destination, and window, if we're aggregating
+  std::map<tuple<int,int,int,int64_t>,Vector<float,2>> batches;
+
   // Traverse each message and place it in the appropriate bin
   for (const int source_rank : range(ranks)) {
     const int source_thread = source_rank*threads_per_rank;
@@ -352,6 +358,15 @@ message_statistics(const vector<vector<Array<const history_t>>>& event_sorted_hi
                      : source_rank/ranks_per_node==target_rank/ranks_per_node ? 1
                                                                               : 2;
       data[type].push_back(Vector<float,2>(size,time));
+
+      // Add to batch
+      if (aggregate_window) {
+        const int destination = type<2 ? target_rank : target_rank/ranks_per_node;
+        const int64_t window = int64_t(source.start.seconds()/aggregate_window);
+        auto& batch = batches[make_tuple(type,source_rank,destination,window)];
+        batch[0] += size;
+        batch[1] = max(batch[1],float(time));
+      }
     }
   }
 
@@ -360,6 +375,14 @@ message_statistics(const vector<vector<Array<const history_t>>>& event_sorted_hi
   table["same-rank"] = asarray(data[0]).copy();
   table["same-node"] = asarray(data[1]).copy();
   table["different"] = asarray(data[2]).copy();
+  if (aggregate_window) {
+    Vector<vector<Vector<float,2>>,3> batched;
+    for (const auto& [key, batch] : batches)
+      batched[get<0>(key)].push_back(batch);
+    table["same-rank-batched"] = asarray(batched[0]).copy();
+    table["same-node-batched"] = asarray(batched[1]).copy();
+    table["different-batched"] = asarray(batched[2]).copy();
+  }
   return table;
 }
 
@@ -77,11 +77,17 @@ void check_dependencies(const vector<vector<Array<const history_t>>>& event_sort
 Array<double,3> estimate_bandwidth(const vector<vector<Array<const history_t>>>& event_sorted_history,
                                    const int threads, const double dt_seconds);
 
+// Sizes and latencies of messages of the given kind, binned into same-rank, same-node, and
+// different-node.  If aggregate_window is positive, also estimate the effect of aggregation: messages
+// sent from one rank within the same window of that many seconds form one batch per destination rank,
+// or per destination node for internode messages.  The *-batched tables hold (total size, max latency)
+// per batch.
 unordered_map<string,Array<const Vector<float,2>>>
 message_statistics(const vector<vector<Array<const history_t>>>& event_sorted_history,
                    const int ranks_per_node, const int threads_per_rank,
                    const time_kind_t source_kind, const int steps,
-                   RawArray<const double> slice_compression_ratio);
+                   RawArray<const double> slice_compression_ratio,
+                   const double aggregate_window=0);
 
 }
 }
@@ -1,12 +1,65 @@
 // Information about a single 1D block line
 
 #include "pentago/end/line.h"
+#include "pentago/end/config.h"
+#include "pentago/base/symmetry.h"
+#include "pentago/utility/ceil_div.h"
+#include "pentago/utility/range.h"
+#include <algorithm>
+#include <tuple>
+#include <vector>
 namespace pentago {
 namespace end {
 
+using std::make_tuple;
+using std::tuple;
+using std::vector;
+
 ostream& operator<<(ostream& output, const line_t& line) {
   return output<<line.section<<'-'<<int(line.dimension)<<'-'<<Vector<int,3>(line.block_base);
 }
 
+line_inputs_t line_inputs(const line_t& line) {
+  line_inputs_t inputs;
+  if (line.section.sum()==35) {
+    inputs.section = line.section;
+    inputs.dimension = line.dimension;
+    inputs.count = 0;
+    inputs.first = line.block(0);
+    return inputs;
+  }
+  const auto [child, transform] = line.section.child(line.dimension).standardize<8>();
+  const auto permutation = section_t::quadrant_permutation(symmetry_t::invert_global(transform));
+  inputs.section = child;
+  inputs.dimension = permutation.find(line.dimension);
+  inputs.count = ceil_div(child.shape()[inputs.dimension], block_size);
+  inputs.first = line.block(0).subset(permutation);
+  return inputs;
+}
+
+Array<line_t> completion_order(RawArray<const line_t> lines) {
+  // Sort by the smallest box containing each line's lower corner, as a fraction of its section in
+  // each dimension, then by position within the box and line identity to make the order deterministic
+  vector<tuple<double,double,section_t,int,int,int,int,int>> keys;
+  keys.reserve(lines.size());
+  for (const int i : range(lines.size())) {
+    const auto& line = lines[i];
+    const auto shape = line.section.shape().remove_index(line.dimension);
+    double box = 0, sum = 0;
+    for (const int j : range(3)) {
+      const double f = double(line.block_base[j])/ceil_div(shape[j], block_size);
+      box = std::max(box, f);
+      sum += f;
+    }
+    const auto& base = line.block_base;
+    keys.push_back(make_tuple(box, sum, line.section, int(line.dimension), base[0], base[1], base[2], i));
+  }
+  std::sort(keys.begin(), keys.end());
+  Array<line_t> order(lines.size(), uninit);
+  for (const int i : range(lines.size()))
+    order[i] = lines[std::get<7>(keys[i])];
+  return order;
+}
+
 }
 }
@@ -52,6 +52,32 @@ struct local_block_t {
 
 ostream& operator<<(ostream& output, const line_t& line);
 
+// The blocks of the standardized child section that a line reads as input, following line_details_t.
+// Useful for estimating communication without allocating line data.
+struct line_inputs_t {
+  section_t section; // Standardized child section
+  uint8_t dimension; // Dimension of the line in the child section
+  uint8_t count; // Number of input blocks, zero for lines in the last slice
+  Vector<uint8_t,4> first; // First input block
+
+  Vector<uint8_t,4> block(int i) const {
+    GEODE_ASSERT((unsigned)i<(unsigned)count);
+    auto block = first;
+    block[dimension] = i;
+    return block;
+  }
+};
+
+line_inputs_t line_inputs(const line_t& line);
+
+// Reorder lines so that output blocks complete early.  A block is complete once the lines through
+// it in every dimension have run, so if lines run in random order almost all blocks complete near
+// the end.  Instead, we grow a box of blocks from the origin of each section, running each line
+// once its lower corner falls in the box.  After a fraction f of the lines have run, about f^(4/3)
+// of the blocks are complete, versus f^4 for random order.  Box size is relative to section shape
+// and the order is deterministic, so all ranks grow their boxes together.
+Array<line_t> completion_order(RawArray<const line_t> lines);
+
 template<class T,int d> static inline size_t hash_value(const Vector<T,d>& v) {
   size_t h = 0;
   for (const auto& x : v) boost::hash_combine(h, x);
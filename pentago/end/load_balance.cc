@@ -2,11 +2,13 @@
 
 #include "pentago/end/load_balance.h"
 #include "pentago/end/blocks.h"
+#include "pentago/base/superscore.h"
 #include "pentago/utility/curry.h"
 #include "pentago/utility/log.h"
 namespace pentago {
 namespace end {
 
+using std::get;
 using std::make_shared;
 using std::min;
 using std::max;
@@ -15,7 +17,7 @@ load_balance_t::load_balance_t() {}
 load_balance_t::~load_balance_t() {}
 
 Range<Box<int64_t>*> load_balance_t::boxes() {
-  return range(&lines, &block_local_ids+1);
+  return range(&lines, &output_bytes+1);
 }
 
 void load_balance_t::enlarge(const load_balance_t& load) {
@@ -25,10 +27,39 @@ void load_balance_t::enlarge(const load_balance_t& load) {
   blocks.enlarge(load.blocks);
   block_nodes.enlarge(load.block_nodes);
   block_local_ids.enlarge(load.block_local_ids);
+  input_bytes.enlarge(load.input_bytes);
+  output_bytes.enlarge(load.output_bytes);
+}
+
+Vector<uint64_t,2> remote_bytes(const block_partition_t* prev_partition, const block_partition_t& partition,
+                                const int rank, RawArray<const line_t> lines) {
+  const uint64_t node_bytes = sizeof(Vector<super_t,2>);
+  uint64_t input = 0, output = 0;
+  for (const auto& line : lines) {
+    // Inputs, following line_details_t
+    if (prev_partition) {
+      const auto inputs = line_inputs(line);
+      const auto child_shape = inputs.section.shape();
+      for (const int b : range(int(inputs.count))) {
+        const auto block = inputs.block(b);
+        if (get<0>(prev_partition->find_block(inputs.section, block)) != rank)
+          input += node_bytes*block_shape(child_shape, block).product();
+      }
+    }
+    // Outputs
+    const auto shape = line.section.shape();
+    for (const int b : range(int(line.length))) {
+      const auto block = line.block(b);
+      if (get<0>(partition.find_block(line.section, block)) != rank)
+        output += node_bytes*block_shape(shape, block).product();
+    }
+  }
+  return vec(input, output);
 }
 
 static shared_ptr<load_balance_t>
-local_load_balance(RawArray<const line_t> lines, RawArray<const local_block_t> blocks) {
+local_load_balance(RawArray<const line_t> lines, RawArray<const local_block_t> blocks,
+                   const Vector<uint64_t,2> remote_bytes) {
   const auto load = make_shared<load_balance_t>();
   for (Box<int64_t>& box : load->boxes())
     box = 0;
@@ -45,6 +76,8 @@ local_load_balance(RawArray<const line_t> lines, RawArray<const local_block_t> b
     load->block_local_ids.max = max(load->block_local_ids.max, int64_t(block.local_id.id));
   }
   load->block_local_ids = load->block_local_ids.max;
+  load->input_bytes = remote_bytes[0];
+  load->output_bytes = remote_bytes[1];
   return load;
 }
 
@@ -55,10 +88,10 @@ static void flip_min(load_balance_t& load) {
 
 shared_ptr<const load_balance_t> load_balance(
     const reduction_t<int64_t,max_op>& reduce_max, RawArray<const line_t> lines,
-    RawArray<const local_block_t> blocks) {
-  const auto load = local_load_balance(lines,blocks);
+    RawArray<const local_block_t> blocks, const Vector<uint64_t,2> remote_bytes) {
+  const auto load = local_load_balance(lines,blocks,remote_bytes);
   flip_min(*load);
-  const bool root = reduce_max(RawArray<int64_t>(12,&load->lines.min));
+  const bool root = reduce_max(RawArray<int64_t>(2*load->boxes().size(),&load->lines.min));
   if (root)
     flip_min(*load);
   else
@@ -67,20 +100,25 @@ shared_ptr<const load_balance_t> load_balance(
   return load;
 }
 
-static void serial_load_balance_helper(const partition_t* partition, const Range<int> rank_range,
-                                       load_balance_t* load) {
-  for (const int rank : rank_range)
-    load->enlarge(*local_load_balance(partition->rank_lines(rank), partition->rank_blocks(rank)));
+static void serial_load_balance_helper(const partition_t* partition, const block_partition_t* prev_partition,
+                                       const Range<int> rank_range, load_balance_t* load) {
+  for (const int rank : rank_range) {
+    const auto lines = partition->rank_lines(rank);
+    load->enlarge(*local_load_balance(lines, partition->rank_blocks(rank),
+                                      remote_bytes(prev_partition, *partition, rank, lines)));
+  }
 }
 
-shared_ptr<const load_balance_t> serial_load_balance(const shared_ptr<const partition_t>& partition) {
+shared_ptr<const load_balance_t> serial_load_balance(
+    const shared_ptr<const partition_t>& partition,
+    const shared_ptr<const block_partition_t>& prev_partition) {
   const int count = min(16*thread_counts()[0], partition->ranks);
   GEODE_ASSERT(count);
   vector<shared_ptr<load_balance_t>> loads;
   for (int j=0;j<count;j++)
     loads.push_back(make_shared<load_balance_t>());
   for (const int j : range(count))
-    threads_schedule(CPU, curry(serial_load_balance_helper, partition.get(),
+    threads_schedule(CPU, curry(serial_load_balance_helper, partition.get(), prev_partition.get(),
                                 partition_loop(partition->ranks, count, j), loads[j].get()));
   threads_wait_all_help();
   for (const int j : range(1,count))
@@ -97,6 +135,8 @@ void load_balance_t::print() const {
   FIELD(line nodes, line_nodes)
   FIELD(blocks, blocks)
   FIELD(block nodes, block_nodes)
+  FIELD(input bytes, input_bytes)
+  FIELD(output bytes, output_bytes)
 }
 
 }
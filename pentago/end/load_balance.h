@@ -15,6 +15,7 @@ namespace end {
 struct load_balance_t : public boost::noncopyable {
   Box<int64_t> lines, line_blocks, line_nodes; // Compute counts
   Box<int64_t> blocks, block_nodes, block_local_ids; // Owned block counts
+  Box<int64_t> input_bytes, output_bytes; // Block data received from and sent to other ranks (see remote_bytes)
 
   load_balance_t();
   ~load_balance_t();
@@ -26,13 +27,20 @@ struct load_balance_t : public boost::noncopyable {
   void print() const;
 };
 
-// Compute load balance information given rank_lines and rank_blocks.  The result is valid only on the root.
+// Estimate the (input,output) bytes of uncompressed block data which the given lines of a rank receive from and
+// send to other ranks.  prev_partition owns the input blocks, and is null if there are no inputs.
+Vector<uint64_t,2> remote_bytes(const block_partition_t* prev_partition, const block_partition_t& partition,
+                                const int rank, RawArray<const line_t> lines);
+
+// Compute load balance information given rank_lines, rank_blocks, and remote_bytes.  The result is valid only on the root.
 shared_ptr<const load_balance_t> load_balance(
     const reduction_t<int64_t,max_op>& reduce_max, RawArray<const line_t> lines,
-    RawArray<const local_block_t> blocks);
+    RawArray<const local_block_t> blocks, const Vector<uint64_t,2> remote_bytes);
 
 // Compute local balance information in a single process environment
-shared_ptr<const load_balance_t> serial_load_balance(const shared_ptr<const partition_t>& partition);
+shared_ptr<const load_balance_t> serial_load_balance(
+    const shared_ptr<const partition_t>& partition,
+    const shared_ptr<const block_partition_t>& prev_partition=nullptr);
 
 // Create an empty partition, typically for sentinel use
 shared_ptr<const partition_t> empty_partition(const int ranks, const int slice);
@@ -0,0 +1,340 @@
+// Communication aware partitioning of lines and blocks across processes
+
+#include "pentago/end/locality_partition.h"
+#include "pentago/end/blocks.h"
+#include "pentago/utility/debug.h"
+#include "pentago/utility/index.h"
+#include "pentago/utility/log.h"
+#include "pentago/utility/memory_usage.h"
+#include "pentago/utility/const_cast.h"
+#include "pentago/utility/str.h"
+namespace pentago {
+namespace end {
+
+using std::abs;
+using std::make_tuple;
+using std::min;
+using std::upper_bound;
+
+// Layout of a section as a sequence of slabs along dimension p
+struct slab_section_t {
+  section_t section;
+  Vector<uint8_t,4> blocks; // section_blocks(section)
+  uint8_t p; // Slab dimension
+  uint8_t dimensions; // Bit mask of dimensions with lines
+  uint8_t owner; // Dimension whose lines own blocks
+  int p_lines; // Number of lines along p, shared among slabs using partition_loop
+  int other_lines; // Number of lines not along p in each slab
+  int slab_offset; // Index of first slab
+};
+static_assert(sizeof(slab_section_t)==28,"");
+
+// The two dimensions other than p and d, in increasing order
+static inline Vector<int,2> other_dims(const int p, const int d) {
+  Vector<int,2> dims;
+  int n = 0;
+  for (const int i : range(4))
+    if (i!=p && i!=d)
+      dims[n++] = i;
+  return dims;
+}
+
+// The three dimensions other than p, in increasing order
+static inline Vector<int,3> other_dims(const int p) {
+  return Vector<int,3>(Vector<int,4>(0,1,2,3).remove_index(p));
+}
+
+// Sum of block node counts over the first k blocks of a row major grid over the given dimensions
+template<int m> static uint64_t grid_prefix(const Vector<int,4>& shape, const Vector<uint8_t,4>& blocks,
+                                            const Vector<int,m>& dims, int k) {
+  Vector<int,m> c;
+  for (int j=m-1;j>=0;j--) {
+    c[j] = k%blocks[dims[j]];
+    k /= blocks[dims[j]];
+  }
+  GEODE_ASSERT(k==0 || (k==1 && c==Vector<int,m>()));
+  uint64_t sum = 0, before = 1;
+  for (const int t : range(m)) {
+    uint64_t after = 1;
+    for (const int j : range(t+1,m))
+      after *= shape[dims[j]];
+    const int lo = k ? shape[dims[t]] : min(block_size*c[t], shape[dims[t]]);
+    sum += before*lo*after;
+    if (k)
+      return sum;
+    before *= min(block_size, shape[dims[t]]-block_size*c[t]);
+  }
+  return sum;
+}
+
+int locality_partition_t::slab_lines(const slab_section_t& s, const int x) const {
+  return s.other_lines + partition_loop(s.p_lines, int(s.blocks[s.p]), x).size();
+}
+
+uint64_t locality_partition_t::slab_prefix_work(const slab_section_t& s, const int x, int k) const {
+  const auto shape = s.section.shape();
+  const int p = s.p,
+            wp = min(block_size, shape[p]-block_size*x);
+  uint64_t work = 0;
+  for (const int d : range(4))
+    if (d!=p && s.dimensions&1<<d) {
+      const auto ab = other_dims(p,d);
+      const int n = min(k, s.blocks[ab[0]]*s.blocks[ab[1]]);
+      work += uint64_t(shape[d])*wp*grid_prefix(shape,s.blocks,ab,n);
+      k -= n;
+      if (!k)
+        return work;
+    }
+  const auto lines = partition_loop(s.p_lines, int(s.blocks[p]), x);
+  GEODE_ASSERT(k<=lines.size());
+  const auto dims = other_dims(p);
+  return work + shape[p]*(grid_prefix(shape,s.blocks,dims,lines.lo+k)-grid_prefix(shape,s.blocks,dims,lines.lo));
+}
+
+locality_partition_t::locality_partition_t(const int ranks, const shared_ptr<const sections_t>& sections,
+                                           const double tolerance)
+  : partition_t(ranks, sections)
+  , tolerance(tolerance)
+  , total_lines(0)
+  , total_work(0) {
+  GEODE_ASSERT(ranks>0 && sections->slice<36 && tolerance>=0);
+  Scope scope("locality partition");
+  thread_time_t time(partition_kind,unevent);
+
+  // Lay out each section as a sequence of slabs
+  {
+    vector<slab_section_t> slab_sections;
+    vector<int> slab_starts;
+    vector<uint64_t> slab_work;
+    uint64_t line_offset = 0, work = 0;
+    for (const auto& section : sections->sections) {
+      slab_section_t s;
+      s.section = section;
+      s.blocks = Vector<uint8_t,4>(section_blocks(section));
+      s.dimensions = 0;
+      for (const int d : range(4))
+        if (section.counts[d].sum() < 9)
+          s.dimensions |= 1<<d;
+      GEODE_ASSERT(s.dimensions);
+      s.p = s.blocks.argmax();
+      s.owner = s.p;
+      s.other_lines = 0;
+      for (const int d : range(4))
+        if (d!=s.p && s.dimensions&1<<d) {
+          if (s.owner==s.p)
+            s.owner = d;
+          const auto ab = other_dims(s.p,d);
+          s.other_lines += s.blocks[ab[0]]*s.blocks[ab[1]];
+        }
+      s.p_lines = s.dimensions&1<<s.p ? Vector<int,3>(s.blocks.remove_index(s.p)).product() : 0;
+      s.slab_offset = slab_starts.size();
+      for (const int x : range(int(s.blocks[s.p]))) {
+        slab_starts.push_back(CHECK_CAST_INT(line_offset));
+        slab_work.push_back(work);
+        const int n = slab_lines(s,x);
+        line_offset += n;
+        work += slab_prefix_work(s,x,n);
+      }
+      const_cast_(section_id)[section] = slab_sections.size();
+      slab_sections.push_back(s);
+    }
+    slab_starts.push_back(CHECK_CAST_INT(line_offset));
+    slab_work.push_back(work);
+    const_cast_(total_lines) = CHECK_CAST_INT(line_offset);
+    const_cast_(total_work) = work;
+    const_cast_(this->slab_sections) = asarray(slab_sections).copy();
+    const_cast_(this->slab_starts) = asarray(slab_starts).copy();
+    const_cast_(this->slab_work) = asarray(slab_work).copy();
+  }
+
+  // Cut the sequence of lines into pieces of equal work, snapping to section or slab boundaries if possible
+  const Array<int> rank_starts(ranks+1);
+  rank_starts[ranks] = total_lines;
+  const double average = double(total_work)/ranks,
+               slack = tolerance*average;
+  for (const int r : range(1,ranks)) {
+    const double target = average*r;
+    // Find the slab containing the target, then the closest line boundary within it
+    const int i = int(upper_bound(slab_work.begin(), slab_work.end()-1, uint64_t(target))-slab_work.begin())-1;
+    const auto& s = slab_sections[int(upper_bound(slab_sections.begin(), slab_sections.end(), i,
+        [](const int i, const slab_section_t& s) { return i<s.slab_offset; })-slab_sections.begin())-1];
+    const int x = i-s.slab_offset;
+    int lo = 0, hi = slab_starts[i+1]-slab_starts[i];
+    while (lo < hi) {
+      const int mid = (lo+hi)/2;
+      if (slab_work[i]+slab_prefix_work(s,x,mid+1) <= target)
+        lo = mid+1;
+      else
+        hi = mid;
+    }
+    int best = slab_starts[i]+lo;
+    if (best < slab_starts[i+1] && abs(work_before(best+1)-target) < abs(work_before(best)-target))
+      best++;
+    // Prefer section boundaries, then slab boundaries, if they're within tolerance
+    const auto snap = [&](const int a, const int b) {
+      const double da = abs(double(slab_work[a])-target),
+                   db = abs(double(slab_work[b])-target);
+      const int c = da <= db ? a : b;
+      if (min(da,db) <= slack) {
+        best = slab_starts[c];
+        return true;
+      }
+      return false;
+    };
+    if (!snap(s.slab_offset, s.slab_offset+s.blocks[s.p]))
+      snap(i, i+1);
+    rank_starts[r] = std::max(best, rank_starts[r-1]);
+  }
+  const_cast_(this->rank_starts) = rank_starts;
+}
+
+locality_partition_t::~locality_partition_t() {}
+
+uint64_t locality_partition_t::memory_usage() const {
+  return sizeof(locality_partition_t)
+       + pentago::memory_usage(sections)
+       + pentago::memory_usage(slab_sections)
+       + pentago::memory_usage(section_id)
+       + pentago::memory_usage(slab_starts)
+       + pentago::memory_usage(slab_work)
+       + pentago::memory_usage(rank_starts)
+       ;
+}
+
+uint64_t locality_partition_t::work_before(const int n) const {
+  GEODE_ASSERT(0<=n && n<=total_lines);
+  if (n==total_lines)
+    return total_work;
+  const int i = int(upper_bound(slab_starts.begin(), slab_starts.end(), n)-slab_starts.begin())-1;
+  const auto& s = slab_sections[int(upper_bound(slab_sections.begin(), slab_sections.end(), i,
+      [](const int i, const slab_section_t& s) { return i<s.slab_offset; })-slab_sections.begin())-1];
+  return slab_work[i]+slab_prefix_work(s,i-s.slab_offset,n-slab_starts[i]);
+}
+
+uint64_t locality_partition_t::rank_count_lines(const int rank) const {
+  return rank_starts[rank+1]-rank_starts[rank];
+}
+
+Array<const line_t> locality_partition_t::rank_lines(const int rank) const {
+  const auto lines = range(rank_starts[rank], rank_starts[rank+1]);
+  Array<line_t> result(lines.size(), uninit);
+  for (const int n : lines)
+    result[n-lines.lo] = nth_line(n);
+  return result;
+}
+
+Array<const local_block_t> locality_partition_t::rank_blocks(const int rank) const {
+  vector<local_block_t> blocks;
+  const auto lines = range(rank_starts[rank], rank_starts[rank+1]);
+  for (const int n : lines) {
+    const line_t line = nth_line(n);
+    if (owner_dimension(slab_sections[check_get(section_id, line.section)]) == line.dimension)
+      for (const int b : range(int(line.length))) {
+        local_block_t local;
+        local.local_id = local_id_t((n-lines.lo)<<6|b);
+        local.section = line.section;
+        local.block = line.block(b);
+        blocks.push_back(local);
+      }
+  }
+  return asarray(blocks).copy();
+}
+
+Vector<uint64_t,2> locality_partition_t::rank_counts(const int rank) const {
+  uint64_t nodes = 0;
+  const auto blocks = rank_blocks(rank);
+  for (const auto& block : blocks)
+    nodes += block_shape(block.section.shape(), block.block).product();
+  return vec(uint64_t(blocks.size()),nodes);
+}
+
+tuple<int,local_id_t> locality_partition_t::find_block(const section_t section,
+                                                       const Vector<uint8_t,4> block) const {
+  const auto id = section_id.find(section);
+  if (id == section_id.end())
+    die("locality_partition_t::find_block: section %s, block %d,%d,%d,%d not part of partition "
+        "with slice %d", str(section), block[0], block[1], block[2], block[3], sections->slice);
+  const int dimension = owner_dimension(slab_sections[id->second]);
+  const int n = line_index(section, dimension, block);
+  const int rank = int(upper_bound(rank_starts.begin(), rank_starts.end(), n)-rank_starts.begin())-1;
+  return make_tuple(rank, local_id_t((n-rank_starts[rank])<<6|block[dimension]));
+}
+
+tuple<section_t,Vector<uint8_t,4>> locality_partition_t::rank_block(const int rank,
+                                                                    const local_id_t local_id) const {
+  const int n = rank_starts[rank]+(local_id.id>>6);
+  GEODE_ASSERT(rank_starts[rank]<=n && n<rank_starts[rank+1]);
+  const auto line = nth_line(n);
+  const int b = local_id.id&63;
+  GEODE_ASSERT(b<line.length);
+  return make_tuple(line.section, line.block(b));
+}
+
+static inline line_t make_line(const slab_section_t& s, const int d, const Vector<uint8_t,4> block) {
+  line_t line;
+  line.section = s.section;
+  line.dimension = d;
+  line.length = s.blocks[d];
+  line.block_base = block.remove_index(d);
+  return line;
+}
+
+line_t locality_partition_t::nth_line(const int n) const {
+  GEODE_ASSERT(0<=n && n<total_lines);
+  const int i = int(upper_bound(slab_starts.begin(), slab_starts.end(), n)-slab_starts.begin())-1;
+  const auto& s = slab_sections[int(upper_bound(slab_sections.begin(), slab_sections.end(), i,
+      [](const int i, const slab_section_t& s) { return i<s.slab_offset; })-slab_sections.begin())-1];
+  const int p = s.p,
+            x = i-s.slab_offset;
+  int k = n-slab_starts[i];
+  Vector<uint8_t,4> block;
+  block[p] = x;
+  for (const int d : range(4))
+    if (d!=p && s.dimensions&1<<d) {
+      const auto ab = other_dims(p,d);
+      const int count = s.blocks[ab[0]]*s.blocks[ab[1]];
+      if (k < count) {
+        block[ab[0]] = k/s.blocks[ab[1]];
+        block[ab[1]] = k%s.blocks[ab[1]];
+        return make_line(s,d,block);
+      }
+      k -= count;
+    }
+  const auto lines = partition_loop(s.p_lines, int(s.blocks[p]), x);
+  GEODE_ASSERT(k<lines.size());
+  const auto dims = other_dims(p);
+  const auto rest = decompose(Vector<int,3>(s.blocks.remove_index(p)), lines.lo+k);
+  for (const int j : range(3))
+    block[dims[j]] = rest[j];
+  block[p] = 0;
+  return make_line(s,p,block);
+}
+
+int locality_partition_t::line_index(const section_t section, const int dimension,
+                                     const Vector<uint8_t,4> block) const {
+  const auto& s = slab_sections[check_get(section_id, section)];
+  const int p = s.p;
+  if (dimension != p) {
+    int k = 0;
+    for (const int d : range(dimension))
+      if (d!=p && s.dimensions&1<<d) {
+        const auto ab = other_dims(p,d);
+        k += s.blocks[ab[0]]*s.blocks[ab[1]];
+      }
+    const auto ab = other_dims(p,dimension);
+    return slab_starts[s.slab_offset+block[p]] + k + block[ab[0]]*s.blocks[ab[1]] + block[ab[1]];
+  } else {
+    const int index = pentago::index(Vector<int,3>(s.blocks.remove_index(p)),
+                                     Vector<int,3>(block.remove_index(p)));
+    const int x = partition_loop_inverse(s.p_lines, int(s.blocks[p]), index);
+    return slab_starts[s.slab_offset+x] + s.other_lines + index
+         - partition_loop(s.p_lines, int(s.blocks[p]), x).lo;
+  }
+}
+
+uint8_t locality_partition_t::owner_dimension(const slab_section_t& s) const {
+  return s.owner;
+}
+
+}
+}
@@ -0,0 +1,70 @@
+// Communication aware partitioning of lines and blocks across processes
+//
+// random_partition_t balances load well, but nearly every block a line writes
+// belongs to another rank.  locality_partition_t instead lays out each section as
+// a sequence of slabs along one dimension p, chosen to have the most blocks.  Slab
+// x holds all lines not along p that pass through blocks with block[p] = x, plus
+// a proportional share of the lines along p.  The lines of all sections form one
+// sequence, which is cut into contiguous pieces of equal work (line nodes), and
+// each block is owned by the rank holding its line along the first dimension
+// other than p.  A rank that owns a slab therefore owns every line but one that
+// touches the slab's blocks, so most output contributions stay local.
+//
+// Cuts are moved to section or slab boundaries when this costs at most tolerance
+// times the average work per rank, trading balance for fewer split slabs.  Like
+// random_partition_t, the only shared state is small: O(sections*slabs+ranks).
+#pragma once
+
+#include "pentago/end/partition.h"
+#include "pentago/end/line.h"
+#include "pentago/base/section.h"
+namespace pentago {
+namespace end {
+
+struct slab_section_t;
+
+// Given a set of sections, distribute lines and blocks amongst processes, keeping slabs together
+struct locality_partition_t : public partition_t {
+  typedef partition_t Base;
+
+  const double tolerance; // Allowed load imbalance per cut, as a fraction of the average work per rank
+  const int total_lines;
+  const uint64_t total_work; // Total line nodes
+  const Array<const slab_section_t> slab_sections; // One per section, in order of first line
+  const unordered_map<section_t,int> section_id; // Section to index into slab_sections
+  const Array<const int> slab_starts; // First line of each slab, plus total_lines at the end
+  const Array<const uint64_t> slab_work; // Work before each slab, plus total_work at the end
+  const Array<const int> rank_starts; // First line of each rank, plus total_lines at the end
+
+public:
+  locality_partition_t(const int ranks, const shared_ptr<const sections_t>& sections,
+                       const double tolerance=0);
+  ~locality_partition_t();
+
+  // Define partition_t interface
+  uint64_t memory_usage() const override;
+  uint64_t rank_count_lines(const int rank) const override;
+  Array<const line_t> rank_lines(const int rank) const override;
+  Array<const local_block_t> rank_blocks(const int rank) const override;
+  Vector<uint64_t,2> rank_counts(const int rank) const override; // Expensive, since it calls rank_blocks
+  tuple<int,local_id_t> find_block(const section_t section, const Vector<uint8_t,4> block) const override;
+  tuple<section_t,Vector<uint8_t,4>> rank_block(const int rank, const local_id_t local_id) const override;
+
+  // Total work of the first n lines
+  uint64_t work_before(const int n) const;
+
+private:
+  // The nth line in slab order, and its inverse
+  line_t nth_line(const int n) const;
+  int line_index(const section_t section, const int dimension, const Vector<uint8_t,4> block) const;
+
+  // Which dimension owns a given block
+  uint8_t owner_dimension(const slab_section_t& s) const;
+
+  // Work and number of lines in the first k lines of a slab
+  uint64_t slab_prefix_work(const slab_section_t& s, const int x, const int k) const;
+  int slab_lines(const slab_section_t& s, const int x) const;
+};
+
+}
+}
@@ -13,7 +13,7 @@ using namespace pentago::end;
 
 static const section_t bad_section(Vector<Vector<uint8_t,2>,4>(Vector<uint8_t,2>(255,0),Vector<uint8_t,2>(),Vector<uint8_t,2>(),Vector<uint8_t,2>()));
 
-static section_t parse_section(const string& s) {
+section_t parse_section(const string& s) {
   section_t r;
   if (s.size() != 8)
     return bad_section;
@@ -36,10 +36,15 @@ options_t parse_options(int argc, char** argv, const int ranks, const int rank)
       {"save", required_argument, 0, 's'},
       {"dir", required_argument, 0, 'd'},
       {"restart", required_argument, 0, 'T'},
+      {"resume", required_argument, 0, 'U'},
+      {"restart-chunk", required_argument, 0, 'K'},
+      {"checkpoints", required_argument, 0, 'k'},
       {"level", required_argument, 0, 'l'},
+      {"codec", required_argument, 0, 'c'},
       {"memory", required_argument, 0, 'm'},
       {"gather-limit", required_argument, 0, 'g'},
       {"line-limit", required_argument, 0, 'L'},
+      {"aggregate", required_argument, 0, 'A'},
       {"samples", required_argument, 0, 'p'},
       {"ranks", required_argument, 0, 'r'},
       {"test", required_argument, 0, 'u'},
@@ -47,7 +52,15 @@ options_t parse_options(int argc, char** argv, const int ranks, const int rank)
       {"per-rank-times", no_argument, 0, 'z'},
       {"stop-after", required_argument, 0, 'S'},
       {"randomize", required_argument, 0, 'R'},
+      {"locality", required_argument, 0, 'o'},
       {"log-all", no_argument, 0, 'a'},
+      {"io-threads", required_argument, 0, 'I'},
+      {"write-ahead", required_argument, 0, 'W'},
+      {"shared-blocks", no_argument, 0, 'X'},
+      {"adaptive-lines", no_argument, 0, 'D'},
+      {"completion-order", no_argument, 0, 'O'},
+      {"history", required_argument, 0, 'H'},
+      {"counters", required_argument, 0, 'C'},
       {0, 0, 0, 0}
   };
   for (;;) {
@@ -65,10 +78,20 @@ options_t parse_options(int argc, char** argv, const int ranks, const int rank)
           slog("  -s, --save <n>             Save all slices with n stones for fewer (required)");
           slog("  -d, --dir <dir>            Save and log to given new directory (required)");
           slog("      --restart <file>       Restart from the given slice file");
+          slog("      --restart-chunk <n>    Read restart data and checkpoints in collective rounds of up to n bytes per rank (default %d)", o.restart_chunk);
+          slog("      --resume <file>        Resume a partially computed slice from the given checkpoint");
+          slog("      --checkpoints <n>      Compute each slice in n epochs, checkpointing after all but the last (default %d)", o.checkpoints);
           slog("      --level <n>            Compression level: 1-9 is zlib, 20-29 is xz (default %d)", o.level);
+          slog("      --codec <name>         In memory compression: snappy, lz4, zstd, or zstd<level> (default %s)", o.codec);
           slog("  -m, --memory <n>           Approximate memory usage limit per *rank* (required)");
+          slog("      --io-threads <n>       Number of extra threads per rank for background I/O (default %d)", o.io_threads);
+          slog("      --write-ahead <n>      Compress each slice for writing while the next computes, using up to n memory per rank");
           slog("      --gather-limit <n>     Maximum number of simultaneous active line gathers (default %d)", o.gather_limit);
           slog("      --line-limit <n>       Maximum number of simultaneously allocated lines (default %d)", o.line_limit);
+          slog("      --adaptive-lines       Adapt the number of allocated lines, starting from --line-limit, to network and store pressure");
+          slog("      --completion-order     Order each rank's lines so that blocks complete as early as possible");
+          slog("      --aggregate <bytes>    Coalesce block requests and small outputs into messages of up to this size per rank");
+          slog("      --shared-blocks        Read input blocks owned by ranks on the same node through shared memory");
           slog("      --samples <n>          Number of sparse samples to save per section (default %d)", o.samples);
           slog("      --ranks <n>            Allowed for compatibility with predict, but must match mpirun --np");
           slog("      --test <name>          Run the MPI side of one of the unit tests");
@@ -76,7 +99,10 @@ options_t parse_options(int argc, char** argv, const int ranks, const int rank)
           slog("      --per-rank-times       Print a timing report for each rank");
           slog("      --stop-after <n>       Stop after computing the given slice");
           slog("      --randomize <key>      If nonzero, partition lines and blocks randomly using the given key");
+          slog("      --locality <p>         Partition for communication locality, allowing p percent load imbalance per cut");
           slog("      --log-all              Write log files for every process");
+          slog("      --history <n>          Trace the last n timed events per thread, writing history-r* and trace-r*.json");
+          slog("      --counters <events>    Count hardware events per time kind with perf_event_open, e.g. 'default'");
         }
         exit(0);
         break;
@@ -89,33 +115,59 @@ options_t parse_options(int argc, char** argv, const int ranks, const int rank)
       PENTAGO_INT_ARG('n', meaningless, meaningless)
       PENTAGO_INT_ARG('g', gather-limit, gather_limit)
       PENTAGO_INT_ARG('L', line-limit, line_limit)
+      PENTAGO_INT_ARG('A', aggregate, aggregate)
       PENTAGO_INT_ARG('S', stop-after, stop_after)
       PENTAGO_INT_ARG('R', randomize, randomize)
-      case 'm': {
+      PENTAGO_INT_ARG('o', locality, locality)
+      PENTAGO_INT_ARG('k', checkpoints, checkpoints)
+      PENTAGO_INT_ARG('I', io-threads, io_threads)
+      PENTAGO_INT_ARG('H', history, history)
+      case 'm':
+      case 'W':
+      case 'K': {
         char* end;
         double memory = strtod(optarg, &end);
+        auto& limit = c=='m' ? o.memory_limit : c=='W' ? o.write_ahead : o.restart_chunk;
         if (!strcmp(end, "MB") || !strcmp(end, "M"))
-          o.memory_limit = uint64_t(memory*pow(2.,20));
+          limit = uint64_t(memory*pow(2.,20));
         else if (!strcmp(end,"GB") || !strcmp(end,"G"))
-          o.memory_limit = uint64_t(memory*pow(2.,30));
+          limit = uint64_t(memory*pow(2.,30));
         else
           error("don't understand memory limit \"%s\", use e.g. 1.5GB",optarg);
         break; }
+      case 'c':
+        o.codec = optarg;
+        break;
       case 'd':
         o.dir = optarg;
         break;
       case 'T':
         o.restart = optarg;
         break;
+      case 'U':
+        o.resume = optarg;
+        break;
       case 'u':
         o.test = optarg;
         break;
+      case 'C':
+        o.counters = optarg;
+        break;
       case 'z':
         o.per_rank_times = true;
         break;
       case 'a':
         o.log_all = true;
         break;
+      case 'X':
+        o.shared_blocks = true;
+        break;
+      case 'D':
+        o.adaptive_lines = true;
+        break;
+      case 'O':
+        o.completion_order = true;
+        break;
       default:
         error("impossible option character %d", c);
     }
@@ -136,6 +188,8 @@ options_t parse_options(int argc, char** argv, const int ranks, const int rank)
     error("--gather-limit %d must be at least 1", o.gather_limit);
   if (o.line_limit < 2)
     error("--line-limit %d must be at least 2", o.line_limit);
+  if (o.aggregate && (o.aggregate < 1024 || o.aggregate > 1<<20))
+    error("--aggregate %d should be 0 or in [1024,2^20]", o.aggregate);
   if (o.samples < 0)
     error("must specify positive value for --samples, not %d", o.samples);
   if (o.save == -100 && !o.test.size())
@@ -145,6 +199,26 @@ options_t parse_options(int argc, char** argv, const int ranks, const int rank)
       error("--ranks %d doesn't match actual number of ranks %d", o.ranks, ranks);
     o.ranks = ranks;
   }
+  if (o.checkpoints < 1)
+    error("--checkpoints %d must be at least 1", o.checkpoints);
+  if (o.resume.size() && !o.restart.size() && !o.meaningless)
+    error("--resume requires the inputs to the checkpointed slice via --restart or --meaningless");
+  if (o.restart_chunk < 1)
+    error("--restart-chunk %d should be positive", o.restart_chunk);
+  if (o.io_threads < 0)
+    error("--io-threads %d should be nonnegative", o.io_threads);
+  if (o.write_ahead && !o.io_threads)
+    error("--write-ahead compresses on IO threads, so it requires --io-threads");
+  if (o.write_ahead && (o.checkpoints > 1 || o.resume.size()))
+    error("--write-ahead can't be combined with checkpoints, which need the previous slice on disk");
+  if (o.shared_blocks && !PENTAGO_MPI_COMPRESS)
+    error("--shared-blocks requires compressed block storage (PENTAGO_MPI_COMPRESS)");
+  if (o.history < 0 || (o.history & (o.history-1)))
+    error("--history %d should be 0 or a power of two", o.history);
+  if (o.locality < -1)
+    error("--locality %d should be a nonnegative percentage", o.locality);
+  if (o.randomize && o.locality >= 0)
+    error("--randomize and --locality are mutually exclusive");
   if (o.stop_after < 0)
     error("--stop-after %d should be nonnegative", o.stop_after);
   if (!o.dir.size())
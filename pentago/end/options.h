@@ -10,22 +10,38 @@ struct options_t {
   int save = -100;
   int block_size = 8;
   int level = 26;
+  string codec = "snappy";
   int64_t memory_limit = 0;
+  int64_t write_ahead = 0;
+  int64_t restart_chunk = int64_t(1)<<28;
+  int io_threads = 0;
   int gather_limit = 32;
   int line_limit = 32;
+  int aggregate = 0;
   int samples = 256;
   int ranks = -1;
   string dir;
   string restart;
+  string resume;
+  int checkpoints = 1;
   string test;
   int meaningless = 0;
   bool per_rank_times = false;
   int stop_after = 0;
   int randomize = 0;
+  int locality = -1;
   bool log_all = false;
+  bool shared_blocks = false;
+  bool adaptive_lines = false;
+  bool completion_order = false;
+  int history = 0;
+  string counters;
   section_t section;
 };
 
+// Parse a section given as 8 digits, returning an invalid section on failure
+section_t parse_section(const string& s);
+
 // Parse command line options
 options_t parse_options(int argc, char** argv, const int ranks = -1, const int rank = 0);
 
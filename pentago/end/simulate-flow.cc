@@ -0,0 +1,252 @@
+// Simulate an endgame run to tune flow parameters
+//
+// Takes the same section, rank, thread, memory, and flow limit options as endgame-mpi, and runs
+// simulate_flow on each slice in turn.  Costs default to rough figures, but should be replaced
+// by measurements from compute-benchmark and codec-benchmark on the target machine, and the
+// latency and bandwidth of its interconnect.  For example,
+//
+//   simulate-flow --ranks 64 --threads 16 --memory 7G --speed 7e5 00000000 --restart 20 --stop-after 16
+
+#include "pentago/end/load_balance.h"
+#include "pentago/end/locality_partition.h"
+#include "pentago/end/options.h"
+#include "pentago/end/predict.h"
+#include "pentago/end/random_partition.h"
+#include "pentago/end/sections.h"
+#include "pentago/end/simple_partition.h"
+#include "pentago/end/simulate.h"
+#include "pentago/utility/large.h"
+#include "pentago/utility/log.h"
+#include "pentago/utility/thread.h"
+#include "pentago/utility/wall_time.h"
+#include <getopt.h>
+
+namespace pentago {
+namespace end {
+namespace {
+
+using std::make_shared;
+using std::max;
+
+struct options_t {
+  int ranks = 0;
+  int threads = 0;
+  uint64_t memory_limit = 0;
+  int gather_limit = 32;
+  int line_limit = 32;
+  int randomize = 0;
+  int locality = -1;
+  int restart = 36;
+  int stop_after = 0;
+  int samples = 11;
+  bool curves = false;
+  flow_costs_t costs;
+  section_t section;
+};
+
+options_t parse_options(int argc, char** argv) {
+  options_t o;
+  static const option options[] = {
+      {"help", no_argument, 0, 'h'},
+      {"ranks", required_argument, 0, 'r'},
+      {"threads", required_argument, 0, 't'},
+      {"memory", required_argument, 0, 'm'},
+      {"gather-limit", required_argument, 0, 'g'},
+      {"line-limit", required_argument, 0, 'L'},
+      {"randomize", required_argument, 0, 'R'},
+      {"locality", required_argument, 0, 'o'},
+      {"restart", required_argument, 0, 'T'},
+      {"stop-after", required_argument, 0, 'S'},
+      {"samples", required_argument, 0, 'p'},
+      {"curves", no_argument, 0, 'c'},
+      {"speed", required_argument, 0, 'x'},
+      {"compress-speed", required_argument, 0, 'C'},
+      {"uncompress-speed", required_argument, 0, 'U'},
+      {"ratio", required_argument, 0, 'q'},
+      {"latency", required_argument, 0, 'l'},
+      {"bandwidth", required_argument, 0, 'B'},
+      {0, 0, 0, 0},
+  };
+  const int rank = 0;
+  for (;;) {
+    int option = 0;
+    int c = getopt_long(argc, argv, "hr:t:m:", options, &option);
+    if (c == -1) break;  // Out of options
+    switch (c) {
+      case 'h':
+        slog("usage: %s [options...] <section>", argv[0]);
+        slog("Simulate endgame-mpi's compute flow for all ranks to predict runtime, memory, and idle time.");
+        slog("  -h, --help                  Display usage information and quit");
+        slog("  -r, --ranks <n>             Number of MPI ranks (required)");
+        slog("  -t, --threads <n>           Threads per rank including the communication thread (required)");
+        slog("  -m, --memory <n>            Approximate memory usage limit per rank (required)");
+        slog("      --gather-limit <n>      Maximum number of simultaneous active line gathers (default %d)", o.gather_limit);
+        slog("      --line-limit <n>        Maximum number of simultaneously allocated lines (default %d)", o.line_limit);
+        slog("      --randomize <key>       If nonzero, partition lines and blocks randomly using the given key");
+        slog("      --locality <p>          Partition for communication locality, allowing p percent load imbalance per cut");
+        slog("      --restart <slice>       Simulate only slices below the given slice");
+        slog("      --stop-after <n>        Stop after simulating slice n (default %d)", o.stop_after);
+        slog("      --samples <n>           Points in each memory curve (default %d)", o.samples);
+        slog("      --curves                Print memory curves for each slice");
+        slog("      --speed <x>             Compute speed in nodes/s/thread (default %g)", o.costs.compute_speed);
+        slog("      --compress-speed <x>    Codec compression speed in bytes/s/thread (default %g)", o.costs.compress_speed);
+        slog("      --uncompress-speed <x>  Codec decompression speed in bytes/s/thread (default %g)", o.costs.uncompress_speed);
+        slog("      --ratio <x>             Compressed over uncompressed size (default %g)", o.costs.compression_ratio);
+        slog("      --latency <x>           Network latency in seconds (default %g)", o.costs.latency);
+        slog("      --bandwidth <x>         Network bandwidth per rank in bytes/s (default %g)", o.costs.bandwidth);
+        exit(0);
+      PENTAGO_INT_ARG('r', ranks, ranks)
+      PENTAGO_INT_ARG('t', threads, threads)
+      PENTAGO_INT_ARG('g', gather-limit, gather_limit)
+      PENTAGO_INT_ARG('L', line-limit, line_limit)
+      PENTAGO_INT_ARG('R', randomize, randomize)
+      PENTAGO_INT_ARG('o', locality, locality)
+      PENTAGO_INT_ARG('T', restart, restart)
+      PENTAGO_INT_ARG('S', stop-after, stop_after)
+      PENTAGO_INT_ARG('p', samples, samples)
+      case 'c':
+        o.curves = true;
+        break;
+      case 'm': {
+        char* end;
+        double memory = strtod(optarg, &end);
+        if (!strcmp(end, "MB") || !strcmp(end, "M"))
+          o.memory_limit = uint64_t(memory*pow(2.,20));
+        else if (!strcmp(end,"GB") || !strcmp(end,"G"))
+          o.memory_limit = uint64_t(memory*pow(2.,30));
+        else
+          PENTAGO_OPTION_ERROR("don't understand memory limit \"%s\", use e.g. 1.5GB",optarg);
+        break; }
+      case 'x': case 'C': case 'U': case 'q': case 'l': case 'B': {
+        char* end;
+        const double x = strtod(optarg, &end);
+        if (!*optarg || *end || !(x > 0))
+          PENTAGO_OPTION_ERROR("--%s expected positive number, got '%s'", options[option].name, optarg);
+        auto& costs = o.costs;
+        (c=='x' ? costs.compute_speed : c=='C' ? costs.compress_speed : c=='U' ? costs.uncompress_speed
+         : c=='q' ? costs.compression_ratio : c=='l' ? costs.latency : costs.bandwidth) = x;
+        break; }
+      default:
+        die("impossible option character %d", c);
+    }
+  }
+  if (o.ranks < 1)
+    PENTAGO_OPTION_ERROR("must specify --ranks n with n >= 1");
+  if (o.threads < 2)
+    PENTAGO_OPTION_ERROR("must specify --threads n with n >= 2 for communication vs. compute");
+  if (!o.memory_limit)
+    PENTAGO_OPTION_ERROR("must specify --memory");
+  if (o.gather_limit < 1)
+    PENTAGO_OPTION_ERROR("--gather-limit %d must be at least 1", o.gather_limit);
+  if (o.line_limit < 2)
+    PENTAGO_OPTION_ERROR("--line-limit %d must be at least 2", o.line_limit);
+  if (o.locality < -1)
+    PENTAGO_OPTION_ERROR("--locality %d should be a nonnegative percentage", o.locality);
+  if (o.randomize && o.locality >= 0)
+    PENTAGO_OPTION_ERROR("--randomize and --locality are mutually exclusive");
+  if (o.samples < 2)
+    PENTAGO_OPTION_ERROR("--samples %d must be at least 2", o.samples);
+  if (o.stop_after < 0)
+    PENTAGO_OPTION_ERROR("--stop-after %d should be nonnegative", o.stop_after);
+  if (argc-optind != 1)
+    PENTAGO_OPTION_ERROR("expected exactly one argument (section)");
+  const char* section_str = argv[optind++];
+  o.section = parse_section(section_str);
+  if (!o.section.valid())
+    PENTAGO_OPTION_ERROR("invalid section '%s'", section_str);
+  return o;
+}
+
+shared_ptr<const partition_t> make_partition(const options_t& o, const shared_ptr<const sections_t>& sections) {
+  if (o.randomize)
+    return make_shared<random_partition_t>(o.randomize, o.ranks, sections);
+  else if (o.locality >= 0)
+    return make_shared<locality_partition_t>(o.ranks, sections, o.locality/100.);
+  else
+    return make_shared<simple_partition_t>(o.ranks, sections);
+}
+
+void toplevel(int argc, char** argv) {
+  const auto o = parse_options(argc, argv);
+  Scope scope("simulate flow");
+  init_threads(-1, 0);
+  {
+    Scope scope("parameters");
+    slog("ranks = %d", o.ranks);
+    slog("threads / rank = %d", o.threads);
+    slog("section = %s", o.section);
+    slog("memory limit = %s", large(o.memory_limit));
+    slog("gather limit = %d", o.gather_limit);
+    slog("line limit = %d", o.line_limit);
+    slog("speeds: compute %g nodes/s, compress %g B/s, uncompress %g B/s", o.costs.compute_speed,
+         o.costs.compress_speed, o.costs.uncompress_speed);
+    slog("network: latency %g s, bandwidth %g B/s", o.costs.latency, o.costs.bandwidth);
+  }
+
+  const auto slices = descendent_sections(o.section, 35);
+  shared_ptr<const partition_t> prev_partition;
+  shared_ptr<const load_balance_t> prev_load;
+  double total_time = 0, max_idle = 0;
+  uint64_t max_memory = 0;
+  for (int slice=std::min(int(slices.size())-1,o.restart);slice>=o.stop_after;slice--) {
+    if (!slices[slice]->sections.size())
+      break;
+    const auto partition = make_partition(o, slices[slice]);
+    const auto load = serial_load_balance(partition);
+    if (slice < o.restart) {
+      Scope scope(format("slice %d", slice));
+      const auto start = wall_time();
+      const auto base_memory = max_rank_memory_usage(prev_partition, prev_load, *partition, *load);
+      if (o.memory_limit <= base_memory)
+        die("memory limit exceeded: base = %s, limit = %s", large(base_memory), large(o.memory_limit));
+      const auto free_memory = o.memory_limit-base_memory;
+      const auto sim = simulate_flow(prev_partition, partition, o.threads-1, o.costs, free_memory,
+                                     o.gather_limit, o.line_limit, o.samples);
+      double idle = 0;
+      for (const auto i : sim.idle)
+        idle = max(idle, i);
+      slog("lines = %d, base memory = %s, free memory = %s", load->lines.max, large(base_memory),
+           large(free_memory));
+      slog("time = %.4g s, idle = %.3g mean %.3g max, peak line memory = %s",
+           sim.time, sim.mean_idle(), idle, large(sim.max_peak_memory()));
+      slog("messages = %d, bytes = %s, simulation time = %.3g s", sim.messages, large(sim.bytes),
+           (wall_time()-start).seconds());
+      if (o.curves) {
+        Scope scope("memory curve");
+        for (const int i : range(o.samples)) {
+          uint64_t peak = 0, sum = 0;
+          for (const int rank : range(o.ranks)) {
+            peak = max(peak, sim.memory(i, rank));
+            sum += sim.memory(i, rank);
+          }
+          slog("t = %.4g s: max %s, mean %s", sim.sample_times[i], large(base_memory+peak),
+               large(base_memory+sum/o.ranks));
+        }
+      }
+      total_time += sim.time;
+      max_idle = max(max_idle, idle);
+      max_memory = max(max_memory, base_memory+sim.max_peak_memory());
+    }
+    prev_partition = partition;
+    prev_load = load;
+  }
+  Scope summary("summary");
+  slog("time = %.4g s", total_time);
+  slog("core hours = %.4g", total_time*o.ranks*o.threads/3600);
+  slog("max idle = %.3g", max_idle);
+  slog("max memory = %s", large(max_memory));
+}
+
+}  // namespace
+}  // namespace end
+}  // namespace pentago
+
+int main(int argc, char** argv) {
+  try {
+    pentago::end::toplevel(argc, argv);
+    return 0;
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+}
@@ -0,0 +1,395 @@
+// Discrete event simulation of the endgame flow
+
+#include "pentago/end/simulate.h"
+#include "pentago/end/blocks.h"
+#include "pentago/end/compute.h"
+#include "pentago/end/line.h"
+#include "pentago/utility/debug.h"
+#include "pentago/utility/large.h"
+#include "pentago/utility/str.h"
+#include <deque>
+#include <queue>
+namespace pentago {
+namespace end {
+
+using std::deque;
+using std::function;
+using std::get;
+using std::max;
+using std::min;
+using std::priority_queue;
+using std::unique_ptr;
+
+double flow_simulation_t::mean_idle() const {
+  double sum = 0;
+  for (const auto i : idle)
+    sum += i;
+  return idle.size() ? sum/idle.size() : 0;
+}
+
+uint64_t flow_simulation_t::max_peak_memory() const {
+  uint64_t peak = 0;
+  for (const auto m : peak_memory)
+    peak = max(peak, m);
+  return peak;
+}
+
+namespace {
+
+const uint64_t node_bytes = sizeof(Vector<super_t,2>);
+
+// A line in flight, mirroring line_details_t
+struct sim_line_t {
+  const line_t* line;
+  int rank;
+  uint64_t memory;
+  uint64_t nodes; // Output nodes
+  int microlines;
+  line_inputs_t inputs;
+  int missing_responses, missing_inputs, missing_chunks, unsent_outputs;
+};
+
+// Mirrors block_request_t
+struct sim_request_t {
+  section_t section;
+  Vector<uint8_t,4> block;
+  uint64_t nodes;
+  vector<sim_line_t*> dependent_lines;
+};
+
+struct sim_job_t {
+  double seconds;
+  function<void()> done;
+};
+
+struct sim_rank_t {
+  vector<sim_line_t*> unscheduled_lines; // In reverse order, as in flow_t
+  vector<sim_request_t*> block_requests;
+  uint64_t free_memory;
+  int free_line_gathers;
+  int free_lines;
+
+  // Compute threads
+  int free_threads;
+  deque<sim_job_t> jobs;
+  double busy = 0; // Total thread seconds of work
+  double finish = 0;
+
+  // Network links are busy until these times
+  double send_free = 0, recv_free = 0;
+
+  // Line memory, and its history as (time,memory) pairs
+  uint64_t memory = 0, peak_memory = 0;
+  vector<tuple<double,uint64_t>> memory_history;
+};
+
+struct sim_event_t {
+  double time;
+  uint64_t order; // Break ties in order of creation
+  function<void()> f;
+
+  bool operator<(const sim_event_t& e) const { // Reversed for priority_queue
+    return time!=e.time ? time>e.time : order>e.order;
+  }
+};
+
+struct simulator_t {
+  const shared_ptr<const block_partition_t> prev_partition;
+  const shared_ptr<const partition_t> partition;
+  const int threads;
+  const flow_costs_t costs;
+  vector<sim_rank_t> ranks;
+  vector<unique_ptr<sim_line_t>> lines;
+  vector<Array<const line_t>> rank_lines;
+
+  double now = 0;
+  uint64_t order = 0;
+  priority_queue<sim_event_t> events;
+  uint64_t messages = 0, bytes = 0;
+
+  simulator_t(const shared_ptr<const block_partition_t>& prev_partition,
+              const shared_ptr<const partition_t>& partition, const int threads,
+              const flow_costs_t& costs, const uint64_t memory_limit, const int gather_limit,
+              const int line_limit);
+
+  void at(const double time, function<void()> f) {
+    events.push(sim_event_t{time, order++, std::move(f)});
+  }
+
+  void run() {
+    while (events.size()) {
+      auto event = events.top();
+      events.pop();
+      now = event.time;
+      event.f();
+    }
+  }
+
+  // Schedule work on a rank's compute threads.  front = true mimics threads_schedule(...,true).
+  void schedule_job(const int rank, const double seconds, function<void()> done, const bool front=false);
+  void start_jobs(const int rank);
+
+  // Send a message between ranks.  Each rank's links carry one message at a time in order of sending.
+  void send(const int source, const int dest, const uint64_t size, function<void()> sent,
+            function<void()> arrived);
+
+  void change_memory(const int rank, const int64_t delta);
+
+  // Mirrors of the corresponding flow_t routines
+  void schedule_lines(const int rank);
+  void process_response(const int rank, sim_request_t* request);
+  void compute_line(sim_line_t* line);
+  void send_outputs(sim_line_t* line);
+  void send_output(sim_line_t* line, const int b);
+  void finish_output_send(sim_line_t* line);
+};
+
+simulator_t::simulator_t(const shared_ptr<const block_partition_t>& prev_partition,
+                         const shared_ptr<const partition_t>& partition, const int threads,
+                         const flow_costs_t& costs, const uint64_t memory_limit,
+                         const int gather_limit, const int line_limit)
+  : prev_partition(prev_partition), partition(partition), threads(threads), costs(costs)
+  , ranks(partition->ranks) {
+  GEODE_ASSERT(threads>=1 && gather_limit>=1 && line_limit>=1);
+  GEODE_ASSERT(!prev_partition || prev_partition->ranks==partition->ranks);
+  for (const int rank : range(partition->ranks)) {
+    auto& r = ranks[rank];
+    r.free_memory = memory_limit;
+    r.free_line_gathers = gather_limit;
+    r.free_lines = line_limit;
+    r.free_threads = threads;
+    r.memory_history.emplace_back(0, 0);
+    rank_lines.push_back(partition->rank_lines(rank));
+    const auto& lines = rank_lines.back();
+    for (int i=lines.size()-1;i>=0;i--) {
+      const line_data_t pre(lines[i]);
+      if (pre.memory_usage>memory_limit/2)
+        THROW(ValueError,"simulate_flow: line %s needs %s, more than half of free memory %s",
+              str(lines[i]),large(pre.memory_usage),large(memory_limit));
+      unique_ptr<sim_line_t> line(new sim_line_t);
+      line->line = &lines[i];
+      line->rank = rank;
+      line->memory = pre.memory_usage;
+      line->nodes = pre.output_shape.product();
+      line->microlines = pre.output_shape.remove_index(lines[i].dimension).product();
+      line->inputs = line_inputs(lines[i]);
+      if (!prev_partition)
+        line->inputs.count = 0;
+      r.unscheduled_lines.push_back(line.get());
+      this->lines.push_back(std::move(line));
+    }
+  }
+}
+
+void simulator_t::schedule_job(const int rank, const double seconds, function<void()> done,
+                               const bool front) {
+  auto& r = ranks[rank];
+  if (front)
+    r.jobs.push_front(sim_job_t{seconds, std::move(done)});
+  else
+    r.jobs.push_back(sim_job_t{seconds, std::move(done)});
+  start_jobs(rank);
+}
+
+void simulator_t::start_jobs(const int rank) {
+  auto& r = ranks[rank];
+  while (r.free_threads && r.jobs.size()) {
+    auto job = std::move(r.jobs.front());
+    r.jobs.pop_front();
+    r.free_threads--;
+    r.busy += job.seconds;
+    at(now+job.seconds, [this,rank,done=std::move(job.done)]() {
+      auto& r = ranks[rank];
+      r.free_threads++;
+      r.finish = max(r.finish, now);
+      done();
+      start_jobs(rank);
+    });
+  }
+}
+
+void simulator_t::send(const int source, const int dest, const uint64_t size,
+                       function<void()> sent, function<void()> arrived) {
+  if (source==dest) {
+    // Local messages skip the network
+    at(now, std::move(sent));
+    at(now, std::move(arrived));
+    return;
+  }
+  messages++;
+  bytes += size;
+  const double transfer = size/costs.bandwidth;
+  auto &s = ranks[source], &d = ranks[dest];
+  s.send_free = max(now, s.send_free)+transfer;
+  d.recv_free = max(s.send_free+costs.latency, d.recv_free+transfer);
+  at(s.send_free, std::move(sent));
+  at(d.recv_free, std::move(arrived));
+}
+
+void simulator_t::change_memory(const int rank, const int64_t delta) {
+  auto& r = ranks[rank];
+  r.memory += delta;
+  r.peak_memory = max(r.peak_memory, r.memory);
+  r.memory_history.emplace_back(now, r.memory);
+}
+
+void simulator_t::schedule_lines(const int rank) {
+  auto& r = ranks[rank];
+  while (r.free_lines && r.free_line_gathers && r.unscheduled_lines.size()) {
+    const auto line = r.unscheduled_lines.back();
+    if (r.free_memory < line->memory)
+      return;
+    r.unscheduled_lines.pop_back();
+    r.free_memory -= line->memory;
+    r.free_lines--;
+    change_memory(rank, line->memory);
+    if (!line->inputs.count) {
+      compute_line(line);
+      continue;
+    }
+    // Request all input blocks, merging with existing requests
+    r.free_line_gathers--;
+    line->missing_responses = line->missing_inputs = line->inputs.count;
+    for (const int b : range(int(line->inputs.count))) {
+      const auto block = line->inputs.block(b);
+      sim_request_t* request = 0;
+      for (auto existing : r.block_requests)
+        if (existing->section==line->inputs.section && existing->block==block) {
+          request = existing;
+          break;
+        }
+      if (!request) {
+        request = new sim_request_t;
+        request->section = line->inputs.section;
+        request->block = block;
+        request->nodes = block_shape(line->inputs.section.shape(), block).product();
+        r.block_requests.push_back(request);
+        const int owner = get<0>(prev_partition->find_block(request->section, block));
+        const uint64_t response_size = uint64_t(costs.compression_ratio*node_bytes*request->nodes);
+        send(rank, owner, 2*sizeof(int), []() {}, [=]() {
+          send(owner, rank, response_size, []() {}, [=]() { process_response(rank, request); });
+        });
+      }
+      request->dependent_lines.push_back(line);
+    }
+  }
+}
+
+void simulator_t::process_response(const int rank, sim_request_t* request) {
+  auto& r = ranks[rank];
+  const auto it = std::find(r.block_requests.begin(), r.block_requests.end(), request);
+  GEODE_ASSERT(it != r.block_requests.end());
+  std::swap(*it, r.block_requests.back());
+  r.block_requests.pop_back();
+  for (auto line : request->dependent_lines)
+    if (!--line->missing_responses)
+      r.free_line_gathers++;
+
+  // Decompress, and copy to lines other than the first
+  schedule_job(rank, node_bytes*request->nodes/costs.uncompress_speed, [=]() {
+    for (auto line : request->dependent_lines)
+      if (!--line->missing_inputs)
+        compute_line(line);
+    delete request;
+  });
+  schedule_lines(rank);
+}
+
+void simulator_t::compute_line(sim_line_t* line) {
+  // compute_line schedules one job per microline.  Splitting each line into as many chunks as
+  // threads gives the same parallelism with far fewer events.
+  const int chunks = min(line->microlines, threads);
+  const double seconds = line->nodes/costs.compute_speed/chunks;
+  line->missing_chunks = chunks;
+  for (int c=0;c<chunks;c++)
+    schedule_job(line->rank, seconds, [=]() {
+      if (!--line->missing_chunks)
+        send_outputs(line);
+    });
+}
+
+void simulator_t::send_outputs(sim_line_t* line) {
+  line->unsent_outputs = line->line->length;
+  for (const int b : range(int(line->line->length))) {
+    if (PENTAGO_MPI_COMPRESS_OUTPUTS) {
+      const auto raw = node_bytes*block_shape(line->line->section.shape(), line->line->block(b)).product();
+      schedule_job(line->rank, raw/costs.compress_speed, [=]() { send_output(line, b); });
+    } else
+      send_output(line, b);
+  }
+}
+
+void simulator_t::send_output(sim_line_t* line, const int b) {
+  const auto block = line->line->block(b);
+  const uint64_t raw = node_bytes*block_shape(line->line->section.shape(), block).product();
+  const int owner = get<0>(partition->find_block(line->line->section, block));
+  const uint64_t size = PENTAGO_MPI_COMPRESS_OUTPUTS ? uint64_t(costs.compression_ratio*raw) : raw;
+  send(line->rank, owner, size, [=]() { finish_output_send(line); }, [=]() {
+    // Accumulate at the owner: uncompress the message if necessary, merge with
+    // the stored block, and recompress
+    const double seconds = (1+PENTAGO_MPI_COMPRESS_OUTPUTS)*raw/costs.uncompress_speed
+                          + raw/costs.compress_speed;
+    schedule_job(owner, seconds, []() {}, true);
+  });
+}
+
+void simulator_t::finish_output_send(sim_line_t* line) {
+  if (!--line->unsent_outputs) {
+    auto& r = ranks[line->rank];
+    r.free_lines++;
+    r.free_memory += line->memory;
+    change_memory(line->rank, -int64_t(line->memory));
+    schedule_lines(line->rank);
+  }
+}
+
+}  // namespace
+
+flow_simulation_t simulate_flow(const shared_ptr<const block_partition_t>& prev_partition,
+                                const shared_ptr<const partition_t>& partition,
+                                const int threads, const flow_costs_t& costs,
+                                const uint64_t memory_limit, const int gather_limit,
+                                const int line_limit, const int samples) {
+  GEODE_ASSERT(samples>=2);
+  simulator_t sim(prev_partition, partition, threads, costs, memory_limit, gather_limit, line_limit);
+  for (const int rank : range(partition->ranks))
+    sim.at(0, [&sim,rank]() { sim.schedule_lines(rank); });
+  sim.run();
+
+  // Collect results
+  const int ranks = partition->ranks;
+  flow_simulation_t result;
+  result.time = 0;
+  for (const auto& r : sim.ranks) {
+    GEODE_ASSERT(!r.unscheduled_lines.size() && !r.block_requests.size() && !r.memory);
+    result.time = max(result.time, r.finish);
+  }
+  Array<double> rank_time(ranks), idle(ranks), sample_times(samples);
+  Array<uint64_t> peak_memory(ranks);
+  Array<uint64_t,2> memory(samples, ranks);
+  for (const int i : range(samples))
+    sample_times[i] = result.time*i/(samples-1);
+  for (const int rank : range(ranks)) {
+    const auto& r = sim.ranks[rank];
+    rank_time[rank] = r.finish;
+    idle[rank] = result.time ? 1-r.busy/(threads*result.time) : 0;
+    peak_memory[rank] = r.peak_memory;
+    int j = 0;
+    for (const int i : range(samples)) {
+      while (j+1<int(r.memory_history.size()) && get<0>(r.memory_history[j+1])<=sample_times[i])
+        j++;
+      memory(i, rank) = get<1>(r.memory_history[j]);
+    }
+  }
+  result.rank_time = rank_time;
+  result.idle = idle;
+  result.peak_memory = peak_memory;
+  result.sample_times = sample_times;
+  result.memory = memory;
+  result.messages = sim.messages;
+  result.bytes = sim.bytes;
+  return result;
+}
+
+}
+}
@@ -0,0 +1,55 @@
+// Discrete event simulation of the endgame flow
+//
+// The gather, line, and memory limits in options.h are chosen by hand, and predict estimates
+// only peak memory.  simulate_flow instead replays the control flow of compute_lines (see
+// mpi/flow.cc) for every rank of a slice: line allocation under the memory and line limits, input
+// gathers under the gather limit with merged block requests, decompression of responses, compute
+// parallelized over microlines, output sends, and accumulation by block owners.  Costs come from a
+// simple model: measured per thread speeds for the compute kernel and the block codec, and one
+// network link per rank in each direction with fixed latency and bandwidth.
+//
+// The model ignores the cost of the communication thread itself, contention inside the network,
+// and compaction of the block store, so it is best used to compare parameters and rank counts
+// rather than to predict absolute times.
+#pragma once
+
+#include "pentago/end/config.h"
+#include "pentago/end/partition.h"
+namespace pentago {
+namespace end {
+
+// Costs for simulate_flow.  The defaults are rough figures for one modern core and interconnect.
+struct flow_costs_t {
+  double compute_speed = 7e5; // Output nodes per second per thread (see compute-benchmark)
+  double compress_speed = 4e8; // Uncompressed bytes per second per thread (see codec-benchmark)
+  double uncompress_speed = 1.5e9; // Uncompressed bytes per second per thread
+  double compression_ratio = snappy_compression_estimate; // Compressed size over uncompressed size
+  double latency = 2e-6; // Seconds per message
+  double bandwidth = 1e10; // Bytes per second into and out of each rank
+};
+
+struct flow_simulation_t {
+  double time; // Time until the last rank finishes
+  Array<const double> rank_time; // Time at which each rank finished its last job
+  Array<const double> idle; // Fraction of each rank's thread time spent idle before time
+  Array<const uint64_t> peak_memory; // Peak line memory of each rank
+  Array<const double> sample_times; // Evenly spaced times in [0,time]
+  Array<const uint64_t,2> memory; // memory(i,rank) = line memory of rank at sample_times[i]
+  uint64_t messages; // Messages between different ranks
+  uint64_t bytes; // Bytes sent between different ranks
+
+  double mean_idle() const;
+  uint64_t max_peak_memory() const;
+};
+
+// Simulate compute_lines for all ranks of one slice.  prev_partition holds the inputs, and is null
+// if the slice has no inputs.  memory_limit, gather_limit, and line_limit are per rank, as in
+// compute_lines.  Memory curves are sampled at the given number of times.
+flow_simulation_t simulate_flow(const shared_ptr<const block_partition_t>& prev_partition,
+                                const shared_ptr<const partition_t>& partition,
+                                const int threads, const flow_costs_t& costs,
+                                const uint64_t memory_limit, const int gather_limit,
+                                const int line_limit, const int samples=32);
+
+}
+}
@@ -0,0 +1,375 @@
+// Line granular checkpoints within a slice
+
+#include "pentago/mpi/checkpoint.h"
+#include "pentago/base/hash.h"
+#include "pentago/mpi/utility.h"
+#include "pentago/utility/debug.h"
+#include "pentago/utility/index.h"
+#include "pentago/utility/large.h"
+#include "pentago/utility/log.h"
+#include "pentago/utility/str.h"
+#include <errno.h>
+#include <stdio.h>
+namespace pentago {
+namespace mpi {
+
+using std::get;
+
+/* File format:
+ *
+ *   header_t header
+ *   uint64_t offsets[ranks+1]            // Start of each rank's chunk, plus the total file size
+ *   For each rank r:
+ *     uint64_t counts[4]                 // blocks, sections, samples, hash of the rank's ordered lines
+ *     Vector<uint64_t,3> section_counts[sections]
+ *     Vector<super_t,2> sample_wins[samples]  // Only meaningful for completed blocks
+ *     block_record_t records[blocks]     // In flat_id order
+ *     uint8_t data[]                     // Concatenated fast compressed block data, in flat_id order
+ *
+ * Everything is native endian.  Since blocks are stored in fast_compress format, resuming requires
+ * the same interleave filtering setting, but the codec may differ: each block records its own.
+ * Block data is written and read in collective rounds of bounded size, so checkpointing never
+ * holds a second copy of the store.
+ */
+
+#if !PENTAGO_MPI_COMPRESS
+#error "Checkpoints require PENTAGO_MPI_COMPRESS"
+#endif
+
+namespace {
+struct header_t {
+  char magic[12];
+  int version;
+  int slice;
+  int epoch;
+  int epochs;
+  int ranks;
+};
+static_assert(sizeof(header_t)==32,"");
+
+struct block_record_t {
+  section_t section;
+  Vector<uint8_t,4> block;
+  uint8_t missing_dimensions;
+  uint8_t pad[3];
+  uint32_t size; // Compressed size, or zero if no contributions have arrived
+};
+static_assert(sizeof(block_record_t)==20,"");
+}
+
+static const char magic[13] = "pentago ckpt";
+static const int version = 2;
+
+RawArray<const line_t> epoch_lines(RawArray<const line_t> lines, const int epoch, const int epochs) {
+  GEODE_ASSERT(0<=epoch && epoch<epochs);
+  const auto chunk = partition_loop(lines.size(),epochs,epoch);
+  return lines.slice(chunk.lo,chunk.hi);
+}
+
+int epoch_contributions(const MPI_Comm comm, const block_partition_t& partition,
+                        RawArray<const line_t> lines) {
+  Array<int> counts(comm_size(comm));
+  for (const auto& line : lines)
+    for (const int i : range(int(line.length)))
+      counts[get<0>(partition.find_block(line.section,line.block(i)))]++;
+  int contributions = 0;
+  CHECK(MPI_Reduce_scatter_block(counts.data(),&contributions,1,MPI_INT,MPI_SUM,comm));
+  return contributions;
+}
+
+// Blocks in flat_id order
+static vector<const block_info_t*> flat_block_infos(const accumulating_block_store_t& blocks) {
+  vector<const block_info_t*> infos(blocks.total_blocks());
+  for (const auto& info : blocks.block_infos)
+    infos[get<1>(info).flat_id] = &get<1>(info);
+  return infos;
+}
+
+// Hash a rank's lines in order, so that resuming can verify that it computes the same lines
+static uint64_t lines_hash(RawArray<const line_t> lines) {
+  uint64_t h = lines.size();
+  for (const auto& line : lines) {
+    uint32_t words[3];
+    memcpy(words,&line,sizeof(line));
+    h = hash_board(h^(uint64_t(words[1])<<32|words[0]));
+    h = hash_board(h^words[2]);
+  }
+  return h;
+}
+
+// Group blocks into chunks of at most chunk_bytes of data (or one block if larger).  Chunk i is
+// blocks [starts[i],starts[i+1]).
+static vector<int> data_chunks(RawArray<const uint32_t> sizes, const uint64_t chunk_bytes) {
+  vector<int> starts(1);
+  uint64_t size = 0;
+  for (const int b : range(sizes.size())) {
+    if (b>starts.back() && size+sizes[b]>chunk_bytes) {
+      starts.push_back(b);
+      size = 0;
+    }
+    size += sizes[b];
+  }
+  starts.push_back(sizes.size());
+  return starts;
+}
+
+// Number of collective rounds needed to move every rank's chunks
+static int data_rounds(const MPI_Comm comm, const vector<int>& starts) {
+  int rounds = int(starts.size())-1;
+  CHECK(MPI_Allreduce(MPI_IN_PLACE,&rounds,1,MPI_INT,MPI_MAX,comm));
+  return rounds;
+}
+
+void write_checkpoint(const MPI_Comm comm, const string& filename, accumulating_block_store_t& blocks,
+                      RawArray<const line_t> lines, const int epoch, const int epochs,
+                      const uint64_t chunk_bytes) {
+  Scope scope("checkpoint");
+  thread_time_t time(write_kind,unevent);
+  const int ranks = comm_size(comm),
+            rank = comm_rank(comm);
+  const auto infos = flat_block_infos(blocks);
+  const auto samples = blocks.samples.flat;
+  const auto& section_counts = blocks.section_counts;
+
+  // Compute our chunk size
+  Array<uint32_t> sizes(infos.size());
+  uint64_t data_size = 0;
+  for (const int b : range(int(infos.size()))) {
+    compacting_store_t::lock_t alock(blocks.store,b);
+    sizes[b] = alock.get().size();
+    data_size += sizes[b];
+  }
+  const uint64_t counts_offset = !rank ? sizeof(header_t)+(ranks+1)*sizeof(uint64_t) : 0,
+                 records_offset = counts_offset + 4*sizeof(uint64_t)
+                                + sizeof(Vector<uint64_t,3>)*section_counts.size()
+                                + sizeof(Vector<super_t,2>)*samples.size(),
+                 data_offset = records_offset + sizeof(block_record_t)*infos.size();
+
+  // Compute offsets
+  uint64_t offset = 0, total = 0;
+  {
+    uint64_t size = data_offset+data_size;
+    CHECK(MPI_Exscan(&size,&offset,1,datatype<uint64_t>(),MPI_SUM,comm));
+    CHECK(MPI_Allreduce(&size,&total,1,datatype<uint64_t>(),MPI_SUM,comm));
+  }
+  Array<uint64_t> offsets(ranks+1);
+  CHECK(MPI_Gather(&offset,1,datatype<uint64_t>(),offsets.data(),1,datatype<uint64_t>(),0,comm));
+  offsets[ranks] = total;
+
+  // Pack the header and offsets on rank 0
+  Array<uint8_t> buffer(CHECK_CAST_INT(data_offset),uninit);
+  if (!rank) {
+    header_t header;
+    memcpy(header.magic,magic,sizeof(header.magic));
+    header.version = version;
+    header.slice = blocks.sections->slice;
+    header.epoch = epoch;
+    header.epochs = epochs;
+    header.ranks = ranks;
+    memcpy(buffer.data(),&header,sizeof(header));
+    memcpy(buffer.data()+sizeof(header),offsets.data(),sizeof(uint64_t)*offsets.size());
+  }
+
+  // Pack counts, samples, and block records
+  const uint64_t counts[4] = {uint64_t(infos.size()),uint64_t(section_counts.size()),
+                              uint64_t(samples.size()),lines_hash(lines)};
+  memcpy(buffer.data()+counts_offset,counts,sizeof(counts));
+  memcpy(buffer.data()+counts_offset+sizeof(counts),section_counts.data(),
+         sizeof(Vector<uint64_t,3>)*section_counts.size());
+  for (const int i : range(samples.size()))
+    memcpy(buffer.data()+records_offset-sizeof(Vector<super_t,2>)*(samples.size()-i),&samples[i].wins,
+           sizeof(Vector<super_t,2>));
+  for (const int b : range(int(infos.size()))) {
+    block_record_t record;
+    memset(&record,0,sizeof(record));
+    record.section = infos[b]->section;
+    record.block = infos[b]->block;
+    record.missing_dimensions = infos[b]->missing_dimensions;
+    record.size = sizes[b];
+    memcpy(buffer.data()+records_offset+sizeof(block_record_t)*b,&record,sizeof(record));
+  }
+
+  // Write to a temporary file, truncating any leftovers from a previous attempt
+  const auto tmp = filename+".tmp";
+  MPI_File file;
+  const int r = MPI_File_open(comm,(char*)tmp.c_str(),MPI_MODE_WRONLY|MPI_MODE_CREATE,MPI_INFO_NULL,&file);
+  if (r != MPI_SUCCESS)
+    die("failed to open '%s' for writing: %s",tmp,error_string(r));
+  CHECK(MPI_File_set_size(file,total));
+  CHECK(MPI_File_write_at_all(file,offset,buffer.data(),buffer.size(),MPI_BYTE,MPI_STATUS_IGNORE));
+  buffer.clean_memory();
+
+  // Copy block data out of the store a chunk at a time.  Writes are collective, so ranks with fewer
+  // chunks join the remaining rounds with empty writes.
+  const auto starts = data_chunks(sizes,chunk_bytes);
+  const int rounds = data_rounds(comm,starts);
+  uint64_t next = offset+data_offset;
+  for (const int round : range(rounds)) {
+    Array<uint8_t> chunk;
+    if (round+1 < int(starts.size())) {
+      uint64_t size = 0;
+      for (const int b : range(starts[round],starts[round+1]))
+        size += sizes[b];
+      chunk = Array<uint8_t>(CHECK_CAST_INT(size),uninit);
+      int c = 0;
+      for (const int b : range(starts[round],starts[round+1])) {
+        compacting_store_t::lock_t alock(blocks.store,b);
+        const auto data = alock.get();
+        GEODE_ASSERT(uint32_t(data.size())==sizes[b]);
+        memcpy(chunk.data()+c,data.data(),data.size());
+        c += data.size();
+      }
+    }
+    CHECK(MPI_File_write_at_all(file,next,chunk.data(),chunk.size(),MPI_BYTE,MPI_STATUS_IGNORE));
+    next += chunk.size();
+  }
+  GEODE_ASSERT(next==offset+data_offset+data_size);
+  CHECK(MPI_File_close(&file));
+
+  // Atomically replace the previous checkpoint
+  if (!rank && rename(tmp.c_str(),filename.c_str()) < 0)
+    die("failed to rename checkpoint '%s' to '%s': %s",tmp,filename,strerror(errno));
+  CHECK(MPI_Barrier(comm));
+  slog("checkpoint: slice %d, epoch %d of %d, size %s, rounds %d, file %s",blocks.sections->slice,epoch,
+       epochs,large(total),rounds,filename);
+}
+
+checkpoint_t read_checkpoint_header(const MPI_Comm comm, const string& filename) {
+  header_t header;
+  if (!comm_rank(comm)) {
+    FILE* file = fopen(filename.c_str(),"rb");
+    if (!file)
+      die("failed to open checkpoint '%s': %s",filename,strerror(errno));
+    const bool success = fread(&header,sizeof(header),1,file)==1;
+    fclose(file);
+    if (!success)
+      die("checkpoint '%s' is truncated",filename);
+    if (memcmp(header.magic,magic,sizeof(header.magic)))
+      die("'%s' is not a checkpoint file",filename);
+    if (header.version!=version)
+      die("checkpoint '%s' has version %d, expected %d",filename,header.version,version);
+  }
+  CHECK(MPI_Bcast(&header,sizeof(header),MPI_BYTE,0,comm));
+  checkpoint_t checkpoint;
+  checkpoint.slice = header.slice;
+  checkpoint.epoch = header.epoch;
+  checkpoint.epochs = header.epochs;
+  return checkpoint;
+}
+
+checkpoint_t read_checkpoint(const MPI_Comm comm, const string& filename, accumulating_block_store_t& blocks,
+                             RawArray<const line_t> lines, const uint64_t chunk_bytes) {
+  Scope scope("read checkpoint");
+  thread_time_t time(read_kind,unevent);
+  const int ranks = comm_size(comm),
+            rank = comm_rank(comm);
+  const auto checkpoint = read_checkpoint_header(comm,filename);
+  if (checkpoint.slice!=blocks.sections->slice)
+    die("checkpoint '%s' is for slice %d, not slice %d",filename,checkpoint.slice,blocks.sections->slice);
+  if (!(0<checkpoint.epoch && checkpoint.epoch<checkpoint.epochs))
+    die("checkpoint '%s' has invalid epoch %d of %d",filename,checkpoint.epoch,checkpoint.epochs);
+
+  // Read offsets
+  MPI_File file;
+  const int r = MPI_File_open(comm,(char*)filename.c_str(),MPI_MODE_RDONLY,MPI_INFO_NULL,&file);
+  if (r != MPI_SUCCESS)
+    die("failed to open '%s' for reading: %s",filename,error_string(r));
+  header_t header;
+  CHECK(MPI_File_read_at_all(file,0,&header,sizeof(header),MPI_BYTE,MPI_STATUS_IGNORE));
+  if (header.ranks!=ranks)
+    die("checkpoint '%s' was written by %d ranks, but we have %d",filename,header.ranks,ranks);
+  Array<uint64_t> offsets(ranks+1);
+  CHECK(MPI_File_read_at_all(file,sizeof(header),offsets.data(),sizeof(uint64_t)*offsets.size(),
+                             MPI_BYTE,MPI_STATUS_IGNORE));
+  const uint64_t start = rank ? offsets[rank] : sizeof(header_t)+sizeof(uint64_t)*offsets.size();
+  GEODE_ASSERT(start<=offsets[rank+1]);
+
+  // Read counts, samples, and block records, whose sizes we know if the partition matches
+  const auto infos = flat_block_infos(blocks);
+  const auto samples = blocks.samples.flat;
+  const auto& section_counts = blocks.section_counts;
+  uint64_t counts[4];
+  const uint64_t records_offset = sizeof(counts) + sizeof(Vector<uint64_t,3>)*section_counts.size()
+                                + sizeof(Vector<super_t,2>)*samples.size(),
+                 data_offset = records_offset + sizeof(block_record_t)*infos.size();
+  Array<uint8_t> buffer(CHECK_CAST_INT(std::min(data_offset,offsets[rank+1]-start)),uninit);
+  CHECK(MPI_File_read_at_all(file,start,buffer.data(),buffer.size(),MPI_BYTE,MPI_STATUS_IGNORE));
+
+  // Verify that the partition and line order match
+  GEODE_ASSERT(uint64_t(buffer.size())>=sizeof(counts));
+  memcpy(counts,buffer.data(),sizeof(counts));
+  if (counts[0]!=infos.size() || counts[1]!=uint64_t(section_counts.size()) ||
+      counts[2]!=uint64_t(samples.size()))
+    die("checkpoint '%s' doesn't match partition: rank %d, blocks %d vs. %d, sections %d vs. %d, "
+        "samples %d vs. %d",filename,rank,counts[0],infos.size(),counts[1],section_counts.size(),
+        counts[2],samples.size());
+  if (counts[3]!=lines_hash(lines))
+    die("checkpoint '%s' doesn't match line order: rank %d, hash %d vs. %d (were the partition or "
+        "line ordering options changed?)",filename,rank,counts[3],lines_hash(lines));
+  GEODE_ASSERT(uint64_t(buffer.size())==data_offset);
+
+  // Restore counts and samples
+  memcpy(section_counts.data(),buffer.data()+sizeof(counts),sizeof(Vector<uint64_t,3>)*section_counts.size());
+  for (const int i : range(samples.size()))
+    memcpy(&samples[i].wins,buffer.data()+records_offset-sizeof(Vector<super_t,2>)*(samples.size()-i),
+           sizeof(Vector<super_t,2>));
+
+  // Check block records
+  Array<uint32_t> sizes(infos.size(),uninit);
+  Array<uint8_t> missing(infos.size(),uninit);
+  uint64_t data_size = 0;
+  for (const int b : range(int(infos.size()))) {
+    const auto& info = *infos[b];
+    block_record_t record;
+    memcpy(&record,buffer.data()+records_offset+sizeof(block_record_t)*b,sizeof(record));
+    if (!(record.section==info.section && record.block==info.block))
+      die("checkpoint '%s' doesn't match partition: rank %d, flat id %d, block %s %s vs. %s %s",filename,rank,
+          b,str(record.section),str(Vector<int,4>(record.block)),str(info.section),str(Vector<int,4>(info.block)));
+    if (record.missing_dimensions&~info.missing_dimensions ||
+        !record.size!=(record.missing_dimensions==info.missing_dimensions))
+      die("checkpoint '%s' is corrupt: rank %d, flat id %d, missing dimensions %d of %d, size %d",filename,
+          rank,b,record.missing_dimensions,info.missing_dimensions,record.size);
+    sizes[b] = record.size;
+    missing[b] = record.missing_dimensions;
+    data_size += record.size;
+  }
+  buffer.clean_memory();
+  if (start+data_offset+data_size!=offsets[rank+1])
+    die("checkpoint '%s' is corrupt: rank %d, data size %d, expected %d",filename,rank,data_size,
+        offsets[rank+1]-start-data_offset);
+
+  // Restore blocks a chunk at a time.  Reads are collective, so ranks with fewer chunks join the
+  // remaining rounds with empty reads.
+  const auto starts = data_chunks(sizes,chunk_bytes);
+  const int rounds = data_rounds(comm,starts);
+  uint64_t next = start+data_offset;
+  for (const int round : range(rounds)) {
+    Array<uint8_t> chunk;
+    if (round+1 < int(starts.size())) {
+      uint64_t size = 0;
+      for (const int b : range(starts[round],starts[round+1]))
+        size += sizes[b];
+      chunk = Array<uint8_t>(CHECK_CAST_INT(size),uninit);
+    }
+    CHECK(MPI_File_read_at_all(file,next,chunk.data(),chunk.size(),MPI_BYTE,MPI_STATUS_IGNORE));
+    next += chunk.size();
+    if (round+1 < int(starts.size())) {
+      int c = 0;
+      for (const int b : range(starts[round],starts[round+1])) {
+        compacting_store_t::lock_t alock(blocks.store,b);
+        GEODE_ASSERT(!alock.get().size());
+        if (sizes[b])
+          alock.set(chunk.slice(c,c+sizes[b]));
+        infos[b]->missing_dimensions = missing[b];
+        c += sizes[b];
+      }
+    }
+  }
+  CHECK(MPI_File_close(&file));
+  slog("checkpoint: slice %d, epoch %d of %d, rounds %d, file %s",checkpoint.slice,checkpoint.epoch,
+       checkpoint.epochs,rounds,filename);
+  return checkpoint;
+}
+
+}
+}
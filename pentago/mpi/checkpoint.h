@@ -0,0 +1,55 @@
+// Line granular checkpoints within a slice
+//
+// --restart works only at slice boundaries, so a failure partway through a large slice loses
+// the whole slice.  To avoid this, a slice can be computed in several epochs, each consisting
+// of a contiguous chunk of every rank's lines.  compute_lines finishes all communication before
+// returning, so between epochs the accumulating block store is consistent: every block holds
+// exactly the contributions from the lines of finished epochs.  We write this partial state to
+// a checkpoint file, and resuming reloads it and computes only the remaining epochs.
+//
+// Blocks are stored in their in memory compressed form, so checkpoints are quick to write but
+// larger than slice files.  A checkpoint can be resumed only with the same number of ranks and
+// the same partition and line order, on machines of the same endianness.  Each rank records a
+// hash of its ordered lines, so resuming with different line options (e.g. --completion-order)
+// dies rather than recomputing the wrong lines.
+#pragma once
+
+#include "pentago/end/block_store.h"
+#include "pentago/end/line.h"
+#include <mpi.h>
+namespace pentago {
+namespace mpi {
+
+using namespace pentago::end;
+
+struct checkpoint_t {
+  int slice;
+  int epoch; // Number of finished epochs
+  int epochs; // Total number of epochs in the slice
+};
+
+// The lines computed during the given epoch
+RawArray<const line_t> epoch_lines(RawArray<const line_t> lines, const int epoch, const int epochs);
+
+// Count the output contributions this rank will receive if every rank computes the given lines.  Collective.
+int epoch_contributions(const MPI_Comm comm, const block_partition_t& partition,
+                        RawArray<const line_t> lines);
+
+// Write a checkpoint of a partially computed slice, given all of this rank's lines in order.  Collective.
+// The data is written to a temporary file and then renamed into place, so a failure during writing
+// leaves any previous checkpoint intact.  Block data is copied out of the store and written in
+// collective rounds of at most chunk_bytes per rank (or one block if larger).
+void write_checkpoint(const MPI_Comm comm, const string& filename, accumulating_block_store_t& blocks,
+                      RawArray<const line_t> lines, const int epoch, const int epochs,
+                      const uint64_t chunk_bytes=uint64_t(1)<<28);
+
+// Read only the header of a checkpoint.  Collective.
+checkpoint_t read_checkpoint_header(const MPI_Comm comm, const string& filename);
+
+// Restore a checkpoint into a freshly constructed block store for the same slice, partition, and lines,
+// reading in rounds of at most chunk_bytes as in write_checkpoint.  Collective.
+checkpoint_t read_checkpoint(const MPI_Comm comm, const string& filename, accumulating_block_store_t& blocks,
+                             RawArray<const line_t> lines, const uint64_t chunk_bytes=uint64_t(1)<<28);
+
+}
+}
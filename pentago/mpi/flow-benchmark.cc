@@ -0,0 +1,176 @@
+// Time compute_lines on in-process virtual ranks
+//
+// Runs the real flow.cc communication logic for one slice of meaningless data with many virtual
+// ranks in a single process, optionally delaying messages to mimic an interconnect.  Virtual ranks
+// share one pool of compute threads, so this measures communication overhead and scaling of the
+// flow logic rather than the speed of a real cluster.  For example,
+//
+//   flow-benchmark --ranks 64 --slice 5 --latency 2e-6 --bandwidth 5e9 --aggregate 65536
+
+#include "pentago/mpi/inproc/slice.h"
+#include "pentago/end/options.h"
+#include "pentago/utility/large.h"
+#include "pentago/utility/log.h"
+#include "pentago/utility/range.h"
+#include "pentago/utility/thread.h"
+#include <getopt.h>
+
+namespace pentago {
+namespace mpi {
+namespace {
+
+using namespace pentago::mpi::inproc;
+
+struct options_t {
+  slice_options_t slice;
+  int threads = -1;
+  int repeats = 1;
+};
+
+options_t parse_options(int argc, char** argv) {
+  options_t o;
+  auto& s = o.slice;
+  static const option options[] = {
+      {"help", no_argument, 0, 'h'},
+      {"ranks", required_argument, 0, 'r'},
+      {"threads", required_argument, 0, 't'},
+      {"slice", required_argument, 0, 's'},
+      {"memory", required_argument, 0, 'm'},
+      {"gather-limit", required_argument, 0, 'g'},
+      {"line-limit", required_argument, 0, 'L'},
+      {"randomize", required_argument, 0, 'R'},
+      {"aggregate", required_argument, 0, 'A'},
+      {"shared-blocks", no_argument, 0, 'X'},
+      {"adaptive-lines", no_argument, 0, 'D'},
+      {"completion-order", no_argument, 0, 'O'},
+      {"latency", required_argument, 0, 'l'},
+      {"bandwidth", required_argument, 0, 'B'},
+      {"repeats", required_argument, 0, 'n'},
+      {0, 0, 0, 0},
+  };
+  const int rank = 0;
+  for (;;) {
+    int option = 0;
+    int c = getopt_long(argc, argv, "hr:t:s:m:", options, &option);
+    if (c == -1) break;  // Out of options
+    switch (c) {
+      case 'h':
+        slog("usage: %s [options...]", argv[0]);
+        slog("Time compute_lines for one slice of meaningless data on in-process virtual ranks.");
+        slog("  -h, --help                Display usage information and quit");
+        slog("  -r, --ranks <n>           Number of virtual ranks (default %d)", s.ranks);
+        slog("  -t, --threads <n>         Compute threads shared by all ranks (default: one per core)");
+        slog("  -s, --slice <n>           Slice to compute from meaningless data for slice n+1 (default %d)", s.slice);
+        slog("  -m, --memory <n>          Line memory limit per rank (default %s)", large(s.memory_limit));
+        slog("      --gather-limit <n>    Maximum number of simultaneous active line gathers (default %d)", s.gather_limit);
+        slog("      --line-limit <n>      Maximum number of simultaneously allocated lines (default %d)", s.line_limit);
+        slog("      --randomize <key>     If nonzero, partition lines and blocks randomly using the given key");
+        slog("      --aggregate <n>       Batch requests and outputs per destination up to n bytes (default off)");
+        slog("      --shared-blocks       Read input blocks of other ranks directly from their heaps");
+        slog("      --adaptive-lines      Adapt the number of allocated lines, starting from --line-limit");
+        slog("      --completion-order    Order lines so that blocks complete as early as possible");
+        slog("      --latency <x>         Message latency in seconds (default 0)");
+        slog("      --bandwidth <x>       Outgoing bandwidth per rank in bytes/s (default unlimited)");
+        slog("      --repeats <n>         Number of timed runs (default %d)", o.repeats);
+        exit(0);
+      PENTAGO_INT_ARG('r', ranks, slice.ranks)
+      PENTAGO_INT_ARG('t', threads, threads)
+      PENTAGO_INT_ARG('s', slice, slice.slice)
+      PENTAGO_INT_ARG('g', gather-limit, slice.gather_limit)
+      PENTAGO_INT_ARG('L', line-limit, slice.line_limit)
+      PENTAGO_INT_ARG('R', randomize, slice.randomize)
+      PENTAGO_INT_ARG('A', aggregate, slice.aggregate)
+      PENTAGO_INT_ARG('n', repeats, repeats)
+      case 'X':
+        s.shared_blocks = true;
+        break;
+      case 'D':
+        s.adaptive_lines = true;
+        break;
+      case 'O':
+        s.completion_order = true;
+        break;
+      case 'm': {
+        char* end;
+        double memory = strtod(optarg, &end);
+        if (!strcmp(end, "MB") || !strcmp(end, "M"))
+          s.memory_limit = uint64_t(memory*pow(2.,20));
+        else if (!strcmp(end,"GB") || !strcmp(end,"G"))
+          s.memory_limit = uint64_t(memory*pow(2.,30));
+        else
+          PENTAGO_OPTION_ERROR("don't understand memory limit \"%s\", use e.g. 1.5GB",optarg);
+        break; }
+      case 'l': case 'B': {
+        char* end;
+        const double x = strtod(optarg, &end);
+        if (!*optarg || *end || !(c=='l' ? x >= 0 : x > 0))
+          PENTAGO_OPTION_ERROR("--%s expected %s number, got '%s'", options[option].name,
+                               c=='l' ? "nonnegative" : "positive", optarg);
+        (c=='l' ? s.network.latency : s.network.bandwidth) = x;
+        break; }
+      default:
+        die("impossible option character %d", c);
+    }
+  }
+  if (s.ranks < 1)
+    PENTAGO_OPTION_ERROR("--ranks %d must be at least 1", s.ranks);
+  if (!(0 <= s.slice && s.slice < 35))
+    PENTAGO_OPTION_ERROR("--slice %d must be in [0,34]", s.slice);
+  if (s.gather_limit < 1)
+    PENTAGO_OPTION_ERROR("--gather-limit %d must be at least 1", s.gather_limit);
+  if (s.line_limit < 2)
+    PENTAGO_OPTION_ERROR("--line-limit %d must be at least 2", s.line_limit);
+  if (s.aggregate && (s.aggregate < 1024 || s.aggregate > (1<<20)))
+    PENTAGO_OPTION_ERROR("--aggregate %d must be 0 or between 1024 and 2^20", s.aggregate);
+  if (o.repeats < 1)
+    PENTAGO_OPTION_ERROR("--repeats %d must be at least 1", o.repeats);
+  if (optind != argc)
+    PENTAGO_OPTION_ERROR("expected no arguments");
+  return o;
+}
+
+void toplevel(int argc, char** argv) {
+  const auto o = parse_options(argc, argv);
+  const auto& s = o.slice;
+  Scope scope("flow benchmark");
+  init_threads(o.threads, 0);
+  {
+    Scope scope("parameters");
+    slog("ranks = %d", s.ranks);
+    slog("threads = %d", o.threads);
+    slog("slice = %d", s.slice);
+    slog("memory limit = %s", large(s.memory_limit));
+    slog("gather limit = %d", s.gather_limit);
+    slog("line limit = %d", s.line_limit);
+    slog("randomize = %d", s.randomize);
+    slog("aggregate = %d", s.aggregate);
+    slog("shared blocks = %d", s.shared_blocks);
+    slog("adaptive lines = %d", s.adaptive_lines);
+    slog("completion order = %d", s.completion_order);
+    slog("network: latency %g s, bandwidth %g B/s", s.network.latency, s.network.bandwidth);
+  }
+  double best = std::numeric_limits<double>::infinity();
+  for (const int i : range(o.repeats)) {
+    const auto results = compute_slice(s);
+    slog("run %d: time = %.4g s, messages = %d, bytes = %s, nodes = %d", i, results.elapsed,
+         results.traffic.messages, large(results.traffic.bytes), results.counts[2]);
+    slog("  block completion: median %.4g s, last %.4g s, store peak %s", results.median_completion,
+         results.last_completion, large(results.peak_store));
+    best = std::min(best, results.elapsed);
+  }
+  slog("best time = %.4g s", best);
+}
+
+}  // namespace
+}  // namespace mpi
+}  // namespace pentago
+
+int main(int argc, char** argv) {
+  try {
+    pentago::mpi::toplevel(argc, argv);
+    return 0;
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+}
@@ -1,10 +1,13 @@
 // Endgame computation structure code with interleaved communication and compute
 
 #include "pentago/mpi/flow.h"
+#include "pentago/end/compacting_store.h"
 #include "pentago/end/compute.h"
+#include "pentago/end/config.h"
 #include "pentago/end/trace.h"
 #include "pentago/mpi/ibarrier.h"
 #include "pentago/mpi/requests.h"
+#include "pentago/mpi/shared_blocks.h"
 #include "pentago/mpi/utility.h"
 #include "pentago/end/fast_compress.h"
 #include "pentago/utility/thread.h"
@@ -16,11 +19,16 @@
 #include "pentago/utility/const_cast.h"
 #include "pentago/utility/curry.h"
 #include "pentago/utility/sqr.h"
+#include <unordered_set>
 namespace pentago {
 namespace mpi {
 
 using std::get;
 using std::make_pair;
+using std::make_tuple;
+using std::max;
+using std::unordered_map;
+using std::unordered_set;
 
 static inline int request_id(local_id_t owner_block_id, uint8_t dimension) {
   return (owner_block_id.id<<2) | dimension;
@@ -58,6 +66,21 @@ struct block_request_t : public boost::noncopyable {
     return pentago::mpi::block_lines_event(section,dimensions,block);
   }
 };
+
+// Messages waiting to be aggregated for one destination rank
+struct message_batch_t {
+  vector<tuple<int,block_request_t*>> requests; // request_id, request
+  vector<tuple<line_details_t*,int,int>> outputs; // line, output block, request_id
+  int output_nodes = 0;
+};
+}
+
+// Aggregated messages have at most this many pieces
+static const int max_batch_pieces = 64;
+
+// Output batches start with a header of piece count followed by (request_id, nodes) pairs, padded to whole nodes
+static inline int batch_header_nodes(const int pieces) {
+  return (sizeof(int)*(1+2*pieces)+sizeof(Vector<super_t,2>)-1)/sizeof(Vector<super_t,2>);
 }
 
 static int total_blocks(RawArray<const line_t> lines) {
@@ -67,12 +90,24 @@ static int total_blocks(RawArray<const line_t> lines) {
   return count;
 }
 
+// Uncompress an input block from another rank's heap directly into a line
+static void absorb_shared(line_details_t* line, const int b, RawArray<const uint8_t> compressed, const event_t event) {
+#if PENTAGO_MPI_COMPRESS
+  const auto block_data = line->input_block_data(b);
+  const auto buffer = local_fast_uncompress(compressed,event);
+  GEODE_ASSERT(buffer.size()+1==block_data.size());
+  memcpy(block_data.data(),buffer.data(),memory_usage(buffer));
+  line->decrement_missing_input_blocks();
+#endif
+}
+
 flow_comms_t::flow_comms_t(MPI_Comm comm)
   : rank(comm_rank(comm))
   , barrier_comm(comm_dup(comm))
   , request_comm(comm_dup(comm))
   , response_comm(comm_dup(comm))
   , output_comm(comm_dup(comm))
+  , batch_comm(comm_dup(comm))
 #if !PENTAGO_MPI_FUNNEL
   , wakeup_comm(comm_dup(MPI_COMM_SELF))
 #endif
@@ -83,6 +118,7 @@ flow_comms_t::~flow_comms_t() {
   CHECK(MPI_Comm_free(&request_comm));
   CHECK(MPI_Comm_free(&response_comm));
   CHECK(MPI_Comm_free(&output_comm));
+  CHECK(MPI_Comm_free(&batch_comm));
 #if !PENTAGO_MPI_FUNNEL
   CHECK(MPI_Comm_free(&wakeup_comm));
 #endif
@@ -109,15 +145,34 @@ struct flow_t {
   // Keep track of how much more stuff has to happen.  This includes both blocks we need to send and those we need to receive.
   ibarrier_countdown_t countdown;
 
-  // Current free memory, line gathers (lines whose input requests have been sent out), and allocated lines
+  // Current free memory, line gathers (lines whose input requests have been sent out), and allocated lines.
+  // In adaptive mode line_target replaces line_limit as the cap, so free_lines may go negative.
   uint64_t free_memory;
   int free_line_gathers;
   int free_lines;
 
+  // Adaptive admission: if on, at most line_target lines are allocated at once, where line_target
+  // starts at line_limit, shrinks with output sends in flight or a full output store, and otherwise
+  // grows until free memory rather than the target limits admission.
+  const bool adaptive_lines;
+  const int line_limit;
+  int line_target;
+  int completions_since_decrease;
+  bool memory_bound; // Whether the last attempt to schedule a line ran out of memory
+  unordered_set<line_details_t*> sending_lines; // Computed lines with unfinished output sends
+
   // Space for persistent message requests
   Vector<Vector<int,2>,wildcard_recv_count> request_buffers;
   Vector<Array<Vector<super_t,2>>,wildcard_recv_count> output_buffers;
 
+  // Requests and outputs waiting to be aggregated, by destination rank.  Flushed once per pass of the communication loop.
+  const int aggregate_bytes;
+  unordered_map<int,message_batch_t> batches;
+  Vector<Array<Vector<super_t,2>>,wildcard_recv_count> batch_buffers;
+
+  // Frozen input blocks of ranks on our node, if available
+  const shared_blocks_t* const shared;
+
   // Wakeup support
 #if !PENTAGO_MPI_FUNNEL
   uint64_t wakeup_buffer;
@@ -125,19 +180,28 @@ struct flow_t {
 
   flow_t(const flow_comms_t& comms, const shared_ptr<const readable_block_store_t> input_blocks,
          accumulating_block_store_t& output_blocks, RawArray<const line_t> lines,
-         const uint64_t memory_limit, const int line_gather_limit, const int line_limit);
+         const int contributions, const uint64_t memory_limit, const int line_gather_limit,
+         const int line_limit, const int aggregate_bytes, const shared_blocks_t* shared,
+         const bool adaptive_lines);
   ~flow_t();
 
   void schedule_lines();
+  void adapt_line_target();
   void post_barrier_recv();
   void post_request_recv(Vector<int,2>* buffer);
   void post_output_recv(Array<Vector<super_t,2>>* buffer);
   void process_barrier(MPI_Status* status);
+  void post_batch_recv(Array<Vector<super_t,2>>* buffer);
   void process_request(Vector<int,2>* buffer, MPI_Status* status);
+  void send_response(const int source, const int request_tag, const dimensions_t dimensions, const int response_tag);
   void process_output(Array<Vector<super_t,2>>* buffer, MPI_Status* status);
+  void process_batch(Array<Vector<super_t,2>>* buffer, MPI_Status* status);
   void process_response(block_request_t* request, MPI_Status* status);
   void send_output(line_details_t* const line, const int b);
+  void send_output_batch(const int owner, message_batch_t& batch);
   void finish_output_send(line_details_t* const line, MPI_Status* status);
+  void finish_output_batch_send(const vector<line_details_t*>& lines, MPI_Status* status);
+  void flush_batches();
 
   // Wakeup support
   typedef line_details_t::wakeup_block_t wakeup_block_t;
@@ -151,15 +215,24 @@ struct flow_t {
 
 flow_t::flow_t(const flow_comms_t& comms, const shared_ptr<const readable_block_store_t> input_blocks,
                accumulating_block_store_t& output_blocks, RawArray<const line_t> lines,
-               const uint64_t memory_limit, const int line_gather_limit, const int line_limit)
+               const int contributions, const uint64_t memory_limit, const int line_gather_limit,
+               const int line_limit, const int aggregate_bytes, const shared_blocks_t* shared,
+               const bool adaptive_lines)
   : comms(comms)
   , input_blocks(input_blocks)
   , output_blocks(output_blocks)
   , next_response_tag(0)
-  , countdown(comms.barrier_comm,requests,barrier_tag,total_blocks(lines)+output_blocks.required_contributions)
+  , countdown(comms.barrier_comm,requests,barrier_tag,total_blocks(lines)+contributions)
   , free_memory(memory_limit)
   , free_line_gathers(line_gather_limit)
   , free_lines(line_limit)
+  , adaptive_lines(adaptive_lines)
+  , line_limit(line_limit)
+  , line_target(line_limit)
+  , completions_since_decrease(0)
+  , memory_bound(false)
+  , aggregate_bytes(aggregate_bytes)
+  , shared(shared)
 {
   GEODE_ASSERT(line_gather_limit<=32); // Make sure linear search through block_requests is okay
   GEODE_ASSERT(free_line_gathers>=1);
@@ -178,6 +251,9 @@ flow_t::flow_t(const flow_comms_t& comms, const shared_ptr<const readable_block_
     post_request_recv(&buffer);
   for (auto& buffer : output_buffers)
     post_output_recv(&buffer);
+  if (aggregate_bytes)
+    for (auto& buffer : batch_buffers)
+      post_batch_recv(&buffer);
 #if !PENTAGO_MPI_FUNNEL
   post_wakeup_recv();
 #endif
@@ -186,8 +262,10 @@ flow_t::flow_t(const flow_comms_t& comms, const shared_ptr<const readable_block_
   schedule_lines();
 
   // Enter communication loop
-  while (!countdown.barrier.done())
+  while (!countdown.barrier.done()) {
+    flush_batches();
     requests.waitsome();
+  }
 
   // Cancel the wildcard receives
   requests.cancel_and_waitall();
@@ -202,12 +280,14 @@ flow_t::~flow_t() {}
 
 void flow_t::schedule_lines() {
   // If there are unscheduled lines, try to schedule them
-  while (free_lines && free_line_gathers && unscheduled_lines.size()) {
+  while (   free_line_gathers && unscheduled_lines.size()
+         && (adaptive_lines ? line_limit-free_lines < line_target : free_lines > 0)) {
     line_details_t* line;
     {
       const line_data_t* preline = unscheduled_lines.back();
       const auto line_memory = preline->memory_usage;
-      if (free_memory < line_memory)
+      memory_bound = free_memory < line_memory;
+      if (memory_bound)
         return;
       // Schedule the line
       thread_time_t time(allocate_line_kind,preline->line.line_event());
@@ -226,6 +306,18 @@ void flow_t::schedule_lines() {
       const auto child_section = line->standard_child_section;
       for (int b : range((int)line->input_blocks)) {
         const auto block = line->input_block(b);
+        // Read blocks owned by ranks on our node in place.  History tracking expects messages, so skip this if it's on.
+        if (shared && !thread_history_enabled()) {
+          const auto [owner, owner_block_id] = input_blocks->partition->find_block(child_section, block);
+          if (shared->contains(owner)) {
+            const auto compressed = shared->get_compressed(owner, owner_block_id);
+            const dimensions_t dimensions(line->section_transform,line->child_dimension);
+            threads_schedule(CPU,curry(absorb_shared,line,b,compressed,block_lines_event(child_section,dimensions,block)));
+            if (!line->decrement_input_responses())
+              free_line_gathers++;
+            continue;
+          }
+        }
         // Check for an existing block request if desired
         block_request_t* block_request = 0;
         static const bool merge_block_requests = !thread_history_enabled();
@@ -254,11 +346,21 @@ void flow_t::schedule_lines() {
             CHECK(MPI_Irecv(block_data.data(),CHECK_CAST_INT(memory_usage(block_data)),MPI_BYTE,owner,response_tag,comms.response_comm,&response_request));
           else
             CHECK(MPI_Irecv((uint64_t*)block_data.data(),8*block_data.size(),datatype<uint64_t>(),owner,response_tag,comms.response_comm,&response_request));
-          // Send request
-          MPI_Request request_request;
+          // Send request, or queue it for aggregation
           const auto request_tag = request_id(owner_block_id,line->child_dimension);
-          CHECK(MPI_Isend((void*)&block_request->request_buffer,2,MPI_INT,owner,request_tag,comms.request_comm,&request_request));
-          requests.free(request_request);
+          if (aggregate_bytes) {
+            auto& batch = batches[owner];
+            batch.requests.push_back(make_tuple(request_tag,block_request));
+            if (batch.requests.size()==max_batch_pieces) {
+              // flush_batches times its own sends
+              time.stop();
+              flush_batches();
+            }
+          } else {
+            MPI_Request request_request;
+            CHECK(MPI_Isend((void*)&block_request->request_buffer,2,MPI_INT,owner,request_tag,comms.request_comm,&request_request));
+            requests.free(request_request);
+          }
           PENTAGO_MPI_TRACE("block request: owner %d, request_tag %d, response_tag %d",owner,request_tag,response_tag);
           requests.add(response_request,curry(&flow_t::process_response,this,block_request));
         }
@@ -287,26 +389,28 @@ void flow_t::post_request_recv(Vector<int,2>* buffer) {
 }
 
 void flow_t::process_request(Vector<int,2>* buffer, MPI_Status* status) {
+  send_response(status->MPI_SOURCE,status->MPI_TAG,request_dimensions(buffer),request_response_tag(buffer));
+  // Repost wildcard receive
+  post_request_recv(buffer);
+}
+
+void flow_t::send_response(const int source, const int request_tag, const dimensions_t dimensions, const int response_tag) {
   GEODE_ASSERT(input_blocks);
-  const local_id_t local_block_id = request_block_id(status->MPI_TAG);
-  const auto dimensions = request_dimensions(buffer);
-  const int response_tag = request_response_tag(buffer);
+  const local_id_t local_block_id = request_block_id(request_tag);
   thread_time_t time(response_send_kind,input_blocks->local_block_lines_event(local_block_id,dimensions));
   PENTAGO_MPI_TRACE("process request: local block %d, dimensions %d",local_block_id.id,dimensions.data);
   // Send block data
   MPI_Request request;
 #if PENTAGO_MPI_COMPRESS
   const auto compressed_data = input_blocks->get_compressed(local_block_id);
-  CHECK(MPI_Isend((void*)compressed_data.data(),compressed_data.size(),MPI_BYTE,status->MPI_SOURCE,response_tag,comms.response_comm,&request));
+  CHECK(MPI_Isend((void*)compressed_data.data(),compressed_data.size(),MPI_BYTE,source,response_tag,comms.response_comm,&request));
 #else
   const auto block_data = input_blocks->get_raw_flat(local_block_id);
-  CHECK(MPI_Isend((void*)block_data.data(),8*block_data.size(),MPI_LONG_LONG_INT,status->MPI_SOURCE,response_tag,comms.response_comm,&request));
+  CHECK(MPI_Isend((void*)block_data.data(),8*block_data.size(),MPI_LONG_LONG_INT,source,response_tag,comms.response_comm,&request));
 #endif
-  PENTAGO_MPI_TRACE("block response: source %d, local block id %d, dimensions %d",status->MPI_SOURCE,local_block_id.id,dimensions.data);
+  PENTAGO_MPI_TRACE("block response: source %d, local block id %d, dimensions %d",source,local_block_id.id,dimensions.data);
   // The barrier tells us when all messages are finished, so we don't need this request
   requests.free(request);
-  // Repost wildcard receive
-  post_request_recv(buffer);
 }
 
 void flow_t::post_output_recv(Array<Vector<super_t,2>>* buffer) {
@@ -365,6 +469,55 @@ void flow_t::process_output(Array<Vector<super_t,2>>* buffer, MPI_Status* status
   post_output_recv(buffer);
 }
 
+void flow_t::post_batch_recv(Array<Vector<super_t,2>>* buffer) {
+  PENTAGO_MPI_TRACE("post batch recv");
+  const int nodes = batch_header_nodes(max_batch_pieces)+(aggregate_bytes+sizeof(Vector<super_t,2>)-1)/sizeof(Vector<super_t,2>);
+  if (!buffer->size())
+    *buffer = large_buffer<Vector<super_t,2>>(nodes,uninit);
+  GEODE_ASSERT(buffer->size()==nodes);
+  MPI_Request request;
+  {
+    thread_time_t time(mpi_kind,unevent);
+    CHECK(MPI_Irecv(buffer->data(),memory_usage(*buffer),MPI_BYTE,MPI_ANY_SOURCE,MPI_ANY_TAG,comms.batch_comm,&request));
+  }
+  requests.add(request,curry(&flow_t::process_batch,this,buffer),true);
+}
+
+// Incoming aggregated requests or outputs.  Each piece is handled as if it had arrived alone.
+void flow_t::process_batch(Array<Vector<super_t,2>>* buffer, MPI_Status* status) {
+  const int count = get_count(status,MPI_BYTE);
+  if (status->MPI_TAG==request_batch_tag) {
+    GEODE_ASSERT(count%sizeof(Vector<int,3>)==0);
+    PENTAGO_MPI_TRACE("process request batch: source %d, count %d",status->MPI_SOURCE,count/sizeof(Vector<int,3>));
+    const auto pieces = (const Vector<int,3>*)buffer->data();
+    for (const int i : range(int(count/sizeof(Vector<int,3>)))) {
+      const auto& r = pieces[i];
+      send_response(status->MPI_SOURCE,r[0],dimensions_t::raw(r[1]),r[2]);
+    }
+  } else {
+    GEODE_ASSERT(status->MPI_TAG==output_batch_tag && !PENTAGO_MPI_COMPRESS_OUTPUTS);
+    const int* header = (const int*)buffer->data();
+    const int pieces = header[0];
+    int next = batch_header_nodes(pieces);
+    PENTAGO_MPI_TRACE("process output batch: source %d, pieces %d",status->MPI_SOURCE,pieces);
+    for (const int i : range(pieces)) {
+      const int tag = header[1+2*i],
+                nodes = header[2+2*i];
+      const local_id_t local_block_id = request_block_id(tag);
+      const uint8_t dimension = request_dimension(tag);
+      thread_time_t time(output_recv_kind,output_blocks.local_block_line_event(local_block_id,dimension));
+      const auto block_data = buffer->slice_own(next,next+nodes);
+      next += nodes;
+      // Schedule an accumulate as soon as possible to conserve memory
+      threads_schedule(CPU,curry(&accumulating_block_store_t::accumulate,&output_blocks,local_block_id,dimension,block_data),true);
+      countdown.decrement();
+    }
+    GEODE_ASSERT(count==int(sizeof(Vector<super_t,2>)*next));
+    buffer->clean_memory();
+  }
+  post_batch_recv(buffer);
+}
+
 #if !PENTAGO_MPI_FUNNEL
 void flow_t::post_wakeup_recv() {
   PENTAGO_MPI_TRACE("post wakeup recv");
@@ -385,13 +538,27 @@ void flow_t::send_output(line_details_t* const line, const int b) {
 #if PENTAGO_MPI_COMPRESS_OUTPUTS
   // Send compressed block
   thread_time_t time(output_send_kind,event);
+  sending_lines.insert(line);
   const auto compressed = line->compressed_output_block_data(b);
   CHECK(MPI_Isend((void*)compressed.data(),compressed.size(),MPI_BYTE,owner,tag,comms.output_comm,&request));
   PENTAGO_MPI_TRACE("send output %p: owner %d, owner block id %d, dimension %d, count %d, tag %d, event 0x%llx",line,owner,owner_block_id.id,line->pre.line.dimension,compressed.size(),tag,event);
 #else
-  // Send without compression
+  // Send without compression, or queue small blocks for aggregation
   thread_time_t time(output_send_kind,event);
+  sending_lines.insert(line);
   const auto block_data = line->output_block_data(b);
+  if (aggregate_bytes && memory_usage(block_data)<=uint64_t(aggregate_bytes/2)) {
+    auto& batch = batches[owner];
+    if (   batch.outputs.size()==max_batch_pieces
+        || sizeof(Vector<super_t,2>)*(batch.output_nodes+block_data.size())>uint64_t(aggregate_bytes)) {
+      // send_output_batch times its own sends
+      time.stop();
+      send_output_batch(owner,batch);
+    }
+    batch.outputs.push_back(make_tuple(line,b,tag));
+    batch.output_nodes += block_data.size();
+    return;
+  }
   CHECK(MPI_Isend((void*)block_data.data(),8*block_data.size(),MPI_LONG_LONG_INT,owner,tag,comms.output_comm,&request));
   PENTAGO_MPI_TRACE("send output %p: owner %d, owner block id %d, dimension %d, count %d, tag %d, event 0x%llx",line,owner,owner_block_id.id,line->pre.line.dimension,block_data.size(),tag,event);
 #endif
@@ -446,21 +613,120 @@ void flow_t::process_wakeup(MPI_Status* status) {
 }
 #endif
 
+// Send queued requests and outputs as one message per kind and destination
+void flow_t::flush_batches() {
+  for (auto& [owner, batch] : batches) {
+    if (batch.requests.size()==1) {
+      // A lone request goes out as a normal request message
+      const auto [request_tag, block_request] = batch.requests[0];
+      MPI_Request request;
+      CHECK(MPI_Isend((void*)&block_request->request_buffer,2,MPI_INT,owner,request_tag,comms.request_comm,&request));
+      requests.free(request);
+    } else if (batch.requests.size()) {
+      thread_time_t time(mpi_kind,unevent);
+      Array<Vector<int,3>> buffer(CHECK_CAST_INT(batch.requests.size()),uninit);
+      for (const int i : range(buffer.size())) {
+        const auto [request_tag, block_request] = batch.requests[i];
+        buffer[i] = Vector<int,3>(request_tag,block_request->request_buffer[0],block_request->request_buffer[1]);
+      }
+      MPI_Request request;
+      CHECK(MPI_Isend((void*)buffer.data(),memory_usage(buffer),MPI_BYTE,owner,request_batch_tag,comms.batch_comm,&request));
+      PENTAGO_MPI_TRACE("send request batch: owner %d, count %d",owner,buffer.size());
+      // The callback holds onto the buffer until the send completes
+      requests.add(request,[buffer](MPI_Status*) {});
+    }
+    send_output_batch(owner,batch);
+  }
+  batches.clear();
+}
+
+void flow_t::send_output_batch(const int owner, message_batch_t& batch) {
+#if !PENTAGO_MPI_COMPRESS_OUTPUTS
+  const int pieces = CHECK_CAST_INT(batch.outputs.size());
+  MPI_Request request;
+  if (pieces==1) {
+    // A lone block goes out as a normal output message
+    const auto [line, b, tag] = batch.outputs[0];
+    const auto block_data = line->output_block_data(b);
+    CHECK(MPI_Isend((void*)block_data.data(),8*block_data.size(),MPI_LONG_LONG_INT,owner,tag,comms.output_comm,&request));
+    requests.add(request,curry(&flow_t::finish_output_send,this,line));
+  } else if (pieces) {
+    // Copy the header and all blocks into one buffer
+    thread_time_t time(mpi_kind,unevent);
+    const int header = batch_header_nodes(pieces);
+    const auto buffer = large_buffer<Vector<super_t,2>>(header+batch.output_nodes,uninit);
+    const auto ints = (int*)buffer.data();
+    ints[0] = pieces;
+    vector<line_details_t*> lines;
+    int next = header;
+    for (const int i : range(pieces)) {
+      const auto [line, b, tag] = batch.outputs[i];
+      const auto block_data = line->output_block_data(b);
+      ints[1+2*i] = tag;
+      ints[2+2*i] = block_data.size();
+      memcpy(buffer.data()+next,block_data.data(),memory_usage(block_data));
+      next += block_data.size();
+      lines.push_back(line);
+    }
+    CHECK(MPI_Isend((void*)buffer.data(),memory_usage(buffer),MPI_BYTE,owner,output_batch_tag,comms.batch_comm,&request));
+    PENTAGO_MPI_TRACE("send output batch: owner %d, pieces %d, nodes %d",owner,pieces,batch.output_nodes);
+    // The callback holds onto the buffer until the send completes
+    requests.add(request,[this,lines,buffer](MPI_Status* status) { finish_output_batch_send(lines,status); });
+  }
+  batch.outputs.clear();
+  batch.output_nodes = 0;
+#endif
+}
+
+void flow_t::finish_output_batch_send(const vector<line_details_t*>& lines, MPI_Status* status) {
+  for (const auto line : lines)
+    finish_output_send(line,status);
+}
+
 void flow_t::finish_output_send(line_details_t* const line, MPI_Status* status) {
   const int remaining = line->decrement_unsent_output_blocks();
   PENTAGO_MPI_TRACE("finish output send %p: %s: remaining %d",line,str(line->pre.line),remaining);
   if (!remaining) {
     PENTAGO_MPI_TRACE("deallocate line %p: %s",line,str(line->pre.line));
     const auto line_memory = line->pre.memory_usage;
+    sending_lines.erase(line);
     delete line;
     free_lines++;
     free_memory += line_memory;
+    adapt_line_target();
     schedule_lines();
   }
   // One step closer...
   countdown.decrement();
 }
 
+// Called whenever a line finishes.  If most allocated lines are only waiting for their output sends,
+// more lines would just hold memory until the network catches up, and as the output store fills
+// garbage collections become more frequent and we approach death by compacting_store_min_free_ratio.
+// In either case, shrink the target by a quarter, at most once per target's worth of completions
+// so that the effect of the last decrease is visible first, but never below two lines (or line_limit,
+// if smaller).  Otherwise, grow the target by one if it (rather than memory) is what limits admission:
+// the target has no ceiling, so free memory is the only hard cap.
+void flow_t::adapt_line_target() {
+  if (!adaptive_lines)
+    return;
+  completions_since_decrease++;
+  const int allocated = line_limit-free_lines;
+  const double free_ratio = output_blocks.store.parent().free_ratio();
+  if (   2*int(sending_lines.size()) > allocated
+      || free_ratio < 4*compacting_store_min_free_ratio) {
+    if (completions_since_decrease >= line_target) {
+      line_target = max(min(2,line_limit),line_target*3/4);
+      completions_since_decrease = 0;
+      PENTAGO_MPI_TRACE("line target down to %d: sending %d, allocated %d, free ratio %g",
+                        line_target,sending_lines.size(),allocated,free_ratio);
+    }
+  } else if (!memory_bound && allocated+1 >= line_target) {
+    line_target++;
+    PENTAGO_MPI_TRACE("line target up to %d",line_target);
+  }
+}
+
 static void absorb_response(block_request_t* request, const int recv_size) {
   const int lines = CHECK_CAST_INT(request->dependent_lines.size());
   GEODE_ASSERT(lines);
@@ -522,9 +788,11 @@ void flow_t::process_response(block_request_t* request, MPI_Status* status) {
 void compute_lines(const flow_comms_t& comms,
                    const shared_ptr<const readable_block_store_t> input_blocks,
                    accumulating_block_store_t& output_blocks, RawArray<const line_t> lines,
-                   const uint64_t memory_limit, const int line_gather_limit, const int line_limit) {
+                   const int contributions, const uint64_t memory_limit, const int line_gather_limit,
+                   const int line_limit, const int aggregate_bytes, const shared_blocks_t* shared,
+                   const bool adaptive_lines) {
   // Everything happens in this helper class
-  flow_t(comms,input_blocks,output_blocks,lines,memory_limit,line_gather_limit,line_limit);
+  flow_t(comms,input_blocks,output_blocks,lines,contributions,memory_limit,line_gather_limit,line_limit,aggregate_bytes,shared,adaptive_lines);
 }
 
 }  // namespace mpi
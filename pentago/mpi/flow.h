@@ -13,6 +13,7 @@ struct line_data_t;
 namespace mpi {
 
 using namespace pentago::end;
+class shared_blocks_t;
 
 // The various communications used by compute_lines, and their associated messages
 struct flow_comms_t : public boost::noncopyable {
@@ -21,6 +22,7 @@ struct flow_comms_t : public boost::noncopyable {
   MPI_Comm request_comm; // Requests for one of our local input blocks.  Tag = request_id, data = int dimensions, int response_tag.
   MPI_Comm response_comm; // Responses to our block requests complete with input block data.  Tag = response_tag, block data.
   MPI_Comm output_comm; // Output data to be merged into one of our local output blocks.  Tag = request_id, block data.
+  MPI_Comm batch_comm; // Aggregated requests or outputs for one rank.  Tag = request_batch_tag or output_batch_tag, see flow.cc.
 #if !PENTAGO_MPI_FUNNEL
   MPI_Comm wakeup_comm; // Wake up messages from a worker thread to the communication thread when a line finishes, possibly after block compression.  Tag = compress_blocks?b:0, data = &line.
 #endif
@@ -35,6 +37,8 @@ struct flow_comms_t : public boost::noncopyable {
 
 // Associated tags
 const int barrier_tag = 1111; // No data
+const int request_batch_tag = 1; // Sequence of (request_id, dimensions, response_tag)
+const int output_batch_tag = 2; // Header of (request_id, bytes) pairs followed by block data
 
 // Compute all given lines.  Each line requires a number of blocks of data from other processors,
 // so for efficiency we overlap communication and compute.  The computation will usually be mostly
@@ -42,11 +46,26 @@ const int barrier_tag = 1111; // No data
 // for a number of lines in parallel, and compute whenever inputs are ready.
 //
 // The number of lines to speculate is controlled by (1) an arbitrary memory limit in bytes and
-// (2) a limit on the number of lines in communication at any given time.
+// (2) a limit on the number of lines in communication at any given time.  If adaptive_lines is set,
+// line_limit is only a starting point: the number of allocated lines adapts to the number of output
+// sends in flight and the free space in output_blocks' store, and may grow past line_limit until
+// memory_limit is reached.
+//
+// contributions is the number of output block contributions this rank will receive from all ranks'
+// lines, which is output_blocks.required_contributions if the lines cover the whole slice.
+//
+// If aggregate_bytes is positive, block requests and small output blocks produced during one pass of
+// the communication loop are coalesced into one message per destination rank, of at most aggregate_bytes
+// bytes.  The receiver dispatches each piece exactly as if it had arrived alone.
+//
+// If shared is nonnull, input blocks owned by ranks on our node are read directly from their heaps
+// instead of being requested.
 void compute_lines(const flow_comms_t& comms,
                    const shared_ptr<const readable_block_store_t> input_blocks,
                    accumulating_block_store_t& output_blocks, RawArray<const line_t> lines,
-                   const uint64_t memory_limit, const int line_gather_limit, const int line_limit);
+                   const int contributions, const uint64_t memory_limit, const int line_gather_limit,
+                   const int line_limit, const int aggregate_bytes=0,
+                   const shared_blocks_t* shared=nullptr, const bool adaptive_lines=false);
 
 }
 }
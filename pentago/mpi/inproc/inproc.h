@@ -0,0 +1,31 @@
+// Run virtual MPI ranks as threads of one process (see inproc/mpi.h)
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <limits>
+namespace pentago {
+namespace mpi {
+namespace inproc {
+
+// Message costs for the in-process transport.  Each rank sends through one link, so a message
+// arrives latency seconds after the link finishes the previous message and its own bytes.
+struct network_t {
+  double latency = 0; // Seconds per message
+  double bandwidth = std::numeric_limits<double>::infinity(); // Bytes per second out of each rank
+};
+
+// Message statistics for one run_ranks call
+struct traffic_t {
+  uint64_t messages = 0; // Point-to-point messages between different ranks
+  uint64_t bytes = 0; // Bytes in those messages
+};
+
+// Call body(rank) on each of ranks threads, with MPI_COMM_WORLD spanning those threads.  Returns
+// once all ranks finish.  Not reentrant: only one group of virtual ranks may exist at a time.
+traffic_t run_ranks(const int ranks, const std::function<void(int)>& body,
+                    const network_t network=network_t());
+
+}  // namespace inproc
+}  // namespace mpi
+}  // namespace pentago
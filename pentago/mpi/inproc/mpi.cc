@@ -0,0 +1,617 @@
+// In-process stand-in for the subset of MPI used by compute_lines
+
+#include "pentago/mpi/inproc/mpi.h"
+#include "pentago/mpi/inproc/inproc.h"
+#include "pentago/utility/debug.h"
+#include "pentago/utility/format.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace pentago;
+using std::max;
+using std::unique_ptr;
+using std::vector;
+typedef std::chrono::steady_clock steady;
+typedef std::unique_lock<std::mutex> lock_t;
+
+struct pentago_inproc_comm {
+  int id;
+  bool self; // MPI_COMM_SELF or one of its duplicates
+
+  // Collective state
+  std::mutex mutex;
+  std::condition_variable cond;
+  int arrived;
+  uint64_t generation;
+  vector<const void*> slots; // One pointer per rank, published by rendezvous
+
+  // Duplicates, in order of creation, and the number each rank has asked for so far
+  vector<pentago_inproc_comm*> children;
+  vector<int> dups;
+};
+
+struct pentago_inproc_request {
+  bool send;
+  steady::time_point ready; // Sends complete at this time
+  bool done;
+
+  // Receives only
+  int comm, source, tag;
+  void* buffer;
+  size_t capacity;
+  MPI_Status status;
+};
+
+struct pentago_inproc_win {
+  vector<char*> bases;
+  vector<MPI_Aint> sizes;
+  MPI_Comm comm;
+};
+
+pentago_inproc_comm pentago_inproc_comm_world, pentago_inproc_comm_self;
+
+namespace {
+
+struct message_t {
+  int comm, source, tag;
+  vector<char> data;
+  steady::time_point ready; // Not receivable until this time
+};
+
+// Messages waiting for each rank, and its posted receives in order
+struct mailbox_t {
+  std::mutex mutex;
+  std::deque<message_t> messages;
+  vector<MPI_Request> recvs;
+};
+
+// State touched only by each rank's own thread
+struct rank_state_t {
+  steady::time_point link_free; // When our outgoing link finishes its current messages
+  uint64_t messages = 0, bytes = 0;
+};
+
+struct world_t {
+  int ranks = 0;
+  pentago::mpi::inproc::network_t network;
+  unique_ptr<mailbox_t[]> mailboxes;
+  unique_ptr<rank_state_t[]> states;
+  std::mutex comms_mutex;
+  vector<unique_ptr<pentago_inproc_comm>> comms; // Duplicates, owned here
+  int next_comm_id = 0;
+};
+world_t world;
+thread_local int current_rank_ = -1;
+
+int current_rank() {
+  GEODE_ASSERT(current_rank_>=0, "MPI call from a thread that isn't a virtual rank");
+  return current_rank_;
+}
+
+void init_comm(pentago_inproc_comm& comm, const bool self) {
+  comm.id = world.next_comm_id++;
+  comm.self = self;
+  comm.arrived = 0;
+  comm.generation = 0;
+  comm.slots.assign(world.ranks, nullptr);
+  comm.children.clear();
+  comm.dups.assign(world.ranks, 0);
+}
+
+int comm_size(MPI_Comm comm) {
+  return comm->self ? 1 : world.ranks;
+}
+
+int comm_rank(MPI_Comm comm) {
+  return comm->self ? 0 : current_rank();
+}
+
+size_t type_size(const MPI_Datatype type) {
+  switch (type) {
+    case MPI_BYTE: case MPI_CHAR: return 1;
+    case MPI_INT: return sizeof(int);
+    case MPI_LONG: return sizeof(long);
+    case MPI_LONG_LONG: return sizeof(long long);
+    case MPI_UNSIGNED_LONG: return sizeof(unsigned long);
+    case MPI_UNSIGNED_LONG_LONG: return sizeof(unsigned long long);
+    case MPI_DOUBLE: return sizeof(double);
+    default: die("inproc: unknown datatype %d", type);
+  }
+}
+
+steady::duration seconds(const double s) {
+  return std::chrono::duration_cast<steady::duration>(std::chrono::duration<double>(s));
+}
+
+// Match posted receives against ready messages, earliest posted receive first.  Call with the
+// mailbox locked.  Messages from one rank become ready in order, so skipping unready messages
+// never lets a message overtake an earlier one from the same source.
+void match(mailbox_t& box) {
+  const auto now = steady::now();
+  for (size_t i=0;i<box.recvs.size();) {
+    const auto r = box.recvs[i];
+    auto m = box.messages.begin();
+    for (;m!=box.messages.end();++m)
+      if (   m->comm==r->comm && m->ready<=now
+          && (r->source==MPI_ANY_SOURCE || r->source==m->source)
+          && (r->tag==MPI_ANY_TAG || r->tag==m->tag))
+        break;
+    if (m==box.messages.end()) {
+      i++;
+      continue;
+    }
+    if (m->data.size()>r->capacity)
+      die("inproc: message of %d bytes truncated to %d bytes, source %d, tag %d",
+          m->data.size(), r->capacity, m->source, m->tag);
+    if (m->data.size())
+      memcpy(r->buffer, m->data.data(), m->data.size());
+    r->status.MPI_SOURCE = m->source;
+    r->status.MPI_TAG = m->tag;
+    r->status.MPI_ERROR = MPI_SUCCESS;
+    r->status.cancelled = 0;
+    r->status.bytes = m->data.size();
+    r->done = true;
+    box.messages.erase(m);
+    box.recvs.erase(box.recvs.begin()+i);
+  }
+}
+
+void progress() {
+  auto& box = world.mailboxes[current_rank()];
+  lock_t lock(box.mutex);
+  match(box);
+}
+
+bool finished(const MPI_Request r) {
+  return r->send ? r->ready<=steady::now() : r->done;
+}
+
+// Wait for every rank of comm.  Call with comm->mutex held.
+void wait_locked(MPI_Comm comm, lock_t& lock) {
+  const auto generation = comm->generation;
+  if (++comm->arrived==comm_size(comm)) {
+    comm->arrived = 0;
+    comm->generation++;
+    comm->cond.notify_all();
+  } else
+    comm->cond.wait(lock, [=]() { return comm->generation!=generation; });
+}
+
+void barrier(MPI_Comm comm) {
+  if (comm_size(comm)==1)
+    return;
+  lock_t lock(comm->mutex);
+  wait_locked(comm, lock);
+}
+
+// Publish a pointer and wait for every rank's.  Each collective must end with a barrier after it
+// is done reading others' data, so that slots aren't overwritten by the next collective too early.
+vector<const void*> rendezvous(MPI_Comm comm, const void* p) {
+  if (comm_size(comm)==1)
+    return vector<const void*>(1, p);
+  lock_t lock(comm->mutex);
+  comm->slots[current_rank()] = p;
+  wait_locked(comm, lock);
+  return comm->slots;
+}
+
+template<class T> void reduce_into(T* x, const T* y, const int count, const MPI_Op op) {
+  for (int i=0;i<count;i++)
+    x[i] = op==MPI_SUM ? x[i]+y[i] : op==MPI_MAX ? max(x[i], y[i]) : std::min(x[i], y[i]);
+}
+
+void reduce_into(void* x, const void* y, const int count, const MPI_Datatype type, const MPI_Op op) {
+  GEODE_ASSERT(op==MPI_SUM || op==MPI_MAX || op==MPI_MIN);
+  switch (type) {
+    case MPI_INT: reduce_into((int*)x, (const int*)y, count, op); break;
+    case MPI_LONG: reduce_into((long*)x, (const long*)y, count, op); break;
+    case MPI_LONG_LONG: reduce_into((long long*)x, (const long long*)y, count, op); break;
+    case MPI_UNSIGNED_LONG: reduce_into((unsigned long*)x, (const unsigned long*)y, count, op); break;
+    case MPI_UNSIGNED_LONG_LONG:
+      reduce_into((unsigned long long*)x, (const unsigned long long*)y, count, op); break;
+    case MPI_DOUBLE: reduce_into((double*)x, (const double*)y, count, op); break;
+    default: die("inproc: can't reduce datatype %d", type);
+  }
+}
+
+// Reduce everyone's data to all ranks, or only root if root>=0
+void reduce(const void* send, void* recv, const int count, const MPI_Datatype type, const MPI_Op op,
+            const int root, MPI_Comm comm) {
+  const size_t bytes = count*type_size(type);
+  const vector<char> mine((const char*)(send==MPI_IN_PLACE ? recv : send),
+                          (const char*)(send==MPI_IN_PLACE ? recv : send)+bytes);
+  const auto all = rendezvous(comm, mine.data());
+  if (root<0 || root==comm_rank(comm)) {
+    vector<char> result((const char*)all[0], (const char*)all[0]+bytes);
+    for (size_t r=1;r<all.size();r++)
+      reduce_into(result.data(), all[r], count, type, op);
+    if (bytes)
+      memcpy(recv, result.data(), bytes);
+  }
+  barrier(comm);
+}
+
+}  // namespace
+
+namespace pentago {
+namespace mpi {
+namespace inproc {
+
+traffic_t run_ranks(const int ranks, const std::function<void(int)>& body, const network_t network) {
+  GEODE_ASSERT(ranks>=1);
+  GEODE_ASSERT(!world.ranks, "inproc::run_ranks is not reentrant");
+  GEODE_ASSERT(network.latency>=0 && network.bandwidth>0);
+  world.ranks = ranks;
+  world.network = network;
+  world.mailboxes.reset(new mailbox_t[ranks]);
+  world.states.reset(new rank_state_t[ranks]);
+  world.next_comm_id = 0;
+  init_comm(pentago_inproc_comm_world, false);
+  init_comm(pentago_inproc_comm_self, true);
+
+  // Run each rank in its own thread
+  vector<std::thread> threads;
+  for (int rank=0;rank<ranks;rank++)
+    threads.emplace_back([&body,rank]() {
+      current_rank_ = rank;
+      try {
+        body(rank);
+      } catch (const std::exception& e) {
+        die("inproc: rank %d failed: %s", rank, e.what());
+      }
+      current_rank_ = -1;
+    });
+  for (auto& thread : threads)
+    thread.join();
+
+  // Every receive should have completed or been cancelled.  Unreceived messages are dropped,
+  // as MPI would for freed communicators: ibarrier_t's root sends itself a final message that
+  // may never be received.
+  traffic_t traffic;
+  for (int rank=0;rank<ranks;rank++) {
+    const auto& box = world.mailboxes[rank];
+    if (box.recvs.size())
+      die("inproc: rank %d finished with %d pending receives", rank, box.recvs.size());
+    traffic.messages += world.states[rank].messages;
+    traffic.bytes += world.states[rank].bytes;
+  }
+  world.comms.clear();
+  world.mailboxes.reset();
+  world.states.reset();
+  world.ranks = 0;
+  return traffic;
+}
+
+}  // namespace inproc
+}  // namespace mpi
+}  // namespace pentago
+
+int MPI_Init_thread(int* argc, char*** argv, int required, int* provided) {
+  *provided = required;
+  return MPI_SUCCESS;
+}
+
+int MPI_Finalize() {
+  return MPI_SUCCESS;
+}
+
+int MPI_Error_string(int code, char* string, int* length) {
+  *length = snprintf(string, MPI_MAX_ERROR_STRING, "inproc error %d", code);
+  return MPI_SUCCESS;
+}
+
+int MPI_Comm_set_errhandler(MPI_Comm comm, MPI_Errhandler handler) {
+  return MPI_SUCCESS;
+}
+
+int MPI_Comm_get_attr(MPI_Comm comm, int key, void* value, int* flag) {
+  static int tag_ub = INT_MAX;
+  *flag = key==MPI_TAG_UB;
+  if (*flag)
+    *(int**)value = &tag_ub;
+  return MPI_SUCCESS;
+}
+
+int MPI_Comm_size(MPI_Comm comm, int* size) {
+  *size = comm_size(comm);
+  return MPI_SUCCESS;
+}
+
+int MPI_Comm_rank(MPI_Comm comm, int* rank) {
+  *rank = comm_rank(comm);
+  return MPI_SUCCESS;
+}
+
+int MPI_Comm_dup(MPI_Comm comm, MPI_Comm* dup) {
+  // Every rank duplicates communicators in the same order, so the nth duplicate is shared
+  const int rank = current_rank();
+  std::lock_guard<std::mutex> lock(world.comms_mutex);
+  const int n = comm->dups[rank]++;
+  if (n==int(comm->children.size())) {
+    world.comms.emplace_back(new pentago_inproc_comm);
+    init_comm(*world.comms.back(), comm->self);
+    comm->children.push_back(world.comms.back().get());
+  }
+  *dup = comm->children[n];
+  return MPI_SUCCESS;
+}
+
+int MPI_Comm_free(MPI_Comm* comm) {
+  // Duplicates live until run_ranks returns
+  *comm = MPI_COMM_NULL;
+  return MPI_SUCCESS;
+}
+
+int MPI_Comm_split_type(MPI_Comm comm, int split_type, int key, MPI_Info info, MPI_Comm* newcomm) {
+  // All virtual ranks share one node
+  GEODE_ASSERT(split_type==MPI_COMM_TYPE_SHARED);
+  return MPI_Comm_dup(comm, newcomm);
+}
+
+int MPI_Isend(const void* buffer, int count, MPI_Datatype datatype, int dest, int tag, MPI_Comm comm,
+              MPI_Request* request) {
+  const int rank = current_rank();
+  const int target = comm->self ? rank : dest;
+  GEODE_ASSERT(0<=target && target<world.ranks && (!comm->self || dest==0));
+  const size_t bytes = count*type_size(datatype);
+  auto& state = world.states[rank];
+  const auto now = steady::now();
+  auto sent = now, ready = now;
+  if (target!=rank) {
+    sent = max(now, state.link_free)+seconds(bytes/world.network.bandwidth);
+    ready = sent+seconds(world.network.latency);
+    state.link_free = sent;
+    state.messages++;
+    state.bytes += bytes;
+  }
+  {
+    auto& box = world.mailboxes[target];
+    lock_t lock(box.mutex);
+    box.messages.push_back(message_t{comm->id, comm_rank(comm), tag,
+                                     vector<char>((const char*)buffer, (const char*)buffer+bytes),
+                                     ready});
+  }
+  *request = new pentago_inproc_request{true, sent, false};
+  return MPI_SUCCESS;
+}
+
+int MPI_Irecv(void* buffer, int count, MPI_Datatype datatype, int source, int tag, MPI_Comm comm,
+              MPI_Request* request) {
+  const auto r = new pentago_inproc_request{false, steady::time_point(), false, comm->id, source, tag,
+                                            buffer, count*type_size(datatype), MPI_Status()};
+  auto& box = world.mailboxes[current_rank()];
+  lock_t lock(box.mutex);
+  box.recvs.push_back(r);
+  match(box);
+  *request = r;
+  return MPI_SUCCESS;
+}
+
+int MPI_Recv(void* buffer, int count, MPI_Datatype datatype, int source, int tag, MPI_Comm comm,
+             MPI_Status* status) {
+  MPI_Request request;
+  MPI_Irecv(buffer, count, datatype, source, tag, comm, &request);
+  return MPI_Waitall(1, &request, status);
+}
+
+int MPI_Testsome(int incount, MPI_Request* requests, int* outcount, int* indices, MPI_Status* statuses) {
+  progress();
+  bool active = false;
+  int n = 0;
+  for (int i=0;i<incount;i++) {
+    const auto r = requests[i];
+    if (!r)
+      continue;
+    active = true;
+    if (finished(r)) {
+      if (statuses)
+        statuses[n] = r->status;
+      indices[n++] = i;
+      delete r;
+      requests[i] = MPI_REQUEST_NULL;
+    }
+  }
+  *outcount = active ? n : MPI_UNDEFINED;
+  // Callers poll, so give other virtual ranks a chance to run
+  if (active && !n)
+    std::this_thread::yield();
+  return MPI_SUCCESS;
+}
+
+int MPI_Waitsome(int incount, MPI_Request* requests, int* outcount, int* indices, MPI_Status* statuses) {
+  do {
+    MPI_Testsome(incount, requests, outcount, indices, statuses);
+  } while (!*outcount);
+  return MPI_SUCCESS;
+}
+
+int MPI_Waitall(int count, MPI_Request* requests, MPI_Status* statuses) {
+  for (;;) {
+    progress();
+    bool active = false;
+    for (int i=0;i<count;i++) {
+      const auto r = requests[i];
+      if (!r)
+        continue;
+      if (finished(r)) {
+        if (statuses)
+          statuses[i] = r->status;
+        delete r;
+        requests[i] = MPI_REQUEST_NULL;
+      } else
+        active = true;
+    }
+    if (!active)
+      return MPI_SUCCESS;
+    std::this_thread::yield();
+  }
+}
+
+int MPI_Cancel(MPI_Request* request) {
+  // Sends are already buffered, so only receives can be cancelled
+  const auto r = *request;
+  if (!r->send) {
+    auto& box = world.mailboxes[current_rank()];
+    lock_t lock(box.mutex);
+    if (!r->done) {
+      box.recvs.erase(std::find(box.recvs.begin(), box.recvs.end(), r));
+      r->done = true;
+      r->status.cancelled = 1;
+    }
+  }
+  return MPI_SUCCESS;
+}
+
+int MPI_Request_free(MPI_Request* request) {
+  GEODE_ASSERT((*request)->send, "inproc: only send requests may be freed");
+  delete *request;
+  *request = MPI_REQUEST_NULL;
+  return MPI_SUCCESS;
+}
+
+int MPI_Get_count(const MPI_Status* status, MPI_Datatype datatype, int* count) {
+  const size_t size = type_size(datatype);
+  *count = status->bytes%size ? MPI_UNDEFINED : int(status->bytes/size);
+  return MPI_SUCCESS;
+}
+
+int MPI_Barrier(MPI_Comm comm) {
+  barrier(comm);
+  return MPI_SUCCESS;
+}
+
+int MPI_Bcast(void* buffer, int count, MPI_Datatype datatype, int root, MPI_Comm comm) {
+  const auto all = rendezvous(comm, buffer);
+  if (comm_rank(comm)!=root && count)
+    memcpy(buffer, all[root], count*type_size(datatype));
+  barrier(comm);
+  return MPI_SUCCESS;
+}
+
+int MPI_Reduce(const void* send, void* recv, int count, MPI_Datatype datatype, MPI_Op op, int root,
+               MPI_Comm comm) {
+  GEODE_ASSERT(root>=0);
+  reduce(send, recv, count, datatype, op, root, comm);
+  return MPI_SUCCESS;
+}
+
+int MPI_Allreduce(const void* send, void* recv, int count, MPI_Datatype datatype, MPI_Op op,
+                  MPI_Comm comm) {
+  reduce(send, recv, count, datatype, op, -1, comm);
+  return MPI_SUCCESS;
+}
+
+int MPI_Allgather(const void* send, int send_count, MPI_Datatype send_type, void* recv,
+                  int recv_count, MPI_Datatype recv_type, MPI_Comm comm) {
+  const int rank = comm_rank(comm);
+  const size_t bytes = recv_count*type_size(recv_type);
+  const auto all = rendezvous(comm, send==MPI_IN_PLACE ? (char*)recv+rank*bytes : send);
+  for (size_t r=0;r<all.size();r++)
+    if (bytes && (send!=MPI_IN_PLACE || int(r)!=rank))
+      memcpy((char*)recv+r*bytes, all[r], bytes);
+  barrier(comm);
+  return MPI_SUCCESS;
+}
+
+int MPI_Allgatherv(const void* send, int send_count, MPI_Datatype send_type, void* recv,
+                   const int* recv_counts, const int* recv_offsets, MPI_Datatype recv_type,
+                   MPI_Comm comm) {
+  const int rank = comm_rank(comm);
+  const size_t size = type_size(recv_type);
+  const auto all = rendezvous(comm, send==MPI_IN_PLACE ? (char*)recv+recv_offsets[rank]*size : send);
+  for (size_t r=0;r<all.size();r++)
+    if (recv_counts[r] && (send!=MPI_IN_PLACE || int(r)!=rank))
+      memcpy((char*)recv+recv_offsets[r]*size, all[r], recv_counts[r]*size);
+  barrier(comm);
+  return MPI_SUCCESS;
+}
+
+int MPI_Alltoallv(const void* send, const int* send_counts, const int* send_offsets,
+                  MPI_Datatype send_type, void* recv, const int* recv_counts,
+                  const int* recv_offsets, MPI_Datatype recv_type, MPI_Comm comm) {
+  struct part_t { const void* send; const int* counts; const int* offsets; size_t size; };
+  const int rank = comm_rank(comm);
+  const part_t mine = {send, send_counts, send_offsets, type_size(send_type)};
+  const auto all = rendezvous(comm, &mine);
+  const size_t size = type_size(recv_type);
+  for (size_t r=0;r<all.size();r++) {
+    const auto& p = *(const part_t*)all[r];
+    const size_t bytes = p.counts[rank]*p.size;
+    GEODE_ASSERT(bytes==recv_counts[r]*size);
+    if (bytes)
+      memcpy((char*)recv+recv_offsets[r]*size, (const char*)p.send+p.offsets[rank]*p.size, bytes);
+  }
+  barrier(comm);
+  return MPI_SUCCESS;
+}
+
+int MPI_Info_create(MPI_Info* info) {
+  *info = 0;
+  return MPI_SUCCESS;
+}
+
+int MPI_Info_set(MPI_Info info, const char* key, const char* value) {
+  return MPI_SUCCESS;
+}
+
+int MPI_Info_free(MPI_Info* info) {
+  return MPI_SUCCESS;
+}
+
+int MPI_Win_allocate_shared(MPI_Aint size, int disp_unit, MPI_Info info, MPI_Comm comm, void* base,
+                            MPI_Win* win) {
+  // Each rank allocates its own part, and everyone records everyone's parts
+  const auto mine = (char*)malloc(max(size, MPI_Aint(1)));
+  GEODE_ASSERT(mine);
+  const std::pair<char*,MPI_Aint> part(mine, size);
+  const auto all = rendezvous(comm, &part);
+  const auto w = new pentago_inproc_win;
+  for (const auto p : all) {
+    w->bases.push_back(((const std::pair<char*,MPI_Aint>*)p)->first);
+    w->sizes.push_back(((const std::pair<char*,MPI_Aint>*)p)->second);
+  }
+  w->comm = comm;
+  barrier(comm);
+  *(char**)base = mine;
+  *win = w;
+  return MPI_SUCCESS;
+}
+
+int MPI_Win_shared_query(MPI_Win win, int rank, MPI_Aint* size, int* disp_unit, void* base) {
+  *size = win->sizes.at(rank);
+  *disp_unit = 1;
+  *(char**)base = win->bases.at(rank);
+  return MPI_SUCCESS;
+}
+
+int MPI_Win_lock_all(int assert, MPI_Win win) {
+  return MPI_SUCCESS;
+}
+
+int MPI_Win_unlock_all(MPI_Win win) {
+  return MPI_SUCCESS;
+}
+
+int MPI_Win_sync(MPI_Win win) {
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  return MPI_SUCCESS;
+}
+
+int MPI_Win_free(MPI_Win* win) {
+  // Wait until no one can be reading our part
+  const auto w = *win;
+  barrier(w->comm);
+  free(w->bases[comm_rank(w->comm)]);
+  delete w;
+  *win = nullptr;
+  return MPI_SUCCESS;
+}
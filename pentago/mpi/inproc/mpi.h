@@ -0,0 +1,135 @@
+// In-process stand-in for the subset of MPI used by compute_lines
+//
+// Each virtual rank is a thread started by inproc::run_ranks (see inproc.h), and messages travel
+// through in-memory mailboxes, optionally delayed by a simple latency and bandwidth model.  This
+// header replaces <mpi.h> for the flow_inproc library in mpi/BUILD, so that flow.cc, ibarrier.cc,
+// requests.cc, and shared_blocks.cc compile unchanged.  Only what they use is provided, together with
+// the common collectives: point-to-point messages with wildcard receives and cancellation,
+// communicator duplication, shared memory windows (all virtual ranks share one node), and barrier,
+// bcast, reduce, allreduce, allgather(v), and alltoallv.  There is no file I/O, general one-sided
+// communication, or derived datatype support.
+//
+// Sends are buffered: the data is copied immediately, and the send completes once the message
+// would have left the sending rank.  As with MPI_THREAD_FUNNELED, only the virtual rank's own
+// thread may make MPI calls.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+typedef struct pentago_inproc_comm* MPI_Comm;
+typedef struct pentago_inproc_request* MPI_Request;
+typedef int MPI_Datatype;
+typedef int MPI_Op;
+typedef int MPI_Errhandler;
+typedef int MPI_Info;
+typedef struct pentago_inproc_win* MPI_Win;
+typedef ptrdiff_t MPI_Aint;
+
+typedef struct MPI_Status {
+  int MPI_SOURCE;
+  int MPI_TAG;
+  int MPI_ERROR;
+  int cancelled;
+  size_t bytes;
+} MPI_Status;
+
+extern struct pentago_inproc_comm pentago_inproc_comm_world, pentago_inproc_comm_self;
+#define MPI_COMM_WORLD (&pentago_inproc_comm_world)
+#define MPI_COMM_SELF (&pentago_inproc_comm_self)
+#define MPI_COMM_NULL ((MPI_Comm)0)
+#define MPI_REQUEST_NULL ((MPI_Request)0)
+#define MPI_STATUS_IGNORE ((MPI_Status*)0)
+#define MPI_STATUSES_IGNORE ((MPI_Status*)0)
+#define MPI_IN_PLACE ((void*)1)
+#define MPI_INFO_NULL 0
+
+enum {
+  MPI_SUCCESS = 0,
+  MPI_ERR_OTHER = 1,
+  MPI_ANY_SOURCE = -1,
+  MPI_ANY_TAG = -1,
+  MPI_UNDEFINED = -32766,
+  MPI_MAX_ERROR_STRING = 256,
+  MPI_TAG_UB = 1,
+  MPI_ERRORS_RETURN = 1,
+  MPI_COMM_TYPE_SHARED = 1,
+  MPI_MODE_NOCHECK = 1,
+};
+
+enum {
+  MPI_THREAD_SINGLE,
+  MPI_THREAD_FUNNELED,
+  MPI_THREAD_SERIALIZED,
+  MPI_THREAD_MULTIPLE,
+};
+
+// Datatypes and operations
+enum {
+  MPI_BYTE,
+  MPI_CHAR,
+  MPI_INT,
+  MPI_LONG,
+  MPI_LONG_LONG,
+  MPI_UNSIGNED_LONG,
+  MPI_UNSIGNED_LONG_LONG,
+  MPI_DOUBLE,
+};
+#define MPI_LONG_LONG_INT MPI_LONG_LONG
+enum { MPI_SUM, MPI_MAX, MPI_MIN };
+
+// Environment
+int MPI_Init_thread(int* argc, char*** argv, int required, int* provided);
+int MPI_Finalize();
+int MPI_Error_string(int code, char* string, int* length);
+int MPI_Comm_set_errhandler(MPI_Comm comm, MPI_Errhandler handler);
+int MPI_Comm_get_attr(MPI_Comm comm, int key, void* value, int* flag);
+
+// Communicators
+int MPI_Comm_size(MPI_Comm comm, int* size);
+int MPI_Comm_rank(MPI_Comm comm, int* rank);
+int MPI_Comm_dup(MPI_Comm comm, MPI_Comm* dup);
+int MPI_Comm_free(MPI_Comm* comm);
+int MPI_Comm_split_type(MPI_Comm comm, int split_type, int key, MPI_Info info, MPI_Comm* newcomm);
+
+// Point-to-point
+int MPI_Isend(const void* buffer, int count, MPI_Datatype datatype, int dest, int tag, MPI_Comm comm,
+              MPI_Request* request);
+int MPI_Irecv(void* buffer, int count, MPI_Datatype datatype, int source, int tag, MPI_Comm comm,
+              MPI_Request* request);
+int MPI_Recv(void* buffer, int count, MPI_Datatype datatype, int source, int tag, MPI_Comm comm,
+             MPI_Status* status);
+int MPI_Testsome(int incount, MPI_Request* requests, int* outcount, int* indices, MPI_Status* statuses);
+int MPI_Waitsome(int incount, MPI_Request* requests, int* outcount, int* indices, MPI_Status* statuses);
+int MPI_Waitall(int count, MPI_Request* requests, MPI_Status* statuses);
+int MPI_Cancel(MPI_Request* request);
+int MPI_Request_free(MPI_Request* request);
+int MPI_Get_count(const MPI_Status* status, MPI_Datatype datatype, int* count);
+
+// Collectives
+int MPI_Barrier(MPI_Comm comm);
+int MPI_Bcast(void* buffer, int count, MPI_Datatype datatype, int root, MPI_Comm comm);
+int MPI_Reduce(const void* send, void* recv, int count, MPI_Datatype datatype, MPI_Op op, int root,
+               MPI_Comm comm);
+int MPI_Allreduce(const void* send, void* recv, int count, MPI_Datatype datatype, MPI_Op op,
+                  MPI_Comm comm);
+int MPI_Allgather(const void* send, int send_count, MPI_Datatype send_type, void* recv,
+                  int recv_count, MPI_Datatype recv_type, MPI_Comm comm);
+int MPI_Allgatherv(const void* send, int send_count, MPI_Datatype send_type, void* recv,
+                   const int* recv_counts, const int* recv_offsets, MPI_Datatype recv_type,
+                   MPI_Comm comm);
+int MPI_Alltoallv(const void* send, const int* send_counts, const int* send_offsets,
+                  MPI_Datatype send_type, void* recv, const int* recv_counts,
+                  const int* recv_offsets, MPI_Datatype recv_type, MPI_Comm comm);
+
+// Shared memory windows
+int MPI_Info_create(MPI_Info* info);
+int MPI_Info_set(MPI_Info info, const char* key, const char* value);
+int MPI_Info_free(MPI_Info* info);
+int MPI_Win_allocate_shared(MPI_Aint size, int disp_unit, MPI_Info info, MPI_Comm comm, void* base,
+                            MPI_Win* win);
+int MPI_Win_shared_query(MPI_Win win, int rank, MPI_Aint* size, int* disp_unit, void* base);
+int MPI_Win_lock_all(int assert, MPI_Win win);
+int MPI_Win_unlock_all(MPI_Win win);
+int MPI_Win_sync(MPI_Win win);
+int MPI_Win_free(MPI_Win* win);
@@ -0,0 +1,115 @@
+// Compute one slice with compute_lines on in-process virtual ranks
+
+#include "pentago/mpi/inproc/slice.h"
+#include "pentago/mpi/flow.h"
+#include "pentago/mpi/shared_blocks.h"
+#include "pentago/mpi/utility.h"
+#include "pentago/base/count.h"
+#include "pentago/end/check.h"
+#include "pentago/end/compacting_store.h"
+#include "pentago/end/line.h"
+#include "pentago/end/partition.h"
+#include "pentago/end/predict.h"
+#include "pentago/end/random_partition.h"
+#include "pentago/end/sections.h"
+#include "pentago/end/simple_partition.h"
+#include "pentago/utility/hash.h"
+#include "pentago/utility/wall_time.h"
+#include <algorithm>
+#include <mutex>
+namespace pentago {
+namespace mpi {
+namespace inproc {
+
+using std::make_shared;
+using std::make_tuple;
+using std::max;
+using std::unique_ptr;
+
+slice_results_t compute_slice(const slice_options_t& o) {
+  GEODE_ASSERT(o.ranks>=1 && o.slice>=0 && o.slice<35);
+  const auto slices = descendent_sections(section_t(), o.slice+1);
+  const auto partition_factory = [&o](const shared_ptr<const sections_t>& sections)
+      -> shared_ptr<const partition_t> {
+    if (o.randomize)
+      return make_shared<random_partition_t>(o.randomize, o.ranks, sections);
+    return make_shared<simple_partition_t>(o.ranks, sections, false);
+  };
+  const auto prev_partition = partition_factory(slices[o.slice+1]),
+             partition = partition_factory(slices[o.slice]);
+
+  // Virtual ranks share the logging state, so setup and teardown hold a lock
+  std::mutex setup_mutex, results_mutex;
+  slice_results_t results;
+  vector<double> completions;
+  results.traffic = run_ranks(o.ranks, [&](const int rank) {
+    const uint64_t heap_size = max(uint64_t(1)<<26, estimate_block_heap_size(*prev_partition, rank) +
+                                                    estimate_block_heap_size(*partition, rank));
+    unique_ptr<shared_heap_t> heap;
+    if (o.shared_blocks)
+      heap.reset(new shared_heap_t(MPI_COMM_WORLD, heap_size));
+    const auto store = heap ? make_shared<compacting_store_t>(heap->heap)
+                            : make_shared<compacting_store_t>(heap_size);
+    shared_ptr<const readable_block_store_t> inputs;
+    shared_ptr<accumulating_block_store_t> outputs;
+    {
+      std::lock_guard<std::mutex> lock(setup_mutex);
+      inputs = meaningless_block_store(prev_partition, rank, 0, store);
+      outputs = make_shared<accumulating_block_store_t>(partition, rank, partition->rank_blocks(rank),
+                                                        0, store);
+    }
+    unique_ptr<const shared_blocks_t> shared;
+    if (heap)
+      shared.reset(new shared_blocks_t(*heap, *inputs));
+
+    // Compute
+    const flow_comms_t comms(MPI_COMM_WORLD);
+    CHECK(MPI_Barrier(MPI_COMM_WORLD));
+    const auto start = wall_time();
+    const auto lines = o.completion_order ? completion_order(partition->rank_lines(rank))
+                                          : partition->rank_lines(rank);
+    compute_lines(comms, inputs, *outputs, lines, outputs->required_contributions,
+                  o.memory_limit, o.gather_limit, o.line_limit, o.aggregate, shared.get(),
+                  o.adaptive_lines);
+    const double elapsed = (wall_time()-start).seconds();
+
+    // compute_lines ends with a barrier, so no one is still reading our inputs
+    shared.reset();
+    inputs.reset();
+    {
+      std::lock_guard<std::mutex> lock(setup_mutex);
+      outputs->store.freeze();
+    }
+
+    // Summarize our outputs
+    const auto counts = sum_section_counts(partition->sections->sections, outputs->section_counts);
+    vector<tuple<tuple<section_t,Vector<uint8_t,4>>,string>> hashes;
+    for (const auto& [local_id, info] : outputs->block_infos)
+      hashes.push_back(make_tuple(make_tuple(info.section, info.block),
+                                  portable_hash(outputs->uncompress_and_get_flat(local_id, unevent))));
+    {
+      std::lock_guard<std::mutex> lock(results_mutex);
+      results.elapsed = max(results.elapsed, elapsed);
+      results.peak_store = max(results.peak_store, store->peak_live());
+      for (const auto t : outputs->completion_times)
+        completions.push_back((t-start).seconds());
+      results.counts += counts;
+      for (const auto& [block, hash] : hashes)
+        GEODE_ASSERT(results.hashes.emplace(block, hash).second);
+    }
+
+    // Make sure no one is still reading our heap before it goes away
+    outputs.reset();
+    CHECK(MPI_Barrier(MPI_COMM_WORLD));
+  }, o.network);
+  if (completions.size()) {
+    std::sort(completions.begin(), completions.end());
+    results.median_completion = completions[completions.size()/2];
+    results.last_completion = completions.back();
+  }
+  return results;
+}
+
+}  // namespace inproc
+}  // namespace mpi
+}  // namespace pentago
@@ -0,0 +1,52 @@
+// Compute one slice with compute_lines on in-process virtual ranks
+//
+// Each virtual rank gets meaningless input blocks for slice+1 and computes its lines of slice
+// exactly as toplevel.cc would, but without checkpoints, samples, or I/O.  The results are
+// independent of the number of ranks, the partition, and the network model, so comparing runs
+// checks the communication logic of flow.cc, and timing them shows how it scales.
+#pragma once
+
+#include "pentago/mpi/inproc/inproc.h"
+#include "pentago/base/section.h"
+#include "pentago/utility/vector.h"
+#include <boost/functional/hash.hpp>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+namespace pentago {
+namespace mpi {
+namespace inproc {
+
+using std::string;
+using std::tuple;
+using std::unordered_map;
+
+struct slice_options_t {
+  int ranks = 1;
+  int slice = 4; // Output slice
+  int randomize = 0; // If nonzero, use random partitions with this key
+  uint64_t memory_limit = uint64_t(1)<<30; // Line memory per rank
+  int gather_limit = 32;
+  int line_limit = 32;
+  int aggregate = 0;
+  bool shared_blocks = false;
+  bool adaptive_lines = false;
+  bool completion_order = false;
+  network_t network;
+};
+
+struct slice_results_t {
+  double elapsed = 0; // Seconds spent in compute_lines, maximized over ranks
+  double median_completion = 0, last_completion = 0; // Seconds until blocks complete, over all blocks
+  uint64_t peak_store = 0; // Peak size of live store data, maximized over ranks
+  traffic_t traffic;
+  Vector<uint64_t,3> counts; // Win/(win-or-tie)/total counts summed over the slice
+  unordered_map<tuple<section_t,Vector<uint8_t,4>>,string,
+                boost::hash<tuple<section_t,Vector<uint8_t,4>>>> hashes; // Hash of each output block
+};
+
+slice_results_t compute_slice(const slice_options_t& o);
+
+}  // namespace inproc
+}  // namespace mpi
+}  // namespace pentago
@@ -0,0 +1,103 @@
+// Tests of compute_lines on in-process virtual ranks
+
+#include "pentago/mpi/inproc/slice.h"
+#include "pentago/utility/log.h"
+#include "pentago/utility/thread.h"
+#include "gtest/gtest.h"
+
+namespace pentago {
+namespace mpi {
+namespace {
+
+using namespace pentago::mpi::inproc;
+
+const slice_results_t& serial(const int slice) {
+  static unordered_map<int,slice_results_t> results;
+  auto it = results.find(slice);
+  if (it == results.end()) {
+    slice_options_t o;
+    o.slice = slice;
+    it = results.emplace(slice, compute_slice(o)).first;
+  }
+  return it->second;
+}
+
+// Compare against a single rank, which does no communication
+void flow_test(const slice_options_t& o) {
+  init_threads(-1, -1);
+  const auto& expected = serial(o.slice);
+  const auto results = compute_slice(o);
+  slog("ranks %d, slice %d: elapsed %g s, %d messages, %d bytes", o.ranks, o.slice, results.elapsed,
+       results.traffic.messages, results.traffic.bytes);
+  ASSERT_EQ(results.counts, expected.counts);
+  ASSERT_EQ(results.hashes.size(), expected.hashes.size());
+  for (const auto& [block, hash] : expected.hashes)
+    ASSERT_EQ(results.hashes.at(block), hash);
+  if (o.ranks > 1) {
+    ASSERT_GT(results.traffic.messages, 0);
+  }
+}
+
+slice_options_t options(const int ranks, const int slice) {
+  slice_options_t o;
+  o.ranks = ranks;
+  o.slice = slice;
+  return o;
+}
+
+TEST(inproc, simple) {
+  for (const int ranks : {2, 7, 16})
+    flow_test(options(ranks, 4));
+}
+
+TEST(inproc, random) {
+  auto o = options(32, 4);
+  o.randomize = 17;
+  flow_test(o);
+}
+
+TEST(inproc, limits) {
+  auto o = options(8, 4);
+  o.gather_limit = o.line_limit = 1;
+  flow_test(o);
+}
+
+TEST(inproc, network) {
+  auto o = options(8, 4);
+  o.network.latency = 1e-4;
+  o.network.bandwidth = 1e9;
+  flow_test(o);
+}
+
+TEST(inproc, aggregate) {
+  auto o = options(16, 4);
+  o.randomize = 17;
+  o.aggregate = 4096;
+  o.network.latency = 1e-4;
+  flow_test(o);
+}
+
+TEST(inproc, adaptive_lines) {
+  auto o = options(8, 4);
+  o.adaptive_lines = true;
+  o.line_limit = 64;
+  o.network.bandwidth = 1e8;
+  flow_test(o);
+}
+
+TEST(inproc, completion_order) {
+  auto o = options(8, 4);
+  o.randomize = 17;
+  o.completion_order = true;
+  flow_test(o);
+}
+
+TEST(inproc, shared_blocks) {
+  auto o = options(8, 4);
+  o.shared_blocks = true;
+  flow_test(o);
+}
+
+}  // namespace
+}  // namespace mpi
+}  // namespace pentago
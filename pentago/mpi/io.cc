@@ -17,6 +17,9 @@
 #include "pentago/utility/random.h"
 #include "pentago/utility/curry.h"
 #include "pentago/utility/log.h"
+#include "pentago/utility/large.h"
+#include "pentago/utility/wall_time.h"
+#include <algorithm>
 #include <sys/stat.h>
 namespace pentago {
 namespace mpi {
@@ -94,12 +97,92 @@ static void file_open(const MPI_Comm comm, const string& filename, MPI_File* fil
     die("failed to open '%s' for writing: %s",filename,error_string(r));
 }
 
+static Array<const local_id_t> flat_local_ids(const readable_block_store_t& blocks) {
+  Array<local_id_t> local_ids(blocks.total_blocks(),uninit);
+  for (const auto& info : blocks.block_infos)
+    local_ids[get<1>(info).flat_id] = get<0>(info);
+  return local_ids;
+}
+
+compressed_sections_t::compressed_sections_t(const readable_block_store_t& blocks, const int level,
+                                             const uint64_t memory_limit)
+  : blocks(blocks)
+  , level(level)
+  , memory_limit(memory_limit)
+  , local_ids(flat_local_ids(blocks))
+  , compressed(local_ids.size())
+  , next(0)
+  , memory(0)
+  , stopping(false) {
+  // Start one chain of background jobs per IO thread.  Each job compresses one block and schedules
+  // the next, so that compression interleaves with other I/O.  Chains stay off the CPU pool, since
+  // any wait on that pool would also wait for the entire backlog.
+  if (memory_limit) {
+    const int io_threads = thread_counts()[1];
+    GEODE_ASSERT(io_threads, "write ahead compression requires IO threads");
+    for (int i=0;i<io_threads;i++)
+      threads_schedule(IO, curry(&compressed_sections_t::background, this));
+  }
+}
+
+compressed_sections_t::~compressed_sections_t() {
+  // Background jobs refer to us
+  stop();
+  threads_wait_all();
+}
+
+void compressed_sections_t::stop() {
+  spin_t spin(lock);
+  stopping = true;
+}
+
+void compressed_sections_t::compress_block(const int b) {
+  const bool turn = blocks.partition->sections->slice&1;
+#if PENTAGO_MPI_COMPRESS
+  filter_and_compress_and_store(&compressed[b], &blocks, local_ids[b], level, turn);
+#else
+  filter_and_compress_and_store(&compressed[b], blocks.get_raw_flat(local_ids[b]), level, turn);
+#endif
+}
+
+void compressed_sections_t::background() {
+  int b;
+  {
+    spin_t spin(lock);
+    if (stopping || next==local_ids.size() || memory>=memory_limit)
+      return;
+    b = next++;
+  }
+  compress_block(b);
+  {
+    spin_t spin(lock);
+    memory += compressed[b].size();
+  }
+  threads_schedule(IO, curry(&compressed_sections_t::background, this));
+}
+
+void compressed_sections_t::finish() {
+  // Stop the chains so that we wait only for blocks already in flight, then fan out the rest
+  stop();
+  threads_wait_all();
+  for (const int b : range(next, local_ids.size()))
+    threads_schedule(CPU, curry(&compressed_sections_t::compress_block, this, b));
+  next = local_ids.size();
+  threads_wait_all_help();
+}
+
 void write_sections(const MPI_Comm comm, const string& filename, const readable_block_store_t& blocks, const int level) {
+  compressed_sections_t local(blocks, level, 0);
+  write_sections(comm, filename, local);
+}
+
+void write_sections(const MPI_Comm comm, const string& filename, compressed_sections_t& local) {
   const int ranks = comm_size(comm),
             rank = comm_rank(comm);
+  const auto& blocks = local.blocks;
+  const int level = local.level;
   const auto& partition = *blocks.partition;
   const int filter = 1; // interleave filtering
-  const bool turn = partition.sections->slice&1;
   const event_t event = unevent;
 
   // Open the file
@@ -109,21 +192,13 @@ void write_sections(const MPI_Comm comm, const string& filename, const readable_
     file_open(comm,filename,&file);
   }
 
-  // Compress all local data
+  // Compress whatever wasn't compressed ahead of time
+  local.finish();
   const int local_blocks = blocks.total_blocks();
   Array<const block_info_t*> flat_info(local_blocks); // Allow indexing by flat_id
-  vector<Array<uint8_t>> compressed(local_blocks);
-  for (const auto& info : blocks.block_infos) {
+  for (const auto& info : blocks.block_infos)
     flat_info[get<1>(info).flat_id] = &get<1>(info);
-#if PENTAGO_MPI_COMPRESS
-    threads_schedule(CPU, curry(filter_and_compress_and_store, &compressed[get<1>(info).flat_id],
-                                &blocks, get<0>(info), level, turn));
-#else
-    threads_schedule(CPU, curry(filter_and_compress_and_store, &compressed[get<1>(info).flat_id],
-                                blocks.get_raw_flat(get<0>(info)), level, turn));
-#endif
-  }
-  threads_wait_all_help();
+  auto& compressed = local.compressed;
 
   // Determine the base offset of each rank
   const auto sections = partition.sections->sections.raw();
@@ -397,96 +472,125 @@ static ReadSectionsStart read_sections_start(const MPI_Comm comm, const string&
   return ReadSectionsStart(partition,local_blocks,blobs);
 }
 
+// Group local blobs into chunks of at most chunk_bytes compressed bytes (or one blob if larger),
+// each sorted by file offset so that a chunk can be read through a single file view.
+static vector<vector<int>> read_chunks(RawArray<const supertensor_blob_t> blobs, const uint64_t chunk_bytes) {
+  vector<int> order(blobs.size());
+  for (const int b : range(blobs.size()))
+    order[b] = b;
+  std::sort(order.begin(), order.end(), [&](const int a, const int b) {
+    return blobs[a].offset < blobs[b].offset; });
+  vector<vector<int>> chunks;
+  uint64_t size = 0;
+  for (const int b : order) {
+    if (chunks.empty() || size+blobs[b].compressed_size > chunk_bytes) {
+      chunks.emplace_back();
+      size = 0;
+    }
+    chunks.back().push_back(b);
+    size += blobs[b].compressed_size;
+  }
+  return chunks;
+}
+
+// Collectively read the given blobs into one contiguous buffer.  Each rank may pass any set of blobs,
+// including none, as long as they are sorted by offset.
+static Array<uint8_t> read_blobs(const MPI_File file, RawArray<const supertensor_blob_t> blobs,
+                                 const vector<int>& chunk) {
+  vector<int> sizes;
+  vector<MPI_Aint> offsets;
+  uint64_t total = 0;
+  for (const int b : chunk) {
+    sizes.push_back(CHECK_CAST_INT(blobs[b].compressed_size));
+    offsets.push_back(MPI_Aint(blobs[b].offset));
+    total += blobs[b].compressed_size;
+  }
+  Array<uint8_t> buffer(CHECK_CAST_INT(total),uninit);
+  MPI_Datatype type;
+  CHECK(MPI_Type_create_hindexed(CHECK_CAST_INT(chunk.size()),sizes.data(),offsets.data(),MPI_BYTE,&type));
+  CHECK(MPI_Type_commit(&type));
+  CHECK(MPI_File_set_view(file,0,MPI_BYTE,type,(char*)"native",MPI_INFO_NULL));
+  CHECK(MPI_File_read_all(file,buffer.data(),buffer.size(),MPI_BYTE,MPI_STATUS_IGNORE));
+  CHECK(MPI_Type_free(&type));
+  return buffer;
+}
+
 shared_ptr<const readable_block_store_t> read_sections(
     const MPI_Comm comm, const string& filename, const shared_ptr<compacting_store_t>& store,
-    const partition_factory_t& partition_factory) {
+    const partition_factory_t& partition_factory, const uint64_t chunk_bytes) {
   Scope scope("read sections");
-  const int ranks = comm_size(comm),
-            rank = comm_rank(comm);
+  const int rank = comm_rank(comm);
+  const auto start = wall_time();
 
   // Read header and blob information
   const auto [partition, local_blocks_, blobs_] = read_sections_start(comm, filename, partition_factory);
   const auto local_blocks = local_blocks_;  // Needed to make lambda captures work
   const auto blobs = blobs_;
 
-  // Allocate ordered compressed memory
-  uint64_t compressed_total = 0;
-  Array<int> compressed_sizes(blobs.size());
-  for (const int b : range(blobs.size())) {
-    compressed_total += blobs[b].compressed_size;
-    compressed_sizes[b] = CHECK_CAST_INT(blobs[b].compressed_size);
-  }
-  GEODE_ASSERT(compressed_total<uint64_t(numeric_limits<int>::max()));
-  Nested<uint8_t> compressed(compressed_sizes);
-  compressed_sizes.clean_memory();
-
-  // Slurp in the entire file
+  // Every rank reads its own blocks straight from the file, in chunks of bounded size.  Reads are
+  // collective, so ranks with fewer chunks join the remaining rounds with empty reads.
+  const auto chunks = read_chunks(blobs, chunk_bytes);
+  int rounds = CHECK_CAST_INT(chunks.size());
+  CHECK(MPI_Allreduce(MPI_IN_PLACE,&rounds,1,MPI_INT,MPI_MAX,comm));
   const auto total_size = file_size(comm,filename);
   if (!rank)
-    slog("total size = %d", total_size);
-  Array<char> raw;
+    slog("total size = %d, read rounds = %d", total_size, rounds);
+
+  // Decompress each chunk into the block store while the next one is read, so at most two chunks
+  // are in memory at once
+  const bool turn = partition->sections->slice&1;
+  const auto blocks = make_shared<restart_block_store_t>(partition, rank, local_blocks, store);
+  uint64_t local_bytes = 0;
   {
     Scope scope("read data");
-    const auto chunk = partition_loop(total_size,ranks,rank);
-    raw = Array<char>(CHECK_CAST_INT(chunk.size()), uninit);
     MPI_File file;
     const int r = MPI_File_open(comm,(char*)filename.c_str(),MPI_MODE_RDONLY,MPI_INFO_NULL,&file);
     if (r != MPI_SUCCESS)
       die("failed to open '%s' for reading: %s",filename,error_string(r));
-    CHECK(MPI_File_read_at_all(file,chunk.lo,raw.data(),raw.size(),MPI_BYTE,MPI_STATUS_IGNORE));
-    CHECK(MPI_File_close(&file));
-  }
-
-  // Just for fun, we rearrange the data using one-sided communication
-  {
-    Scope scope("shuffle");
-    MPI_Win win;
-    CHECK(MPI_Win_create(raw.data(),raw.size(),1,MPI_INFO_NULL,comm,&win));
-    CHECK(MPI_Win_fence(MPI_MODE_NOPUT|MPI_MODE_NOPRECEDE,win));
-    for (const int b : range(blobs.size())) {
-      const auto blob = blobs[b];
-      const auto blob_range = blob.offset+range(blob.compressed_size);
-      for (const int r : range(partition_loop_inverse(total_size,ranks,blob_range.lo),
-                               partition_loop_inverse(total_size,ranks,blob_range.hi-1)+1)) {
-        const auto r_range = partition_loop(total_size,ranks,r);
-        GEODE_ASSERT(r_range.lo<blob_range.hi && blob_range.lo<r_range.hi);
-        const auto common = range(max(blob_range.lo,r_range.lo),min(blob_range.hi,r_range.hi));
-        const int size = CHECK_CAST_INT(common.size());
-        CHECK(MPI_Get(&compressed(b,CHECK_CAST_INT(common.lo-blob_range.lo)),size,MPI_BYTE,
-                                  r,CHECK_CAST_INT(common.lo-   r_range.lo) ,size,MPI_BYTE,win));
+    const vector<int> none;
+    for (const int round : range(rounds)) {
+      const auto& chunk = round < int(chunks.size()) ? chunks[round] : none;
+      const auto compressed = ({
+        thread_time_t time(read_kind,unevent);
+        read_blobs(file, blobs, chunk); });
+      local_bytes += compressed.size();
+      threads_wait_all_help();
+      uint64_t offset = 0;
+      for (const int b : chunk) {
+        const auto data = compressed.slice_own(CHECK_CAST_INT(offset),
+                                                CHECK_CAST_INT(offset+blobs[b].compressed_size));
+        offset += blobs[b].compressed_size;
+        threads_schedule(CPU, [=, blob=blobs[b], local_id=local_blocks[b].local_id]() {
+          const auto filtered = decompress(data, blob.uncompressed_size, unevent);
+          const auto unfiltered = large_buffer<Vector<super_t,2>>(
+              filtered.size() / sizeof(Vector<super_t,2>), uninit);
+          for (const int i : range(unfiltered.size())) {
+            Vector<super_t,2> s;
+            memcpy(&s,&filtered[sizeof(s)*i],sizeof(s));
+            s = uninterleave_super(boost::endian::little_to_native(s));
+            unfiltered[i] = !turn ? vec(s[0],~s[1]) : vec(s[1],~s[0]);
+          }
+          blocks->set(local_id,unfiltered);
+        });
       }
     }
-    CHECK(MPI_Win_fence(MPI_MODE_NOSUCCEED,win));
-    CHECK(MPI_Win_free(&win));
-    raw.clean_memory();
+    threads_wait_all_help();
+    CHECK(MPI_File_close(&file));
   }
+  blocks->store.freeze();
 
-  // Decompose data into block store
-  {
-    Scope scope("decompress");
-    const bool turn = partition->sections->slice&1;
-    const auto blocks = make_shared<restart_block_store_t>(
-        partition, rank, partition->rank_blocks(rank), store);
-    for (const int b : range(blobs.size()))
-      threads_schedule(CPU, [=](){
-        const auto filtered = decompress(compressed[b], blobs[b].uncompressed_size, unevent);
-        const auto unfiltered = large_buffer<Vector<super_t,2>>(
-            filtered.size() / sizeof(Vector<super_t,2>), uninit);
-        for (const int i : range(unfiltered.size())) {
-          Vector<super_t,2> s;
-          memcpy(&s,&filtered[sizeof(s)*i],sizeof(s));
-          s = uninterleave_super(boost::endian::little_to_native(s));
-          unfiltered[i] = !turn ? vec(s[0],~s[1]) : vec(s[1],~s[0]);
-        }
-        blocks->set(local_blocks[b].local_id,unfiltered);
-      });
-    threads_wait_all_help();
-    blocks->store.freeze();
-    return blocks;
+  // Report throughput
+  uint64_t total_bytes = 0;
+  CHECK(MPI_Reduce(&local_bytes,&total_bytes,1,datatype<uint64_t>(),MPI_SUM,0,comm));
+  if (!rank) {
+    const double elapsed = (wall_time()-start).seconds();
+    slog("read %s bytes in %.3g s: %.3g GB/s", large(total_bytes), elapsed, total_bytes/elapsed/1e9);
   }
+  return blocks;
 }
 
-void read_sections_test(const MPI_Comm comm, const string& filename, const partition_factory_t& partition_factory) {
+void read_sections_test(const MPI_Comm comm, const string& filename,
+                        const partition_factory_t& partition_factory, const uint64_t chunk_bytes) {
   Scope scope("read sections test");
   const int ranks = comm_size(comm),
             rank = comm_rank(comm);
@@ -495,47 +599,28 @@ void read_sections_test(const MPI_Comm comm, const string& filename, const parti
 
   // Read header and blob information
   const auto [partition, local_blocks, blobs] = read_sections_start(comm,filename,partition_factory);
-
-  // Determine how much ordered compressed memory to allocate, but don't allocate it
-  uint64_t compressed_total = 0;
-  Array<int> compressed_sizes(blobs.size());
-  for (const int b : range(blobs.size())) {
-    compressed_total += blobs[b].compressed_size;
-    compressed_sizes[b] = CHECK_CAST_INT(blobs[b].compressed_size);
-  }
-  if (!rank && !(compressed_total<uint64_t(numeric_limits<int>::max())))
-    slog("WARNING: compressed_total = %d, real restart job would fail", compressed_total);
-
-  // Don't slurp in the entire file
   const auto total_size = file_size(comm,filename);
   if (!rank)
     slog("total size = %d", total_size);
 
-  // Just for fun, we rearrange the data using one-sided communication.  Rather, we pretend to.
-  {
-    Scope scope("shuffle");
-    for (const int b : range(blobs.size())) {
-      uint64_t offset = 0;
-      const auto blob = blobs[b];
-      const Range<uint64_t> blob_range = blob.offset+range(blob.compressed_size);
-      typedef uint64_t UI;
-      if (!(   blob_range.size()
-            && UI(blob_range.lo)  <UI(total_size)
-            && UI(blob_range.hi-1)<UI(total_size)))
-        GEODE_ASSERT(false,format("b %d, offset %lld, cs %lld, br %lld %lld",
-          b,blob.offset,blob.compressed_size,blob_range.lo,blob_range.hi));
-      for (const int r : range(partition_loop_inverse(total_size,ranks,blob_range.lo),
-                               partition_loop_inverse(total_size,ranks,blob_range.hi-1)+1)) {
-        const auto r_range = partition_loop(total_size,ranks,r);
-        GEODE_ASSERT(r_range.lo<blob_range.hi && blob_range.lo<r_range.hi);
-        const auto common = range(max(blob_range.lo,r_range.lo),min(blob_range.hi,r_range.hi));
-        GEODE_ASSERT(common.lo-blob_range.lo==offset);
-        // Here's where we would read common.size() bytes into compressed(b,offset:?)
-        offset += common.size();
-      }
-      GEODE_ASSERT(offset==uint64_t(compressed_sizes[b]));
+  // Check that chunks cover every blob once, in file order, within the size limit, without
+  // actually reading anything
+  const auto chunks = read_chunks(blobs,chunk_bytes);
+  Array<int> seen(blobs.size());
+  for (const auto& chunk : chunks) {
+    uint64_t size = 0, end = 0;
+    for (const int b : chunk) {
+      const auto& blob = blobs[b];
+      GEODE_ASSERT(blob.compressed_size && blob.offset+blob.compressed_size<=total_size,
+                   format("b %d, offset %lld, compressed size %lld",b,blob.offset,blob.compressed_size));
+      GEODE_ASSERT(end<=blob.offset);
+      end = blob.offset+blob.compressed_size;
+      size += blob.compressed_size;
+      seen[b]++;
     }
+    GEODE_ASSERT(chunk.size()==1 || size<=chunk_bytes);
   }
+  GEODE_ASSERT(std::all_of(seen.begin(), seen.end(), [](const int n) { return n==1; }));
 }
 
 void check_directory(const MPI_Comm comm, const string& dir) {
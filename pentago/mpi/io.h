@@ -7,24 +7,65 @@
 #include "pentago/end/block_store.h"
 #include "pentago/end/config.h"
 #include "pentago/end/partition.h"
+#include "pentago/utility/spinlock.h"
 #include <mpi.h>
 namespace pentago {
 namespace mpi {
 
 using namespace pentago::end;
 
+// Local blocks of a slice compressed for writing, possibly ahead of time.
+//
+// Compressing at a high lzma level dominates the cost of writing a slice, but needs no communication.
+// If memory_limit is positive, compression starts immediately as background jobs on the IO threads
+// (which must exist), and stops once the compressed data exceeds memory_limit or write_sections begins.
+// write_sections then compresses any remaining blocks on the CPU threads and does the collective writes.  This lets a
+// finished slice compress while the next slice computes.  blocks must remain alive and unchanged
+// until the write.
+struct compressed_sections_t : public boost::noncopyable {
+  const readable_block_store_t& blocks;
+  const int level;
+  const uint64_t memory_limit;
+  const Array<const local_id_t> local_ids; // In order of flat_id
+  vector<Array<uint8_t>> compressed; // Indexed by flat_id
+
+private:
+  spinlock_t lock;
+  int next; // Next block to compress
+  uint64_t memory; // Total size of compressed blocks
+  bool stopping; // Set by finish to end the background chains
+public:
+
+  compressed_sections_t(const readable_block_store_t& blocks, const int level,
+                        const uint64_t memory_limit);
+  ~compressed_sections_t();
+
+  // Compress all remaining blocks, waiting for any background jobs
+  void finish();
+
+private:
+  void compress_block(const int b);
+  void background();
+  void stop();
+};
+
 // Write all data to a single slice file.  Collective.
 void write_sections(const MPI_Comm comm, const string& filename, const readable_block_store_t& blocks,
                     const int level);
+void write_sections(const MPI_Comm comm, const string& filename, compressed_sections_t& local);
 
-// Read all data from a set of supertensor files
+// Read all data from a slice file.  Collective.
+// The file layout does not depend on the number of ranks that wrote it, so any partition may be
+// used.  Each rank reads its own blocks directly in collective rounds of at most chunk_bytes
+// compressed bytes, decompressing one chunk while reading the next.
 shared_ptr<const readable_block_store_t> read_sections(
     const MPI_Comm comm, const string& filename, const shared_ptr<compacting_store_t>& store,
-    const partition_factory_t& partition_factory);
+    const partition_factory_t& partition_factory, const uint64_t chunk_bytes=uint64_t(1)<<28);
 
-// Consistency check for some of the read sections code
+// Consistency check for the read plan of read_sections, without reading any data
 void read_sections_test(const MPI_Comm comm, const string& filename,
-                        const partition_factory_t& partition_factory);
+                        const partition_factory_t& partition_factory,
+                        const uint64_t chunk_bytes=uint64_t(1)<<28);
 
 // Write an empty section file to the directory to check that basic I/O works
 void check_directory(const MPI_Comm comm, const string& dir);
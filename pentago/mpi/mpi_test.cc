@@ -1,9 +1,11 @@
 #include "pentago/utility/exceptions.h"
 #include "pentago/utility/join.h"
 #include "pentago/utility/log.h"
+#include "pentago/utility/range.h"
 #include "pentago/utility/temporary.h"
 #include "gtest/gtest.h"
 #include <stdlib.h>
+#include <unistd.h>
 
 namespace pentago {
 namespace {
@@ -65,6 +67,14 @@ void meaningless_test(const int slice, const int key, const bool restart = false
     const auto rdir = wdir + "-restarted";
     run(format("%s --restart %s/slice-%d.pentago --dir %s", base, wdir, slice-1, rdir));
     check(rdir);
+
+    // Restart on a different number of ranks, reading in many small rounds.  Padding makes file
+    // hashes depend on the rank count, so check only the contents.
+    const auto sdir = wdir + "-resized";
+    run(format("%s -n 3 pentago/mpi/endgame-mpi --threads 3 --save 20 --memory 3G --meaningless %d "
+               "--randomize %d --restart %s/slice-%d.pentago --restart-chunk .0002M --dir %s 00000000",
+               mpirun(), slice, key, wdir, slice-1, sdir));
+    check(sdir, "--skip-hashes");
   }
 }
 TEST(mpi, meaningless_simple_slice4) { meaningless_test(4, 0); }
@@ -72,5 +82,79 @@ TEST(mpi, meaningless_simple_slice5) { meaningless_test(5, 0); }
 TEST(mpi, meaningless_random_slice4) { meaningless_test(4, 17, true, true); }
 TEST(mpi, meaningless_random_slice5) { meaningless_test(5, 17, true, true); }
 
+// Compute one slice in epochs, then resume from the last checkpoint.  The directory names
+// match those of meaningless_test, so check verifies the results against the same hashes.
+// A tiny chunk size spreads checkpoint data over many rounds, and resuming with a different
+// line order must fail.
+void checkpoint_test(const int slice, const int key) {
+  tempdir_t tmp("checkpoint");
+  const auto wdir = format("%s/checkpoints-s%d-r%d", tmp.path, slice, key);
+  const auto base = format("%s -n 2 pentago/mpi/endgame-mpi --threads 3 --save 20 --memory 3G "
+                           "--meaningless %d --randomize %d --restart-chunk .0002M 00000000",
+                           mpirun(), slice, key);
+  run(format("%s --checkpoints 3 --stop-after %d --dir %s", base, slice-1, wdir));
+  check(wdir);
+  ASSERT_THROW(run(format("%s --completion-order --resume %s/checkpoint --dir %s-reordered", base, wdir,
+                          wdir)), OSError);
+  const auto rdir = wdir + "-restarted";
+  run(format("%s --resume %s/checkpoint --dir %s", base, wdir, rdir));
+  check(rdir);
+}
+TEST(mpi, checkpoint_slice5) { checkpoint_test(5, 17); }
+
+// Compress each slice for writing while the next one computes.  A tiny budget leaves most blocks
+// for write_sections to compress, and a large one compresses everything in the background.  As in
+// checkpoint_test, the directory name matches the memorized hashes of meaningless_test.
+void write_ahead_test(const int slice, const int key, const int io_threads, const string& budget) {
+  tempdir_t tmp("write-ahead");
+  const auto wdir = format("%s/deferred-writes-s%d-r%d", tmp.path, slice, key);
+  run(format("%s -n 2 pentago/mpi/endgame-mpi --threads 3 --save 20 --memory 3G --meaningless %d "
+             "--randomize %d --io-threads %d --write-ahead %s --dir %s 00000000",
+             mpirun(), slice, key, io_threads, budget, wdir));
+  check(wdir);
+}
+TEST(mpi, write_ahead_slice5) {
+  write_ahead_test(5, 17, 1, ".01M");
+  write_ahead_test(5, 17, 2, "1G");
+}
+
+// Coalesce block requests and small outputs per destination rank.  The smallest size splits most
+// batches, exercising both batched and lone messages.
+void aggregate_test(const int slice, const int key, const int bytes) {
+  tempdir_t tmp("aggregate");
+  const auto wdir = format("%s/aggregates-s%d-r%d", tmp.path, slice, key);
+  run(format("%s -n 2 pentago/mpi/endgame-mpi --threads 3 --save 20 --memory 3G --meaningless %d "
+             "--randomize %d --aggregate %d --dir %s 00000000", mpirun(), slice, key, bytes, wdir));
+  check(wdir);
+}
+TEST(mpi, aggregate_slice5) {
+  aggregate_test(5, 17, 1024);
+  aggregate_test(5, 17, 65536);
+}
+
+// Read input blocks owned by ranks on the same node through a shared memory window.  All ranks
+// of the test share a node, so no input blocks travel through messages.
+TEST(mpi, shared_blocks_slice5) {
+  tempdir_t tmp("shared-blocks");
+  const auto wdir = format("%s/shared-blocks-s5-r17", tmp.path);
+  run(format("%s -n 2 pentago/mpi/endgame-mpi --threads 3 --save 20 --memory 3G --meaningless 5 "
+             "--randomize 17 --shared-blocks --dir %s 00000000", mpirun(), wdir));
+  check(wdir);
+}
+
+// Trace every thread.  Tracing turns off request merging and shared reads, which must not change
+// the results, and each rank writes both history formats.
+TEST(mpi, history_slice5) {
+  tempdir_t tmp("history");
+  const auto wdir = format("%s/histories-s5-r17", tmp.path);
+  run(format("%s -n 2 pentago/mpi/endgame-mpi --threads 3 --save 20 --memory 3G --meaningless 5 "
+             "--randomize 17 --history 65536 --dir %s 00000000", mpirun(), wdir));
+  check(wdir);
+  for (const int rank : range(2)) {
+    ASSERT_FALSE(access(format("%s/history-r%d", wdir, rank).c_str(), R_OK));
+    ASSERT_FALSE(access(format("%s/trace-r%d.json", wdir, rank).c_str(), R_OK));
+  }
+}
+
 }  // namespace
 }  // namespace pentago
@@ -0,0 +1,116 @@
+// Direct access to other ranks' input blocks on the same node
+
+#include "pentago/mpi/shared_blocks.h"
+#include "pentago/mpi/utility.h"
+#include "pentago/end/compacting_store.h"
+#include "pentago/utility/const_cast.h"
+#include "pentago/utility/debug.h"
+#include "pentago/utility/log.h"
+#include "pentago/utility/memory.h"
+namespace pentago {
+namespace mpi {
+
+shared_heap_t::shared_heap_t(const MPI_Comm comm, const uint64_t heap_size) {
+  const int rank = comm_rank(comm);
+  CHECK(MPI_Comm_split_type(comm,MPI_COMM_TYPE_SHARED,rank,MPI_INFO_NULL,&node_comm));
+  const int node_rank = comm_rank(node_comm),
+            node_size = comm_size(node_comm);
+
+  // Allocate our part of the window, with slack for alignment since MPI doesn't promise any.
+  // Noncontiguous allocation lets each rank's heap live near it.
+  const int alignment = compacting_store_t::alignment;
+  const uint64_t size = compacting_store_t::align_size(heap_size);
+  MPI_Info info;
+  CHECK(MPI_Info_create(&info));
+  CHECK(MPI_Info_set(info,"alloc_shared_noncontig","true"));
+  uint8_t* start;
+  CHECK(MPI_Win_allocate_shared(size+alignment,1,info,node_comm,&start,&win));
+  CHECK(MPI_Info_free(&info));
+  const_cast_(heap) = RawArray<uint8_t>(size,start+(-uintptr_t(start)&(alignment-1)));
+  report_large_alloc(size+alignment);
+
+  // Find everyone else's heaps
+  Array<const uint8_t*> bases(node_size,uninit);
+  for (const int r : range(node_size)) {
+    MPI_Aint peer_size;
+    int disp_unit;
+    CHECK(MPI_Win_shared_query(win,r,&peer_size,&disp_unit,&bases[r]));
+  }
+  this->bases = bases;
+
+  // Map ranks to node ranks
+  Array<int> node_world(node_size,uninit);
+  CHECK(MPI_Allgather((void*)&rank,1,MPI_INT,node_world.data(),1,MPI_INT,node_comm));
+  Array<int> node_ranks(comm_size(comm));
+  node_ranks.fill(-1);
+  for (const int r : range(node_size))
+    node_ranks[node_world[r]] = r;
+  this->node_ranks = node_ranks;
+  GEODE_ASSERT(node_ranks[rank]==node_rank);
+
+  // Open a passive target epoch so that MPI_Win_sync can order our reads and writes against other ranks
+  CHECK(MPI_Win_lock_all(MPI_MODE_NOCHECK,win));
+}
+
+shared_heap_t::~shared_heap_t() {
+  CHECK(MPI_Win_unlock_all(win));
+  CHECK(MPI_Win_free(&win));
+  CHECK(MPI_Comm_free(&node_comm));
+  report_large_alloc(-ssize_t(heap.size()+compacting_store_t::alignment));
+}
+
+shared_blocks_t::shared_blocks_t(const shared_heap_t& heap, const readable_block_store_t& local)
+  : heap(heap) {
+#if PENTAGO_MPI_COMPRESS
+  // Collect the location of each of our blocks, relative to the start of our part of the window
+  const auto start = heap.bases[heap.node_ranks[local.rank]];
+  vector<Vector<uint64_t,3>> mine; // local_id, offset, size
+  mine.reserve(local.block_infos.size());
+  for (const auto& [local_id, info] : local.block_infos) {
+    const auto data = local.store.get_frozen(info.flat_id);
+    GEODE_ASSERT(heap.heap.data()<=data.data() && data.data()+data.size()<=heap.heap.data()+heap.heap.size());
+    mine.push_back(Vector<uint64_t,3>(local_id.id,data.data()-start,data.size()));
+  }
+
+  // Make sure our writes to the heap are visible before anyone else reads them, then exchange locations
+  CHECK(MPI_Win_sync(heap.win));
+  const int node_size = heap.bases.size();
+  Array<int> counts(node_size,uninit), offsets(node_size,uninit);
+  const int count = CHECK_CAST_INT(3*mine.size());
+  CHECK(MPI_Allgather((void*)&count,1,MPI_INT,counts.data(),1,MPI_INT,heap.node_comm));
+  int total = 0;
+  for (const int r : range(node_size)) {
+    offsets[r] = total;
+    total += counts[r];
+  }
+  Array<uint64_t> all(total,uninit);
+  CHECK(MPI_Allgatherv((void*)mine.data(),count,datatype<uint64_t>(),all.data(),counts.data(),
+                       offsets.data(),datatype<uint64_t>(),heap.node_comm));
+  CHECK(MPI_Win_sync(heap.win));
+
+  // Build a directory for each node rank
+  blocks.resize(node_size);
+  for (const int r : range(node_size)) {
+    auto& b = blocks[r];
+    b.reserve(counts[r]/3);
+    for (int i=offsets[r];i<offsets[r]+counts[r];i+=3)
+      b[local_id_t(int(all[i]))] = Vector<uint64_t,2>(all[i+1],all[i+2]);
+  }
+#else
+  die("shared_blocks_t: shared input blocks require PENTAGO_MPI_COMPRESS");
+#endif
+}
+
+shared_blocks_t::~shared_blocks_t() {}
+
+RawArray<const uint8_t> shared_blocks_t::get_compressed(const int rank, const local_id_t local_id) const {
+  const int node_rank = heap.node_ranks[rank];
+  GEODE_ASSERT(node_rank>=0);
+  const auto it = blocks[node_rank].find(local_id);
+  GEODE_ASSERT(it!=blocks[node_rank].end());
+  const auto& location = it->second; // offset, size
+  return RawArray<const uint8_t>(CHECK_CAST_INT(location[1]),heap.bases[node_rank]+location[0]);
+}
+
+}
+}
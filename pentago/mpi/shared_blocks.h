@@ -0,0 +1,56 @@
+// Direct access to other ranks' input blocks on the same node
+//
+// Ranks on the same node normally exchange input blocks through point-to-point messages, copying
+// compressed data from one address space to another.  If each rank's compacting_store_t heap lives
+// in an MPI-3 shared memory window, frozen blocks owned by ranks on our node can instead be read in
+// place: frozen arrays never move until their group is destroyed, and compute_lines ends with a
+// barrier, so a rank's input blocks stay put for as long as any other rank might read them.
+//
+// shared_heap_t allocates the window once per run, and shared_blocks_t publishes the location of
+// every frozen block of an input slice to the other ranks on the node.  Requests for blocks owned
+// by ranks on other nodes go through the usual message path in flow.cc.
+#pragma once
+
+#include "pentago/end/block_store.h"
+#include "pentago/utility/array.h"
+#include <boost/core/noncopyable.hpp>
+#include <unordered_map>
+#include <mpi.h>
+namespace pentago {
+namespace mpi {
+
+using namespace pentago::end;
+using std::unordered_map;
+
+struct shared_heap_t : public boost::noncopyable {
+  MPI_Comm node_comm; // Ranks sharing our node
+  MPI_Win win;
+  const RawArray<uint8_t> heap; // Aligned heap inside our part of the window, for use by compacting_store_t
+  Array<const int> node_ranks; // Node rank of each rank in the original communicator, or -1 if off node
+  Array<const uint8_t*> bases; // Start of each node rank's part of the window in our address space
+
+  // Collective over comm
+  shared_heap_t(const MPI_Comm comm, const uint64_t heap_size);
+  ~shared_heap_t();
+};
+
+class shared_blocks_t : public boost::noncopyable {
+  const shared_heap_t& heap;
+  vector<unordered_map<local_id_t,Vector<uint64_t,2>>> blocks; // Offset and size of each frozen block, by node rank
+public:
+  // Exchange block locations with the other ranks on our node.  Collective over heap.node_comm,
+  // and blocks must be frozen and allocated from heap.
+  shared_blocks_t(const shared_heap_t& heap, const readable_block_store_t& blocks);
+  ~shared_blocks_t();
+
+  // Is the given rank on our node?
+  bool contains(const int rank) const {
+    return heap.node_ranks[rank] >= 0;
+  }
+
+  // Compressed data for a block owned by a rank on our node
+  RawArray<const uint8_t> get_compressed(const int rank, const local_id_t local_id) const;
+};
+
+}
+}
@@ -1,9 +1,11 @@
 // Massively parallel in-core endgame database computation
 
 #include "pentago/mpi/toplevel.h"
+#include "pentago/mpi/checkpoint.h"
 #include "pentago/mpi/flow.h"
 #include "pentago/mpi/io.h"
 #include "pentago/mpi/reduction.h"
+#include "pentago/mpi/shared_blocks.h"
 #include "pentago/mpi/utility.h"
 #include "pentago/base/all_boards.h"
 #include "pentago/data/block_cache.h"
@@ -11,7 +13,9 @@
 #include "pentago/data/supertensor.h"
 #include "pentago/end/check.h"
 #include "pentago/end/config.h"
+#include "pentago/end/fast_compress.h"
 #include "pentago/end/load_balance.h"
+#include "pentago/end/locality_partition.h"
 #include "pentago/end/options.h"
 #include "pentago/end/partition.h"
 #include "pentago/end/predict.h"
@@ -55,6 +59,24 @@ static void report(MPI_Comm comm, const char* name) {
     slog("memory %s: %s", name, memory_report(info));
 }
 
+// Report when the median and last blocks of a slice completed relative to the start of compute,
+// and the peak size of live store data so far, each maximized over ranks
+static void report_completion(const MPI_Comm comm, const accumulating_block_store_t& blocks,
+                              const wall_time_t start) {
+  vector<double> times;
+  for (const auto t : blocks.completion_times)
+    if (t.us) // Blocks completed before a resumed checkpoint have no time
+      times.push_back((t-start).seconds());
+  std::sort(times.begin(), times.end());
+  double numbers[3] = {times.size() ? times[times.size()/2] : 0, times.size() ? times.back() : 0,
+                       double(blocks.store.parent().peak_live())};
+  const int rank = comm_rank(comm);
+  CHECK(MPI_Reduce(rank ? numbers : MPI_IN_PLACE, numbers, 3, MPI_DOUBLE, MPI_MAX, 0, comm));
+  if (!rank)
+    slog("block completion: median %.3g s, last %.3g s, store peak %s", numbers[0], numbers[1],
+         large(uint64_t(numbers[2])));
+}
+
 static void report_mpi_times(const MPI_Comm comm, const options_t& o, const thread_times_t local,
                              const wall_time_t elapsed, const uint64_t local_outputs,
                              const uint64_t local_inputs) {
@@ -95,6 +117,33 @@ static void report_mpi_times(const MPI_Comm comm, const options_t& o, const thre
   }
 }
 
+// A finished slice whose files have yet to be written.  With --write-ahead, the write is
+// deferred until the next slice computes, and its blocks are compressed in the meantime.
+struct pending_write_t {
+  int slice;
+  shared_ptr<accumulating_block_store_t> blocks;
+  unique_ptr<compressed_sections_t> sections; // Null if the slice isn't saved
+};
+
+static unique_ptr<pending_write_t> pending_write(const options_t& o, const int slice,
+                                                 const shared_ptr<accumulating_block_store_t>& blocks,
+                                                 const uint64_t write_ahead) {
+  unique_ptr<pending_write_t> w(new pending_write_t);
+  w->slice = slice;
+  w->blocks = blocks;
+  if (slice <= o.save)
+    w->sections.reset(new compressed_sections_t(*blocks, o.level, write_ahead));
+  return w;
+}
+
+static void write_slice(const MPI_Comm comm, const options_t& o, pending_write_t& w) {
+  Scope scope(format("write slice %d", w.slice));
+  write_counts(comm, format("%s/counts-%d.npy", o.dir, w.slice), *w.blocks);
+  write_sparse_samples(comm, format("%s/sparse-%d.npy", o.dir, w.slice), *w.blocks);
+  if (w.sections)
+    write_sections(comm, format("%s/slice-%d.pentago", o.dir, w.slice), *w.sections);
+}
+
 static int broadcast_supertensor_slice(const MPI_Comm comm, const string& path) {
   int slice;
   if (!comm_rank(comm))
@@ -108,6 +157,12 @@ static shared_ptr<partition_t> make_simple_partition(
   return make_shared<simple_partition_t>(ranks, sections);
 }
 
+static shared_ptr<partition_t>
+make_locality_partition(const double tolerance, const int ranks,
+                        const shared_ptr<const sections_t>& sections) {
+  return make_shared<locality_partition_t>(ranks, sections, tolerance);
+}
+
 static shared_ptr<partition_t>
 make_random_partition(const uint128_t key, const int ranks,
                       const shared_ptr<const sections_t>& sections) {
@@ -171,7 +226,11 @@ int toplevel(int argc, char** argv) {
 
   // Allocate thread pool
   const int workers = o.threads - 1;
-  init_threads(workers, 0);
+  init_threads(workers, o.io_threads);
+  if (o.history)
+    enable_thread_history(o.history);
+  if (o.counters.size())
+    enable_perf_counters(o.counters);
   report(comm, "threads");
 
   // Make sure the compression level is valid
@@ -182,10 +241,18 @@ int toplevel(int argc, char** argv) {
     GEODE_ASSERT(decompress(compress(data, o.level, unevent), data.size(), unevent)==data);
   }
 
+  // Select the in memory compression codec
+  try {
+    set_fast_codec(o.codec);
+  } catch (const ValueError& e) {
+    error("%s", e.what());
+  }
+
   // Make partition factory
   const auto partition_factory =
-      o.randomize ? partition_factory_t(curry(make_random_partition, o.randomize))
-                  :                           make_simple_partition;
+      o.randomize      ? partition_factory_t(curry(make_random_partition, o.randomize))
+      : o.locality>=0  ? partition_factory_t(curry(make_locality_partition, o.locality/100.))
+                       :                           make_simple_partition;
 
   // Run a unit test if requested.  See mpi_test.cc for invocation.
   if (o.test.size()) {
@@ -205,12 +272,13 @@ int toplevel(int argc, char** argv) {
         write_sections(comm, sections_file, *blocks, o.level);
       } {
         Scope scope("restart");
-        const auto restart = read_sections(comm, sections_file, store, partition_factory);
+        const auto restart = read_sections(comm, sections_file, store, partition_factory,
+                                           o.restart_chunk);
         Scope write_scope("write");
         write_sections(comm, format("%s/slice-%d-restart.pentago", o.dir, slice), *restart, o.level);
       }
     } else if (o.test == "restart") {
-      read_sections_test(comm, o.restart, partition_factory);
+      read_sections_test(comm, o.restart, partition_factory, o.restart_chunk);
     } else
       error("unknown unit test '%s'", o.test);
     return 0;
@@ -227,9 +295,18 @@ int toplevel(int argc, char** argv) {
     slog("block size = %d", block_size);
     slog("saved slices = %d", o.save);
     slog("level = %d", o.level);
+    slog("codec = %s", fast_codec_name());
     slog("memory limit = %s", large(o.memory_limit));
     slog("gather limit = %d", o.gather_limit);
     slog("line limit = %d", o.line_limit);
+    slog("adaptive lines = %d", o.adaptive_lines);
+    slog("completion order = %d", o.completion_order);
+    slog("aggregate = %d", o.aggregate);
+    slog("shared blocks = %d", o.shared_blocks);
+    slog("checkpoints = %d", o.checkpoints);
+    slog("io threads = %d", o.io_threads);
+    slog("write ahead = %s", large(o.write_ahead));
+    slog("restart chunk = %s", large(o.restart_chunk));
     slog("mode = %s", GEODE_DEBUG_ONLY(1)+0?"debug":"optimized");
     slog("funnel = %d", PENTAGO_MPI_FUNNEL);
     slog("compress = %d", PENTAGO_MPI_COMPRESS);
@@ -239,11 +316,12 @@ int toplevel(int argc, char** argv) {
     slog("endian = %s", boost::endian::order::native == boost::endian::order::little ? "little"
                       : boost::endian::order::native == boost::endian::order::big    ? "big"
                                                                                      : "unknown");
-    slog("history = %d", thread_history_enabled());
-    slog("papi = %s", papi_enabled() ? join(" ",papi_event_names()) : "<disabled>");
+    slog("history = %d", o.history);
+    slog("counters = %s", papi_enabled() ? join(" ",papi_event_names()) : "<disabled>");
     slog("wildcard recvs = %d", wildcard_recv_count);
     slog("meaningless = %d", o.meaningless);
     slog("randomize = %d", o.randomize);
+    slog("locality = %d", o.locality);
     slog("tag ub = %d (%d required)", tag_ub, required_tag_ub);
     if (PENTAGO_MPI_DEBUG)
       slog("WARNING: EXPENSIVE DEBUGGING CODE ENABLED!");
@@ -270,6 +348,7 @@ int toplevel(int argc, char** argv) {
   const int restart_slice = o.restart.size() ? broadcast_supertensor_slice(comm, o.restart) : -1;
   if (o.restart.size())
     slog("restart: slice %d, file %s", restart_slice, o.restart);
+  const auto resume = o.resume.size() ? read_checkpoint_header(comm, o.resume) : checkpoint_t();
 
   // Allocate the space needed for block storage
   uint64_t heap_size = 0;
@@ -294,7 +373,12 @@ int toplevel(int argc, char** argv) {
       heap_size = min_heap_size;
     }
   }
-  const auto store = make_shared<compacting_store_t>(heap_size);
+  // If desired, place the heap in shared memory so that ranks on the same node can read each other's input blocks
+  unique_ptr<shared_heap_t> shared_heap;
+  if (o.shared_blocks)
+    shared_heap.reset(new shared_heap_t(comm, heap_size));
+  const auto store = shared_heap ? make_shared<compacting_store_t>(shared_heap->heap)
+                                 : make_shared<compacting_store_t>(heap_size);
 
   // Compute each slice in turn
   wall_time_t total_elapsed;
@@ -303,10 +387,11 @@ int toplevel(int argc, char** argv) {
   {
     shared_ptr<const block_partition_t> prev_partition;
     shared_ptr<const readable_block_store_t> prev_blocks;
+    unique_ptr<pending_write_t> pending;
 
     // Load existing restart data if available
     if (o.restart.size()) {
-      prev_blocks = read_sections(comm, o.restart, store, partition_factory);
+      prev_blocks = read_sections(comm, o.restart, store, partition_factory, o.restart_chunk);
       prev_partition = prev_blocks->partition;
       // Verify that we match the expected set of sections
       if (prev_partition->sections->slice!=restart_slice)
@@ -334,6 +419,9 @@ int toplevel(int argc, char** argv) {
 
     // Compute!
     const int first_slice = prev_partition ? prev_partition->sections->slice-1 : int(slices.size())-1;
+    if (o.resume.size() && resume.slice != first_slice)
+      error("checkpoint '%s' is for slice %d, but we're starting at slice %d", o.resume, resume.slice,
+            first_slice);
     for (int slice=first_slice;slice>=o.stop_after;slice--) {
       if (!slices[slice]->sections.size())
         break;
@@ -345,12 +433,15 @@ int toplevel(int argc, char** argv) {
 
       // Allocate memory for all the blocks we own
       auto lines = partition->rank_lines(rank);
+      if (o.completion_order)
+        lines = completion_order(lines);
       auto local_blocks = partition->rank_blocks(rank);
       const auto blocks = make_shared<accumulating_block_store_t>(
           partition, rank, local_blocks, o.samples, store);
       {
         Scope scope("load balance");
-        const auto load = load_balance(reduction<int64_t,max_op>(comm), lines, local_blocks);
+        const auto load = load_balance(reduction<int64_t,max_op>(comm), lines, local_blocks,
+                                       remote_bytes(prev_partition.get(), *partition, rank, lines));
         if (!rank)
           load->print();
         local_blocks.clean_memory();
@@ -363,7 +454,8 @@ int toplevel(int argc, char** argv) {
                     base_block_memory = (prev_blocks ? prev_blocks->base_memory_usage() : 0) +
                                         blocks->base_memory_usage(),
                     line_memory = memory_usage(lines)+base_compute_memory_usage(lines.size()),
-                    base_memory = store_memory+partition_memory+base_block_memory+line_memory;
+                    write_memory = pending ? o.write_ahead : 0,
+                    base_memory = store_memory+partition_memory+base_block_memory+line_memory+write_memory;
       if (o.memory_limit <= base_memory)
         die("memory limit exceeded: base = %s, limit = %s", large(base_memory), large(o.memory_limit));
       const int64_t free_memory = o.memory_limit - base_memory;
@@ -385,10 +477,36 @@ int toplevel(int argc, char** argv) {
       const auto local_inputs = prev_blocks?prev_blocks->total_nodes:0;
       total_local_inputs += local_inputs;
 
-      // Compute (and communicate)
+      // Compute (and communicate), in several epochs if we're checkpointing
+      const auto compute_start = wall_time();
       {
         Scope scope("compute");
-        compute_lines(comms, prev_blocks, *blocks, lines, free_memory, o.gather_limit, o.line_limit);
+        unique_ptr<const shared_blocks_t> shared;
+        if (shared_heap && prev_blocks)
+          shared.reset(new shared_blocks_t(*shared_heap, *prev_blocks));
+        int epoch = 0, epochs = o.checkpoints;
+        if (o.resume.size() && slice == first_slice) {
+          const auto checkpoint = read_checkpoint(comm, o.resume, *blocks, lines, o.restart_chunk);
+          epoch = checkpoint.epoch;
+          epochs = checkpoint.epochs;
+        }
+        for (; epoch < epochs; epoch++) {
+          const auto chunk = epoch_lines(lines, epoch, epochs);
+          const int contributions = epochs == 1 ? blocks->required_contributions
+                                                : epoch_contributions(comm, *partition, chunk);
+          compute_lines(comms, prev_blocks, *blocks, chunk, contributions, free_memory,
+                        o.gather_limit, o.line_limit, o.aggregate, shared.get(), o.adaptive_lines);
+          if (epoch+1 < epochs)
+            write_checkpoint(comm, format("%s/checkpoint", o.dir), *blocks, lines, epoch+1, epochs,
+                             o.restart_chunk);
+        }
+      }
+      report_completion(comm, *blocks, compute_start);
+
+      // Finish writing the previous slice before its blocks go away
+      if (pending) {
+        write_slice(comm, o, *pending);
+        pending.reset();
       }
 
       // Deallocate obsolete slice
@@ -405,19 +523,26 @@ int toplevel(int argc, char** argv) {
       const auto local_outputs = blocks->total_nodes;
       total_local_outputs += local_outputs;
 
-      // Write various information to disk
-      {
-        Scope scope("write");
-        write_counts(comm, format("%s/counts-%d.npy", o.dir, slice), *blocks);
-        write_sparse_samples(comm, format("%s/sparse-%d.npy", o.dir, slice), *blocks);
-        if (slice <= o.save)
-          write_sections(comm, format("%s/slice-%d.pentago", o.dir, slice), *blocks, o.level);
-      }
+      // Write various information to disk, now or overlapped with the next slice
+      if (!o.write_ahead)
+        write_slice(comm, o, *pending_write(o, slice, blocks, 0));
 
       // Dump timing
       const auto elapsed = wall_time()-start;
       total_elapsed += elapsed;
       report_mpi_times(comm, o, clear_thread_times(), elapsed, local_outputs, local_inputs);
+
+      // Start compressing in the background.  This comes after the timing report, which waits for all threads.
+      if (o.write_ahead)
+        pending = pending_write(o, slice, blocks, o.write_ahead);
+    }
+
+    // Write the last slice
+    if (pending) {
+      const auto start = wall_time();
+      write_slice(comm, o, *pending);
+      pending.reset();
+      total_elapsed += wall_time()-start;
     }
   }
 
@@ -425,7 +550,12 @@ int toplevel(int argc, char** argv) {
   report_mpi_times(comm, o, total_thread_times(), total_elapsed, total_local_outputs,
                    total_local_inputs);
   report(comm, "final");
-  write_thread_history(format("%s/history-r%d", o.dir, rank));
+  if (o.history) {
+    if (const auto dropped = thread_history_dropped())
+      slog("rank %d: history dropped %d old events, consider raising --history", rank, dropped);
+    write_thread_history(format("%s/history-r%d", o.dir, rank));
+    write_chrome_trace(format("%s/trace-r%d.json", o.dir, rank), rank);
+  }
   return 0;
 }
 
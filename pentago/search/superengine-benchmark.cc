@@ -0,0 +1,64 @@
+// Time an end to end superengine search
+//
+// Runs both sides of super_evaluate on random boards, the best of several tries, so that changes to
+// the move generation, standardization, and table kernels can be judged by their effect on search.
+
+#include "pentago/search/superengine.h"
+#include "pentago/search/supertable.h"
+#include "pentago/utility/log.h"
+#include "pentago/utility/random.h"
+#include "pentago/utility/range.h"
+#include "pentago/utility/wall_time.h"
+
+namespace pentago {
+namespace {
+
+using std::min;
+
+// Run f several times and return the best time in seconds
+template<class F> double best_time(const int tries, const F& f) {
+  double best = std::numeric_limits<double>::infinity();
+  for (int t = 0; t < tries; t++) {
+    const auto start = wall_time();
+    f();
+    best = min(best, (wall_time()-start).seconds());
+  }
+  return best;
+}
+
+volatile uint64_t sink;
+
+// Both sides of super_evaluate at depth 8 on random 10 stone boards, from a fresh table each try
+void superengine_benchmark(Random& random) {
+  init_supertable(22, false);
+  vector<board_t> boards;
+  for (__attribute__((unused)) const int i : range(40))
+    boards.push_back(random_board(random, 10));
+  slog("superengine, depth 8, 40 boards = %.3g s", best_time(3, [&]() {
+    clear_supertable();
+    uint64_t sum = 0;
+    for (const auto board : boards)
+      for (const bool aggressive : {true, false})
+        sum = 3*sum + super_evaluate(aggressive, 8, board, Vector<int,4>());
+    sink = sum;
+  }));
+}
+
+void toplevel() {
+  Scope scope("superengine benchmark");
+  Random random(7183);
+  superengine_benchmark(random);
+}
+
+}  // namespace
+}  // namespace pentago
+
+int main() {
+  try {
+    pentago::toplevel();
+    return 0;
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+}
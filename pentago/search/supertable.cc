@@ -11,7 +11,6 @@
 namespace pentago {
 
 using std::max;
-using std::tie;
 
 static const int hash_bits = 54;
 static const int depth_bits = 10;
@@ -66,10 +65,11 @@ int supertable_bits() {
 template<bool aggressive> superlookup_t super_lookup(int depth, side_t side0, side_t side1) {
   STAT(total_lookups++);
   STAT_DETAIL(lookup_detail[depth]++);
-  // Standardize the board
+  // Standardize the board, with the SSE kernel if we have one.  Only boards which reach the table pay
+  // for this, which beats standardizing all children of a node up front.
   superlookup_t data;
   board_t standard;
-  tie(standard, data.symmetry) = superstandardize(side0, side1);
+  superstandardize(side0, side1, standard, data.symmetry);
   data.hash = hash_board(standard|(uint64_t)aggressive<<aggressive_bit);
   // Lookup entry
   const superentry_t& entry = table[data.hash&((1<<table_bits)-1)];
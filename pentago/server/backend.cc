@@ -0,0 +1,220 @@
+// Serve board values over HTTP, as a native replacement for web/server
+//
+// Requests for /<board> return a json dictionary mapping boards to values exactly as web/server/index.js
+// does, looking up boards with fewer than --max-slice stones in a directory of slice-<n>.pentago and
+// slice-<n>.pentago.index files (or in an opening book from make-book, if given) and solving boards with
+// 18 or more stones via midsolve.  /stats returns request counts and the hit rates of the block and result
+// caches as json.  For example,
+//
+//   backend --data /data/pentago --port 8080 --usage web/server/usage.txt
+
+#include "pentago/end/options.h"
+#include "pentago/server/http.h"
+#include "pentago/server/values.h"
+#include "pentago/utility/large.h"
+#include "pentago/utility/log.h"
+#include "pentago/utility/wall_time.h"
+#include <atomic>
+#include <cmath>
+#include <fstream>
+#include <getopt.h>
+#include <sstream>
+
+namespace pentago {
+namespace {
+
+using std::get;
+using std::make_shared;
+
+struct options_t {
+  int port = 8080;
+  int threads = 64;
+  string data;
+  uint64_t cache = uint64_t(250) << 20;
+  uint64_t results = uint64_t(64) << 20;
+  int max_slice = 18;
+  int midsolves = 1;
+  string book;
+  string usage;
+  bool verbose = false;
+};
+
+options_t parse_options(int argc, char** argv) {
+  options_t o;
+  static const option options[] = {
+      {"help", no_argument, 0, 'h'},
+      {"port", required_argument, 0, 'p'},
+      {"threads", required_argument, 0, 't'},
+      {"data", required_argument, 0, 'd'},
+      {"cache", required_argument, 0, 'c'},
+      {"results", required_argument, 0, 'r'},
+      {"max-slice", required_argument, 0, 's'},
+      {"midsolves", required_argument, 0, 'm'},
+      {"book", required_argument, 0, 'b'},
+      {"usage", required_argument, 0, 'u'},
+      {"verbose", no_argument, 0, 'v'},
+      {0, 0, 0, 0},
+  };
+  const int rank = 0;
+  for (;;) {
+    int option = 0;
+    int c = getopt_long(argc, argv, "hp:t:d:c:r:b:v", options, &option);
+    if (c == -1) break;  // Out of options
+    switch (c) {
+      case 'h':
+        slog("usage: %s [options...]", argv[0]);
+        slog("Serve board values over HTTP.");
+        slog("  -h, --help                Display usage information and quit");
+        slog("  -p, --port <n>            Port to listen on (default %d)", o.port);
+        slog("  -t, --threads <n>         Threads, and thus simultaneous connections (default %d)", o.threads);
+        slog("  -d, --data <dir>          Directory with slice-<n>.pentago and slice-<n>.pentago.index (required)");
+        slog("  -c, --cache <size>        Size of block cache, e.g. 250M or 1.5G (default %s)", large(o.cache));
+        slog("  -r, --results <size>      Size of result cache (default %s)", large(o.results));
+        slog("      --max-slice <n>       Maximum slice available in database (default %d)", o.max_slice);
+        slog("      --midsolves <n>       Simultaneous midsolves, each using about 1 GB (default %d)", o.midsolves);
+        slog("  -b, --book <file>         Opening book for boards with few stones (see make-book)");
+        slog("      --usage <file>        Usage text to include in responses to bad requests");
+        slog("  -v, --verbose             Log each request");
+        exit(0);
+      PENTAGO_INT_ARG('p', port, port)
+      PENTAGO_INT_ARG('t', threads, threads)
+      PENTAGO_INT_ARG('s', max-slice, max_slice)
+      PENTAGO_INT_ARG('m', midsolves, midsolves)
+      case 'd':
+        o.data = optarg;
+        break;
+      case 'c':
+      case 'r': {
+        char* end;
+        const double size = strtod(optarg, &end);
+        auto& limit = c=='c' ? o.cache : o.results;
+        if (!strcmp(end, "MB") || !strcmp(end, "M"))
+          limit = uint64_t(size*pow(2.,20));
+        else if (!strcmp(end, "GB") || !strcmp(end, "G"))
+          limit = uint64_t(size*pow(2.,30));
+        else
+          PENTAGO_OPTION_ERROR("don't understand cache size \"%s\", use e.g. 250M or 1.5G", optarg);
+        break; }
+      case 'b':
+        o.book = optarg;
+        break;
+      case 'u':
+        o.usage = optarg;
+        break;
+      case 'v':
+        o.verbose = true;
+        break;
+      default:
+        PENTAGO_OPTION_ERROR("impossible option character %d", c);
+    }
+  }
+  if (o.data.empty())
+    PENTAGO_OPTION_ERROR("--data is required");
+  if (!(0 <= o.port && o.port < 65536))
+    PENTAGO_OPTION_ERROR("--port %d must be in [0,65536)", o.port);
+  if (o.threads < 1)
+    PENTAGO_OPTION_ERROR("--threads %d must be positive", o.threads);
+  if (!(0 <= o.max_slice && o.max_slice <= 18))
+    PENTAGO_OPTION_ERROR("--max-slice %d must be in [0,18]", o.max_slice);
+  if (o.midsolves < 0)
+    PENTAGO_OPTION_ERROR("--midsolves %d must be nonnegative", o.midsolves);
+  if (optind != argc)
+    PENTAGO_OPTION_ERROR("expected no arguments");
+  return o;
+}
+
+// HTTP date one year from now, for the expires header
+string next_year() {
+  const time_t t = time(0) + 31536000;
+  tm gmt;
+  gmtime_r(&t, &gmt);
+  char date[64];
+  strftime(date, sizeof(date), "%a, %d %b %Y %H:%M:%S GMT", &gmt);
+  return date;
+}
+
+string stats_json(const cache_stats_t& s) {
+  return format("{\"hits\":%d,\"coalesced\":%d,\"misses\":%d,\"hit_rate\":%.4f,\"evictions\":%d,"
+                "\"entries\":%d,\"memory\":%d}", s.hits, s.coalesced, s.misses, s.hit_rate(), s.evictions,
+                s.entries, s.memory);
+}
+
+void toplevel(int argc, char** argv) {
+  const auto o = parse_options(argc, argv);
+  Scope scope("backend");
+  slog("data = %s, cache = %s, results = %s, max slice = %d, midsolves = %d", o.data, large(o.cache),
+       large(o.results), o.max_slice, o.midsolves);
+  string usage;
+  if (o.usage.size()) {
+    std::ifstream file(o.usage);
+    if (!file)
+      THROW(IOError, "can't read usage file '%s'", o.usage);
+    std::stringstream s;
+    s << file.rdbuf();
+    usage = s.str();
+  }
+  shared_ptr<const opening_book_t> book;
+  if (o.book.size()) {
+    book = make_shared<opening_book_t>(o.book);
+    slog("book = %s, max slice = %d, boards = %s, size = %s", o.book, book->max_slice, large(book->boards),
+         large(book->memory_usage()));
+  }
+  const values_t values(local_files(o.data), o.max_slice, o.cache, o.midsolves, o.results, book);
+  std::atomic<uint64_t> requests(0), errors(0);
+
+  const auto handler = [&](const string& path) {
+    if (path == "/stats")
+      return http_response_t{200, {{"content-type", "application/json; charset=utf-8"}},
+          format("{\"requests\":%d,\"errors\":%d,\"results\":%s,\"blocks\":%s}", uint64_t(requests), uint64_t(errors),
+                 stats_json(values.result_stats()), stats_json(values.block_stats()))};
+    requests++;
+
+    // Parse board
+    high_board_t board;
+    try {
+      board = high_board_t::parse(path.substr(1));
+    } catch (const std::exception& e) {
+      errors++;
+      if (o.verbose)
+        slog("bad request %s", path);
+      return http_response_t{404, {}, format(
+          "bad url %s: expected (\\d+)m? representing valid board as described below\n\n%s", path, usage)};
+    }
+
+    // Lookup!
+    const auto start = wall_time();
+    shared_ptr<const board_values_t> results;
+    try {
+      results = values.values(board);
+    } catch (const ValueError& e) {
+      errors++;
+      return http_response_t{404, {}, format("%s\n", e.what())};
+    }
+    if (o.verbose)
+      slog("response %s, elapsed %g s", board.name(), (wall_time() - start).seconds());
+
+    // Send reply, following cache advice at https://developers.google.com/speed/docs/best-practices/caching
+    return http_response_t{200, {
+        {"content-type", "application/json; charset=utf-8"},
+        {"cache-control", "public"},
+        {"access-control-allow-origin", "*"},  // All access from javascript is safe
+        {"expires", next_year()}}, values_json(*results)};
+  };
+
+  http_server_t server(o.port, o.threads, handler);
+  slog("listening on port %d with %d threads", server.port(), o.threads);
+  server.wait();
+}
+
+}  // namespace
+}  // namespace pentago
+
+int main(int argc, char** argv) {
+  try {
+    pentago::toplevel(argc, argv);
+    return 0;
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+}
@@ -0,0 +1,73 @@
+// Time opening book lookups
+//
+// Builds a small book of meaningless values in a temporary directory, then times lookups of random
+// boards with few enough stones to be in it.  Each timing is the best of several tries.
+
+#include "pentago/base/superscore.h"
+#include "pentago/base/symmetry.h"
+#include "pentago/server/book.h"
+#include "pentago/utility/log.h"
+#include "pentago/utility/random.h"
+#include "pentago/utility/range.h"
+#include "pentago/utility/temporary.h"
+#include "pentago/utility/thread.h"
+#include "pentago/utility/wall_time.h"
+
+namespace pentago {
+namespace {
+
+using std::min;
+
+// Run f several times and return the best time in seconds
+template<class F> double best_time(const int tries, const F& f) {
+  double best = std::numeric_limits<double>::infinity();
+  for (int t = 0; t < tries; t++) {
+    const auto start = wall_time();
+    f();
+    best = min(best, (wall_time()-start).seconds());
+  }
+  return best;
+}
+
+volatile uint64_t sink;
+
+// Lookups in a book of slices 0 through 4 of symmetric, meaningless values
+void book_benchmark(Random& random) {
+  tempdir_t tmp("book");
+  const int max_slice = 4;
+  const auto path = tmp.path + "/meaningless.pentago";
+  write_opening_book(path, max_slice, [](const board_t board) {
+    const auto a = super_meaningless(board, 1), b = super_meaningless(board, 2);
+    return vec(a & b, a | b);
+  });
+  const opening_book_t book(path);
+  vector<high_board_t> boards;
+  for (__attribute__((unused)) const int i : range(1<<16))
+    boards.push_back(high_board_t::from_board(random_board(random, random.uniform<int>(0, max_slice+1)), false));
+  slog("book lookup = %.3g ns", 1e9/boards.size()*best_time(5, [&]() {
+    int sum = 0;
+    for (const auto& board : boards)
+      sum += book.value(board);
+    sink = sum;
+  }));
+}
+
+void toplevel() {
+  Scope scope("book benchmark");
+  init_threads(-1, -1);
+  Random random(7183);
+  book_benchmark(random);
+}
+
+}  // namespace
+}  // namespace pentago
+
+int main() {
+  try {
+    pentago::toplevel();
+    return 0;
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+}
@@ -0,0 +1,278 @@
+// Opening book: compact in-memory values for boards with few stones
+
+#include "pentago/server/book.h"
+#include "pentago/base/all_boards.h"
+#include "pentago/base/hash.h"
+#include "pentago/base/section.h"
+#include "pentago/base/superscore.h"
+#include "pentago/base/symmetry.h"
+#include "pentago/data/block_cache.h"
+#include "pentago/utility/const_cast.h"
+#include "pentago/utility/debug.h"
+#include "pentago/utility/large.h"
+#include "pentago/utility/log.h"
+#include "pentago/utility/random.h"
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+namespace pentago {
+
+using std::max;
+
+static const char magic[21] = "pentago book       \n";
+static const int header_size = 64;
+static const int max_displacement = 1<<16;
+
+// Keys are hashed once with hash_board, which is invertible, so distinct boards have distinct hashes.
+// The high half picks a bucket, and each bucket's displacement rehashes all of its boards into slots.
+static inline uint64_t key_hash(const uint64_t seed, const board_t board) {
+  return hash_board(board ^ seed);
+}
+
+static inline int fast_range(const uint32_t x, const int n) {
+  return int(uint64_t(x) * uint64_t(n) >> 32);
+}
+
+static inline int bucket_hash(const uint64_t h, const int buckets) {
+  return fast_range(uint32_t(h >> 32), buckets);
+}
+
+static inline int slot_hash(const uint64_t h, const int displacement, const int slots) {
+  return fast_range(uint32_t(hash_board(h ^ (0x9e3779b97f4a7c15 * (displacement + 1))) >> 32), slots);
+}
+
+static inline uint64_t align64(const uint64_t n) {
+  return (n + 63) & ~uint64_t(63);
+}
+
+book_supers_t block_cache_supers(const block_cache_t& cache) {
+  return [&cache](const board_t board) {
+    const auto flip = flip_board(board, count(board).sum() & 1);
+    Vector<super_t,2> supers;
+    GEODE_ASSERT(cache.lookup(true, flip, supers[0]));
+    GEODE_ASSERT(cache.lookup(false, flip, supers[1]));
+    return supers;
+  };
+}
+
+// Fold immediate results into the supers of a standard board, so that lookups needn't check for five in a
+// row.  Bit r of each super is the value of standard rotated by r, as is bit r of super_wins.
+static Vector<super_t,2> fold_done(const board_t standard, const Vector<super_t,2>& supers) {
+  const int n = count(standard).sum();
+  const super_t us = super_wins(unpack(standard, n & 1)),
+                them = super_wins(unpack(standard, !(n & 1))),
+                done = n == 36 ? ~super_t(0) : us | them;
+  return vec((supers[0] & ~done) | (us & ~them),
+             (supers[1] & ~done) | (done & ~(them & ~us)));
+}
+
+opening_book_t::opening_book_t(const string& path)
+  : max_slice(0), boards(0), seed(0) {
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    THROW(IOError, "opening book: can't open '%s': %s", path, strerror(errno));
+  struct stat st;
+  if (fstat(fd, &st) < 0 || size_t(st.st_size) < header_size) {
+    close(fd);
+    THROW(IOError, "opening book: '%s' is too small", path);
+  }
+  const size_t size = st.st_size;
+  int flags = MAP_SHARED;
+#ifdef MAP_POPULATE
+  flags |= MAP_POPULATE;  // Fault everything in now so that lookups never touch the disk
+#endif
+  void* start = mmap(0, size, PROT_READ, flags, fd, 0);
+  close(fd);
+  if (start == MAP_FAILED)
+    THROW(IOError, "opening book: mmap of '%s' failed: %s", path, strerror(errno));
+  const shared_ptr<const uint8_t> owner(static_cast<const uint8_t*>(start), [size](const uint8_t* start) {
+    munmap(const_cast<uint8_t*>(start), size);
+  });
+
+  // Parse header
+  const auto data = owner.get();
+  if (memcmp(data, magic, 20))
+    THROW(IOError, "opening book: '%s' has bad magic string", path);
+  uint32_t fields[3];
+  memcpy(fields, data + 20, sizeof(fields));
+  const int buckets = fields[1], slots = fields[2];
+  memcpy(&const_cast_(boards), data + 32, sizeof(uint64_t));
+  memcpy(&const_cast_(seed), data + 40, sizeof(uint64_t));
+  const_cast_(max_slice) = fields[0];
+  const uint64_t supers_offset = align64(header_size + sizeof(uint16_t) * uint64_t(buckets));
+  if (!(0 <= max_slice && max_slice <= 36 && buckets > 0 && slots > 0 && boards <= uint64_t(slots)
+        && size == supers_offset + sizeof(Vector<super_t,2>) * uint64_t(slots)))
+    THROW(IOError, "opening book: '%s' has inconsistent header or size", path);
+  const_cast_(displacements) = Array<const uint16_t>(vec(buckets), shared_ptr<const uint16_t>(
+      owner, reinterpret_cast<const uint16_t*>(data + header_size)));
+  const_cast_(supers) = Array<const Vector<super_t,2>>(vec(slots), shared_ptr<const Vector<super_t,2>>(
+      owner, reinterpret_cast<const Vector<super_t,2>*>(data + supers_offset)));
+}
+
+opening_book_t::~opening_book_t() {}
+
+uint64_t opening_book_t::memory_usage() const {
+  return align64(header_size + sizeof(uint16_t) * uint64_t(displacements.size()))
+       + sizeof(Vector<super_t,2>) * uint64_t(supers.size());
+}
+
+int opening_book_t::slot(const board_t standard) const {
+  const auto h = key_hash(seed, standard);
+  return slot_hash(h, displacements[bucket_hash(h, displacements.size())], supers.size());
+}
+
+int opening_book_t::value(const high_board_t board) const {
+  if (!board.middle()) {
+    // Immediate results are already folded in, so we needn't check board.done()
+    GEODE_ASSERT(board.count() <= max_slice);
+    const auto [standard, symmetry] = superstandardize(board.board());
+    const auto& s = supers[slot(standard)];
+
+    // We store supers for standard = symmetry(board), and the identity rotation of board corresponds
+    // to rotation symmetry.inverse().local of standard (see transform_super in symmetry.h).
+    const uint8_t r = symmetry.inverse().local;
+    return s[0](r) + s[1](r) - 1;
+  } else if (board.done()) {
+    return board.immediate_value();
+  } else {
+    int best = -1;
+    for (const auto& move : board.moves()) {
+      best = max(best, -value(move));
+      if (best == 1)
+        break;
+    }
+    return best;
+  }
+}
+
+void write_opening_book(const string& path, const int max_slice, const book_supers_t& supers) {
+  Scope scope("opening book");
+  GEODE_ASSERT(0 <= max_slice && max_slice <= 36);
+
+  // Collect superstandardized boards
+  vector<board_t> keys;
+  for (const int n : range(max_slice+1)) {
+    Scope scope(format("slice %d", n));
+    const auto before = keys.size();
+    all_boards_stream(n, 2048, [&keys](RawArray<const board_t> boards) {
+      const auto start = keys.size();
+      keys.resize(start + boards.size());
+      superstandardize(boards, RawArray<board_t>(boards.size(), keys.data() + start), RawArray<symmetry_t>());
+    });
+    slog("boards = %d", keys.size() - before);
+  }
+  const uint64_t boards = keys.size();
+  GEODE_ASSERT(boards < (uint64_t(1)<<31) * 15 / 16, format("%d boards is too many", boards));
+
+  // About four boards per bucket and 3% empty slots makes a displacement search cheap: buckets are
+  // placed largest first, and the last single board buckets still find an empty slot within about
+  // 33 tries.  If any bucket exhausts its displacements, we start over with a new seed.
+  const int buckets = max(1, int((boards + 3) / 4));
+  const int slots = max(1, int(boards + boards / 32 + 1));
+  Array<uint16_t> displacements(buckets);
+  Array<int> key_slots(CHECK_CAST_INT(boards), uninit);
+  uint64_t seed;
+  {
+    Scope scope("perfect hash");
+    Random random(1831);
+    for (int attempt = 0;; attempt++) {
+      GEODE_ASSERT(attempt < 16, "opening book: perfect hash construction failed repeatedly");
+      seed = random.bits<uint64_t>();
+
+      // Sort keys into buckets, then order buckets by decreasing size
+      Array<uint64_t> hashes(key_slots.size(), uninit);
+      Array<int> starts(buckets + 1);
+      for (const int i : range(hashes.size())) {
+        hashes[i] = key_hash(seed, keys[i]);
+        starts[bucket_hash(hashes[i], buckets) + 1]++;
+      }
+      int largest = 0;
+      for (const int b : range(buckets)) {
+        largest = max(largest, starts[b+1]);
+        starts[b+1] += starts[b];
+      }
+      Array<int> members(hashes.size(), uninit);
+      {
+        auto next = starts.slice(0, buckets).copy();
+        for (const int i : range(hashes.size()))
+          members[next[bucket_hash(hashes[i], buckets)]++] = i;
+      }
+      vector<int> order(buckets);
+      for (const int b : range(buckets))
+        order[b] = b;
+      std::stable_sort(order.begin(), order.end(), [&starts](const int a, const int b) {
+        return starts[a+1] - starts[a] > starts[b+1] - starts[b];
+      });
+      slog("seed %d: largest bucket = %d", seed, largest);
+
+      // Greedily find a displacement for each bucket
+      vector<bool> taken(slots);
+      displacements.fill(0);
+      vector<int> tentative;
+      bool success = true;
+      for (const int b : order) {
+        const auto bucket = members.slice(starts[b], starts[b+1]);
+        if (!bucket.size())
+          break;
+        int d = 0;
+        for (; d < max_displacement; d++) {
+          tentative.clear();
+          for (const int i : bucket) {
+            const int s = slot_hash(hashes[i], d, slots);
+            if (taken[s] || std::find(tentative.begin(), tentative.end(), s) != tentative.end())
+              break;
+            tentative.push_back(s);
+          }
+          if (tentative.size() == size_t(bucket.size()))
+            break;
+        }
+        if (d == max_displacement) {
+          slog("bucket of size %d failed, retrying", bucket.size());
+          success = false;
+          break;
+        }
+        displacements[b] = d;
+        for (const int j : range(bucket.size())) {
+          taken[tentative[j]] = true;
+          key_slots[bucket[j]] = tentative[j];
+        }
+      }
+      if (success)
+        break;
+    }
+  }
+
+  // Fill in values
+  Array<Vector<super_t,2>> table(slots);
+  {
+    Scope scope("supers");
+    for (const int i : range(key_slots.size()))
+      table[key_slots[i]] = fold_done(keys[i], supers(keys[i]));
+  }
+
+  // Write book
+  FILE* file = fopen(path.c_str(), "wb");
+  if (!file)
+    THROW(IOError, "write_opening_book: can't open '%s' for writing", path);
+  const uint32_t fields[3] = {uint32_t(max_slice), uint32_t(buckets), uint32_t(slots)};
+  const uint8_t zeros[64] = {0};
+  fwrite(magic, 1, 20, file);
+  fwrite(fields, sizeof(uint32_t), 3, file);
+  fwrite(&boards, sizeof(uint64_t), 1, file);
+  fwrite(&seed, sizeof(uint64_t), 1, file);
+  fwrite(zeros, 1, header_size - 48, file);
+  fwrite(displacements.data(), sizeof(uint16_t), buckets, file);
+  const uint64_t supers_offset = align64(header_size + sizeof(uint16_t) * uint64_t(buckets));
+  fwrite(zeros, 1, supers_offset - header_size - sizeof(uint16_t) * buckets, file);
+  fwrite(table.data(), sizeof(Vector<super_t,2>), slots, file);
+  const bool error = ferror(file);
+  if (fclose(file) || error)
+    THROW(IOError, "write_opening_book: error writing '%s'", path);
+  slog("boards = %d, slots = %d, size = %s", boards, slots,
+       large(supers_offset + sizeof(Vector<super_t,2>) * uint64_t(slots)));
+}
+
+}  // namespace pentago
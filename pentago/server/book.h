@@ -0,0 +1,71 @@
+// Opening book: compact in-memory values for boards with few stones
+//
+// An opening book holds the values of every board with at most max_slice stones, so that the opening
+// can be answered without touching the database.  Only superstandardized boards are stored: each one
+// gets a pair of super_ts (win and notlose for the player to move, for all 256 local rotations), so
+// every board in its orbit under the 2048 element symmetry group is answered by one 64 byte slot.
+// Rotations which have five in a row store their immediate values, so lookups need only superstandardize,
+// hash, and read two bits.
+// Slots are found by a hash and displace perfect hash (one 16-bit displacement per bucket of about
+// four boards), and keys are not stored, so looking up a board with too many stones gives garbage.
+//
+// Book files are mmapped, so loading is immediate and lookups do no I/O beyond page faults.  Counting
+// orbits, slices 0 through 8 take about 220 MB, and slices 0 through 9 about 1 GB.
+//
+// The file format is little endian:
+//
+//   char magic[20] = "pentago book       \n";
+//   uint32_t max_slice;
+//   uint32_t buckets;  // Number of displacements
+//   uint32_t slots;    // Size of the table, slightly larger than the number of boards
+//   uint64_t boards;
+//   uint64_t seed;     // Hash seed
+//   (padding to 64 bytes)
+//   uint16_t displacements[buckets];
+//   (padding to a multiple of 64 bytes)
+//   Vector<super_t,2> supers[slots];  // Zero for empty slots
+#pragma once
+
+#include "pentago/base/superscore.h"
+#include "pentago/high/board.h"
+#include "pentago/utility/array.h"
+#include <boost/core/noncopyable.hpp>
+#include <functional>
+namespace pentago {
+
+struct block_cache_t;
+using std::function;
+
+// Win and notlose super_ts for the player to move in the given board
+typedef function<Vector<super_t,2>(const board_t board)> book_supers_t;
+
+// book_supers_t from a database, as in values_t::lookup
+book_supers_t block_cache_supers(const block_cache_t& cache);
+
+struct opening_book_t : private boost::noncopyable {
+  const int max_slice;
+  const uint64_t boards;
+private:
+  const uint64_t seed;
+  const Array<const uint16_t> displacements;
+  const Array<const Vector<super_t,2>> supers;
+
+public:
+  opening_book_t(const string& path);
+  ~opening_book_t();
+
+  // 1 if the player to move wins, 0 for tie, -1 if the player to move loses.  Requires at most
+  // max_slice stones.
+  int value(const high_board_t board) const;
+
+  // Mapped size in bytes
+  uint64_t memory_usage() const;
+
+private:
+  int slot(const board_t standard) const;
+};
+
+// Write an opening book for all boards with at most max_slice stones.  Requires init_threads.
+void write_opening_book(const string& path, const int max_slice, const book_supers_t& supers);
+
+}  // namespace pentago
@@ -0,0 +1,294 @@
+// Minimal HTTP/1.1 server and client
+
+#include "pentago/server/http.h"
+#include "pentago/utility/log.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+namespace pentago {
+
+using std::get;
+using std::make_tuple;
+using std::unique_lock;
+
+namespace {
+
+const int max_header_size = 16 << 10;
+const int max_body_size = 64 << 10;  // We skip request bodies, so there's no need for large ones
+const int idle_timeout = 5;  // Seconds before we drop a silent connection, which otherwise holds a thread
+
+const char* reason(const int status) {
+  switch (status) {
+    case 200: return "OK";
+    case 400: return "Bad Request";
+    case 404: return "Not Found";
+    case 431: return "Request Header Fields Too Large";
+    case 500: return "Internal Server Error";
+    default: return "Unknown";
+  }
+}
+
+void send_all(const int fd, const string& data) {
+  for (size_t sent = 0; sent < data.size();) {
+    const auto n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      THROW(IOError, "http: send failed: %s", strerror(errno));
+    }
+    sent += n;
+  }
+}
+
+// Receive more data onto the end of buffer, returning false on a closed connection
+bool recv_some(const int fd, string& buffer) {
+  char chunk[4096];
+  for (;;) {
+    const auto n = recv(fd, chunk, sizeof(chunk), 0);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    buffer.append(chunk, n);
+    return true;
+  }
+}
+
+// Head of an HTTP message: the first line, and the values of the headers we care about
+struct head_t {
+  string first;
+  int64_t content_length = 0;  // -1 if malformed
+  string connection;
+};
+
+// Parse the head of a message at the start of buffer, ending at the given \r\n\r\n
+head_t parse_head(const string& buffer, const size_t end) {
+  head_t head;
+  size_t line = 0;
+  for (bool first = true; line < end; first = false) {
+    auto next = buffer.find("\r\n", line);
+    const auto text = buffer.substr(line, next - line);
+    line = next + 2;
+    if (first) {
+      head.first = text;
+      continue;
+    }
+    const auto colon = text.find(':');
+    if (colon == string::npos) continue;
+    const auto name = text.substr(0, colon);
+    auto value = text.substr(colon + 1);
+    value.erase(0, value.find_first_not_of(" \t"));
+    if (!strcasecmp(name.c_str(), "content-length")) {
+      // Only plain decimal digits, which also rules out negative lengths
+      const auto digits = value.substr(0, value.find_last_not_of(" \t") + 1);
+      head.content_length = !digits.empty() && digits.size() <= 18
+                            && digits.find_first_not_of("0123456789") == string::npos
+                              ? atoll(digits.c_str()) : -1;
+    }
+    else if (!strcasecmp(name.c_str(), "connection"))
+      head.connection = value;
+  }
+  return head;
+}
+
+// Read the head of a message into buffer, returning the end of the head or npos if the connection closes
+size_t read_head(const int fd, string& buffer) {
+  for (;;) {
+    const auto end = buffer.find("\r\n\r\n");
+    if (end != string::npos)
+      return end + 2;
+    if (buffer.size() > max_header_size || !recv_some(fd, buffer))
+      return string::npos;
+  }
+}
+
+}  // namespace
+
+http_server_t::http_server_t(const int port, const int threads, const http_handler_t& handler)
+  : handler(handler)
+  , listen_fd(socket(AF_INET6, SOCK_STREAM, 0))
+  , port_(port)
+  , stopping(false) {
+  GEODE_ASSERT(threads > 0);
+  if (listen_fd < 0)
+    THROW(IOError, "http: socket failed: %s", strerror(errno));
+  const int one = 1, zero = 0;
+  setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  setsockopt(listen_fd, IPPROTO_IPV6, IPV6_V6ONLY, &zero, sizeof(zero));
+  sockaddr_in6 addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin6_family = AF_INET6;
+  addr.sin6_addr = in6addr_any;
+  addr.sin6_port = htons(port);
+  if (bind(listen_fd, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(listen_fd, SOMAXCONN) < 0) {
+    const string error = strerror(errno);
+    close(listen_fd);
+    THROW(IOError, "http: can't listen on port %d: %s", port, error);
+  }
+  socklen_t size = sizeof(addr);
+  getsockname(listen_fd, (sockaddr*)&addr, &size);
+  port_ = ntohs(addr.sin6_port);
+  for (int i = 0; i < threads; i++)
+    this->threads.emplace_back([this]() { serve(); });
+}
+
+http_server_t::~http_server_t() {
+  stop();
+  close(listen_fd);
+}
+
+void http_server_t::wait() {
+  for (auto& thread : threads)
+    if (thread.joinable())
+      thread.join();
+}
+
+void http_server_t::stop() {
+  if (!stopping.exchange(true)) {
+    // Shutting down a socket wakes up any thread blocked on it
+    shutdown(listen_fd, SHUT_RDWR);
+    unique_lock<std::mutex> lock(connections_mutex);
+    for (const int fd : connections)
+      shutdown(fd, SHUT_RDWR);
+  }
+  wait();
+}
+
+void http_server_t::serve() {
+  while (!stopping) {
+    const int fd = accept(listen_fd, 0, 0);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) continue;
+      if (!stopping)
+        slog("http: accept failed: %s", strerror(errno));
+      return;
+    }
+    {
+      unique_lock<std::mutex> lock(connections_mutex);
+      if (stopping) {
+        close(fd);
+        return;
+      }
+      connections.insert(fd);
+    }
+    try {
+      serve_connection(fd);
+    } catch (const IOError& e) {
+      // The client went away
+    }
+    {
+      unique_lock<std::mutex> lock(connections_mutex);
+      connections.erase(fd);
+    }
+    close(fd);
+  }
+}
+
+void http_server_t::serve_connection(const int fd) {
+  const int one = 1;
+  const timeval timeout = {idle_timeout, 0};
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  string buffer;
+  while (!stopping) {
+    const auto end = read_head(fd, buffer);
+    if (end == string::npos) {
+      if (buffer.size() > max_header_size)
+        send_all(fd, format("HTTP/1.1 431 %s\r\ncontent-length: 0\r\nconnection: close\r\n\r\n", reason(431)));
+      return;
+    }
+    const auto head = parse_head(buffer, end);
+
+    // Reject bad content lengths.  We can't find the next request, so close the connection.
+    if (head.content_length < 0 || head.content_length > max_body_size) {
+      send_all(fd, format("HTTP/1.1 400 %s\r\ncontent-length: 0\r\nconnection: close\r\n\r\n", reason(400)));
+      return;
+    }
+
+    // Skip any request body
+    const auto body_end = end + 2 + head.content_length;
+    while (buffer.size() < body_end)
+      if (!recv_some(fd, buffer))
+        return;
+    buffer.erase(0, body_end);
+
+    // Request line is "<method> <path> HTTP/1.x"
+    http_response_t response;
+    const auto space0 = head.first.find(' ');
+    const auto space1 = head.first.find(' ', space0 + 1);
+    const auto version = space1 == string::npos ? string() : head.first.substr(space1 + 1);
+    const bool keep_alive = version == "HTTP/1.1" ? strcasecmp(head.connection.c_str(), "close")
+                                                  : !strcasecmp(head.connection.c_str(), "keep-alive");
+    if (space0 == string::npos || space1 == string::npos || version.compare(0, 5, "HTTP/"))
+      response = http_response_t{400, {}, "malformed request line\n"};
+    else {
+      try {
+        response = handler(head.first.substr(space0 + 1, space1 - space0 - 1));
+      } catch (const std::exception& e) {
+        response = http_response_t{500, {}, format("internal error: %s\n", e.what())};
+      }
+    }
+
+    // Send response
+    string reply = format("HTTP/1.1 %d %s\r\n", response.status, reason(response.status));
+    for (const auto& [name, value] : response.headers)
+      reply += format("%s: %s\r\n", name, value);
+    reply += format("content-length: %d\r\nconnection: %s\r\n\r\n", response.body.size(),
+                    keep_alive ? "keep-alive" : "close");
+    reply += response.body;
+    send_all(fd, reply);
+    if (!keep_alive)
+      return;
+  }
+}
+
+http_client_t::http_client_t(const string& host, const int port)
+  : host(host)
+  , fd(-1) {
+  addrinfo hints, *addrs;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  if (const int r = getaddrinfo(host.c_str(), format("%d", port).c_str(), &hints, &addrs))
+    THROW(IOError, "http: can't resolve %s: %s", host, gai_strerror(r));
+  for (auto a = addrs; a; a = a->ai_next) {
+    fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+    if (fd < 0) continue;
+    if (!connect(fd, a->ai_addr, a->ai_addrlen)) break;
+    close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(addrs);
+  if (fd < 0)
+    THROW(IOError, "http: can't connect to %s:%d: %s", host, port, strerror(errno));
+  const int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+http_client_t::~http_client_t() {
+  close(fd);
+}
+
+tuple<int,string> http_client_t::get(const string& path) {
+  send_all(fd, format("GET %s HTTP/1.1\r\nhost: %s\r\n\r\n", path, host));
+  const auto end = read_head(fd, buffer);
+  if (end == string::npos)
+    THROW(IOError, "http: connection to %s closed before response", host);
+  const auto head = parse_head(buffer, end);
+  int status;
+  if (sscanf(head.first.c_str(), "HTTP/%*d.%*d %d", &status) != 1)
+    THROW(IOError, "http: bad status line '%s'", head.first);
+  if (head.content_length < 0)
+    THROW(IOError, "http: bad content-length from %s", host);
+  const size_t body_end = end + 2 + head.content_length;
+  while (buffer.size() < body_end)
+    if (!recv_some(fd, buffer))
+      THROW(IOError, "http: connection to %s closed during response", host);
+  const auto body = buffer.substr(end + 2, head.content_length);
+  buffer.erase(0, body_end);
+  return make_tuple(status, body);
+}
+
+}  // namespace pentago
@@ -0,0 +1,75 @@
+// Minimal HTTP/1.1 server and client
+//
+// Just enough HTTP to serve board values: every request is treated as a GET of its path, request bodies
+// are skipped, responses always carry a content-length, and connections are kept alive unless the
+// client asks otherwise.  The server runs a fixed pool of threads, each of which accepts and then serves
+// one connection at a time, so the number of threads bounds the number of concurrent connections.  Idle
+// connections are dropped after a few seconds so that they don't starve new clients.
+#pragma once
+
+#include "pentago/utility/array.h"
+#include <atomic>
+#include <boost/core/noncopyable.hpp>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <unordered_set>
+namespace pentago {
+
+using std::function;
+using std::tuple;
+
+struct http_response_t {
+  int status;
+  vector<tuple<string,string>> headers;  // Content-length and connection are added automatically
+  string body;
+};
+
+// Map a request path (e.g. /1m) to a response
+typedef function<http_response_t(const string& path)> http_handler_t;
+
+struct http_server_t : private boost::noncopyable {
+private:
+  const http_handler_t handler;
+  const int listen_fd;
+  int port_;
+  std::atomic<bool> stopping;
+  std::mutex connections_mutex;
+  std::unordered_set<int> connections;  // Open connections, so that stop() can interrupt them
+  vector<std::thread> threads;
+
+public:
+  // Listen on the given port (0 for any free port), serving requests with the given number of threads
+  http_server_t(const int port, const int threads, const http_handler_t& handler);
+  ~http_server_t();
+
+  int port() const { return port_; }
+
+  // Block until the server is stopped
+  void wait();
+
+  // Close all connections and stop serving
+  void stop();
+
+private:
+  void serve();
+  void serve_connection(const int fd);
+};
+
+// A single keep-alive connection to an HTTP server
+struct http_client_t : private boost::noncopyable {
+private:
+  const string host;
+  int fd;
+  string buffer;  // Bytes received beyond the last response
+
+public:
+  http_client_t(const string& host, const int port);
+  ~http_client_t();
+
+  // Send a GET request and wait for the response, returning status and body
+  tuple<int,string> get(const string& path);
+};
+
+}  // namespace pentago
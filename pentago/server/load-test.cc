@@ -0,0 +1,167 @@
+// Load test a board value server
+//
+// Opens several keep-alive connections to a server (either backend.cc or web/server), sends requests for
+// random boards with fewer than --max-slice stones, and reports latency percentiles and throughput.
+// For example,
+//
+//   load-test --port 8080 --connections 32 --requests 100000
+
+#include "pentago/end/options.h"
+#include "pentago/high/board.h"
+#include "pentago/server/http.h"
+#include "pentago/utility/log.h"
+#include "pentago/utility/random.h"
+#include "pentago/utility/range.h"
+#include "pentago/utility/wall_time.h"
+#include <algorithm>
+#include <getopt.h>
+#include <thread>
+
+namespace pentago {
+namespace {
+
+using std::get;
+using std::unique_ptr;
+
+struct options_t {
+  string host = "localhost";
+  int port = 8080;
+  int connections = 16;
+  int requests = 10000;
+  int min_slice = 0;
+  int max_slice = 18;
+  int seed = 7;
+  int distinct = 0;
+};
+
+options_t parse_options(int argc, char** argv) {
+  options_t o;
+  static const option options[] = {
+      {"help", no_argument, 0, 'h'},
+      {"host", required_argument, 0, 'H'},
+      {"port", required_argument, 0, 'p'},
+      {"connections", required_argument, 0, 'c'},
+      {"requests", required_argument, 0, 'n'},
+      {"min-slice", required_argument, 0, 'a'},
+      {"max-slice", required_argument, 0, 's'},
+      {"seed", required_argument, 0, 'r'},
+      {"distinct", required_argument, 0, 'd'},
+      {0, 0, 0, 0},
+  };
+  const int rank = 0;
+  for (;;) {
+    int option = 0;
+    int c = getopt_long(argc, argv, "hH:p:c:n:d:", options, &option);
+    if (c == -1) break;  // Out of options
+    switch (c) {
+      case 'h':
+        slog("usage: %s [options...]", argv[0]);
+        slog("Load test a board value server.");
+        slog("  -h, --help                Display usage information and quit");
+        slog("  -H, --host <host>         Server host (default %s)", o.host);
+        slog("  -p, --port <n>            Server port (default %d)", o.port);
+        slog("  -c, --connections <n>     Simultaneous connections (default %d)", o.connections);
+        slog("  -n, --requests <n>        Total requests (default %d)", o.requests);
+        slog("      --min-slice <n>       Minimum stones in requested boards (default %d)", o.min_slice);
+        slog("      --max-slice <n>       Requested boards have fewer stones than this (default %d)", o.max_slice);
+        slog("      --seed <n>            Random seed (default %d)", o.seed);
+        slog("  -d, --distinct <n>        Draw requests from n distinct boards (default: all distinct)");
+        exit(0);
+      PENTAGO_INT_ARG('p', port, port)
+      PENTAGO_INT_ARG('c', connections, connections)
+      PENTAGO_INT_ARG('n', requests, requests)
+      PENTAGO_INT_ARG('a', min-slice, min_slice)
+      PENTAGO_INT_ARG('s', max-slice, max_slice)
+      PENTAGO_INT_ARG('r', seed, seed)
+      PENTAGO_INT_ARG('d', distinct, distinct)
+      case 'H':
+        o.host = optarg;
+        break;
+      default:
+        PENTAGO_OPTION_ERROR("impossible option character %d", c);
+    }
+  }
+  if (o.connections < 1)
+    PENTAGO_OPTION_ERROR("--connections %d must be positive", o.connections);
+  if (o.requests < 1)
+    PENTAGO_OPTION_ERROR("--requests %d must be positive", o.requests);
+  if (!(0 <= o.min_slice && o.min_slice < o.max_slice && o.max_slice <= 36))
+    PENTAGO_OPTION_ERROR("need 0 <= --min-slice %d < --max-slice %d <= 36", o.min_slice, o.max_slice);
+  if (o.distinct < 0)
+    PENTAGO_OPTION_ERROR("--distinct %d must be nonnegative", o.distinct);
+  if (optind != argc)
+    PENTAGO_OPTION_ERROR("expected no arguments");
+  return o;
+}
+
+void toplevel(int argc, char** argv) {
+  const auto o = parse_options(argc, argv);
+  Scope scope("load test");
+
+  // Pick boards in advance so that generating them doesn't count against the server.  With --distinct,
+  // requests repeat boards to exercise caching.
+  vector<string> paths;
+  Random random(o.seed);
+  const int distinct = o.distinct ? std::min(o.distinct, o.requests) : o.requests;
+  for (__attribute__((unused)) const int i : range(distinct)) {
+    const int n = random.uniform<int>(o.min_slice, o.max_slice);
+    const bool middle = n && random.bits<uint8_t>() & 1;
+    paths.push_back("/" + high_board_t::from_board(random_board(random, n), middle).name());
+  }
+  for (__attribute__((unused)) const int i : range(distinct, o.requests))
+    paths.push_back(paths[random.uniform<int>(distinct)]);
+
+  // Each connection handles an interleaved subset of the requests
+  vector<double> latencies(o.requests);
+  vector<int> errors(o.connections);
+  vector<std::thread> threads;
+  const auto start = wall_time();
+  for (const int c : range(o.connections)) {
+    threads.emplace_back([&o, &paths, &latencies, &errors, c]() {
+      // Failed requests count as errors, and we reconnect afterwards
+      unique_ptr<http_client_t> client;
+      for (int i = c; i < o.requests; i += o.connections) {
+        const auto request = wall_time();
+        try {
+          if (!client)
+            client.reset(new http_client_t(o.host, o.port));
+          errors[c] += get<0>(client->get(paths[i])) != 200;
+        } catch (const IOError& e) {
+          slog("request %s failed: %s", paths[i], e.what());
+          errors[c]++;
+          client.reset();
+        }
+        latencies[i] = (wall_time() - request).seconds();
+      }
+    });
+  }
+  for (auto& thread : threads)
+    thread.join();
+  const double elapsed = (wall_time() - start).seconds();
+
+  // Report
+  std::sort(latencies.begin(), latencies.end());
+  const auto percentile = [&](const double p) {
+    return 1e3*latencies[std::min(o.requests - 1, int(p*o.requests))];
+  };
+  int total_errors = 0;
+  for (const int e : errors)
+    total_errors += e;
+  slog("requests = %d, connections = %d, errors = %d", o.requests, o.connections, total_errors);
+  slog("latency: p50 = %.3g ms, p90 = %.3g ms, p99 = %.3g ms, max = %.3g ms", percentile(.5),
+       percentile(.9), percentile(.99), 1e3*latencies.back());
+  slog("time = %.3g s, %.3g requests/s", elapsed, o.requests/elapsed);
+}
+
+}  // namespace
+}  // namespace pentago
+
+int main(int argc, char** argv) {
+  try {
+    pentago::toplevel(argc, argv);
+    return 0;
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+}
@@ -0,0 +1,114 @@
+// Build an opening book from the database
+//
+// Reads slice-<n>.pentago files for n <= --max-slice and writes every superstandardized board with
+// their values into a compact book file (see book.h), which backend --book serves without touching
+// the database.  For example,
+//
+//   make-book --data /data/pentago --max-slice 8 --output book-8.pentago
+
+#include "pentago/data/block_cache.h"
+#include "pentago/data/supertensor.h"
+#include "pentago/end/options.h"
+#include "pentago/server/book.h"
+#include "pentago/utility/large.h"
+#include "pentago/utility/log.h"
+#include "pentago/utility/range.h"
+#include "pentago/utility/thread.h"
+#include <cmath>
+#include <getopt.h>
+
+namespace pentago {
+namespace {
+
+struct options_t {
+  string data;
+  string output;
+  int max_slice = 8;
+  uint64_t cache = uint64_t(1) << 30;
+  int threads = -1;
+};
+
+options_t parse_options(int argc, char** argv) {
+  options_t o;
+  static const option options[] = {
+      {"help", no_argument, 0, 'h'},
+      {"data", required_argument, 0, 'd'},
+      {"output", required_argument, 0, 'o'},
+      {"max-slice", required_argument, 0, 's'},
+      {"cache", required_argument, 0, 'c'},
+      {"threads", required_argument, 0, 't'},
+      {0, 0, 0, 0},
+  };
+  const int rank = 0;
+  for (;;) {
+    int option = 0;
+    int c = getopt_long(argc, argv, "hd:o:s:c:t:", options, &option);
+    if (c == -1) break;  // Out of options
+    switch (c) {
+      case 'h':
+        slog("usage: %s [options...]", argv[0]);
+        slog("Build an opening book from the database.");
+        slog("  -h, --help                Display usage information and quit");
+        slog("  -d, --data <dir>          Directory with slice-<n>.pentago (required)");
+        slog("  -o, --output <file>       Book to write (required)");
+        slog("  -s, --max-slice <n>       Include boards with at most this many stones (default %d)", o.max_slice);
+        slog("  -c, --cache <size>        Size of block cache, e.g. 250M or 1.5G (default %s)", large(o.cache));
+        slog("  -t, --threads <n>         Number of threads for enumerating boards (default: one per core)");
+        exit(0);
+      PENTAGO_INT_ARG('s', max-slice, max_slice)
+      PENTAGO_INT_ARG('t', threads, threads)
+      case 'd':
+        o.data = optarg;
+        break;
+      case 'o':
+        o.output = optarg;
+        break;
+      case 'c': {
+        char* end;
+        const double size = strtod(optarg, &end);
+        if (!strcmp(end, "MB") || !strcmp(end, "M"))
+          o.cache = uint64_t(size*pow(2.,20));
+        else if (!strcmp(end, "GB") || !strcmp(end, "G"))
+          o.cache = uint64_t(size*pow(2.,30));
+        else
+          PENTAGO_OPTION_ERROR("don't understand cache size \"%s\", use e.g. 250M or 1.5G", optarg);
+        break; }
+      default:
+        die("impossible option character %d", c);
+    }
+  }
+  if (o.data.empty())
+    PENTAGO_OPTION_ERROR("--data is required");
+  if (o.output.empty())
+    PENTAGO_OPTION_ERROR("--output is required");
+  if (!(0 <= o.max_slice && o.max_slice <= 10))
+    PENTAGO_OPTION_ERROR("--max-slice %d must be in [0,10]", o.max_slice);
+  if (optind != argc)
+    PENTAGO_OPTION_ERROR("expected no arguments");
+  return o;
+}
+
+void toplevel(int argc, char** argv) {
+  const auto o = parse_options(argc, argv);
+  Scope scope("make book");
+  init_threads(o.threads, -1);
+  vector<shared_ptr<const supertensor_reader_t>> readers;
+  for (const int slice : range(o.max_slice+1))
+    for (const auto& reader : open_supertensors(format("%s/slice-%d.pentago", o.data, slice)))
+      readers.push_back(reader);
+  const auto cache = reader_block_cache(readers, o.cache);
+  write_opening_book(o.output, o.max_slice, block_cache_supers(*cache));
+}
+
+}  // namespace
+}  // namespace pentago
+
+int main(int argc, char** argv) {
+  try {
+    pentago::toplevel(argc, argv);
+    return 0;
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+}
@@ -0,0 +1,295 @@
+// Board value server tests
+
+#include "pentago/data/block_cache.h"
+#include "pentago/data/supertensor.h"
+#include "pentago/end/config.h"
+#include "pentago/high/check.h"
+#include "pentago/high/index.h"
+#include "pentago/mid/midengine.h"
+#include "pentago/base/score.h"
+#include "pentago/base/symmetry.h"
+#include "pentago/server/book.h"
+#include "pentago/server/http.h"
+#include "pentago/server/values.h"
+#include "pentago/utility/temporary.h"
+#include "pentago/utility/thread.h"
+#include "gtest/gtest.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unordered_map>
+#include <unistd.h>
+#include <unordered_set>
+namespace pentago {
+namespace {
+
+using std::get;
+using std::make_shared;
+using std::unordered_map;
+using std::unordered_set;
+
+// Write a database of random values for slices [0,max_slice], in the layout the server expects
+void write_random_database(const string& dir, const int max_slice) {
+  const auto slices = end::descendent_sections(section_t(), max_slice);
+  uint128_t key = 18731;
+  for (const int slice : range(max_slice+1)) {
+    const auto path = format("%s/slice-%d.pentago", dir, slice);
+    for (const auto& writer : supertensor_writers(path, slices[slice]->sections, end::block_size, 1, 6)) {
+      const auto blocks = writer->header.blocks;
+      for (const uint8_t i : range(blocks[0]))
+        for (const uint8_t j : range(blocks[1]))
+          for (const uint8_t k : range(blocks[2]))
+            for (const uint8_t l : range(blocks[3])) {
+              const auto b = vec(i, j, k, l);
+              const auto shape = writer->header.block_shape(b);
+              const auto five = random_supers(key++, concat(shape, vec(2)));
+              writer->write_block(b, Array<Vector<super_t,2>,4>(shape, shared_ptr<Vector<super_t,2>>(
+                  five.owner(), reinterpret_cast<Vector<super_t,2>*>(five.data()))));
+            }
+      writer->finalize();
+    }
+    write_supertensor_index(path + ".index", open_supertensors(path));
+  }
+}
+
+vector<high_board_t> random_high_boards(Random& random, const int max_slice, const int count) {
+  vector<high_board_t> boards;
+  for (__attribute__((unused)) const int i : range(count)) {
+    const int n = random.uniform<int>(0, max_slice);
+    boards.push_back(high_board_t::from_board(random_board(random, n), n && random.bits<uint8_t>() & 1));
+  }
+  return boards;
+}
+
+TEST(server, values) {
+  init_threads(-1, -1);
+  const int max_slice = 3;
+  tempdir_t tmp("server");
+  write_random_database(tmp.path, max_slice);
+
+  // Compare against a reader_block_cache_t over the same files
+  vector<shared_ptr<const supertensor_reader_t>> readers;
+  for (const int slice : range(max_slice+1))
+    for (const auto& reader : open_supertensors(format("%s/slice-%d.pentago", tmp.path, slice)))
+      readers.push_back(reader);
+  const auto reader_cache = reader_block_cache(readers, 1<<30);
+  Random random(7121);
+  const auto boards = random_high_boards(random, max_slice, 64);
+  vector<board_values_t> correct;
+  for (const auto& board : boards) {
+    board_values_t results;
+    unordered_set<high_board_t> seen;
+    const auto add = [&](const high_board_t b) {
+      if (seen.insert(b).second)
+        results.emplace_back(b, value(*reader_cache, b));
+    };
+    if (!board.done())
+      for (const auto& a : board.moves()) {
+        add(a);
+        if (!board.middle() && !a.done())
+          for (const auto& b : a.moves())
+            add(b);
+      }
+    if (board.done() || board.middle())
+      add(board);
+    else {
+      // The root's value comes from its children, which may disagree with random database values
+      int best = -1;
+      for (const auto& a : board.moves())
+        best = std::max(best, value(*reader_cache, a));
+      results.emplace_back(board, best);
+    }
+    correct.push_back(results);
+  }
+
+  // Check from several threads at once, with caches large enough for everything and too small for anything
+  for (const uint64_t cache_limit : {uint64_t(1)<<30, uint64_t(1)}) {
+    const values_t values(local_files(tmp.path), max_slice, cache_limit, 0, cache_limit);
+    vector<std::thread> threads;
+    for (const int t : range(4)) {
+      threads.emplace_back([&, t]() {
+        for (int i = t; i < int(boards.size()); i += 4) {
+          const auto results = values.values(boards[i]);
+          ASSERT_EQ(results->size(), correct[i].size());
+          unordered_map<high_board_t,int> map;
+          for (const auto& [b, v] : *results)
+            map[b] = v;
+          for (const auto& [b, v] : correct[i])
+            ASSERT_EQ(check_get(map, b), v) << "board " << b;
+        }
+      });
+    }
+    for (auto& thread : threads)
+      thread.join();
+  }
+
+  // Boards beyond the database are rejected
+  const values_t values(local_files(tmp.path), max_slice, 1<<20, 0, 1<<20);
+  ASSERT_THROW(values.values(high_board_t::from_board(random_board(random, max_slice), false)), ValueError);
+}
+
+TEST(server, results) {
+  tempdir_t tmp("server");
+  write_random_database(tmp.path, 2);
+
+  // Simultaneous requests for the same board share one computation, and later requests hit the cache
+  const values_t values(local_files(tmp.path), 2, 1<<20, 0, 1<<20);
+  const auto board = high_board_t::from_board(0, false);
+  vector<shared_ptr<const board_values_t>> results(8);
+  vector<std::thread> threads;
+  for (const int t : range(8))
+    threads.emplace_back([&, t]() { results[t] = values.values(board); });
+  for (auto& thread : threads)
+    thread.join();
+  for (const auto& r : results)
+    ASSERT_EQ(r, results[0]);
+  auto stats = values.result_stats();
+  ASSERT_EQ(stats.misses, 1);
+  ASSERT_EQ(stats.hits + stats.coalesced, 7);
+  ASSERT_EQ(stats.entries, 1);
+  ASSERT_EQ(values.values(board), results[0]);
+  ASSERT_EQ(values.result_stats().hits, stats.hits + 1);
+
+  // Errors are shared but not cached
+  Random random(8181);
+  const auto big = high_board_t::from_board(random_board(random, 2), false);
+  for (__attribute__((unused)) const int i : range(2))
+    ASSERT_THROW(values.values(big), ValueError);
+  ASSERT_EQ(values.result_stats().misses, 3);
+
+  // A result cache of one byte fits no result, so each one is evicted as soon as it is inserted
+  const values_t tiny(local_files(tmp.path), 2, 1<<20, 0, 1);
+  for (const auto& b : random_high_boards(random, 2, 16))
+    tiny.values(b);
+  stats = tiny.result_stats();
+  ASSERT_EQ(stats.misses, 16);
+  ASSERT_EQ(stats.evictions, 16);
+  ASSERT_EQ(stats.entries, 0);
+  ASSERT_EQ(stats.memory, 0);
+}
+
+// Values from supers that transform correctly under all symmetries, as real database values do
+Vector<super_t,2> meaningless_supers(const board_t board) {
+  const auto a = super_meaningless(board, 1), b = super_meaningless(board, 2);
+  return vec(a & b, a | b);
+}
+
+int meaningless_value(const high_board_t board) {
+  if (board.done())
+    return board.immediate_value();
+  else if (!board.middle()) {
+    const auto s = meaningless_supers(board.board());
+    return s[0](0) + s[1](0) - 1;
+  }
+  int best = -1;
+  for (const auto& move : board.moves())
+    best = std::max(best, -meaningless_value(move));
+  return best;
+}
+
+TEST(server, book) {
+  init_threads(-1, -1);
+  tempdir_t tmp("book");
+  Random random(9183);
+
+  // Symmetric values check that lookups undo superstandardization correctly
+  {
+    const int max_slice = 4;
+    const auto path = tmp.path + "/meaningless.pentago";
+    write_opening_book(path, max_slice, meaningless_supers);
+    const opening_book_t book(path);
+    ASSERT_EQ(book.max_slice, max_slice);
+    for (const auto& board : random_high_boards(random, max_slice+1, 1024))
+      ASSERT_EQ(book.value(board), meaningless_value(board)) << "board " << board;
+
+    // Immediate results are folded in assuming super_wins rotates the same way as stored supers
+    for (__attribute__((unused)) const int i : range(256)) {
+      const auto board = random_board(random, random.uniform<int>(9, 30));
+      const auto [standard, symmetry] = superstandardize(board);
+      for (const int s : range(2))
+        ASSERT_EQ(super_wins(unpack(standard, s))(symmetry.inverse().local), won(unpack(board, s)));
+    }
+
+  }
+
+  // Random database values differ across each orbit, so compare only on superstandardized boards
+  const int max_slice = 3;
+  write_random_database(tmp.path, max_slice);
+  vector<shared_ptr<const supertensor_reader_t>> readers;
+  for (const int slice : range(max_slice+1))
+    for (const auto& reader : open_supertensors(format("%s/slice-%d.pentago", tmp.path, slice)))
+      readers.push_back(reader);
+  const auto reader_cache = reader_block_cache(readers, 1<<30);
+  const auto path = tmp.path + "/book.pentago";
+  write_opening_book(path, max_slice, block_cache_supers(*reader_cache));
+  const auto book = make_shared<const opening_book_t>(path);
+  const values_t values(local_files(tmp.path), max_slice, 1<<20, 0, 1<<20, book);
+  for (__attribute__((unused)) const int i : range(256)) {
+    const int n = random.uniform<int>(0, max_slice+1);
+    const auto board = high_board_t::from_board(get<0>(superstandardize(random_board(random, n))), false);
+    const int correct = value(*reader_cache, board);
+    ASSERT_EQ(book->value(board), correct) << "board " << board;
+    ASSERT_EQ(values.lookup(board), correct) << "board " << board;
+  }
+
+  // Bad files are rejected
+  ASSERT_THROW(opening_book_t(tmp.path + "/slice-0.pentago"), IOError);
+  ASSERT_THROW(opening_book_t(tmp.path + "/missing"), IOError);
+}
+
+// Send raw bytes to a server, returning everything it sends back before closing the connection
+string raw_request(const int port, const string& request) {
+  const int fd = socket(AF_INET, SOCK_STREAM, 0);
+  GEODE_ASSERT(fd >= 0);
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  GEODE_ASSERT(!connect(fd, (sockaddr*)&addr, sizeof(addr)));
+  GEODE_ASSERT(send(fd, request.data(), request.size(), 0) == ssize_t(request.size()));
+  string response;
+  char chunk[4096];
+  for (ssize_t n; (n = recv(fd, chunk, sizeof(chunk), 0)) > 0;)
+    response.append(chunk, n);
+  close(fd);
+  return response;
+}
+
+TEST(server, http) {
+  tempdir_t tmp("server");
+  write_random_database(tmp.path, 1);
+  const values_t values(local_files(tmp.path), 1, 1<<20, 1, 1<<20);
+  http_server_t server(0, 2, [&](const string& path) {
+    try {
+      return http_response_t{200, {{"content-type", "application/json"}},
+                             values_json(*values.values(high_board_t::parse(path.substr(1))))};
+    } catch (const ValueError& e) {
+      return http_response_t{404, {}, e.what()};
+    }
+  });
+
+  // Database lookups, midsolves, and errors over one keep-alive connection
+  Random random(1731);
+  const auto late = high_board_t::from_board(random_board(random, 30), true);
+  http_client_t client("localhost", server.port());
+  for (const auto& board : {high_board_t(), late}) {
+    const auto [status, body] = client.get("/" + board.name());
+    ASSERT_EQ(status, 200);
+    ASSERT_EQ(body, values_json(*values.values(board)));
+  }
+  ASSERT_EQ(values.values(late)->size(), midsolve(late, midsolve_workspace(30)).size());
+  ASSERT_EQ(get<0>(client.get("/1")), 404);
+  ASSERT_EQ(get<0>(client.get("/junk")), 404);
+  ASSERT_EQ(get<0>(client.get("/0")), 200);
+
+  // Bad content lengths are rejected, and the connection closed
+  for (const string length : {"-1", "1000000000000", "12x", ""})
+    ASSERT_EQ(raw_request(server.port(), format("GET /0 HTTP/1.1\r\ncontent-length: %s\r\n\r\n", length)),
+              "HTTP/1.1 400 Bad Request\r\ncontent-length: 0\r\nconnection: close\r\n\r\n");
+  server.stop();
+}
+
+}  // namespace
+}  // namespace pentago
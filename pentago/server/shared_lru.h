@@ -0,0 +1,90 @@
+// Thread safe LRU cache which merges simultaneous misses
+//
+// shared_lru_t wraps lru_t with a mutex and a memory limit.  On a miss, the first thread computes the
+// value outside the lock, and any other threads asking for the same key wait for that computation
+// instead of repeating it.  Exceptions propagate to all waiting threads and are not cached.
+#pragma once
+
+#include "pentago/data/lru.h"
+#include <functional>
+#include <future>
+#include <mutex>
+namespace pentago {
+
+struct cache_stats_t {
+  uint64_t hits = 0;       // Found in the cache
+  uint64_t coalesced = 0;  // Waited for another thread computing the same key
+  uint64_t misses = 0;     // Computed from scratch
+  uint64_t evictions = 0;
+  uint64_t entries = 0;    // Current number of cached values
+  uint64_t memory = 0;     // Current memory usage of cached values
+
+  // Fraction of lookups which didn't need their own computation
+  double hit_rate() const {
+    const auto total = hits + coalesced + misses;
+    return total ? double(hits + coalesced) / total : 0;
+  }
+};
+
+template<class K,class V,class H=boost::hash<K>> class shared_lru_t : boost::noncopyable {
+  const uint64_t memory_limit;
+  const std::function<uint64_t(const V&)> memory_usage;
+  mutable std::mutex mutex;
+  lru_t<K,V,H> lru;
+  unordered_map<K,std::shared_future<V>,H> pending;
+  cache_stats_t stats_;
+public:
+
+  shared_lru_t(const uint64_t memory_limit, const std::function<uint64_t(const V&)>& memory_usage)
+    : memory_limit(memory_limit)
+    , memory_usage(memory_usage) {}
+
+  // Look up key, calling compute() to produce the value on a miss
+  template<class F> V get(const K& key, const F& compute) {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (const auto p = lru.get(key)) {
+      stats_.hits++;
+      return *p;
+    }
+    const auto it = pending.find(key);
+    if (it != pending.end()) {
+      stats_.coalesced++;
+      const auto future = it->second;
+      lock.unlock();
+      return future.get();
+    }
+    stats_.misses++;
+    std::promise<V> promise;
+    pending.insert(make_pair(key, promise.get_future().share()));
+    lock.unlock();
+
+    V value;
+    try {
+      value = compute();
+    } catch (...) {
+      promise.set_exception(std::current_exception());
+      lock.lock();
+      pending.erase(key);
+      throw;
+    }
+    promise.set_value(value);
+    lock.lock();
+    pending.erase(key);
+    lru.add(key, value);
+    stats_.entries++;
+    stats_.memory += memory_usage(value);
+    while (stats_.memory > memory_limit) {
+      stats_.memory -= memory_usage(std::get<1>(lru.drop()));
+      stats_.entries--;
+      stats_.evictions++;
+    }
+    return value;
+  }
+
+  cache_stats_t stats() const {
+    std::unique_lock<std::mutex> lock(mutex);
+    return stats_;
+  }
+};
+
+}  // namespace pentago
@@ -0,0 +1,222 @@
+// Board value lookup for the web backend
+
+#include "pentago/server/values.h"
+#include "pentago/data/block_cache.h"
+#include "pentago/data/lru.h"
+#include "pentago/end/config.h"
+#include "pentago/high/index.h"
+#include "pentago/mid/midengine.h"
+#include "pentago/utility/const_cast.h"
+#include "pentago/utility/memory_usage.h"
+#include <algorithm>
+#include <future>
+namespace pentago {
+
+using std::make_shared;
+using std::max;
+using std::move;
+using std::shared_future;
+using std::unique_lock;
+
+open_file_t local_files(const string& dir) {
+  return [dir](const string& name) { return read_local_file(dir + "/" + name); };
+}
+
+namespace {
+typedef supertensor_index_t::block_t block_t;
+typedef Array<const Vector<super_t,2>,4> block_data_t;
+
+Array<const uint8_t> pread(const read_file_t& file, const compact_blob_t blob) {
+  Array<uint8_t> data(blob.size, uninit);
+  const auto error = file.pread(data, blob.offset());
+  if (!error.empty())
+    THROW(IOError, "range read of %s failed: %s", file.name(), error);
+  return data;
+}
+
+}  // namespace
+
+// Blocks read through supertensor_index_t.  Unlike reader_block_cache_t, this cache is thread safe.
+struct index_block_cache_t : public block_cache_t {
+  const vector<shared_ptr<const supertensor_index_t>> indices;  // Per slice
+  const vector<shared_ptr<const read_file_t>> index_files, data_files;  // Per slice
+  mutable shared_lru_t<block_t,block_data_t> blocks;
+
+public:
+  index_block_cache_t(const open_file_t& open, const int max_slice, const uint64_t memory_limit)
+    : blocks(memory_limit, [](const block_data_t& data) { return memory_usage(data); }) {
+    const auto slices = end::descendent_sections(section_t(), max_slice);
+    for (const int slice : range(max_slice+1)) {
+      const_cast_(indices).push_back(make_shared<supertensor_index_t>(slices.at(slice)));
+      const_cast_(index_files).push_back(open(format("slice-%d.pentago.index", slice)));
+      const_cast_(data_files).push_back(open(format("slice-%d.pentago", slice)));
+    }
+  }
+
+  int block_size() const {
+    return end::block_size;
+  }
+
+  bool has_section(const section_t section) const {
+    const int slice = section.sum();
+    return slice < int(indices.size()) && contains(indices[slice]->sections->section_id, section);
+  }
+
+  super_t extract(const bool turn, const bool aggressive, const Vector<super_t,2>& data) const {
+    return !turn ? aggressive ? data[0] : ~data[1]  // Black to move
+                 : aggressive ? data[1] : ~data[0]; // White to move
+  }
+
+  block_data_t read_block(const block_t block) const {
+    const int slice = get<0>(block).sum();
+    const auto& index = *indices[slice];
+    const auto blob = pread(*index_files[slice], index.blob_location(block));
+    return index.unpack_block(block, pread(*data_files[slice], index.block_location(blob)));
+  }
+
+  RawArray<const Vector<super_t,2>,4> load_block(const section_t section, const Vector<uint8_t,4> block) const {
+    // block_cache_t::lookup reads the returned data immediately on the same thread, so holding a
+    // reference per thread keeps it alive even if another thread evicts it.
+    static thread_local block_data_t pinned;
+    const auto key = make_tuple(section, block);
+    pinned = blocks.get(key, [=]() { return read_block(key); });
+    return pinned;
+  }
+};
+
+static uint64_t memory_usage(const shared_ptr<const board_values_t>& values) {
+  return sizeof(board_values_t) + sizeof(tuple<high_board_t,int>) * values->capacity();
+}
+
+values_t::values_t(const open_file_t& open, const int max_slice, const uint64_t cache_limit,
+                   const int midsolves, const uint64_t result_limit,
+                   const shared_ptr<const opening_book_t>& book)
+  : max_slice(max_slice)
+  , midsolves(midsolves)
+  , cache(make_shared<index_block_cache_t>(open, max_slice, cache_limit))
+  , book(book)
+  , allocated_workspaces(0)
+  , results(result_limit, [](const shared_ptr<const board_values_t>& v) { return memory_usage(v); }) {
+  GEODE_ASSERT(0 <= max_slice && max_slice <= 35);
+  GEODE_ASSERT(midsolves >= 0);
+}
+
+values_t::~values_t() {}
+
+int values_t::lookup(const high_board_t board) const {
+  GEODE_ASSERT(!board.middle() && board.count() <= max_slice);
+  if (book && board.count() <= book->max_slice)
+    return book->value(board);
+  const auto flip = flip_board(board.board(), board.turn());
+  int value = -1;
+  for (const bool aggressive : {true, false}) {
+    super_t wins;
+    GEODE_ASSERT(cache->lookup(aggressive, flip, wins));
+    value += wins(0);
+  }
+  return value;
+}
+
+// Same traversal as web/server/values.js
+int values_t::traverse(const high_board_t board, const bool children, board_values_t& results) const {
+  int value;
+  if (board.done()) {  // Done, so no lookup required
+    value = board.immediate_value();
+  } else if (!children && !board.middle()) {  // Look up a database value
+    value = lookup(board);
+  } else {  // Traverse into children
+    value = -1;
+    const int scale = board.middle() ? -1 : 1;
+    for (const auto& move : board.moves())
+      value = max(value, scale*traverse(move, false, results));
+  }
+  results.emplace_back(board, value);
+  return value;
+}
+
+board_values_t values_t::midsolve(const high_board_t board) const {
+  // Grab a workspace, making a new one if we're under the limit
+  Array<halfsupers_t> workspace;
+  {
+    unique_lock<std::mutex> lock(workspace_mutex);
+    workspace_free.wait(lock, [this]() { return workspaces.size() || allocated_workspaces < midsolves; });
+    if (workspaces.size()) {
+      workspace = workspaces.back();
+      workspaces.pop_back();
+    } else
+      allocated_workspaces++;
+  }
+  const auto release = [&]() {
+    {
+      unique_lock<std::mutex> lock(workspace_mutex);
+      workspaces.push_back(workspace);
+    }
+    workspace_free.notify_one();
+  };
+
+  // Workspaces grow as needed, since boards with more stones need much less space
+  board_values_t results;
+  try {
+    if (workspace.size() < midsolve_workspace_size(board.count()))
+      workspace = midsolve_workspace(board.count());
+    for (const auto& r : pentago::midsolve(board, workspace))
+      results.push_back(r);
+  } catch (...) {
+    release();
+    throw;
+  }
+  release();
+  return results;
+}
+
+shared_ptr<const board_values_t> values_t::values(const high_board_t board) const {
+  return results.get(board, [=]() { return compute(board); });
+}
+
+cache_stats_t values_t::block_stats() const {
+  return cache->blocks.stats();
+}
+
+cache_stats_t values_t::result_stats() const {
+  return results.stats();
+}
+
+shared_ptr<const board_values_t> values_t::compute(const high_board_t board) const {
+  board_values_t results;
+  if (board.count() < max_slice)
+    traverse(board, true, results);
+  else if (board.count() >= 18 && midsolves)
+    results = midsolve(board);
+  else
+    THROW(ValueError, "board %s has %d >= %d stones, and should be computed locally",
+          board.name(), board.count(), max_slice);
+
+  // Boards reached along several paths appear several times
+  const auto key = [](const tuple<high_board_t,int>& x) {
+    return make_tuple(get<0>(x).board(), get<0>(x).middle());
+  };
+  std::sort(results.begin(), results.end(), [=](const auto& x, const auto& y) { return key(x) < key(y); });
+  results.erase(std::unique(results.begin(), results.end(),
+                            [=](const auto& x, const auto& y) { return key(x) == key(y); }),
+                results.end());
+  return make_shared<const board_values_t>(move(results));
+}
+
+string values_json(const board_values_t& values) {
+  // Appending by hand is several times faster than format, which matters for cached results
+  string json = "{";
+  json.reserve(32*values.size() + 2);
+  for (const auto& [board, value] : values) {
+    if (json.size() > 1)
+      json += ',';
+    json += '"';
+    json += std::to_string(board.board());
+    if (board.middle())
+      json += 'm';
+    json += "\":";
+    json += std::to_string(value);
+  }
+  return json + "}";
+}
+
+}  // namespace pentago
@@ -0,0 +1,80 @@
+// Board value lookup for the web backend
+//
+// values_t answers the same queries as web/server/values.js: given a board, compute the values of the
+// board, its children, and whatever other boards we traverse on the way.  Boards with fewer than max_slice
+// stones are looked up in the database of slice-<n>.pentago files via their .pentago.index files (see
+// high/index.h), or in an optional opening book (see book.h) if they have few enough stones, and boards
+// with at least 18 stones are solved with midsolve.  values_t is thread safe.
+// Both blocks and complete results are kept in LRU caches, and simultaneous requests for the same block or
+// board share one computation, so popular positions cost a hash lookup.
+#pragma once
+
+#include "pentago/data/file.h"
+#include "pentago/high/board.h"
+#include "pentago/mid/halfsuper.h"
+#include "pentago/server/book.h"
+#include "pentago/server/shared_lru.h"
+#include <boost/core/noncopyable.hpp>
+#include <condition_variable>
+#include <mutex>
+#include <tuple>
+namespace pentago {
+
+struct index_block_cache_t;
+using std::tuple;
+
+// Open one of the database files (slice-<n>.pentago or slice-<n>.pentago.index) for range reads.
+// Other storage backends can be plugged in via read_function (see data/file.h).
+typedef function<shared_ptr<const read_file_t>(const string& name)> open_file_t;
+
+// Open database files in a local directory
+open_file_t local_files(const string& dir);
+
+typedef vector<tuple<high_board_t,int>> board_values_t;
+
+struct values_t : private boost::noncopyable {
+  const int max_slice;  // Boards with fewer stones are looked up in the database
+  const int midsolves;  // Maximum number of simultaneous midsolves, each with its own workspace
+private:
+  const shared_ptr<const index_block_cache_t> cache;
+  const shared_ptr<const opening_book_t> book;  // Optional
+
+  // Midsolve workspaces, allocated lazily since each takes up to 1 GB
+  mutable std::mutex workspace_mutex;
+  mutable std::condition_variable workspace_free;
+  mutable vector<Array<halfsupers_t>> workspaces;
+  mutable int allocated_workspaces;
+
+  // Complete results, keyed by the requested board
+  mutable shared_lru_t<high_board_t,shared_ptr<const board_values_t>,std::hash<high_board_t>> results;
+
+public:
+  // cache_limit and result_limit bound the memory used by cached blocks and results, respectively.
+  // If given, boards with at most book->max_slice stones are answered from book.
+  values_t(const open_file_t& open, const int max_slice, const uint64_t cache_limit,
+           const int midsolves, const uint64_t result_limit,
+           const shared_ptr<const opening_book_t>& book = nullptr);
+  ~values_t();
+
+  // Values of a board, its children, and its grandchildren if !board.middle().  1 if the player to move
+  // wins, 0 for tie, -1 if the player to move loses.  Each board appears once, in no particular order.
+  // Throws ValueError if the board is neither in the database nor large enough to midsolve.
+  shared_ptr<const board_values_t> values(const high_board_t board) const;
+
+  // Hit rates and sizes of the block and result caches
+  cache_stats_t block_stats() const;
+  cache_stats_t result_stats() const;
+
+  // Database lookup of a board with at most max_slice stones
+  int lookup(const high_board_t board) const;
+
+private:
+  shared_ptr<const board_values_t> compute(const high_board_t board) const;
+  int traverse(const high_board_t board, const bool children, board_values_t& results) const;
+  board_values_t midsolve(const high_board_t board) const;
+};
+
+// Format values as a json dictionary mapping board name to value
+string values_json(const board_values_t& values);
+
+}  // namespace pentago
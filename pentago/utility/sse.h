@@ -24,6 +24,13 @@
 #endif
 #endif
 
+// AVX2 lets a whole super_t live in one register.  Enabled only if the compiler targets it (e.g., -march=native).
+#if defined(__AVX2__)
+#define PENTAGO_AVX2 1
+#else
+#define PENTAGO_AVX2 0
+#endif
+
 #if PENTAGO_CPP
 namespace pentago {
 
@@ -9,7 +9,17 @@
 #include "pentago/utility/log.h"
 #include <stdio.h>
 #include <pthread.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
 #include <unistd.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
+#include <algorithm>
+#include <atomic>
 #include <mutex>
 #include <deque>
 #include <set>
@@ -17,17 +27,10 @@ namespace pentago {
 
 /****************** Configuration *****************/
 
-// Flip to enable history tracking
-#define HISTORY 0
-
 // Whether to use blocking pthread locking or nonblocking spinlocks.
 // Use nonblocking mode (0) except for testing purposes.
 #define BLOCKING 0
 
-// Set to nonzero to enable PAPI support.  If on, the set of counters can be
-// controlled with the PENTAGO_PAPI environment variable.
-#define PAPI_MAX 0
-
 /********************** Setup *********************/
 
 using std::deque;
@@ -40,185 +43,316 @@ using std::exception;
     THROW(RuntimeError,"thread_pool_t: %s failed, %s",#exp,strerror(r_)); \
   })
 
-/****************** PAPI support ******************/
+/****************** Hardware counters ******************/
 
-static_assert(PAPI_MAX >= 0,"");
+// Per-thread counters from Linux perf_event_open, off unless enable_perf_counters is called.
+// Each thread gets one event group, and thread_time_t reads the whole group when it starts and
+// stops, adding the differences to its kind.  A group read is a system call, so counters are for
+// profiling runs only.  The group is not pinned: if it needs more hardware counters than the
+// processor has, the kernel multiplexes it and counts undercount.
 
-#if PAPI_MAX
-#ifndef PENTAGO_PAPI
-#error "PAPI support not available"
-#endif
-}
-#include <papi.h>
-namespace pentago {
-#endif
+static const int papi_max = 8;
 
-static bool papi_initialized = false;
-static int papi_count = 0;
-static int papi_events[PAPI_MAX];
+struct perf_event_info_t {
+  const char* name;
+  uint32_t type;
+  uint64_t config;
+};
 
-static string papi_event_name(const int event) {
-#if !PAPI_MAX
-  die("Compiled without PAPI support");
+#ifdef __linux__
+#define LL_READ(result) \
+  (PERF_COUNT_HW_CACHE_LL | PERF_COUNT_HW_CACHE_OP_READ<<8 | PERF_COUNT_HW_CACHE_RESULT_##result<<16)
+static const perf_event_info_t perf_event_infos[] = {
+  {"cycles",           PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+  {"instructions",     PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+  {"ref-cycles",       PERF_TYPE_HARDWARE, PERF_COUNT_HW_REF_CPU_CYCLES},
+  {"cache-references", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES},
+  {"cache-misses",     PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+  {"branches",         PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_INSTRUCTIONS},
+  {"branch-misses",    PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+  {"llc-loads",        PERF_TYPE_HW_CACHE, LL_READ(ACCESS)},
+  {"llc-misses",       PERF_TYPE_HW_CACHE, LL_READ(MISS)},
+  {"task-clock",       PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK},
+  {"page-faults",      PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+  {"context-switches", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES},
+  {"cpu-migrations",   PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS},
+};
+#undef LL_READ
 #else
-  char name[PAPI_MAX_STR_LEN];
-  if (const int r = PAPI_event_code_to_name(event,name))
-    die("Failed to convert PAPI event %d to string: %s",event,PAPI_strerror(r));
-  return name;
+static const perf_event_info_t perf_event_infos[] = {{"", 0, 0}};
 #endif
-}
 
-static void init_papi() {
-  if (papi_initialized)
-    return;
-  papi_initialized = true;
-#if PAPI_MAX
-  const int version = PAPI_library_init(PAPI_VER_CURRENT);
-  if (version != PAPI_VER_CURRENT)
-    die("PAPI_library_init failed: %s",
-        version>0 ? format("version mismatch: expected %d, got %d",PAPI_VER_CURRENT,version)
-                  : PAPI_strerror(version));
-  if (const int r = PAPI_thread_init(pthread_self))
-    die("PAPI_thread_init failed: %s",PAPI_strerror(r));
-#endif
-  const char* events = getenv("PENTAGO_PAPI");
-  if (!events)
-    return;
-#if !PAPI_MAX
-  die("PAPI events '%s' requested, but PAPI support was disabled at compile time",events);
-#else
-  const char* white = " \t\v\f\r\n";
+static int papi_count = 0;
+static int papi_events[papi_max]; // Indices into perf_event_infos
+
+static vector<int> parse_perf_events(const string& events) {
   string copy = events;
+  if (copy == "default")
+    copy = "cycles instructions llc-misses branch-misses";
+  vector<int> parsed;
+  const char* separators = " ,\t\v\f\r\n";
   char *p = copy.data(), *save;
-  while (char* event = strtok_r(p,white,&save)) {
-    if (papi_count == PAPI_MAX)
-      die("Too many PAPI events requested, limit is %d, got %s",PAPI_MAX,events);
-    if (const int r = PAPI_event_name_to_code(event,&papi_events[papi_count]))
-      die("Can't parse PAPI event '%s': %s",event,PAPI_strerror(r));
-    papi_count++;
+  while (const char* event = strtok_r(p,separators,&save)) {
     p = 0; // Prepare for next strtok_r call
+    int index = -1;
+    for (const int i : range(int(sizeof(perf_event_infos)/sizeof(perf_event_info_t))))
+      if (!strcmp(event,perf_event_infos[i].name))
+        index = i;
+    if (index < 0)
+      THROW(ValueError,"unknown perf event '%s'",event);
+    parsed.push_back(index);
   }
+  if (parsed.empty() || parsed.size() > papi_max)
+    THROW(ValueError,"expected between 1 and %d perf events, got '%s'",papi_max,events);
+  return parsed;
+}
+
+// Open a counter group for the given thread, returning all file descriptors with the leader first
+static vector<int> open_perf_group(const pid_t tid) {
+#ifndef __linux__
+  THROW(RuntimeError,"perf counters require Linux");
+#else
+  vector<int> fds;
+  for (const int p : range(papi_count)) {
+    const auto& info = perf_event_infos[papi_events[p]];
+    perf_event_attr attr;
+    memset(&attr,0,sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = info.type;
+    attr.config = info.config;
+    attr.read_format = PERF_FORMAT_GROUP;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    const int fd = int(syscall(SYS_perf_event_open,&attr,tid,-1,fds.size() ? fds[0] : -1,
+                               PERF_FLAG_FD_CLOEXEC));
+    if (fd < 0) {
+      const int e = errno;
+      for (const int f : fds)
+        close(f);
+      THROW(RuntimeError,"perf_event_open failed for event '%s': %s%s",info.name,strerror(e),
+            e==EACCES || e==EPERM ? " (see /proc/sys/kernel/perf_event_paranoid)"
+            : e==ENOENT || e==EOPNOTSUPP ? " (no such counter on this machine; virtualized?)" : "");
+    }
+    fds.push_back(fd);
+  }
+  return fds;
 #endif
 }
 
+// Read all counters in a group
+static inline void read_perf_group(const int fd, papi_t* values) {
+  uint64_t buffer[1+papi_max]; // Count followed by values
+  const auto size = sizeof(uint64_t)*(1+papi_count);
+  if (read(fd,buffer,size) != ssize_t(size))
+    die("perf counter read failed: %s",strerror(errno));
+  for (const int p : range(papi_count))
+    values[p] = papi_t(buffer[1+p]);
+}
+
 bool papi_enabled() {
-  return PAPI_MAX > 0;
+  return papi_count > 0;
 }
 
 vector<string> papi_event_names() {
-  GEODE_ASSERT(papi_initialized);
   vector<string> names;
   for (const int p : range(papi_count))
-    names.push_back(papi_event_name(papi_events[p]));
+    names.push_back(perf_event_infos[papi_events[p]].name);
   return names;
 }
 
-#if PAPI_MAX
-static int create_papi_eventset() {
-  GEODE_ASSERT(papi_initialized);
-  int set = PAPI_NULL;
-  if (!papi_count)
-    return set;
-  if (const int r = PAPI_create_eventset(&set))
-    die("Failed to create PAPI eventset: %s",PAPI_strerror(r));
-  for (const int i : range(papi_count)) {
-    const auto event = papi_events[i];
-    if (const int r = PAPI_add_event(set,event))
-      die("Failed to add event '%s' (0x%x) to eventset: %s",papi_event_name(event),event,PAPI_strerror(r));
+/****************** cycle_clock_t *****************/
+
+// thread_time_t often brackets operations of a microsecond or less, so it reads the processor's
+// timestamp counter instead of calling gettimeofday, and accumulates time in counter ticks.
+// Ticks convert to wall time at a rate calibrated at startup and refined by each
+// clear_thread_times.  Without an invariant timestamp counter, ticks are microseconds.
+
+struct cycle_clock_t {
+  bool tsc;
+  int64_t ticks0;
+  wall_time_t wall0;
+  std::atomic<double> us_per_tick;
+
+  cycle_clock_t()
+    : tsc(invariant_tsc()), ticks0(0), wall0(0), us_per_tick(1) {
+    if (tsc) {
+      // Busy wait for a millisecond to get a first estimate
+      ticks0 = ticks();
+      wall0 = wall_time();
+      wall_time_t now;
+      while ((now = wall_time())-wall0 < wall_time_t(1000));
+      us_per_tick = (now-wall0).us/double(ticks()-ticks0);
+    }
   }
-  return set;
-}
+
+  static bool invariant_tsc() {
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned a, b, c, d;
+    return __get_cpuid(0x80000007,&a,&b,&c,&d) && (d & 1<<8);
+#else
+    return false;
 #endif
+  }
+
+  int64_t ticks() const {
+#if defined(__x86_64__) || defined(__i386__)
+    if (tsc)
+      return __rdtsc();
+#endif
+    return wall_time().us;
+  }
+
+  wall_time_t duration(const int64_t ticks) const {
+    return wall_time_t(int64_t(ticks*us_per_tick.load(std::memory_order_relaxed)));
+  }
+
+  wall_time_t wall(const int64_t ticks) const {
+    return tsc ? wall_time_t(wall0.us+duration(ticks-ticks0).us) : wall_time_t(ticks);
+  }
+
+  // Improve our estimate of the tick rate using everything since startup
+  void refine() {
+    if (tsc) {
+      const auto t = ticks();
+      const auto now = wall_time();
+      if (now-wall0 > wall_time_t(1000000))
+        us_per_tick = (now-wall0).us/double(t-ticks0);
+    }
+  }
+};
+static cycle_clock_t cycle_clock;
+
+string thread_time_clock() {
+  return cycle_clock.tsc ? format("tsc (%.4g GHz)", 1e-3/cycle_clock.us_per_tick) : "gettimeofday";
+}
 
 /****************** thread_time_t *****************/
 
 struct time_table_t;
 
 struct time_entry_t {
-  wall_time_t total, local, start;
+  wall_time_t total;
+  int64_t local, start; // Ticks of cycle_clock, with start = 0 if inactive
   event_t event;
-  GEODE_DEBUG_ONLY(time_table_t* thread;)
-#if HISTORY
-  Array<history_t> history;
-#endif
-#if PAPI_MAX
-  int papi_eventset;
-  papi_t papi_total[PAPI_MAX], papi_local[PAPI_MAX];
-#endif
+  time_table_t* thread;
+  int perf_fd; // Counter group read at start, or -1
+  papi_t papi_total[papi_max], papi_local[papi_max], papi_start[papi_max];
 
   time_entry_t()
-    : total(0), local(0), start(0), event(0) {
-#if PAPI_MAX
-    papi_eventset = PAPI_NULL;
+    : total(0), local(0), start(0), event(0), thread(0), perf_fd(-1) {
     memset(papi_total,0,sizeof(papi_total));
     memset(papi_local,0,sizeof(papi_local));
-#endif
   }
 };
 
+/* History is off unless enable_thread_history is called, in which case each thread records
+ * every timed interval into its own ring buffer, overwriting the oldest records once full.  Only
+ * the owning thread writes to a ring, and readers first wait for the thread pools to go idle, so
+ * recording is a few stores and needs no locks.
+ */
+
+struct history_record_t {
+  event_t event;
+  int64_t start; // Microseconds
+  uint32_t duration; // Microseconds, saturating
+  uint32_t kind;
+};
+static_assert(sizeof(history_record_t)==24,"");
+
+struct history_ring_t {
+  const Array<history_record_t> records; // Power of two size
+  std::atomic<uint64_t> head; // Total number of records ever appended
+
+  history_ring_t(const int capacity)
+    : records(capacity,uninit)
+    , head(0) {
+    GEODE_ASSERT(capacity>0 && !(capacity&(capacity-1)));
+  }
+
+  void append(const time_kind_t kind, const event_t event, const wall_time_t start,
+              const wall_time_t end) {
+    const auto h = head.load(std::memory_order_relaxed);
+    auto& r = records[h&(records.size()-1)];
+    r.event = event;
+    r.start = start.us;
+    r.duration = uint32_t(std::min(end.us-start.us,int64_t(0xffffffff)));
+    r.kind = kind;
+    head.store(h+1,std::memory_order_release);
+  }
+
+  // Number of records overwritten so far
+  uint64_t dropped() const {
+    return std::max(head.load(std::memory_order_acquire),uint64_t(records.size()))-records.size();
+  }
+};
+
+// Records per thread, or zero if history is off
+static std::atomic<int> history_capacity(0);
+
 struct time_table_t {
   thread_type_t type;
+  pid_t tid;
+  vector<int> perf_group; // Counter file descriptors, leader first, if counters are on
+  std::atomic<int> perf_fd; // Group leader or -1, set by enable_perf_counters for existing threads
   time_entry_t times[_time_kinds];
+  std::unique_ptr<history_ring_t> history; // Allocated if history is on
   GEODE_DEBUG_ONLY(time_kind_t active_kind;)
 
   time_table_t(thread_type_t type)
-    : type(type) {
-    GEODE_DEBUG_ONLY(
-      for (auto& entry : times)
-        entry.thread = this;
-      active_kind = (time_kind_t)-1;
-    )
-#if PAPI_MAX
-    // Create one eventset for the entire thread to avoid hitting the file descriptor limit
-    // For details, see https://lists.eecs.utk.edu/pipermail/ptools-perfapi/2014-April/003205.html.
-    const auto eventset = create_papi_eventset();
-    for (auto& time : times)
-      time.papi_eventset = eventset;
-#endif
+    : type(type)
+    , tid(pid_t(syscall(SYS_gettid)))
+    , perf_group(papi_count ? open_perf_group(tid) : vector<int>())
+    , perf_fd(perf_group.size() ? perf_group[0] : -1) {
+    for (auto& entry : times)
+      entry.thread = this;
+    if (const int capacity = history_capacity.load(std::memory_order_relaxed))
+      history.reset(new history_ring_t(capacity));
+    GEODE_DEBUG_ONLY(active_kind = (time_kind_t)-1;)
   }
 };
 vector<time_table_t*> time_tables;
 static spinlock_t time_lock;
 
+// Our thread's table.  The initial-exec model avoids a __tls_get_addr call in position
+// independent code.
+static thread_local time_table_t* thread_table __attribute__((tls_model("initial-exec"))) = 0;
+
 struct time_info_t {
-  pthread_key_t key;
   wall_time_t local_start;
 
   time_info_t()
-    : local_start(0) {
-    pthread_key_create(&key,0);
-  }
+    : local_start(0) {}
 
   void init_thread(thread_type_t type) {
-    if (!pthread_getspecific(key)) {
+    if (!thread_table) {
       spin_t spin(time_lock);
       time_tables.push_back(new time_table_t(type));
-      pthread_setspecific(key, time_tables.back());
+      thread_table = time_tables.back();
     }
   }
 };
 static time_info_t time_info;
 
 thread_type_t thread_type() {
-  auto table = (time_table_t*)pthread_getspecific(time_info.key);
-  GEODE_ASSERT(table, "threads not initialized");
-  return table->type;
+  GEODE_ASSERT(thread_table, "threads not initialized");
+  return thread_table->type;
 }
 
 #if PENTAGO_TIMING
 
 static inline time_entry_t& time_entry(time_kind_t kind) {
-  auto table = (time_table_t*)pthread_getspecific(time_info.key);
-  if (!table) {
+  if (__builtin_expect(!thread_table,0))
     time_info.init_thread(UNKNOWN);
-    table = (time_table_t*)pthread_getspecific(time_info.key);
-  }
-  return table->times[kind];
+  return thread_table->times[kind];
 }
 
 thread_time_t::thread_time_t(time_kind_t kind, event_t event)
   : entry(&time_entry(kind)) {
-  entry->start = wall_time();
+  // Intervals already running when counters are enabled aren't counted
+  entry->perf_fd = entry->thread->perf_fd.load(std::memory_order_relaxed);
+  if (entry->perf_fd >= 0)
+    read_perf_group(entry->perf_fd,entry->papi_start);
+  entry->start = cycle_clock.ticks();
   entry->event = event;
   GEODE_DEBUG_ONLY(
     auto& active = entry->thread->active_kind;
@@ -226,11 +360,6 @@ thread_time_t::thread_time_t(time_kind_t kind, event_t event)
       die("Tried to start time kind %d inside time kind %d",kind,active);
     active = kind;
   )
-#if PAPI_MAX
-  if (entry->papi_eventset != PAPI_NULL)
-    if (const int r = PAPI_start(entry->papi_eventset))
-      die("PAPI_start failed: eventset %d, %s",entry->papi_eventset,PAPI_strerror(r));
-#endif
 }
 
 thread_time_t::~thread_time_t() {
@@ -240,21 +369,18 @@ thread_time_t::~thread_time_t() {
 void thread_time_t::stop() {
   if (entry) {
     GEODE_DEBUG_ONLY(entry->thread->active_kind = (time_kind_t)-1;)
-#if PAPI_MAX
-    if (entry->papi_eventset != PAPI_NULL) {
-      papi_t values[papi_count];
-      if (const int r = PAPI_stop(entry->papi_eventset,values))
-        die("PAPI_stop failed: %s",PAPI_strerror(r));
-      for (int p=0;p<papi_count;p++)
-        entry->papi_local[p] += values[p];
+    const auto now = cycle_clock.ticks();
+    if (entry->perf_fd >= 0) {
+      papi_t values[papi_max];
+      read_perf_group(entry->perf_fd,values);
+      for (const int p : range(papi_count))
+        entry->papi_local[p] += values[p]-entry->papi_start[p];
     }
-#endif
-    wall_time_t now = wall_time();
-#if HISTORY
-    entry->history.append(history_t(entry->event,entry->start,now));
-#endif
+    if (history_capacity.load(std::memory_order_acquire))
+      entry->thread->history->append(time_kind_t(entry-entry->thread->times),entry->event,
+                                     cycle_clock.wall(entry->start),cycle_clock.wall(now));
     entry->local += now-entry->start;
-    entry->start = wall_time_t(0);
+    entry->start = 0;
     entry = 0;
   }
 }
@@ -520,7 +646,6 @@ unit_t init_threads(int cpu_threads, int io_threads) {
   lock_t lock(init_threads_mutex());
   if (cpu_threads!=-1 || io_threads!=-1 || !cpu_pool) {
     GEODE_ASSERT(!cpu_pool && !io_pool);
-    init_papi();
     time_info.init_thread(MASTER);
     if (cpu_threads<0)
       cpu_threads = int(sysconf(_SC_NPROCESSORS_ONLN));
@@ -625,7 +750,9 @@ void threads_wait_all_help() {
 thread_times_t clear_thread_times() {
   threads_wait_all();
   spin_t spin(time_lock);
-  wall_time_t now = wall_time();
+  cycle_clock.refine();
+  const wall_time_t now = wall_time();
+  const int64_t now_ticks = cycle_clock.ticks();
   Array<wall_time_t> times(_time_kinds);
   Array<papi_t,2> papi(_time_kinds, papi_count);
   for (auto table : time_tables) {
@@ -633,34 +760,36 @@ thread_times_t clear_thread_times() {
     for (int k : range((int)master_missing_kind)) {
       auto& entry = table->times[k];
       if (entry.start) {
-#if HISTORY
-        entry.history.append(history_t(entry.event,entry.start,now));
-#endif
-        entry.local += now-entry.start;
-        entry.start = now;
+        if (table->history)
+          table->history->append(time_kind_t(k),entry.event,cycle_clock.wall(entry.start),
+                                 cycle_clock.wall(now_ticks));
+        entry.local += now_ticks-entry.start;
+        entry.start = now_ticks;
       }
     }
+    // Convert local times to wall time
+    wall_time_t local[master_missing_kind];
+    for (int k : range((int)master_missing_kind))
+      local[k] = cycle_clock.duration(table->times[k].local);
     // Compute missing time
     wall_time_t missing = now-time_info.local_start;
     for (int k : range((int)master_missing_kind))
-      missing -= table->times[k].local;
+      missing -= local[k];
     const int missing_kind = master_missing_kind+table->type;
     times[missing_kind] += missing;
     table->times[missing_kind].total += missing;
     // Clear local times
     for (int k : range((int)master_missing_kind)) {
       auto& entry = table->times[k];
-      times[k] += entry.local;
-      entry.total += entry.local;
-      entry.local = wall_time_t(0);
-#if PAPI_MAX
+      times[k] += local[k];
+      entry.total += local[k];
+      entry.local = 0;
       for (const int c : range(papi_count)) {
         auto& local = entry.papi_local[c];
         entry.papi_total[c] += local;
         papi(k,c) += local;
         local = 0;
       }
-#endif
     }
   }
   time_info.local_start = now;
@@ -675,10 +804,8 @@ thread_times_t total_thread_times() {
   for (const auto table : time_tables)
     for (const int k : range((int)_time_kinds)) {
       times[k] += table->times[k].total;
-#if PAPI_MAX
       for (const int p : range(papi_count))
         papi(k,p) += table->times[k].papi_total[p];
-#endif 
     }
   return thread_times_t({times, papi});
 }
@@ -741,61 +868,130 @@ void report_thread_times(RawArray<const wall_time_t> times, const string& name)
 
 void report_papi_counts(RawArray<const papi_t,2> papi) {
   GEODE_ASSERT(papi.shape() == vec(_time_kinds, papi_count));
-#if PAPI_MAX
   if (!papi_count)
     return;
   vector<const char*> names = time_kind_names();
-
-  // Print times
+  const auto events = papi_event_names();
+  const auto find = [&events](const char* name) {
+    return int(std::find(events.begin(), events.end(), name) - events.begin());
+  };
+  const int cycles = find("cycles"),
+            instructions = find("instructions");
+  const bool ipc = cycles < papi_count && instructions < papi_count;
+
+  // Print counts, with instructions per cycle if we have both
   {
-    string s = format("%-22s", "papi");
-    for (const int p : range(papi_count))
-      s += format(" %14s", papi_event_name(papi_events[p]));
+    string s = format("%-22s", "counters");
+    for (const auto& event : events)
+      s += format(" %16s", event);
+    if (ipc)
+      s += format(" %6s", "ipc");
     slog(s);
   }
-  for (const int k : range((int)master_idle_kind))
-    if (!papi[k].contains_only(0)) {
+  for (const int k : range((int)master_idle_kind)) {
+    const auto counts = papi[k];
+    if (std::any_of(counts.begin(), counts.end(), [](const papi_t n) { return n != 0; })) {
       string s = format("  %-20s", names[k]);
       for (const int p : range(papi_count))
-        s += format(" %14lld", papi(k,p));
+        s += format(" %16lld", papi(k,p));
+      if (ipc)
+        s += format(" %6.3f", papi(k,cycles) ? double(papi(k,instructions))/papi(k,cycles) : 0.);
       slog(s);
     }
-#endif
+  }
+}
+
+void enable_perf_counters(const string& events) {
+  const auto parsed = parse_perf_events(events);
+  threads_wait_all();
+  spin_t spin(time_lock);
+  GEODE_ASSERT(!papi_count, "perf counters are already enabled");
+  papi_count = int(parsed.size());
+  std::copy(parsed.begin(), parsed.end(), papi_events);
+  try {
+    for (auto table : time_tables)
+      table->perf_group = open_perf_group(table->tid);
+  } catch (...) {
+    for (auto table : time_tables) {
+      for (const int fd : table->perf_group)
+        close(fd);
+      table->perf_group.clear();
+    }
+    papi_count = 0;
+    throw;
+  }
+  // Existing threads pick up their groups at their next timed interval
+  for (auto table : time_tables)
+    table->perf_fd.store(table->perf_group[0],std::memory_order_relaxed);
+}
+
+void enable_thread_history(const int capacity) {
+  GEODE_ASSERT(capacity>0 && !(capacity&(capacity-1)),
+               format("history capacity %d should be a positive power of two",capacity));
+  spin_t spin(time_lock);
+  GEODE_ASSERT(!history_capacity.load(), "thread history is already enabled");
+  for (auto table : time_tables)
+    table->history.reset(new history_ring_t(capacity));
+  history_capacity.store(capacity,std::memory_order_release);
 }
 
 bool thread_history_enabled() {
-  return HISTORY;
+  return history_capacity.load(std::memory_order_relaxed)!=0;
 }
 
 vector<vector<Array<const history_t>>> thread_history() {
   clear_thread_times();
   spin_t spin(time_lock);
   vector<vector<Array<const history_t>>> data(time_tables.size());
-#if HISTORY
-  for (int t : range((int)data.size())) {
-    auto& table = *time_tables[t];
-    for (int k : range((int)master_missing_kind))
-      data[t].push_back(table.times[k].history.const_());
-  }
-#endif
+  if (thread_history_enabled())
+    for (const int t : range((int)data.size())) {
+      const auto& ring = *time_tables[t]->history;
+      const uint64_t head = ring.head.load(std::memory_order_acquire),
+                     n = ring.records.size(),
+                     first = head-std::min(head,n);
+      Array<int> counts(master_missing_kind);
+      for (uint64_t i=first;i<head;i++)
+        counts[ring.records[i&(n-1)].kind]++;
+      vector<Array<history_t>> kinds;
+      for (const int k : range((int)master_missing_kind))
+        kinds.emplace_back(counts[k],uninit);
+      counts.fill(0);
+      for (uint64_t i=first;i<head;i++) {
+        const auto& r = ring.records[i&(n-1)];
+        kinds[r.kind][counts[r.kind]++] = history_t(r.event,wall_time_t(r.start),
+                                                    wall_time_t(r.start+r.duration));
+      }
+      for (const auto& kind : kinds)
+        data[t].push_back(kind);
+    }
   return data;
 }
 
+uint64_t thread_history_dropped() {
+  spin_t spin(time_lock);
+  uint64_t dropped = 0;
+  if (thread_history_enabled())
+    for (const auto table : time_tables)
+      dropped += table->history->dropped();
+  return dropped;
+}
+
 void write_thread_history(const string& filename) {
-#if HISTORY
   typedef Vector<int64_t,3> Elem;
   static_assert(sizeof(Elem)==sizeof(history_t),"");
+  if (!thread_history_enabled())
+    return;
   const auto history = thread_history();
   if (!history.size())
     return;
   FILE* file = fopen(filename.c_str(),"w");
   GEODE_ASSERT(file);
   int offset = 1+history.size()*history[0].size();
-  Array<Elem> header;
-  header.append(Elem(history.size(),history[0].size(),0));
+  vector<Elem> header;
+  header.push_back(Elem(history.size(),history[0].size(),0));
   for (const auto& thread : history)
     for (const auto& trace : thread) {
-      header.append(Elem(offset,offset+trace.size(),0));
+      header.push_back(Elem(offset,offset+trace.size(),0));
       offset += trace.size();
     }
   fwrite(header.data(),sizeof(Elem),header.size(),file);
@@ -803,7 +999,44 @@ void write_thread_history(const string& filename) {
     for (const auto& trace : thread)
       fwrite(trace.data(),sizeof(Elem),trace.size(),file);
   fclose(file); 
-#endif
+}
+
+void write_chrome_trace(const string& filename, const int rank) {
+  if (!thread_history_enabled())
+    return;
+  const auto history = thread_history();
+  vector<thread_type_t> types;
+  {
+    spin_t spin(time_lock);
+    for (const auto table : time_tables)
+      types.push_back(table->type);
+  }
+  const auto names = time_kind_names();
+  FILE* file = fopen(filename.c_str(),"w");
+  if (!file)
+    THROW(IOError,"write_chrome_trace: can't open '%s' for writing",filename);
+
+  // One process per rank, and one track per thread, named by pool and position within the pool
+  fprintf(file,"{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+  fprintf(file,"{\"ph\":\"M\",\"pid\":%d,\"name\":\"process_name\",\"args\":{\"name\":\"rank %d\"}}",
+          rank,rank);
+  const char* type_names[] = {"master","cpu","io","unknown"};
+  int type_counts[4] = {0,0,0,0};
+  for (const int t : range((int)types.size()))
+    fprintf(file,",\n{\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"name\":\"thread_name\","
+                 "\"args\":{\"name\":\"%s %d\"}}",rank,t,type_names[types[t]],type_counts[types[t]]++);
+
+  // Complete events, in microseconds
+  for (const int t : range((int)history.size()))
+    for (const int k : range((int)history[t].size()))
+      for (const auto& h : history[t][k])
+        fprintf(file,",\n{\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"name\":\"%s\",\"ts\":%lld,"
+                     "\"dur\":%lld,\"args\":{\"event\":\"0x%llx\"}}",
+                rank,t,names[k],(long long)h.start.us,(long long)(h.end-h.start).us,
+                (unsigned long long)h.event);
+  fprintf(file,"\n]}\n");
+  if (fclose(file))
+    THROW(IOError,"write_chrome_trace: failed to write '%s'",filename);
 }
 
 }
@@ -102,16 +102,27 @@ public:
 
 #endif
 
-// Documentation typedef for PAPI counters
+// Clock behind thread_time_t: the timestamp counter if invariant, otherwise gettimeofday
+string thread_time_clock();
+
+// Documentation typedef for hardware counters (named after PAPI, which we used to use)
 typedef long long papi_t;
 
-// Thread timing results include per-kind times and possibly PAPI performance counters
+// Thread timing results include per-kind times and possibly hardware counters, indexed by kind
+// and event
 struct thread_times_t {
   Array<const wall_time_t> times;
   Array<const papi_t,2> papi;
 };
 
-// PAPI information
+// Count hardware events per thread and time kind with perf_event_open.  events is a whitespace or
+// comma separated list of up to 8 of cycles, instructions, ref-cycles, cache-references,
+// cache-misses, branches, branch-misses, llc-loads, llc-misses, task-clock, page-faults,
+// context-switches, and cpu-migrations, or "default" for cycles, instructions, llc-misses, and
+// branch-misses.  Throws if the events are unavailable.  Call at most once, between jobs.
+void enable_perf_counters(const string& events);
+
+// Counter information
 bool papi_enabled();
 vector<string> papi_event_names();
 
@@ -155,9 +166,18 @@ struct history_t {
     : event(event), start(start), end(end) {}
 };
 
+// Start recording the history of every thread_time_t interval, keeping the most recent capacity
+// records per thread (a power of two).  Call at most once, ideally right after init_threads.
+void enable_thread_history(const int capacity);
+
 // Operations on tracked history.  If history is untracked, these are trivial.
 bool thread_history_enabled();
-vector<vector<Array<const history_t>>> thread_history();
-void write_thread_history(const string& filename);
+vector<vector<Array<const history_t>>> thread_history(); // Per thread, per kind
+uint64_t thread_history_dropped(); // Records overwritten because a ring buffer was full
+void write_thread_history(const string& filename); // Format read by bin/draw-history
+
+// Write history as Chrome trace event JSON, viewable in chrome://tracing or ui.perfetto.dev, with
+// one process per rank and one track per thread.  bin/merge-traces combines files from several ranks.
+void write_chrome_trace(const string& filename, const int rank=0);
 
 }
@@ -2,11 +2,14 @@
 #include "pentago/utility/debug.h"
 #include "pentago/utility/range.h"
 #include "pentago/utility/spinlock.h"
+#include "pentago/utility/temporary.h"
 #include "pentago/utility/thread.h"
 #include "pentago/utility/threefry.h"
 #include "pentago/utility/uint128.h"
 #include "gtest/gtest.h"
+#include <fstream>
 #include <mutex>
+#include <sstream>
 namespace pentago {
 
 static void add_noise(Array<uint128_t> data, int key, std::mutex* mutex, spinlock_t* spinlock) {
@@ -47,4 +50,86 @@ TEST(thread, pool) {
   }
 }
 
+static void timed_job(const int i) {
+  thread_time_t time(compute_kind, line_ekind|i);
 }
+
+TEST(thread, history) {
+  init_threads(-1, -1);
+  // Twice as many jobs as all CPU threads can keep, so some are always dropped
+  const int capacity = 16, jobs = 2*capacity*thread_counts()[0];
+  enable_thread_history(capacity);
+  ASSERT_TRUE(thread_history_enabled());
+  for (const int i : range(jobs))
+    threads_schedule(CPU, curry(timed_job, i));
+  threads_wait_all();
+
+  // Each thread keeps its most recent events in order, so the last job survives
+  int kept = 0;
+  bool last = false;
+  for (const auto& thread : thread_history()) {
+    const auto& events = thread[compute_kind];
+    ASSERT_LE(events.size(), capacity);
+    for (const int i : range(events.size())) {
+      ASSERT_EQ(events[i].event & ekind_mask, line_ekind);
+      ASSERT_LE(events[i].start, events[i].end);
+      if (i) {
+        ASSERT_LT(events[i-1].event, events[i].event);
+      }
+      last |= events[i].event == (line_ekind|(jobs-1));
+    }
+    kept += events.size();
+  }
+  ASSERT_TRUE(last);
+  ASSERT_LT(kept, jobs);
+  ASSERT_GE(thread_history_dropped(), jobs - kept);
+
+  // Chrome traces contain a complete event for each record.  Reading history again closes idle
+  // intervals of waiting threads, which may push out a few more old records.
+  tempdir_t tmp("history");
+  const auto file = tmp.path + "/trace.json";
+  write_chrome_trace(file, 3);
+  std::ifstream in(file);
+  std::stringstream trace;
+  trace << in.rdbuf();
+  const auto text = trace.str();
+  ASSERT_EQ(text.find("{\"displayTimeUnit\":\"ms\",\"traceEvents\":["), 0);
+  ASSERT_NE(text.find("\"name\":\"rank 3\""), string::npos);
+  int complete = 0;
+  for (size_t i = 0; (i = text.find("\"name\":\"compute\",\"ts\":", i)) != string::npos; i++)
+    complete++;
+  ASSERT_GT(complete, 0);
+  ASSERT_LE(complete, kept);
+}
+
+static void counted_job(const int i) {
+  thread_time_t time(compute_kind, line_ekind|i);
+  uint128_t sum = 0;
+  for (const int j : range(10000))
+    sum += threefry(i, j);
+  GEODE_ASSERT(sum != 0);
+}
+
+TEST(thread, counters) {
+  init_threads(-1, -1);
+  // Software events work even without a hardware PMU, as in most virtual machines
+  try {
+    enable_perf_counters("task-clock,context-switches");
+  } catch (const RuntimeError& e) {
+    GTEST_SKIP() << e.what();
+  }
+  ASSERT_TRUE(papi_enabled());
+  ASSERT_EQ(papi_event_names(), (vector<string>{"task-clock", "context-switches"}));
+  clear_thread_times();
+  for (const int i : range(20))
+    threads_schedule(CPU, curry(counted_job, i));
+  threads_wait_all();
+  const auto papi = clear_thread_times().papi;
+  ASSERT_EQ(papi.shape(), vec(int(_time_kinds), 2));
+  ASSERT_GT(papi(compute_kind, 0), 0);
+  ASSERT_GE(papi(compute_kind, 1), 0);
+  report_papi_counts(papi);
+}
+
+}
+
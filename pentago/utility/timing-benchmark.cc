@@ -0,0 +1,67 @@
+// Measure the overhead of thread_time_t
+//
+// thread_time_t wraps fine-grained operations such as snappy, filter, accumulate, and request
+// sends, so each scope should cost a few tens of nanoseconds at most.  This times empty scopes
+// with history off and on, alongside the clock reads they replace.
+
+#include "pentago/utility/log.h"
+#include "pentago/utility/range.h"
+#include "pentago/utility/thread.h"
+#include "pentago/utility/wall_time.h"
+#include <pthread.h>
+
+namespace pentago {
+namespace {
+
+// Run f n times and return nanoseconds per call, best of several tries
+template<class F> double time_ns(const int n, const F& f) {
+  double best = std::numeric_limits<double>::infinity();
+  for (int t = 0; t < 5; t++) {
+    const auto start = wall_time();
+    for (int i = 0; i < n; i++)
+      f(i);
+    best = std::min(best, 1e3*(wall_time()-start).us/n);
+  }
+  return best;
+}
+
+volatile int64_t sink;
+
+void toplevel() {
+  Scope scope("timing benchmark");
+  init_threads(-1, 0);
+  slog("clock = %s", thread_time_clock());
+  const int n = 1<<22;
+
+  // What the old implementation did per scope: a key lookup and gettimeofday on each end
+  pthread_key_t key;
+  pthread_key_create(&key, 0);
+  pthread_setspecific(key, &key);
+  slog("pthread_getspecific + wall_time, twice = %.1f ns", time_ns(n, [&](const int i) {
+    sink = wall_time().us + (int64_t)pthread_getspecific(key);
+    sink = wall_time().us + (int64_t)pthread_getspecific(key);
+  }));
+  slog("wall_time = %.1f ns", time_ns(n, [](const int i) { sink = wall_time().us; }));
+
+  // Empty scopes
+  const auto scope_ns = [n]() {
+    return time_ns(n, [](const int i) { thread_time_t time(compute_kind, i); });
+  };
+  slog("thread_time_t, history off = %.1f ns", scope_ns());
+  enable_thread_history(1<<16);
+  slog("thread_time_t, history on = %.1f ns", scope_ns());
+  clear_thread_times();
+}
+
+}  // namespace
+}  // namespace pentago
+
+int main() {
+  try {
+    pentago::toplevel();
+    return 0;
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+}